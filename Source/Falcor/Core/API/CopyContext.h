@@ -45,9 +45,14 @@ namespace Falcor
             using SharedPtr = std::shared_ptr<ReadTextureTask>;
             static SharedPtr create(CopyContext* pCtx, const Texture* pTexture, uint32_t subresourceIndex);
             std::vector<uint8_t> getData();
+
+            /** Check if the copy has finished on the GPU, i.e. if getData() would return without waiting.
+            */
+            bool isReady() const { return mpFence->getGpuValue() >= mSignaledValue; }
         private:
             ReadTextureTask() = default;
             GpuFence::SharedPtr mpFence;
+            uint64_t mSignaledValue = 0;    ///< Fence value signaled after the copy. The fence's CPU value is always one higher.
             Buffer::SharedPtr mpBuffer;
             CopyContext* mpContext;
 #ifdef FALCOR_D3D12
@@ -166,7 +166,7 @@ namespace Falcor
         // Create a fence and signal
         pThis->mpFence = GpuFence::create();
         pCtx->flush(false);
-        pThis->mpFence->gpuSignal(pCtx->getLowLevelData()->getCommandQueue());
+        pThis->mSignaledValue = pThis->mpFence->gpuSignal(pCtx->getLowLevelData()->getCommandQueue());
         pThis->mTextureFormat = pTexture->getFormat();
 
         return pThis;
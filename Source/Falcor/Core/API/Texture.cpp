@@ -29,7 +29,7 @@
 #include "Texture.h"
 #include "Device.h"
 #include "RenderContext.h"
-#include "Utils/Threading.h"
+#include "Utils/Image/ImageWriteQueue.h"
 
 namespace Falcor
 {
@@ -269,12 +269,17 @@ namespace Falcor
             textureData = pContext->readTextureSubresource(this, subresource);
         }
 
-        auto func = [=]()
-        {
-            Bitmap::saveImage(filename, getWidth(mipLevel), getHeight(mipLevel), format, exportFlags, resourceFormat, true, (void*)textureData.data());
-        };
-
-        Threading::dispatchTask(func);
+        // Hand the pixels over to the writer threads, encoding the image would otherwise stall the caller
+        ImageWriteQueue::Image image;
+        image.filename = filename;
+        image.width = getWidth(mipLevel);
+        image.height = getHeight(mipLevel);
+        image.fileFormat = format;
+        image.exportFlags = exportFlags;
+        image.resourceFormat = resourceFormat;
+        image.isTopDown = true;
+        image.data = std::move(textureData);
+        ImageWriteQueue::write(std::move(image));
     }
 
     void Texture::uploadInitData(const void* pData, bool autoGenMips)
@@ -212,6 +212,7 @@ namespace Falcor
         UnorderedAccessView::SharedPtr getUAV(uint32_t mipLevel, uint32_t firstArraySlice = 0, uint32_t arraySize = kMaxPossible);
 
         /** Capture the texture to an image file.
+            The texture is read back immediately, the image is encoded and written by the ImageWriteQueue worker threads.
             \param[in] mipLevel Requested mip-level
             \param[in] arraySlice Requested array-slice
             \param[in] filename Name of the file to save.
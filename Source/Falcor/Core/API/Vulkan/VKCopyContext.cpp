@@ -235,7 +235,7 @@ namespace Falcor
         // Create a fence and signal
         pThis->mpFence = GpuFence::create();
         pCtx->flush(false);
-        pThis->mpFence->gpuSignal(pCtx->getLowLevelData()->getCommandQueue());
+        pThis->mSignaledValue = pThis->mpFence->gpuSignal(pCtx->getLowLevelData()->getCommandQueue());
 
         return pThis;
     }
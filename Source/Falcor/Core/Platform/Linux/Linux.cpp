@@ -41,6 +41,10 @@
 // #include <algorithm>
 // #include <experimental/filesystem>
 // #include <dlfcn.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 namespace Falcor
 {
@@ -530,4 +534,30 @@ namespace Falcor
     {
         return dlsym(dll, funcName.c_str());
     }
+
+    const void* mapFile(const std::string& filename, size_t& size)
+    {
+        int fd = open(filename.c_str(), O_RDONLY);
+        if (fd < 0) return nullptr;
+
+        struct stat fileStat;
+        if (fstat(fd, &fileStat) != 0 || fileStat.st_size == 0)
+        {
+            close(fd);
+            return nullptr;
+        }
+
+        // The mapping stays valid after the file descriptor is closed.
+        void* pData = mmap(nullptr, (size_t)fileStat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (pData == MAP_FAILED) return nullptr;
+
+        size = (size_t)fileStat.st_size;
+        return pData;
+    }
+
+    void unmapFile(const void* pData, size_t size)
+    {
+        if (pData) munmap(const_cast<void*>(pData), size);
+    }
 }
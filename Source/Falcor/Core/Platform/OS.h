@@ -401,6 +401,17 @@ namespace Falcor
     */
     dlldecl std::string readFile(const std::string& filename);
 
+    /** Map the content of a file into memory for reading.
+        \param[in] filename The file to map.
+        \param[out] size On success, the size of the file in bytes.
+        \return Pointer to the file content, or nullptr if the file can't be mapped. Release the mapping with unmapFile().
+    */
+    dlldecl const void* mapFile(const std::string& filename, size_t& size);
+
+    /** Release a file mapping created with mapFile().
+    */
+    dlldecl void unmapFile(const void* pData, size_t size);
+
     /** Load a shared-library
     */
     dlldecl DllHandle loadDll(const std::string& libPath);
@@ -731,6 +731,34 @@ namespace Falcor
         return GetProcAddress(dll, funcName.c_str());
     }
 
+    const void* mapFile(const std::string& filename, size_t& size)
+    {
+        HANDLE hFile = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (hFile == INVALID_HANDLE_VALUE) return nullptr;
+
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(hFile, &fileSize) || fileSize.QuadPart == 0)
+        {
+            CloseHandle(hFile);
+            return nullptr;
+        }
+
+        // The view keeps the mapping alive, so both handles can be closed right away.
+        HANDLE hMapping = CreateFileMappingA(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+        CloseHandle(hFile);
+        if (hMapping == NULL) return nullptr;
+
+        const void* pData = MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0);
+        CloseHandle(hMapping);
+        if (pData) size = (size_t)fileSize.QuadPart;
+        return pData;
+    }
+
+    void unmapFile(const void* pData, size_t size)
+    {
+        if (pData) UnmapViewOfFile(pData);
+    }
+
     void postQuitMessage(int32_t exitCode)
     {
         PostQuitMessage(exitCode);
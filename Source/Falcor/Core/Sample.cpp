@@ -33,6 +33,8 @@
 #include <sstream>
 #include <fstream>
 #include "Utils/Threading.h"
+#include "Utils/Image/ImageWriteQueue.h"
+#include <iomanip>
 #include "dear_imgui/imgui.h"
 
 namespace Falcor
@@ -41,6 +43,7 @@ namespace Falcor
     namespace
     {
         std::string kMonospaceFont = "monospace";
+        const size_t kMaxPendingFrameDumps = 3;     ///< Maximum number of frame dump readbacks in flight.
     }
 
     void Sample::handleWindowSizeChange()
@@ -166,8 +169,10 @@ namespace Falcor
     {
         mpRenderer.reset();
         if (mVideoCapture.pVideoCapture) endVideoCapture();
+        if (mFrameDump.enabled) endFrameDump();
 
         Clock::shutdown();
+        ImageWriteQueue::shutdown();
         Threading::shutdown();
         Scripting::shutdown();
         RenderPassLibrary::instance().shutdown();
@@ -240,6 +245,7 @@ namespace Falcor
         OSServices::start();
         startScripting();
         Threading::start();
+        ImageWriteQueue::start();
 
         mSuppressInput = config.suppressInput;
         mShowUI = config.showUI;
@@ -401,6 +407,12 @@ namespace Falcor
 
             mCaptureScreen = controlsGroup.button("Screen Capture");
             if (controlsGroup.button("Video Capture", true)) initVideoCapture();
+            if (controlsGroup.button(mFrameDump.enabled ? "End Frame Dump" : "Frame Dump", true))
+            {
+                if (mFrameDump.enabled) endFrameDump();
+                else startFrameDump();
+            }
+            controlsGroup.tooltip("Write every frame to a numbered PNG file. Set a fixed framerate in the clock UI for offline sequence rendering");
             if (controlsGroup.button("Save Config")) saveConfigToFile();
 
             controlsGroup.release();
@@ -477,6 +489,7 @@ namespace Falcor
             // Capture video frame before UI is rendered
             bool captureVideoUI = mVideoCapture.pUI && mVideoCapture.pUI->captureUI();  // Check capture mode here once only, as its value may change after renderGUI()
             if (!captureVideoUI) captureVideoFrame();
+            dumpFrame();
             renderUI();
 
             pSwapChainFbo = gpDevice->getSwapChainFbo(); // The UI might have triggered a swap-chain resize, invalidating the previous FBO
@@ -614,6 +627,86 @@ namespace Falcor
         }
     }
 
+    bool Sample::startFrameDump(const std::string& explicitPrefix, const std::string& explicitOutputDirectory)
+    {
+        mFrameDump = {};
+        mFrameDump.prefix = explicitPrefix != "" ? explicitPrefix : getExecutableName();
+        mFrameDump.outputDirectory = explicitOutputDirectory != "" ? explicitOutputDirectory : getExecutableDirectory();
+
+        if (!isDirectoryExists(mFrameDump.outputDirectory) && !createDirectory(mFrameDump.outputDirectory))
+        {
+            logError("Could not create frame dump directory '" + mFrameDump.outputDirectory + "'");
+            mFrameDump = {};
+            return false;
+        }
+
+        mFrameDump.enabled = true;
+        return true;
+    }
+
+    void Sample::endFrameDump()
+    {
+        resolveFrameDumps(true);
+        ImageWriteQueue::flush();
+        if (mFrameDump.heldFrameCount > 0)
+        {
+            logInfo("Frame dump: " + std::to_string(mFrameDump.heldFrameCount) + " frames were rendered again while waiting for the image writers");
+        }
+        mFrameDump = {};
+    }
+
+    void Sample::resolveFrameDumps(bool wait)
+    {
+        // Hand finished readbacks to the image writers in frame order. Without waiting, stop at the first readback still in flight,
+        // or when the write queue is full. The frame then stays pending and is retried on the next frame.
+        auto& pendingFrames = mFrameDump.pendingFrames;
+        while (!pendingFrames.empty())
+        {
+            auto& frame = pendingFrames.front();
+            if (frame.pReadback)
+            {
+                if (!wait && !frame.pReadback->isReady()) break;
+                frame.image.data = frame.pReadback->getData();
+                frame.pReadback = nullptr;
+            }
+
+            if (wait) ImageWriteQueue::write(std::move(frame.image));
+            else if (!ImageWriteQueue::tryWrite(frame.image)) break;
+            pendingFrames.pop_front();
+        }
+    }
+
+    void Sample::dumpFrame()
+    {
+        if (!mFrameDump.enabled) return;
+
+        resolveFrameDumps(false);
+
+        // Never wait for the GPU or the image writers here. The swap chain is read back asynchronously, and picked up a few frames later.
+        // If the readbacks or the image writers fell behind, hold the clock so that the same frame is rendered and dumped again on the next iteration.
+        if (mFrameDump.pendingFrames.size() < kMaxPendingFrameDumps && !ImageWriteQueue::isFull())
+        {
+            Texture* pTexture = gpDevice->getSwapChainFbo()->getColorTexture(0).get();
+
+            std::ostringstream filename;
+            filename << mFrameDump.outputDirectory << "/" << mFrameDump.prefix << "." << std::setfill('0') << std::setw(6) << mFrameDump.frameCount << ".png";
+
+            FrameDumpData::PendingFrame frame;
+            frame.image.filename = filename.str();
+            frame.image.width = pTexture->getWidth();
+            frame.image.height = pTexture->getHeight();
+            frame.image.resourceFormat = pTexture->getFormat();
+            frame.pReadback = getRenderContext()->asyncReadTextureSubresource(pTexture, 0);
+            mFrameDump.pendingFrames.push_back(std::move(frame));
+            mFrameDump.frameCount++;
+        }
+        else
+        {
+            mClock.setTime(mClock.getTime(), true);
+            mFrameDump.heldFrameCount++;
+        }
+    }
+
     SampleConfig Sample::getConfig()
     {
         SampleConfig c;
@@ -662,5 +755,11 @@ namespace Falcor
 
         auto resize = [this](uint32_t width, uint32_t height) {resizeSwapChain(width, height); };
         m.func_("resizeSwapChain", resize, "width"_a, "height"_a);
+
+        auto startFrameDump = [this](const std::string& prefix, const std::string& outputDirectory) { return this->startFrameDump(prefix, outputDirectory); };
+        m.func_("startFrameDump", startFrameDump, "prefix"_a = "", "outputDirectory"_a = "");
+
+        auto endFrameDump = [this]() { this->endFrameDump(); };
+        m.func_("endFrameDump", endFrameDump);
     }
 }
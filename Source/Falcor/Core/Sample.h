@@ -35,6 +35,8 @@
 #include "Utils/UI/TextRenderer.h"
 #include "Utils/UI/PixelZoom.h"
 #include "Utils/Video/VideoEncoderUI.h"
+#include "Utils/Image/ImageWriteQueue.h"
+#include <deque>
 #include <set>
 #include <optional>
 
@@ -113,6 +115,10 @@ namespace Falcor
         bool startVideoCapture();
         void endVideoCapture();
         void captureVideoFrame();
+        bool startFrameDump(const std::string& explicitPrefix = "", const std::string& explicitOutputDirectory = "");
+        void endFrameDump();
+        void dumpFrame();
+        void resolveFrameDumps(bool wait);
         void renderUI();
 
         void runInternal(const SampleConfig& config, uint32_t argc, char** argv);
@@ -139,6 +145,22 @@ namespace Falcor
             bool displayUI = false;
         } mVideoCapture;
 
+        struct FrameDumpData
+        {
+            struct PendingFrame
+            {
+                CopyContext::ReadTextureTask::SharedPtr pReadback;
+                ImageWriteQueue::Image image;   ///< The pixel data is filled in once the readback has finished.
+            };
+
+            bool enabled = false;
+            std::string prefix;
+            std::string outputDirectory;
+            uint64_t frameCount = 0;        ///< Number of frames written so far
+            uint64_t heldFrameCount = 0;    ///< Number of frames rendered again because the image writers fell behind
+            std::deque<PendingFrame> pendingFrames; ///< Frames whose readback is in flight or that wait for room in the image write queue, oldest first
+        } mFrameDump;
+
         std::set<KeyboardEvent::Key> mPressedKeys;
         PixelZoom::SharedPtr mpPixelZoom;
 
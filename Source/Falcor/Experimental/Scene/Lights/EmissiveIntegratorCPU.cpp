@@ -0,0 +1,474 @@
+/***************************************************************************
+ # Copyright (c) 2020, NVIDIA CORPORATION. All rights reserved.
+ #
+ # Redistribution and use in source and binary forms, with or without
+ # modification, are permitted provided that the following conditions
+ # are met:
+ #  * Redistributions of source code must retain the above copyright
+ #    notice, this list of conditions and the following disclaimer.
+ #  * Redistributions in binary form must reproduce the above copyright
+ #    notice, this list of conditions and the following disclaimer in the
+ #    documentation and/or other materials provided with the distribution.
+ #  * Neither the name of NVIDIA CORPORATION nor the names of its
+ #    contributors may be used to endorse or promote products derived
+ #    from this software without specific prior written permission.
+ #
+ # THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ # EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ # IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ # PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ # CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ # EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ # PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ # PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ # OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ # (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ # OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **************************************************************************/
+#include "stdafx.h"
+#include "EmissiveIntegratorCPU.h"
+#include "Utils/Image/Bitmap.h"
+#include <glm/gtc/packing.hpp>
+#include <unordered_set>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#define FALCOR_EMISSIVE_INTEGRATOR_USE_SSE 1
+#include <emmintrin.h>
+#else
+#define FALCOR_EMISSIVE_INTEGRATOR_USE_SSE 0
+#endif
+
+namespace Falcor
+{
+    namespace
+    {
+        // Number of triangles per task. Large meshes are split into several tasks.
+        const uint32_t kTrianglesPerTask = 1024;
+
+        float sRGBToLinear(float srgb)
+        {
+            return srgb <= 0.04045f ? srgb * (1.0f / 12.92f) : std::pow((srgb + 0.055f) * (1.0f / 1.055f), 2.4f);
+        }
+
+        /** Maps a texel coordinate relative to the texture tile at 'tileOffset' to a texel in the image.
+            This matches what the point sampler does for the texture coordinates of the covered texel centers.
+        */
+        uint32_t mapTexel(int64_t x, int64_t tileOffset, uint32_t size, Sampler::AddressMode mode)
+        {
+            if (mode == Sampler::AddressMode::Wrap) return (uint32_t)(x % size);
+            return (uint32_t)std::clamp<int64_t>(x + tileOffset, 0, size - 1);
+        }
+
+        /** Maps an inclusive range of texel coordinates to an inclusive range of image texels.
+            \return False if the texels don't form a single range, i.e. they wrap around the image border.
+        */
+        bool mapTexelRange(int64_t x0, int64_t x1, int64_t tileOffset, uint32_t size, Sampler::AddressMode mode, uint32_t& first, uint32_t& last)
+        {
+            if (mode == Sampler::AddressMode::Wrap && x1 - x0 + 1 >= size)
+            {
+                first = 0;
+                last = size - 1;
+                return true;
+            }
+            first = mapTexel(x0, tileOffset, size, mode);
+            last = mapTexel(x1, tileOffset, size, mode);
+            return first <= last;
+        }
+    }
+
+    EmissiveIntegratorCPU::Image::SharedConstPtr EmissiveIntegratorCPU::Image::create(uint32_t width, uint32_t height, std::vector<float3> texels)
+    {
+        if (width == 0 || height == 0 || texels.size() != (size_t)width * height) return nullptr;
+        return SharedConstPtr(new Image(width, height, std::move(texels)));
+    }
+
+    EmissiveIntegratorCPU::Image::SharedConstPtr EmissiveIntegratorCPU::Image::createFromTexture(const Texture* pTexture)
+    {
+        assert(pTexture);
+
+        // Block compressed formats are not decoded on the CPU.
+        const std::string& filename = pTexture->getSourceFilename();
+        if (filename.empty() || hasSuffix(filename, ".dds", false)) return nullptr;
+
+        // Textures are loaded top-down, see Texture::createFromFile().
+        Bitmap::UniqueConstPtr pBitmap = Bitmap::createFromFile(filename, true);
+        if (!pBitmap || pBitmap->getWidth() != pTexture->getWidth() || pBitmap->getHeight() != pTexture->getHeight()) return nullptr;
+
+        const uint32_t width = pBitmap->getWidth();
+        const uint32_t height = pBitmap->getHeight();
+        const size_t texelCount = (size_t)width * height;
+        const uint8_t* pData = pBitmap->getData();
+        std::vector<float3> texels(texelCount);
+
+        // Decode to linear RGB, with the channels a shader would read from the texture.
+        switch (pBitmap->getFormat())
+        {
+        case ResourceFormat::RGBA32Float:
+        case ResourceFormat::RGB32Float:
+        {
+            const uint32_t channels = pBitmap->getFormat() == ResourceFormat::RGBA32Float ? 4 : 3;
+            const float* pTexels = reinterpret_cast<const float*>(pData);
+            for (size_t i = 0; i < texelCount; i++) texels[i] = float3(pTexels[i * channels], pTexels[i * channels + 1], pTexels[i * channels + 2]);
+            break;
+        }
+        case ResourceFormat::RGBA16Float:
+        case ResourceFormat::RGB16Float:
+        {
+            const uint32_t channels = pBitmap->getFormat() == ResourceFormat::RGBA16Float ? 4 : 3;
+            const uint16_t* pTexels = reinterpret_cast<const uint16_t*>(pData);
+            for (size_t i = 0; i < texelCount; i++)
+            {
+                const uint16_t* pTexel = pTexels + i * channels;
+                texels[i] = float3(glm::unpackHalf1x16(pTexel[0]), glm::unpackHalf1x16(pTexel[1]), glm::unpackHalf1x16(pTexel[2]));
+            }
+            break;
+        }
+        case ResourceFormat::BGRA8Unorm:
+        case ResourceFormat::BGRX8Unorm:
+            for (size_t i = 0; i < texelCount; i++) texels[i] = float3(pData[i * 4 + 2], pData[i * 4 + 1], pData[i * 4]) / 255.f;
+            break;
+        case ResourceFormat::RG8Unorm:
+            for (size_t i = 0; i < texelCount; i++) texels[i] = float3(pData[i * 2], pData[i * 2 + 1], 0) / 255.f;
+            break;
+        case ResourceFormat::R8Unorm:
+            for (size_t i = 0; i < texelCount; i++) texels[i] = float3(pData[i], 0, 0) / 255.f;
+            break;
+        default:
+            return nullptr;
+        }
+
+        if (isSrgbFormat(pTexture->getFormat()))
+        {
+            for (auto& texel : texels) texel = float3(sRGBToLinear(texel.r), sRGBToLinear(texel.g), sRGBToLinear(texel.b));
+        }
+
+        return create(width, height, std::move(texels));
+    }
+
+    EmissiveIntegratorCPU::Image::Image(uint32_t width, uint32_t height, std::vector<float3> texels)
+        : mWidth(width)
+        , mHeight(height)
+        , mTexels(std::move(texels))
+    {
+        // Build the min/max pyramid by reducing 2x2 cells, starting from the texels.
+        uint32_t prevWidth = mWidth;
+        uint32_t prevHeight = mHeight;
+        while (prevWidth > 1 || prevHeight > 1)
+        {
+            Level level;
+            level.width = (prevWidth + 1) / 2;
+            level.height = (prevHeight + 1) / 2;
+            level.minValue.resize((size_t)level.width * level.height);
+            level.maxValue.resize((size_t)level.width * level.height);
+
+            const Level* pPrev = mLevels.empty() ? nullptr : &mLevels.back();
+            for (uint32_t y = 0; y < level.height; y++)
+            {
+                for (uint32_t x = 0; x < level.width; x++)
+                {
+                    float3 minValue(std::numeric_limits<float>::max());
+                    float3 maxValue(-std::numeric_limits<float>::max());
+                    for (uint32_t j = 2 * y; j < std::min(2 * y + 2, prevHeight); j++)
+                    {
+                        for (uint32_t i = 2 * x; i < std::min(2 * x + 2, prevWidth); i++)
+                        {
+                            const size_t index = (size_t)j * prevWidth + i;
+                            minValue = glm::min(minValue, pPrev ? pPrev->minValue[index] : mTexels[index]);
+                            maxValue = glm::max(maxValue, pPrev ? pPrev->maxValue[index] : mTexels[index]);
+                        }
+                    }
+                    level.minValue[(size_t)y * level.width + x] = minValue;
+                    level.maxValue[(size_t)y * level.width + x] = maxValue;
+                }
+            }
+
+            prevWidth = level.width;
+            prevHeight = level.height;
+            mLevels.push_back(std::move(level));
+        }
+    }
+
+    bool EmissiveIntegratorCPU::Image::isConstant(uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1, float3& value) const
+    {
+        assert(x0 <= x1 && x1 < mWidth && y0 <= y1 && y1 < mHeight);
+
+        // Find the finest level where the rectangle is covered by at most 2x2 cells, and compare them.
+        // Level -1 is the texels themselves.
+        for (int32_t level = -1; level < (int32_t)mLevels.size(); level++)
+        {
+            if (level >= 0)
+            {
+                x0 >>= 1; y0 >>= 1;
+                x1 >>= 1; y1 >>= 1;
+            }
+            if (x1 - x0 > 1 || y1 - y0 > 1) continue;
+
+            const uint32_t width = level < 0 ? mWidth : mLevels[level].width;
+            const float3* pMin = level < 0 ? mTexels.data() : mLevels[level].minValue.data();
+            const float3* pMax = level < 0 ? mTexels.data() : mLevels[level].maxValue.data();
+
+            value = pMin[(size_t)y0 * width + x0];
+            for (uint32_t y = y0; y <= y1; y++)
+            {
+                for (uint32_t x = x0; x <= x1; x++)
+                {
+                    const size_t index = (size_t)y * width + x;
+                    if (pMin[index] != value || pMax[index] != value) return false;
+                }
+            }
+            return true;
+        }
+
+        should_not_get_here();
+        return false;
+    }
+
+    EmissiveIntegratorCPU::SharedPtr EmissiveIntegratorCPU::create(Sampler::AddressMode addressModeU, Sampler::AddressMode addressModeV)
+    {
+        if (!isSupported(addressModeU) || !isSupported(addressModeV))
+        {
+            logWarning("EmissiveIntegratorCPU::create() - Only the Wrap and Clamp address modes are supported");
+            return nullptr;
+        }
+        return SharedPtr(new EmissiveIntegratorCPU(addressModeU, addressModeV));
+    }
+
+    void EmissiveIntegratorCPU::integrateTriangles(const Image& image, const float2* pTexCoords, uint32_t triangleCount, Sampler::AddressMode addressModeU, Sampler::AddressMode addressModeV, float4* pTexelSums, Stats* pStats)
+    {
+        assert(isSupported(addressModeU) && isSupported(addressModeV));
+        const uint32_t width = image.getWidth();
+        const uint32_t height = image.getHeight();
+        const float2 size((float)width, (float)height);
+
+        for (uint32_t triIdx = 0; triIdx < triangleCount; triIdx++)
+        {
+            pTexelSums[triIdx] = float4(0.f);
+
+            // Place the triangle in texel space relative to the texture tile containing its minimum,
+            // like the vertex shader in EmissiveIntegrator.ps.slang.
+            const float2* uv = pTexCoords + triIdx * 3;
+            const float2 tile = glm::floor(glm::min(glm::min(uv[0], uv[1]), uv[2]));
+            glm::dvec2 p[3];
+            for (uint32_t j = 0; j < 3; j++) p[j] = glm::dvec2((uv[j] - tile) * size);
+
+            // Range of texel centers (x + 0.5, y + 0.5) within the bounding box.
+            const glm::dvec2 pMin = glm::min(glm::min(p[0], p[1]), p[2]);
+            const glm::dvec2 pMax = glm::max(glm::max(p[0], p[1]), p[2]);
+            const int64_t x0 = (int64_t)std::ceil(pMin.x - 0.5), x1 = (int64_t)std::floor(pMax.x - 0.5);
+            const int64_t y0 = (int64_t)std::ceil(pMin.y - 0.5), y1 = (int64_t)std::floor(pMax.y - 0.5);
+
+            // Degenerate triangles and triangles that cover no texel centers get no samples, as with rasterization.
+            double area = (p[1].x - p[0].x) * (p[2].y - p[0].y) - (p[1].y - p[0].y) * (p[2].x - p[0].x);
+            if (area == 0.0 || x0 > x1 || y0 > y1) continue;
+            if (area < 0.0) std::swap(p[1], p[2]);
+
+            // Early out if all texels in the bounding box have the same color.
+            const int64_t tileOffsetX = (int64_t)tile.x * width;
+            const int64_t tileOffsetY = (int64_t)tile.y * height;
+            uint32_t tx0, tx1, ty0, ty1;
+            float3 constantValue;
+            if (mapTexelRange(x0, x1, tileOffsetX, width, addressModeU, tx0, tx1) &&
+                mapTexelRange(y0, y1, tileOffsetY, height, addressModeV, ty0, ty1) &&
+                image.isConstant(tx0, ty0, tx1, ty1, constantValue))
+            {
+                pTexelSums[triIdx] = float4(constantValue, 1.f);
+                if (pStats) pStats->trianglesConstant++;
+                continue;
+            }
+
+            // Edge functions E(q) = a * q.x + b * q.y + c, positive inside the counter-clockwise triangle.
+            // Texel centers exactly on an edge are covered only for top-left edges, so texels on shared edges are counted once.
+            double a[3], b[3], c[3];
+            bool isTopLeft[3];
+            for (uint32_t j = 0; j < 3; j++)
+            {
+                const glm::dvec2& v0 = p[j];
+                const glm::dvec2& v1 = p[(j + 1) % 3];
+                a[j] = v0.y - v1.y;
+                b[j] = v1.x - v0.x;
+                c[j] = v0.x * v1.y - v0.y * v1.x;
+                isTopLeft[j] = a[j] > 0.0 || (a[j] == 0.0 && b[j] < 0.0);
+            }
+            auto isInside = [&](double qx, double qy)
+            {
+                for (uint32_t j = 0; j < 3; j++)
+                {
+                    const double e = a[j] * qx + b[j] * qy + c[j];
+                    if (e < 0.0 || (e == 0.0 && !isTopLeft[j])) return false;
+                }
+                return true;
+            };
+
+            glm::dvec4 sum(0.0);
+            auto addTexel = [&](int64_t x, uint32_t ty) { sum += glm::dvec4(glm::dvec3(image.getTexel(mapTexel(x, tileOffsetX, width, addressModeU), ty)), 1.0); };
+
+#if FALCOR_EMISSIVE_INTEGRATOR_USE_SSE
+            // Test two texel centers per step. The edge functions are evaluated with the same operations in the same order
+            // as in isInside(), so the coverage is bit-identical to the scalar path.
+            __m128d va[3], vc[3];
+            for (uint32_t j = 0; j < 3; j++)
+            {
+                va[j] = _mm_set1_pd(a[j]);
+                vc[j] = _mm_set1_pd(c[j]);
+            }
+#endif
+
+            for (int64_t y = y0; y <= y1; y++)
+            {
+                const double qy = (double)y + 0.5;
+                const uint32_t ty = mapTexel(y, tileOffsetY, height, addressModeV);
+                int64_t x = x0;
+
+#if FALCOR_EMISSIVE_INTEGRATOR_USE_SSE
+                __m128d vby[3];
+                for (uint32_t j = 0; j < 3; j++) vby[j] = _mm_set1_pd(b[j] * qy);
+
+                __m128d vqx = _mm_set_pd((double)x0 + 1.5, (double)x0 + 0.5);
+                const __m128d vStep = _mm_set1_pd(2.0);
+                for (; x + 1 <= x1; x += 2, vqx = _mm_add_pd(vqx, vStep))
+                {
+                    __m128d inside = _mm_castsi128_pd(_mm_set1_epi32(-1));
+                    for (uint32_t j = 0; j < 3; j++)
+                    {
+                        const __m128d e = _mm_add_pd(_mm_add_pd(_mm_mul_pd(va[j], vqx), vby[j]), vc[j]);
+                        inside = _mm_and_pd(inside, isTopLeft[j] ? _mm_cmpge_pd(e, _mm_setzero_pd()) : _mm_cmpgt_pd(e, _mm_setzero_pd()));
+                    }
+
+                    const int mask = _mm_movemask_pd(inside);
+                    if (mask & 1) addTexel(x, ty);
+                    if (mask & 2) addTexel(x + 1, ty);
+                }
+#endif
+
+                for (; x <= x1; x++)
+                {
+                    if (isInside((double)x + 0.5, qy)) addTexel(x, ty);
+                }
+            }
+
+            pTexelSums[triIdx] = float4(sum);
+            if (pStats) pStats->trianglesIntegrated++;
+        }
+    }
+
+    bool EmissiveIntegratorCPU::integrate(const std::vector<MeshInput>& meshes)
+    {
+        PROFILE("EmissiveIntegratorCPU::integrate");
+
+        CpuTimer timer;
+        timer.update();
+
+        Stats stats;
+
+        // Find the (mesh, material) pairs that are not in the cache, or whose texture has changed.
+        std::vector<const MeshInput*> jobs;
+        std::unordered_set<uint64_t> visited;
+        for (const auto& mesh : meshes)
+        {
+            assert(mesh.pTexture && mesh.texCoords.size() % 3 == 0);
+            if (!visited.insert(getKey(mesh.meshID, mesh.materialID)).second) continue;
+
+            auto it = mCache.find(getKey(mesh.meshID, mesh.materialID));
+            if (it != mCache.end() && it->second.pTexture == mesh.pTexture && it->second.texelSums.size() == mesh.texCoords.size() / 3)
+            {
+                stats.meshesCached++;
+                continue;
+            }
+            jobs.push_back(&mesh);
+        }
+
+        // Decode the textures that have not been decoded before.
+        std::vector<Texture::SharedPtr> newTextures;
+        for (const MeshInput* pMesh : jobs)
+        {
+            if (mImages.find(pMesh->pTexture) != mImages.end()) continue;
+            if (std::find(newTextures.begin(), newTextures.end(), pMesh->pTexture) != newTextures.end()) continue;
+            newTextures.push_back(pMesh->pTexture);
+        }
+
+        std::vector<Image::SharedConstPtr> newImages(newTextures.size());
+        Threading::parallelFor(0u, (uint32_t)newTextures.size(), [&](uint32_t i) { newImages[i] = Image::createFromTexture(newTextures[i].get()); });
+        for (size_t i = 0; i < newTextures.size(); i++) mImages[newTextures[i]] = newImages[i];
+
+        // Integrate. Each task covers a range of triangles of one mesh, so that both many small and few large meshes use all threads.
+        struct Task
+        {
+            uint32_t jobIndex;
+            uint32_t firstTriangle;
+            uint32_t triangleCount;
+        };
+        std::vector<Task> tasks;
+        std::vector<CacheEntry> results(jobs.size());
+        for (uint32_t jobIndex = 0; jobIndex < (uint32_t)jobs.size(); jobIndex++)
+        {
+            const MeshInput& mesh = *jobs[jobIndex];
+            if (!mImages.at(mesh.pTexture)) continue;
+
+            const uint32_t triangleCount = (uint32_t)(mesh.texCoords.size() / 3);
+            results[jobIndex].pTexture = mesh.pTexture;
+            results[jobIndex].texelSums.resize(triangleCount);
+            for (uint32_t first = 0; first < triangleCount; first += kTrianglesPerTask)
+            {
+                tasks.push_back({ jobIndex, first, std::min(kTrianglesPerTask, triangleCount - first) });
+            }
+        }
+
+        std::vector<Stats> taskStats(tasks.size());
+        Threading::parallelFor(0u, (uint32_t)tasks.size(), [&](uint32_t i)
+        {
+            const Task& task = tasks[i];
+            const MeshInput& mesh = *jobs[task.jobIndex];
+            const Image& image = *mImages.at(mesh.pTexture);
+            integrateTriangles(image, mesh.texCoords.data() + task.firstTriangle * 3, task.triangleCount, mAddressModeU, mAddressModeV,
+                results[task.jobIndex].texelSums.data() + task.firstTriangle, &taskStats[i]);
+        });
+
+        // Store the results in the cache.
+        bool success = true;
+        for (uint32_t jobIndex = 0; jobIndex < (uint32_t)jobs.size(); jobIndex++)
+        {
+            const uint64_t key = getKey(jobs[jobIndex]->meshID, jobs[jobIndex]->materialID);
+            if (results[jobIndex].pTexture)
+            {
+                mCache[key] = std::move(results[jobIndex]);
+                stats.meshesIntegrated++;
+            }
+            else
+            {
+                mCache.erase(key);
+                success = false;
+            }
+        }
+        for (const auto& s : taskStats)
+        {
+            stats.trianglesIntegrated += s.trianglesIntegrated;
+            stats.trianglesConstant += s.trianglesConstant;
+        }
+
+        // Release decoded textures that are no longer used.
+        std::unordered_set<const Texture*> usedTextures;
+        for (const auto& mesh : meshes) usedTextures.insert(mesh.pTexture.get());
+        for (auto it = mImages.begin(); it != mImages.end();)
+        {
+            it = usedTextures.count(it->first.get()) ? std::next(it) : mImages.erase(it);
+        }
+
+        timer.update();
+        stats.time = timer.delta();
+        mStats = stats;
+
+        return success;
+    }
+
+    const std::vector<float4>* EmissiveIntegratorCPU::getTexelSums(uint32_t meshID, uint32_t materialID) const
+    {
+        auto it = mCache.find(getKey(meshID, materialID));
+        return it != mCache.end() ? &it->second.texelSums : nullptr;
+    }
+
+    void EmissiveIntegratorCPU::clearCache()
+    {
+        mCache.clear();
+        mImages.clear();
+    }
+}
@@ -0,0 +1,187 @@
+/***************************************************************************
+ # Copyright (c) 2020, NVIDIA CORPORATION. All rights reserved.
+ #
+ # Redistribution and use in source and binary forms, with or without
+ # modification, are permitted provided that the following conditions
+ # are met:
+ #  * Redistributions of source code must retain the above copyright
+ #    notice, this list of conditions and the following disclaimer.
+ #  * Redistributions in binary form must reproduce the above copyright
+ #    notice, this list of conditions and the following disclaimer in the
+ #    documentation and/or other materials provided with the distribution.
+ #  * Neither the name of NVIDIA CORPORATION nor the names of its
+ #    contributors may be used to endorse or promote products derived
+ #    from this software without specific prior written permission.
+ #
+ # THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ # EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ # IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ # PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ # CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ # EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ # PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ # PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ # OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ # (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ # OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **************************************************************************/
+#pragma once
+#include "Core/API/Sampler.h"
+#include "Core/API/Texture.h"
+#include <unordered_map>
+#include <vector>
+
+namespace Falcor
+{
+    /** CPU integrator for textured emissive triangles.
+
+        This computes the same per-triangle texel sums as the raster pass in EmissiveIntegrator.ps.slang:
+        the sum of the colors of the texels whose centers are covered by the triangle in texture space (RGB),
+        and the number of such texels (A). LightCollection turns these into average radiance and flux.
+
+        Triangles whose texel bounding box lies in a constant region of the texture, as detected by a
+        min/max mip pyramid, are resolved without visiting their texels. In that case the result is the
+        constant color with a count of one. Otherwise the coverage of the texel centers is tested two
+        at a time with SSE2 where available, with the same results as the scalar path.
+
+        Results are cached per (mesh, material) pair and only recomputed if the material's emissive
+        texture or the address modes change. The integration itself doesn't use the GPU device.
+    */
+    class dlldecl EmissiveIntegratorCPU
+    {
+    public:
+        using SharedPtr = std::shared_ptr<EmissiveIntegratorCPU>;
+
+        /** Texture decoded to linear RGB, with a min/max pyramid for detecting constant regions.
+        */
+        class dlldecl Image
+        {
+        public:
+            using SharedConstPtr = std::shared_ptr<const Image>;
+
+            /** Creates an image from texels in linear RGB.
+                \param[in] width Width in texels.
+                \param[in] height Height in texels.
+                \param[in] texels Texels in row-major order, top row first.
+                \return The image, or nullptr if the size doesn't match.
+            */
+            static SharedConstPtr create(uint32_t width, uint32_t height, std::vector<float3> texels);
+
+            /** Loads the mip 0 of a texture from its source file.
+                \param[in] pTexture The texture.
+                \return The image, or nullptr if the file format can't be decoded on the CPU (e.g. block compressed DDS).
+            */
+            static SharedConstPtr createFromTexture(const Texture* pTexture);
+
+            uint32_t getWidth() const { return mWidth; }
+            uint32_t getHeight() const { return mHeight; }
+            const float3& getTexel(uint32_t x, uint32_t y) const { return mTexels[(size_t)y * mWidth + x]; }
+
+            /** Checks if all texels in a rectangle have the same value.
+                The check is conservative: it looks at the smallest pyramid cells covering the rectangle.
+                \param[in] x0 First column.
+                \param[in] y0 First row.
+                \param[in] x1 Last column (inclusive).
+                \param[in] y1 Last row (inclusive).
+                \param[out] value The value of the texels if they are constant.
+                \return True if the texels are known to be constant.
+            */
+            bool isConstant(uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1, float3& value) const;
+
+        private:
+            Image(uint32_t width, uint32_t height, std::vector<float3> texels);
+
+            struct Level
+            {
+                uint32_t width;
+                uint32_t height;
+                std::vector<float3> minValue;
+                std::vector<float3> maxValue;
+            };
+
+            uint32_t mWidth;
+            uint32_t mHeight;
+            std::vector<float3> mTexels;
+            std::vector<Level> mLevels;         ///< Min/max pyramid. Level i has cells of 2^(i+1) x 2^(i+1) texels.
+        };
+
+        /** A mesh to integrate.
+        */
+        struct MeshInput
+        {
+            uint32_t meshID = 0;                ///< Mesh ID, used as cache key.
+            uint32_t materialID = 0;            ///< Material ID, used as cache key.
+            Texture::SharedPtr pTexture;        ///< The emissive texture.
+            std::vector<float2> texCoords;      ///< Texture coordinates, three per triangle.
+        };
+
+        /** Integration statistics.
+        */
+        struct Stats
+        {
+            uint64_t meshesIntegrated = 0;      ///< Number of meshes integrated by the last call to integrate().
+            uint64_t meshesCached = 0;          ///< Number of meshes found in the cache by the last call to integrate().
+            uint64_t trianglesIntegrated = 0;   ///< Number of triangles integrated by visiting their texels.
+            uint64_t trianglesConstant = 0;     ///< Number of triangles resolved by the constant region check.
+            double   time = 0.0;                ///< Time in seconds of the last call to integrate().
+        };
+
+        /** Creates a new object.
+            \param[in] addressModeU Texture address mode along U. Only Wrap and Clamp are supported.
+            \param[in] addressModeV Texture address mode along V. Only Wrap and Clamp are supported.
+        */
+        static SharedPtr create(Sampler::AddressMode addressModeU = Sampler::AddressMode::Wrap, Sampler::AddressMode addressModeV = Sampler::AddressMode::Wrap);
+
+        /** Returns true if an address mode is supported.
+        */
+        static bool isSupported(Sampler::AddressMode mode) { return mode == Sampler::AddressMode::Wrap || mode == Sampler::AddressMode::Clamp; }
+
+        /** Integrates the texels covered by each triangle.
+            \param[in] image The emissive texture.
+            \param[in] pTexCoords Texture coordinates, three per triangle.
+            \param[in] triangleCount Number of triangles.
+            \param[in] addressModeU Texture address mode along U.
+            \param[in] addressModeV Texture address mode along V.
+            \param[out] pTexelSums Sum of the covered texel colors (RGB) and their count (A), one per triangle.
+            \param[out] pStats Optional statistics, the triangle counts are incremented.
+        */
+        static void integrateTriangles(const Image& image, const float2* pTexCoords, uint32_t triangleCount, Sampler::AddressMode addressModeU, Sampler::AddressMode addressModeV, float4* pTexelSums, Stats* pStats = nullptr);
+
+        /** Integrates a set of meshes, reusing the cached results of unchanged (mesh, material) pairs.
+            Textures are decoded and meshes integrated in parallel.
+            \param[in] meshes The meshes. Duplicate (mesh, material) pairs are integrated once.
+            \return False if any of the textures can't be decoded on the CPU. The results of the other meshes are still valid.
+        */
+        bool integrate(const std::vector<MeshInput>& meshes);
+
+        /** Returns the texel sums of a mesh integrated by integrate().
+            \param[in] meshID Mesh ID.
+            \param[in] materialID Material ID.
+            \return Sum of the covered texel colors (RGB) and their count (A) per triangle of the mesh, or nullptr if not available.
+        */
+        const std::vector<float4>* getTexelSums(uint32_t meshID, uint32_t materialID) const;
+
+        /** Clears the cache.
+        */
+        void clearCache();
+
+        const Stats& getStats() const { return mStats; }
+
+    private:
+        EmissiveIntegratorCPU(Sampler::AddressMode addressModeU, Sampler::AddressMode addressModeV) : mAddressModeU(addressModeU), mAddressModeV(addressModeV) {}
+
+        struct CacheEntry
+        {
+            Texture::SharedPtr pTexture;        ///< The texture the results were computed from.
+            std::vector<float4> texelSums;      ///< Results per triangle of the mesh.
+        };
+
+        static uint64_t getKey(uint32_t meshID, uint32_t materialID) { return ((uint64_t)meshID << 32) | materialID; }
+
+        Sampler::AddressMode mAddressModeU;
+        Sampler::AddressMode mAddressModeV;
+        std::unordered_map<uint64_t, CacheEntry> mCache;
+        std::unordered_map<Texture::SharedPtr, Image::SharedConstPtr> mImages;  ///< Decoded textures, nullptr for textures that can't be decoded on the CPU.
+        Stats mStats;
+    };
+}
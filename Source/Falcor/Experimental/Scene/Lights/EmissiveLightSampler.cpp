@@ -40,5 +40,6 @@ namespace Falcor
         auto e = m.enum_<EmissiveLightSamplerType>("EmissiveLightSamplerType");
         e.regEnumVal(EmissiveLightSamplerType::Uniform);
         e.regEnumVal(EmissiveLightSamplerType::LightBVH);
+        e.regEnumVal(EmissiveLightSamplerType::Power);
     }
 }
@@ -0,0 +1,337 @@
+/***************************************************************************
+ # Copyright (c) 2020, NVIDIA CORPORATION. All rights reserved.
+ #
+ # Redistribution and use in source and binary forms, with or without
+ # modification, are permitted provided that the following conditions
+ # are met:
+ #  * Redistributions of source code must retain the above copyright
+ #    notice, this list of conditions and the following disclaimer.
+ #  * Redistributions in binary form must reproduce the above copyright
+ #    notice, this list of conditions and the following disclaimer in the
+ #    documentation and/or other materials provided with the distribution.
+ #  * Neither the name of NVIDIA CORPORATION nor the names of its
+ #    contributors may be used to endorse or promote products derived
+ #    from this software without specific prior written permission.
+ #
+ # THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ # EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ # IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ # PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ # CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ # EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ # PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ # PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ # OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ # (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ # OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **************************************************************************/
+#include "stdafx.h"
+#include "EmissivePowerSampler.h"
+#include <algorithm>
+
+namespace Falcor
+{
+    namespace
+    {
+        // Nearby dirty blocks are uploaded with a single copy if they are at most this many blocks apart.
+        const uint32_t kUploadMergeGap = 4;
+
+        /** Builds an alias table over a set of weights using Vose's method.
+            \param[in] count Number of entries.
+            \param[in] aliasOffset Offset added to the local index to form the stored alias index.
+            \param[in] weight Function returning the non-negative weight of the i:th entry.
+            \param[out] pEntries Output entries, count elements.
+            \return Sum of the weights.
+        */
+        template<typename WeightFunc>
+        double buildAliasTable(uint32_t count, uint32_t aliasOffset, WeightFunc weight, EmissivePowerAliasEntry* pEntries)
+        {
+            std::vector<double> scaled(count);
+            double total = 0.0;
+            for (uint32_t i = 0; i < count; ++i)
+            {
+                scaled[i] = std::max((double)weight(i), 0.0);
+                total += scaled[i];
+            }
+
+            // Entries with zero total weight are never selected, as their pdf is zero.
+            for (uint32_t i = 0; i < count; ++i)
+            {
+                pEntries[i] = EmissivePowerAliasEntry();
+                pEntries[i].alias = aliasOffset + i;
+                pEntries[i].pdf = total > 0.0 ? (float)(scaled[i] / total) : 0.f;
+            }
+            if (total <= 0.0) return 0.0;
+
+            // Pair each entry with probability below the average with one above it.
+            std::vector<uint32_t> small, large;
+            for (uint32_t i = 0; i < count; ++i)
+            {
+                scaled[i] *= count / total;
+                if (scaled[i] < 1.0) small.push_back(i);
+                else large.push_back(i);
+            }
+
+            while (!small.empty() && !large.empty())
+            {
+                uint32_t s = small.back();
+                uint32_t l = large.back();
+                small.pop_back();
+
+                pEntries[s].threshold = (float)scaled[s];
+                pEntries[s].alias = aliasOffset + l;
+
+                scaled[l] -= 1.0 - scaled[s];
+                if (scaled[l] < 1.0)
+                {
+                    large.pop_back();
+                    small.push_back(l);
+                }
+            }
+
+            // The remaining entries have probability one up to rounding errors, which is the default.
+            return total;
+        }
+    }
+
+    EmissivePowerSampler::SharedPtr EmissivePowerSampler::create(RenderContext* pRenderContext, Scene::SharedPtr pScene, const Options& options)
+    {
+        return SharedPtr(new EmissivePowerSampler(pRenderContext, pScene, options));
+    }
+
+    bool EmissivePowerSampler::update(RenderContext* pRenderContext)
+    {
+        PROFILE("EmissivePowerSampler::update");
+
+        bool samplerChanged = false;
+
+        // Record the lights that changed on the GPU. Their blocks are rebuilt once the CPU has a copy of the new data.
+        if (is_set(mpScene->getUpdates(), Scene::UpdateFlags::LightCollectionChanged))
+        {
+            const uint64_t dataVersion = mpLightCollection->getDataVersion();
+            for (uint32_t lightIdx : mpLightCollection->getUpdatedLights())
+            {
+                if (mPendingLastVersion[lightIdx] == 0)
+                {
+                    mPendingLights.push_back(lightIdx);
+                    mPendingFirstVersion[lightIdx] = dataVersion;
+                }
+                mPendingLastVersion[lightIdx] = dataVersion;
+            }
+        }
+
+        // Keep a readback of the current data in flight instead of waiting for it.
+        mpLightCollection->requestCPUData(pRenderContext);
+
+        if (mNeedsRebuild)
+        {
+            build();
+            mNeedsRebuild = false;
+            samplerChanged = true;
+        }
+        else if (!mPendingLights.empty())
+        {
+            // Picks up the most recent readback that has finished.
+            mpLightCollection->getAvailableMeshLightTriangles();
+            if (mpLightCollection->getCPUDataVersion() > mBuiltDataVersion)
+            {
+                if (mOptions.useIncrementalUpdate) updateBlocks();
+                else build();
+                samplerChanged = true;
+            }
+        }
+
+        return samplerChanged;
+    }
+
+    bool EmissivePowerSampler::setShaderData(const ShaderVar& var) const
+    {
+        assert(var.isValid());
+
+        var["_aliasTable"] = mpAliasTableBuffer;
+        var["_triangleCount"] = mTriangleCount;
+        var["_blockCount"] = getBlockCount();
+        var["_blockSize"] = mBlockSize;
+
+        return true;
+    }
+
+    bool EmissivePowerSampler::renderUI(Gui::Widgets& widgets)
+    {
+        bool optionsChanged = false;
+
+        if (widgets.var("Block size", mOptions.blockSize, 1u))
+        {
+            mNeedsRebuild = optionsChanged = true;
+        }
+        widgets.tooltip("Number of triangles per block of the alias table. Smaller blocks make incremental updates cheaper, but the top-level table larger.", true);
+        widgets.checkbox("Incremental update", mOptions.useIncrementalUpdate);
+        widgets.tooltip("Rebuild only the blocks containing updated lights, instead of the full table.", true);
+
+        std::ostringstream oss;
+        oss << "Triangle count: " << mTriangleCount << std::endl
+            << "Block count: " << getBlockCount() << std::endl
+            << "Total flux: " << mTotalFlux << std::endl
+            << "Last update: " << mLastUpdatedBlockCount << " blocks in " << mLastUpdateTime * 1000.0 << " ms" << std::endl;
+        widgets.text(oss.str());
+
+        return optionsChanged;
+    }
+
+    EmissivePowerSampler::EmissivePowerSampler(RenderContext* pRenderContext, Scene::SharedPtr pScene, const Options& options)
+        : EmissiveLightSampler(EmissiveLightSamplerType::Power, pScene)
+        , mOptions(options)
+    {
+        mpLightCollection = pScene->getLightCollection(pRenderContext);
+        if (!mpLightCollection) throw std::exception("Failed to create light collection");
+
+        const size_t meshLightCount = mpLightCollection->getMeshLights().size();
+        mPendingFirstVersion.assign(meshLightCount, 0);
+        mPendingLastVersion.assign(meshLightCount, 0);
+    }
+
+    void EmissivePowerSampler::build()
+    {
+        PROFILE("EmissivePowerSampler::build");
+
+        CpuTimer timer;
+        timer.update();
+
+        // This only waits for the GPU if no light data has been read back yet.
+        const auto& triangles = mpLightCollection->getAvailableMeshLightTriangles();
+        mBuiltDataVersion = mpLightCollection->getCPUDataVersion();
+        retirePendingLights(mBuiltDataVersion);
+
+        mTriangleCount = (uint32_t)triangles.size();
+        mBlockSize = std::max(mOptions.blockSize, 1u);
+        const uint32_t blockCount = div_round_up(mTriangleCount, mBlockSize);
+
+        mAliasTable.assign(mTriangleCount + blockCount, EmissivePowerAliasEntry());
+        mBlockFlux.assign(blockCount, 0.0);
+
+        Threading::parallelFor(0u, blockCount, [&](uint32_t blockIndex) { buildBlock(triangles, blockIndex); }, 1);
+        buildTopLevel();
+
+        // Upload the table. The buffer is only reallocated if the size has changed.
+        const uint32_t entryCount = (uint32_t)mAliasTable.size();
+        if (entryCount == 0)
+        {
+            mpAliasTableBuffer = nullptr;
+        }
+        else if (!mpAliasTableBuffer || mpAliasTableBuffer->getElementCount() != entryCount)
+        {
+            mpAliasTableBuffer = Buffer::createStructured(sizeof(EmissivePowerAliasEntry), entryCount, Resource::BindFlags::ShaderResource, Buffer::CpuAccess::None, mAliasTable.data(), false);
+            mpAliasTableBuffer->setName("EmissivePowerSampler_AliasTable");
+        }
+        else
+        {
+            mpAliasTableBuffer->setBlob(mAliasTable.data(), 0, entryCount * sizeof(EmissivePowerAliasEntry));
+        }
+
+        timer.update();
+        mLastUpdateTime = timer.delta();
+        mLastUpdatedBlockCount = blockCount;
+    }
+
+    void EmissivePowerSampler::updateBlocks()
+    {
+        PROFILE("EmissivePowerSampler::updateBlocks");
+
+        CpuTimer timer;
+        timer.update();
+
+        const auto& triangles = mpLightCollection->getAvailableMeshLightTriangles();
+        assert(triangles.size() == mTriangleCount);
+        mBuiltDataVersion = mpLightCollection->getCPUDataVersion();
+        const std::vector<uint32_t> updatedLights = retirePendingLights(mBuiltDataVersion);
+
+        // Find the blocks overlapping the triangle ranges of the updated lights.
+        const auto& meshLights = mpLightCollection->getMeshLights();
+
+        std::vector<uint32_t> dirtyBlocks;
+        for (uint32_t lightIdx : updatedLights)
+        {
+            const MeshLightData& meshLight = meshLights[lightIdx];
+            if (meshLight.triangleCount == 0) continue;
+            uint32_t firstBlock = meshLight.triangleOffset / mBlockSize;
+            uint32_t lastBlock = (meshLight.triangleOffset + meshLight.triangleCount - 1) / mBlockSize;
+            for (uint32_t blockIndex = firstBlock; blockIndex <= lastBlock; ++blockIndex) dirtyBlocks.push_back(blockIndex);
+        }
+        std::sort(dirtyBlocks.begin(), dirtyBlocks.end());
+        dirtyBlocks.erase(std::unique(dirtyBlocks.begin(), dirtyBlocks.end()), dirtyBlocks.end());
+        if (dirtyBlocks.empty()) return;
+
+        Threading::parallelFor(0u, (uint32_t)dirtyBlocks.size(), [&](uint32_t i) { buildBlock(triangles, dirtyBlocks[i]); }, 1);
+        buildTopLevel();
+
+        // Upload the dirty blocks, merging nearby ones into a single copy, followed by the top-level table.
+        auto upload = [this](uint32_t firstEntry, uint32_t lastEntry)
+        {
+            mpAliasTableBuffer->setBlob(&mAliasTable[firstEntry], firstEntry * sizeof(EmissivePowerAliasEntry), (lastEntry - firstEntry) * sizeof(EmissivePowerAliasEntry));
+        };
+
+        uint32_t beginBlock = dirtyBlocks.front();
+        uint32_t endBlock = beginBlock + 1;
+        for (size_t i = 1; i <= dirtyBlocks.size(); ++i)
+        {
+            if (i < dirtyBlocks.size() && dirtyBlocks[i] <= endBlock + kUploadMergeGap)
+            {
+                endBlock = dirtyBlocks[i] + 1;
+                continue;
+            }
+            upload(beginBlock * mBlockSize, std::min(endBlock * mBlockSize, mTriangleCount));
+            if (i < dirtyBlocks.size())
+            {
+                beginBlock = dirtyBlocks[i];
+                endBlock = beginBlock + 1;
+            }
+        }
+        upload(mTriangleCount, (uint32_t)mAliasTable.size());
+
+        timer.update();
+        mLastUpdateTime = timer.delta();
+        mLastUpdatedBlockCount = (uint32_t)dirtyBlocks.size();
+    }
+
+    std::vector<uint32_t> EmissivePowerSampler::retirePendingLights(uint64_t dataVersion)
+    {
+        std::vector<uint32_t> updatedLights;
+        auto pendingEnd = std::remove_if(mPendingLights.begin(), mPendingLights.end(), [&](uint32_t lightIdx)
+        {
+            if (mPendingFirstVersion[lightIdx] > dataVersion) return false;
+            updatedLights.push_back(lightIdx);
+            if (mPendingLastVersion[lightIdx] > dataVersion)
+            {
+                // Changed again after this version. Only the changes after it are missing from the table.
+                mPendingFirstVersion[lightIdx] = dataVersion + 1;
+                return false;
+            }
+            mPendingLastVersion[lightIdx] = 0;
+            return true;
+        });
+        mPendingLights.erase(pendingEnd, mPendingLights.end());
+        return updatedLights;
+    }
+
+    void EmissivePowerSampler::buildBlock(const std::vector<LightCollection::MeshLightTriangle>& triangles, uint32_t blockIndex)
+    {
+        const uint32_t firstTriangle = blockIndex * mBlockSize;
+        const uint32_t count = std::min(mBlockSize, mTriangleCount - firstTriangle);
+        mBlockFlux[blockIndex] = buildAliasTable(count, firstTriangle, [&](uint32_t i) { return triangles[firstTriangle + i].luminousFlux; }, &mAliasTable[firstTriangle]);
+    }
+
+    void EmissivePowerSampler::buildTopLevel()
+    {
+        mTotalFlux = buildAliasTable(getBlockCount(), 0, [this](uint32_t i) { return mBlockFlux[i]; }, mAliasTable.data() + mTriangleCount);
+    }
+
+    SCRIPT_BINDING(EmissivePowerSampler)
+    {
+        // TODO use a nested class in the bindings when supported.
+        auto options = m.class_<EmissivePowerSampler::Options>("EmissivePowerSamplerOptions");
+#define field(f_) rwField(#f_, &EmissivePowerSampler::Options::f_)
+        options.field(blockSize);
+        options.field(useIncrementalUpdate);
+#undef field
+    }
+}
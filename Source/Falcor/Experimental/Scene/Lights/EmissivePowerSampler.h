@@ -0,0 +1,149 @@
+/***************************************************************************
+ # Copyright (c) 2020, NVIDIA CORPORATION. All rights reserved.
+ #
+ # Redistribution and use in source and binary forms, with or without
+ # modification, are permitted provided that the following conditions
+ # are met:
+ #  * Redistributions of source code must retain the above copyright
+ #    notice, this list of conditions and the following disclaimer.
+ #  * Redistributions in binary form must reproduce the above copyright
+ #    notice, this list of conditions and the following disclaimer in the
+ #    documentation and/or other materials provided with the distribution.
+ #  * Neither the name of NVIDIA CORPORATION nor the names of its
+ #    contributors may be used to endorse or promote products derived
+ #    from this software without specific prior written permission.
+ #
+ # THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ # EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ # IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ # PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ # CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ # EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ # PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ # PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ # OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ # (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ # OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **************************************************************************/
+#pragma once
+#include "EmissiveLightSampler.h"
+#include "LightCollection.h"
+#include "EmissivePowerSamplerSharedDefinitions.slang"
+
+namespace Falcor
+{
+    /** Emissive light sampler that selects triangles in proportion to their flux.
+
+        This class wraps a LightCollection object, which holds the set of lights to sample.
+        Internally, the class builds a two-level alias table over the emissive triangles:
+        triangles are grouped in blocks of consecutive indices, each block has an alias
+        table over its triangles, and a top-level alias table selects among the blocks.
+        Sampling is O(1) in the shader. When only a few lights change, only the blocks
+        containing their triangles and the small top-level table are rebuilt and uploaded.
+        The table is built from the light data that has been read back to the CPU, without waiting for the GPU.
+        Changed lights are rebuilt a few frames later, once their new data has arrived.
+
+        The sampler ignores the position of the shading point. For scenes with a few large
+        emitters it is cheaper to build and to sample than the light BVH.
+    */
+    class dlldecl EmissivePowerSampler : public EmissiveLightSampler, public inherit_shared_from_this<EmissiveLightSampler, EmissivePowerSampler>
+    {
+    public:
+        using SharedPtr = std::shared_ptr<EmissivePowerSampler>;
+        using SharedConstPtr = std::shared_ptr<const EmissivePowerSampler>;
+
+        /** EmissivePowerSampler configuration.
+            Note if you change options, please update SCRIPT_BINDING in EmissivePowerSampler.cpp
+        */
+        struct Options : Falcor::ScriptBindings::enable_to_string
+        {
+            uint32_t    blockSize = 256;                    ///< Number of triangles per block of the alias table. Smaller blocks make incremental updates cheaper.
+            bool        useIncrementalUpdate = true;        ///< Rebuild only the blocks containing updated lights, instead of the full table.
+        };
+
+        virtual ~EmissivePowerSampler() = default;
+
+        /** Creates a EmissivePowerSampler for a given scene.
+            \param[in] pRenderContext The render context.
+            \param[in] pScene The scene.
+            \param[in] options The options to override the default behavior.
+        */
+        static SharedPtr create(RenderContext* pRenderContext, Scene::SharedPtr pScene, const Options& options = Options());
+
+        /** Updates the sampler to the current frame.
+            \param[in] pRenderContext The render context.
+            \return True if the sampler was updated.
+        */
+        virtual bool update(RenderContext* pRenderContext) override;
+
+        /** Bind the light sampler data to a given shader variable.
+            \param[in] var Shader variable.
+            \return True if successful, false otherwise.
+        */
+        virtual bool setShaderData(const ShaderVar& var) const override;
+
+        /** Render the GUI.
+            \return True if setting the refresh flag is needed, false otherwise.
+        */
+        virtual bool renderUI(Gui::Widgets& widget) override;
+
+        /** Returns the current configuration.
+        */
+        const Options& getOptions() const { return mOptions; }
+
+        /** Returns the CPU copy of the alias table. See EmissivePowerAliasEntry for the layout.
+        */
+        const std::vector<EmissivePowerAliasEntry>& getAliasTable() const { return mAliasTable; }
+
+    protected:
+        EmissivePowerSampler(RenderContext* pRenderContext, Scene::SharedPtr pScene, const Options& options);
+
+        /** Rebuilds the full alias table from the available light data and uploads it to the GPU.
+        */
+        void build();
+
+        /** Rebuilds the blocks containing the triangles of the pending mesh lights whose data has arrived, and the top-level table.
+            Only the modified parts of the table are uploaded to the GPU.
+        */
+        void updateBlocks();
+
+        /** Removes the mesh lights from the pending list whose last update is included in the given data version.
+            \param[in] dataVersion The version of the light data the table is built from.
+            \return The pending mesh lights that changed in the given data version, i.e. whose blocks need to be rebuilt.
+        */
+        std::vector<uint32_t> retirePendingLights(uint64_t dataVersion);
+
+        /** Builds the alias table of one block from the triangle fluxes and stores the block's total flux.
+            \param[in] triangles The emissive triangles.
+            \param[in] blockIndex Index of the block.
+        */
+        void buildBlock(const std::vector<LightCollection::MeshLightTriangle>& triangles, uint32_t blockIndex);
+
+        /** Builds the top-level alias table from the total flux of each block.
+        */
+        void buildTopLevel();
+
+        uint32_t getBlockCount() const { return (uint32_t)mBlockFlux.size(); }
+
+        // Configuration
+        Options                                 mOptions;               ///< Current configuration options.
+
+        // Internal state
+        LightCollection::SharedConstPtr         mpLightCollection;      ///< The light collection.
+        std::vector<EmissivePowerAliasEntry>    mAliasTable;            ///< CPU copy of the alias table: one entry per triangle followed by one entry per block.
+        std::vector<double>                     mBlockFlux;             ///< Total flux of each block.
+        Buffer::SharedPtr                       mpAliasTableBuffer;     ///< GPU copy of the alias table.
+        uint32_t                                mTriangleCount = 0;     ///< Number of triangles in the table.
+        uint32_t                                mBlockSize = 0;         ///< Block size the table was built with.
+        bool                                    mNeedsRebuild = true;   ///< Trigger rebuild on the next call to update(). We should always build on the first call, so the initial value is true.
+        uint64_t                                mBuiltDataVersion = 0;  ///< Version of the light data the table was built from.
+        std::vector<uint32_t>                   mPendingLights;         ///< Mesh lights that changed on the GPU and are not up to date in the table.
+        std::vector<uint64_t>                   mPendingFirstVersion;   ///< Per mesh light, the first data version with a change that is not in the table.
+        std::vector<uint64_t>                   mPendingLastVersion;    ///< Per mesh light, the last data version with a change that is not in the table, or 0 if none.
+
+        // Statistics
+        double                                  mTotalFlux = 0.0;       ///< Total flux of all triangles.
+        double                                  mLastUpdateTime = 0.0;  ///< Time in seconds of the last build or update.
+        uint32_t                                mLastUpdatedBlockCount = 0; ///< Number of blocks rebuilt by the last build or update.
+    };
+}
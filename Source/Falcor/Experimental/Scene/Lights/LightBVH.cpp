@@ -27,10 +27,19 @@
  **************************************************************************/
 #include "stdafx.h"
 #include "LightBVH.h"
+#include <cfloat>
 
 namespace
 {
     const char kShaderFile[] = "Experimental/Scene/Lights/LightBVHRefit.cs.slang";
+
+    const uint64_t kInvalidBitmask = std::numeric_limits<uint64_t>::max();
+    const size_t kUploadMergeGap = 4096;    ///< Dirty nodes closer than this many bytes are uploaded with a single copy.
+
+    float sinFromCos(float cosAngle)
+    {
+        return std::sqrt(std::max(0.f, 1.f - cosAngle * cosAngle));
+    }
 }
 
 namespace Falcor
@@ -84,6 +93,173 @@ namespace Falcor
         mIsCpuDataValid = false;
     }
 
+    void LightBVH::refitCPU(const std::vector<uint32_t>& updatedLights)
+    {
+        PROFILE("LightBVH::refitCPU()");
+
+        assert(mIsValid);
+        if (updatedLights.empty()) return;
+
+        syncDataToCPU();
+        const auto& meshLights = mpLightCollection->getMeshLights();
+        const auto& triangles = mpLightCollection->getMeshLightTriangles();
+
+        const uintptr_t rootNode = reinterpret_cast<uintptr_t>(mAlignedAllocator.getStartPointer());
+        auto getNode = [rootNode](uint32_t nodeOffset) { return reinterpret_cast<InternalNode*>(rootNode + nodeOffset); };
+        auto getLeaf = [rootNode](uint32_t nodeOffset) { return reinterpret_cast<LeafNode*>(rootNode + nodeOffset); };
+
+        // Follow the traversal bitmask of each updated triangle from the root and record the nodes on its path.
+        // Internal nodes are recorded per depth so that they can be refit bottom-up, one level at a time.
+        // Consecutive triangles mostly share their path, so repeated nodes are skipped before sorting.
+        std::vector<std::vector<uint32_t>> dirtyInternalNodes(mBVHStats.treeHeight);
+        std::vector<uint32_t> dirtyLeafNodes;
+        auto record = [](std::vector<uint32_t>& nodes, uint32_t nodeOffset) { if (nodes.empty() || nodes.back() != nodeOffset) nodes.push_back(nodeOffset); };
+
+        for (uint32_t lightIdx : updatedLights)
+        {
+            const MeshLightData& meshLight = meshLights[lightIdx];
+            for (uint32_t triangleIdx = meshLight.triangleOffset; triangleIdx < meshLight.triangleOffset + meshLight.triangleCount; ++triangleIdx)
+            {
+                // Culled triangles are not in the BVH.
+                uint64_t bitmask = mTriangleBitmasks[triangleIdx];
+                if (bitmask == kInvalidBitmask) continue;
+
+                uint32_t nodeOffset = 0;
+                for (uint32_t depth = 0; getNode(nodeOffset)->nodeType == NodeType::Internal; ++depth, bitmask >>= 1)
+                {
+                    record(dirtyInternalNodes[depth], nodeOffset);
+                    nodeOffset = (bitmask & 1) ? getNode(nodeOffset)->rightNodeOffset : getNode(nodeOffset)->leftNodeOffset;
+                }
+                record(dirtyLeafNodes, nodeOffset);
+            }
+        }
+
+        auto sortUnique = [](std::vector<uint32_t>& nodes)
+        {
+            std::sort(nodes.begin(), nodes.end());
+            nodes.erase(std::unique(nodes.begin(), nodes.end()), nodes.end());
+        };
+        sortUnique(dirtyLeafNodes);
+        for (auto& nodes : dirtyInternalNodes) sortUnique(nodes);
+
+        // Refit the leaves. This mirrors updateLeafNodes() in LightBVHRefit.cs.slang, but also updates the flux.
+        Threading::parallelFor(0, (uint32_t)dirtyLeafNodes.size(), [&](uint32_t i)
+        {
+            LeafNode* pNode = getLeaf(dirtyLeafNodes[i]);
+
+            BBox bounds;
+            float flux = 0.f;
+            float3 normalsSum(0.f);
+            for (uint32_t j = 0; j < pNode->triangleCount; ++j)
+            {
+                const auto& triangle = triangles[pNode->triangleIndices[j]];
+                for (uint32_t vertexIndex = 0; vertexIndex < 3; ++vertexIndex) bounds |= BBox(triangle.vtx[vertexIndex].pos);
+                flux += triangle.luminousFlux;
+                normalsSum += triangle.normal;
+            }
+
+            const float coneDirectionLength = glm::length(normalsSum);
+            float3 coneDirection(0.f);
+            float cosConeAngle = kInvalidCosConeAngle;
+            if (coneDirectionLength >= FLT_MIN)
+            {
+                coneDirection = normalsSum / coneDirectionLength;
+                cosConeAngle = 1.f;
+                for (uint32_t j = 0; j < pNode->triangleCount; ++j)
+                {
+                    cosConeAngle = std::min(cosConeAngle, glm::dot(coneDirection, triangles[pNode->triangleIndices[j]].normal));
+                }
+            }
+
+            pNode->aabbMin = bounds.minPoint;
+            pNode->aabbMax = bounds.maxPoint;
+            pNode->luminousFlux = flux;
+            pNode->coneDirection = coneDirection;
+            pNode->cosConeAngle = cosConeAngle;
+        }, 16);
+
+        // Refit the internal nodes bottom-up. This mirrors updateInternalNodes() in LightBVHRefit.cs.slang, but also updates the flux.
+        // Nodes on the same level are independent of each other.
+        for (int depth = (int)dirtyInternalNodes.size() - 1; depth >= 0; --depth)
+        {
+            const std::vector<uint32_t>& nodes = dirtyInternalNodes[depth];
+            Threading::parallelFor(0, (uint32_t)nodes.size(), [&](uint32_t i)
+            {
+                InternalNode* pNode = getNode(nodes[i]);
+                const InternalNode* pLeft = getNode(pNode->leftNodeOffset);
+                const InternalNode* pRight = getNode(pNode->rightNodeOffset);
+
+                pNode->aabbMin = glm::min(pLeft->aabbMin, pRight->aabbMin);
+                pNode->aabbMax = glm::max(pLeft->aabbMax, pRight->aabbMax);
+                pNode->luminousFlux = pLeft->luminousFlux + pRight->luminousFlux;
+
+                const float3 coneDirectionSum = pLeft->coneDirection + pRight->coneDirection;
+                const float coneDirectionLength = glm::length(coneDirectionSum);
+                float3 coneDirection(0.f);
+                float cosConeAngle = kInvalidCosConeAngle;
+
+                if (coneDirectionLength >= FLT_MIN)
+                {
+                    coneDirection = coneDirectionSum / coneDirectionLength;
+                    if (pLeft->cosConeAngle != kInvalidCosConeAngle && pRight->cosConeAngle != kInvalidCosConeAngle)
+                    {
+                        // Rotate each child's cone axis away from the new axis by the child's spread angle.
+                        // If either sum exceeds pi, the cone would cover the whole sphere and is disabled.
+                        const float cosLeftDiffAngle = glm::dot(coneDirection, pLeft->coneDirection);
+                        const float sinLeftDiffAngle = sinFromCos(cosLeftDiffAngle);
+                        const float cosRightDiffAngle = glm::dot(coneDirection, pRight->coneDirection);
+                        const float sinRightDiffAngle = sinFromCos(cosRightDiffAngle);
+                        const float sinLeftConeAngle = sinFromCos(pLeft->cosConeAngle);
+                        const float sinRightConeAngle = sinFromCos(pRight->cosConeAngle);
+
+                        const float sinLeftTotalAngle = sinLeftConeAngle * cosLeftDiffAngle + sinLeftDiffAngle * pLeft->cosConeAngle;
+                        const float sinRightTotalAngle = sinRightConeAngle * cosRightDiffAngle + sinRightDiffAngle * pRight->cosConeAngle;
+
+                        if (sinLeftTotalAngle > 0.f && sinRightTotalAngle > 0.f)
+                        {
+                            const float cosLeftTotalAngle = pLeft->cosConeAngle * cosLeftDiffAngle - sinLeftConeAngle * sinLeftDiffAngle;
+                            const float cosRightTotalAngle = pRight->cosConeAngle * cosRightDiffAngle - sinRightConeAngle * sinRightDiffAngle;
+                            cosConeAngle = std::min(cosLeftTotalAngle, cosRightTotalAngle);
+                        }
+                    }
+                }
+
+                pNode->coneDirection = coneDirection;
+                pNode->cosConeAngle = cosConeAngle;
+            }, 64);
+        }
+
+        // Upload the modified nodes. Nodes are stored in depth-first order, so dirty paths form clusters
+        // and nearby nodes are merged into a single copy.
+        std::vector<std::pair<uint32_t, uint32_t>> ranges;
+        ranges.reserve(dirtyLeafNodes.size());
+        for (uint32_t nodeOffset : dirtyLeafNodes) ranges.emplace_back(nodeOffset, (uint32_t)sizeof(LeafNode));
+        for (const auto& nodes : dirtyInternalNodes)
+        {
+            for (uint32_t nodeOffset : nodes) ranges.emplace_back(nodeOffset, (uint32_t)sizeof(InternalNode));
+        }
+        if (ranges.empty()) return;
+        std::sort(ranges.begin(), ranges.end());
+
+        size_t begin = ranges.front().first;
+        size_t end = begin + ranges.front().second;
+        for (size_t i = 1; i <= ranges.size(); ++i)
+        {
+            if (i < ranges.size() && ranges[i].first <= end + kUploadMergeGap)
+            {
+                end = std::max(end, (size_t)ranges[i].first + ranges[i].second);
+                continue;
+            }
+            end = std::min(end, getSize());
+            mpBVHNodesBuffer->setBlob(reinterpret_cast<const void*>(rootNode + begin), begin, end - begin);
+            if (i < ranges.size())
+            {
+                begin = ranges[i].first;
+                end = begin + ranges[i].second;
+            }
+        }
+    }
+
     LightBVH::NodeType LightBVH::getNodeType(const uint32_t nodeOffset) const
     {
         assert(isValid());
@@ -175,6 +351,7 @@ namespace Falcor
         // Reset all CPU data.
         mAlignedAllocator.reset();
         mNodeOffsets.clear();
+        mTriangleBitmasks.clear();
         mPerDepthRefitEntryInfo.clear();
         mMaxTriangleCountPerLeaf = 0u;
         mBVHStats = BVHStats();
@@ -345,6 +522,7 @@ namespace Falcor
         mpBVHNodesBuffer->setBlob(mAlignedAllocator.getStartPointer(), 0, bvhByteSize);
         assert(mpTriangleBitmasksBuffer->getSize() >= triangleBitmasks.size() * sizeof(triangleBitmasks[0]));
         mpTriangleBitmasksBuffer->setBlob(triangleBitmasks.data(), 0, triangleBitmasks.size() * sizeof(triangleBitmasks[0]));
+        mTriangleBitmasks = triangleBitmasks;
 
         mIsCpuDataValid = true;
     }
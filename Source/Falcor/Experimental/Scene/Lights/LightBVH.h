@@ -136,6 +136,15 @@ namespace Falcor
         */
         void refit(RenderContext* pRenderContext);
 
+        /** Refit the BVH nodes on the CPU, visiting only the nodes on the paths to the given lights.
+            The affected leaves are found through the per-triangle traversal bitmasks and the dirty nodes are refit
+            bottom-up, with the nodes of each level processed in parallel. Bounds, flux and lighting cones are
+            recomputed. The cost scales with the number of updated triangles rather than with the size of the BVH.
+            The BVH needs to have been built before trying to refit it.
+            \param[in] updatedLights Indices of the updated mesh lights, see LightCollection::getUpdatedLights().
+        */
+        void refitCPU(const std::vector<uint32_t>& updatedLights);
+
         /** Return the type of the specified node.
             \return the type of the specified node.
         */
@@ -170,6 +179,15 @@ namespace Falcor
             uint32_t triangleCount = 0;                      ///< Number of triangles inside the BVH.
         };
 
+        /** Returns the light collection the BVH is built over.
+        */
+        const LightCollection::SharedConstPtr& getLightCollection() const { return mpLightCollection; }
+
+        /** Returns the per triangle bit pattern retracing the tree traversal to reach the triangle: 0=left child, 1=right child.
+            Triangles that are not in the BVH have all bits set.
+        */
+        const std::vector<uint64_t>& getTriangleBitmasks() const { return mTriangleBitmasks; }
+
         /** Returns stats.
         */
         const BVHStats& getStats() const { return mBVHStats; }
@@ -232,6 +250,7 @@ namespace Falcor
         // CPU resources
         mutable AlignedAllocator              mAlignedAllocator;        ///< Utility class for the CPU-side node buffer.
         std::vector<uint32_t>                 mNodeOffsets;
+        std::vector<uint64_t>                 mTriangleBitmasks;        ///< CPU copy of the per triangle traversal bitmasks, see mpTriangleBitmasksBuffer.
         std::vector<RefitEntryInfo>           mPerDepthRefitEntryInfo;  ///< Array containing for each level the number of internal nodes as well as the corresponding offset in mpNodeOffsetsBuffer; the very last entry contains the same data, but for all leaf nodes instead.
         uint32_t                              mMaxTriangleCountPerLeaf = 0u; ///< After the BVH is built, this contains the maximum light count per leaf node.
         BVHStats                              mBVHStats;
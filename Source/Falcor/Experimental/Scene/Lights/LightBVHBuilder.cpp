@@ -27,7 +27,15 @@
  **************************************************************************/
 #include "stdafx.h"
 #include "LightBVHBuilder.h"
+#include "Utils/Math/BoxBatch.h"
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <random>
 
 namespace
 {
@@ -37,6 +45,145 @@ namespace
     // The limitation comes from the need to store the traversal path to each node in a bit mask.
     const uint32_t kMaxBVHDepth = 64;
 
+    // Nodes with at least this many triangles build their two subtrees in parallel.
+    const uint32_t kParallelBuildCutoff = 4096;
+
+    // Nodes with at least this many triangles bin the three axes in parallel.
+    const uint32_t kParallelBinningCutoff = 16384;
+
+    // Number of triangles prepared per task at the start of the build.
+    const uint32_t kTrianglePrepareGrainSize = 4096;
+
+    // BVH cache file format. Bump the version whenever the node layout or the builder output changes.
+    const uint64_t kCacheMagic = 0x3130434856424c46ull; // "FLBVHC01" in little-endian.
+    const uint32_t kCacheVersion = 1;
+
+    // After each write, the cache directory is trimmed to this size by removing the least recently used files.
+    const uint64_t kMaxCacheByteSize = 1ull << 30;
+
+    // Temporary files older than this were left behind by an interrupted write and are removed when trimming.
+    const std::chrono::hours kStaleTempFileAge(1);
+
+    /** The subset of the build options that affects the built hierarchy, in a fixed binary layout.
+        allowRefitting, useParallelBuild and useAvailableLightData are excluded since they don't change the BVH for given light data.
+    */
+    struct CacheOptions
+    {
+        uint32_t splitHeuristicSelection = 0;
+        uint32_t maxTriangleCountPerLeaf = 0;
+        uint32_t binCount = 0;
+        float    volumeEpsilon = 0.f;
+        uint32_t flags = 0;
+
+        CacheOptions(const LightBVHBuilder::Options& options)
+            : splitHeuristicSelection((uint32_t)options.splitHeuristicSelection)
+            , maxTriangleCountPerLeaf(options.maxTriangleCountPerLeaf)
+            , binCount(options.binCount)
+            , volumeEpsilon(options.volumeEpsilon)
+        {
+            flags = (options.splitAlongLargest ? 1u : 0u) |
+                (options.useVolumeOverSA ? 2u : 0u) |
+                (options.useLeafCreationCost ? 4u : 0u) |
+                (options.createLeavesASAP ? 8u : 0u) |
+                (options.usePreintegration ? 16u : 0u) |
+                (options.useLightingCones ? 32u : 0u);
+        }
+
+        bool operator==(const CacheOptions& rhs) const { return std::memcmp(this, &rhs, sizeof(CacheOptions)) == 0; }
+    };
+
+    struct CacheHeader
+    {
+        uint64_t magic = kCacheMagic;
+        uint32_t version = kCacheVersion;
+        uint32_t headerSize = sizeof(CacheHeader);
+        uint64_t key = 0;                       ///< Hash of the emissive triangles and the options.
+        uint64_t payloadHash = 0;               ///< Hash of the node data and triangle bitmasks, to detect corrupt files.
+        uint64_t nodeByteSize = 0;              ///< Size of the node data, which directly follows the header.
+        uint64_t bitmaskCount = 0;              ///< Number of triangle bitmasks, which directly follow the node data.
+        uint32_t maxTriangleCountPerLeaf = 0;
+        CacheOptions options;
+    };
+
+    /** 64-bit FNV-1a hash, consuming eight bytes per step.
+    */
+    uint64_t hashData(const void* pData, size_t size, uint64_t hash = 0xcbf29ce484222325ull)
+    {
+        const uint64_t kPrime = 0x100000001b3ull;
+        const uint8_t* pBytes = static_cast<const uint8_t*>(pData);
+        size_t i = 0;
+        for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t))
+        {
+            uint64_t word;
+            std::memcpy(&word, pBytes + i, sizeof(uint64_t));
+            hash = (hash ^ word) * kPrime;
+        }
+        for (; i < size; i++) hash = (hash ^ pBytes[i]) * kPrime;
+        return hash;
+    }
+
+    /** Get a temporary filename next to the given file, unique across threads and processes.
+        Staying in the same directory keeps the final rename on the same volume.
+    */
+    std::string getUniqueTempFilename(const std::string& filename)
+    {
+        static std::atomic<uint64_t> sCounter{ 0 };
+        std::random_device rd;
+        const uint64_t token = (((uint64_t)rd() << 32) | rd()) ^ sCounter++;
+        char suffix[32];
+        std::snprintf(suffix, sizeof(suffix), ".%016llx.tmp", (unsigned long long)token);
+        return filename + suffix;
+    }
+
+    /** Remove the least recently used cache files until the directory fits in kMaxCacheByteSize, and remove stale temporary files.
+        Files in use by another process may fail to be removed; they are retried on the next trim.
+        \param[in] directory The cache directory.
+        \param[in] keepFilename Cache file that is never removed, i.e. the one just written.
+    */
+    void trimCache(const std::filesystem::path& directory, const std::filesystem::path& keepFilename)
+    {
+        namespace fs = std::filesystem;
+        struct CacheFile
+        {
+            fs::path path;
+            fs::file_time_type time;
+            uint64_t size;
+        };
+
+        std::error_code ec;
+        const auto now = fs::file_time_type::clock::now();
+        std::vector<CacheFile> files;
+        uint64_t totalSize = 0;
+        for (fs::directory_iterator it(directory, ec), end; !ec && it != end; it.increment(ec))
+        {
+            if (!it->is_regular_file(ec)) continue;
+            const fs::path& path = it->path();
+            const fs::file_time_type time = fs::last_write_time(path, ec);
+            if (ec) continue;
+
+            if (path.extension() == ".tmp")
+            {
+                if (now - time > kStaleTempFileAge) fs::remove(path, ec);
+            }
+            else if (path.extension() == ".lbvh")
+            {
+                const uint64_t size = fs::file_size(path, ec);
+                if (ec) continue;
+                files.push_back({ path, time, size });
+                totalSize += size;
+            }
+        }
+        if (totalSize <= kMaxCacheByteSize) return;
+
+        std::sort(files.begin(), files.end(), [](const CacheFile& a, const CacheFile& b) { return a.time < b.time; });
+        for (const auto& f : files)
+        {
+            if (totalSize <= kMaxCacheByteSize) break;
+            if (fs::equivalent(f.path, keepFilename, ec)) continue;
+            if (fs::remove(f.path, ec)) totalSize -= f.size;
+        }
+    }
+
     inline float safeACos(float v)
     {
         return std::acos(glm::clamp(v, -1.0f, 1.0f));
@@ -216,24 +363,28 @@ namespace Falcor
     {
         PROFILE("LightBVHBuilder::build()");
 
+        CpuTimer timer;
+        timer.update();
+
         bvh.clear();
         assert(!bvh.isValid() && bvh.getSize() == 0u);
 
         // Get global list of emissive triangles.
         assert(bvh.mpLightCollection);
-        const auto& triangles = bvh.mpLightCollection->getMeshLightTriangles();
+        const auto& triangles = getTriangles(bvh);
         if (triangles.empty()) return;
 
         // Compute list of triangles that should be included in BVH.
         // For each triangle, precompute data we need for the build.
+        // The per-triangle data is computed in parallel, culled triangles are then removed in order.
         BuildingData data(bvh.mAlignedAllocator);
-        data.trianglesData.reserve(triangles.size());
+        data.trianglesData.resize(triangles.size());
 
-        for (size_t i = 0; i < triangles.size(); i++)
+        auto prepareTriangle = [&](uint32_t i)
         {
             if (!mOptions.usePreintegration || triangles[i].luminousFlux > 0.f)
             {
-                LightBVHBuilder::TriangleSortData tri;
+                LightBVHBuilder::TriangleSortData& tri = data.trianglesData[i];
                 for (uint32_t j = 0; j < 3; j++)
                 {
                     tri.bounds |= triangles[i].vtx[j].pos;
@@ -242,11 +393,15 @@ namespace Falcor
                 tri.coneDirection = triangles[i].normal;
                 tri.cosConeAngle = 1.f; // Single flat emitter => normal bounding cone angle is zero.
                 tri.flux = triangles[i].luminousFlux;
-                tri.triangleIndex = static_cast<uint32_t>(i);
-
-                data.trianglesData.push_back(tri);
+                tri.triangleIndex = i;
             }
-        }
+        };
+
+        const uint32_t triangleCount = static_cast<uint32_t>(triangles.size());
+        if (mOptions.useParallelBuild) Threading::parallelFor(0u, triangleCount, prepareTriangle, kTrianglePrepareGrainSize);
+        else for (uint32_t i = 0; i < triangleCount; i++) prepareTriangle(i);
+
+        data.trianglesData.erase(std::remove_if(data.trianglesData.begin(), data.trianglesData.end(), [](const TriangleSortData& tri) { return tri.triangleIndex == kInvalidIndex; }), data.trianglesData.end());
 
         // If there are no non-culled triangles, we're done.
         if (data.trianglesData.empty()) return;
@@ -256,9 +411,11 @@ namespace Falcor
         const uint64_t invalidBitmask = std::numeric_limits<uint64_t>::max();
         data.triangleBitmasks.resize(triangles.size(), invalidBitmask);
 
-        // Build the tree.
+        // Build the tree and write its nodes to the BVH.
         SplitHeuristicFunction splitFunc = getSplitFunction(mOptions.splitHeuristicSelection);
-        buildInternal(mOptions, splitFunc, 0ull, 0u, Range(0u, static_cast<uint32_t>(data.trianglesData.size())), data);
+        auto pRoot = buildInternal(mOptions, splitFunc, 0u, Range(0u, static_cast<uint32_t>(data.trianglesData.size())), data);
+        writeNodes(*pRoot, 0ull, 0u, data);
+        pRoot.reset();
 
         const uint32_t bvhByteSize = static_cast<uint32_t>(bvh.mAlignedAllocator.getSize());
         if (bvhByteSize == 0u) return;
@@ -280,12 +437,220 @@ namespace Falcor
         // Computate metadata.
         bvh.computeStats();
         bvh.updateNodeOffsets();
+
+        timer.update();
+        mLastBuildTime = timer.delta() * 1000.0;
+        mLastBuildFromCache = false;
+    }
+
+    bool LightBVHBuilder::buildCached(LightBVH& bvh, const std::string& cacheDirectory)
+    {
+        PROFILE("LightBVHBuilder::buildCached()");
+
+        assert(bvh.mpLightCollection);
+        const uint64_t key = computeCacheKey(bvh);
+        const uint64_t dataVersion = bvh.mpLightCollection->getCPUDataVersion();
+
+        char keyStr[17];
+        std::snprintf(keyStr, sizeof(keyStr), "%016llx", (unsigned long long)key);
+        const std::string filename = cacheDirectory + "/" + keyStr + ".lbvh";
+
+        if (loadFromCache(bvh, filename, key)) return true;
+
+        // Newer light data may have been read back in the meantime, in which case the key doesn't match the BVH.
+        build(bvh);
+        if (bvh.isValid() && bvh.mpLightCollection->getCPUDataVersion() == dataVersion) writeToCache(bvh, filename, key);
+        return false;
+    }
+
+    const std::vector<LightCollection::MeshLightTriangle>& LightBVHBuilder::getTriangles(const LightBVH& bvh) const
+    {
+        return mOptions.useAvailableLightData ? bvh.mpLightCollection->getAvailableMeshLightTriangles() : bvh.mpLightCollection->getMeshLightTriangles();
+    }
+
+    uint64_t LightBVHBuilder::computeCacheKey(const LightBVH& bvh) const
+    {
+        const CacheOptions options(mOptions);
+        uint64_t key = hashData(&options, sizeof(options));
+
+        // Hash the inputs of the build bit-exactly; texture coordinates don't affect the BVH.
+        const auto& triangles = getTriangles(bvh);
+        const uint64_t triangleCount = triangles.size();
+        key = hashData(&triangleCount, sizeof(triangleCount), key);
+        for (const auto& triangle : triangles)
+        {
+            const float data[13] =
+            {
+                triangle.vtx[0].pos.x, triangle.vtx[0].pos.y, triangle.vtx[0].pos.z,
+                triangle.vtx[1].pos.x, triangle.vtx[1].pos.y, triangle.vtx[1].pos.z,
+                triangle.vtx[2].pos.x, triangle.vtx[2].pos.y, triangle.vtx[2].pos.z,
+                triangle.normal.x, triangle.normal.y, triangle.normal.z,
+                triangle.luminousFlux
+            };
+            key = hashData(data, sizeof(data), key);
+        }
+        return key;
+    }
+
+    bool LightBVHBuilder::loadFromCache(LightBVH& bvh, const std::string& filename, uint64_t key)
+    {
+        CpuTimer timer;
+        timer.update();
+
+        size_t fileSize = 0;
+        const void* pFile = mapFile(filename, fileSize);
+        if (!pFile) return false;
+
+        // Validate the header, the file size and the payload before touching the BVH.
+        CacheHeader header;
+        const uint8_t* pBytes = static_cast<const uint8_t*>(pFile);
+        bool valid = fileSize >= sizeof(CacheHeader);
+        if (valid)
+        {
+            std::memcpy(&header, pBytes, sizeof(CacheHeader));
+            const uint64_t triangleCount = bvh.mpLightCollection->getTotalLightCount();
+            valid = header.magic == kCacheMagic && header.version == kCacheVersion && header.headerSize == sizeof(CacheHeader) &&
+                header.key == key && header.options == CacheOptions(mOptions) &&
+                header.maxTriangleCountPerLeaf > 0 && header.nodeByteSize > 0 && header.nodeByteSize <= std::numeric_limits<uint32_t>::max() &&
+                header.bitmaskCount == triangleCount &&
+                fileSize == sizeof(CacheHeader) + header.nodeByteSize + header.bitmaskCount * sizeof(uint64_t);
+        }
+        const uint8_t* pNodes = pBytes + sizeof(CacheHeader);
+        const uint8_t* pBitmasks = pNodes + (valid ? header.nodeByteSize : 0);
+        if (valid)
+        {
+            uint64_t payloadHash = hashData(pNodes, (size_t)header.nodeByteSize);
+            payloadHash = hashData(pBitmasks, (size_t)header.bitmaskCount * sizeof(uint64_t), payloadHash);
+            valid = payloadHash == header.payloadHash;
+        }
+        if (!valid)
+        {
+            unmapFile(pFile, fileSize);
+            logWarning("LightBVHBuilder - Ignoring invalid light BVH cache file '" + filename + "'.");
+            return false;
+        }
+
+        bvh.clear();
+        bvh.mAlignedAllocator.resize((size_t)header.nodeByteSize);
+        std::memcpy(bvh.mAlignedAllocator.getStartPointer(), pNodes, (size_t)header.nodeByteSize);
+        std::vector<uint64_t> triangleBitmasks((size_t)header.bitmaskCount);
+        std::memcpy(triangleBitmasks.data(), pBitmasks, triangleBitmasks.size() * sizeof(uint64_t));
+        unmapFile(pFile, fileSize);
+
+        // Mark the file as recently used, so that trimming the cache removes it last.
+        std::error_code ec;
+        std::filesystem::last_write_time(filename, std::filesystem::file_time_type::clock::now(), ec);
+
+        // The BVH is ready, mark it as valid and upload the data.
+        bvh.mIsValid = true;
+        bvh.mMaxTriangleCountPerLeaf = header.maxTriangleCountPerLeaf;
+        bvh.uploadCPUBuffers(triangleBitmasks);
+        bvh.computeStats();
+        bvh.updateNodeOffsets();
+
+        timer.update();
+        mLastBuildTime = timer.delta() * 1000.0;
+        mLastBuildFromCache = true;
+        return true;
+    }
+
+    std::string LightBVHBuilder::ScalingBenchmarkResult::toString() const
+    {
+        std::string s = "Build scaling for " + std::to_string(triangleCount) + " triangles:\n";
+        for (const auto& e : entries)
+        {
+            char line[128];
+            std::snprintf(line, sizeof(line), "%3u threads: %9.3f ms, speedup %.2fx\n", e.threadCount, e.buildTime, e.speedup);
+            s += line;
+        }
+        return s;
+    }
+
+    LightBVHBuilder::ScalingBenchmarkResult LightBVHBuilder::benchmarkBuildScaling(LightBVH& bvh, uint32_t maxThreadCount, uint32_t iterations)
+    {
+        if (maxThreadCount == 0) maxThreadCount = std::max(Threading::getLogicalThreadCount(), 1u);
+        iterations = std::max(iterations, 1u);
+
+        ScalingBenchmarkResult result;
+        result.triangleCount = (uint32_t)getTriangles(bvh).size();
+
+        const Options options = mOptions;
+        const uint32_t threadCount = Threading::getParallelForThreadCount();
+        mOptions.useParallelBuild = true;
+
+        for (uint32_t t = 1; t <= maxThreadCount; t++)
+        {
+            Threading::setParallelForThreadCount(t);
+            double bestTime = std::numeric_limits<double>::max();
+            for (uint32_t i = 0; i < iterations; i++)
+            {
+                build(bvh);
+                bestTime = std::min(bestTime, mLastBuildTime);
+            }
+
+            ScalingBenchmarkResult::Entry e;
+            e.threadCount = t;
+            e.buildTime = bestTime;
+            e.speedup = result.entries.empty() ? 1.0 : result.entries[0].buildTime / std::max(bestTime, 1e-6);
+            result.entries.push_back(e);
+        }
+
+        Threading::setParallelForThreadCount(threadCount);
+        mOptions = options;
+        return result;
+    }
+
+    void LightBVHBuilder::writeToCache(const LightBVH& bvh, const std::string& filename, uint64_t key) const
+    {
+        const size_t nodeByteSize = bvh.mAlignedAllocator.getSize();
+        const std::vector<uint64_t>& triangleBitmasks = bvh.mTriangleBitmasks;
+
+        CacheHeader header;
+        header.key = key;
+        header.nodeByteSize = nodeByteSize;
+        header.bitmaskCount = triangleBitmasks.size();
+        header.maxTriangleCountPerLeaf = bvh.mMaxTriangleCountPerLeaf;
+        header.options = CacheOptions(mOptions);
+        header.payloadHash = hashData(bvh.mAlignedAllocator.getStartPointer(), nodeByteSize);
+        header.payloadHash = hashData(triangleBitmasks.data(), triangleBitmasks.size() * sizeof(uint64_t), header.payloadHash);
+
+        // Write to a temporary file first, so that a concurrent or interrupted run never sees a partial file.
+        std::error_code ec;
+        std::filesystem::create_directories(std::filesystem::path(filename).parent_path(), ec);
+        const std::string tempFilename = getUniqueTempFilename(filename);
+        {
+            std::ofstream file(tempFilename, std::ios::binary | std::ios::trunc);
+            if (!file)
+            {
+                logWarning("LightBVHBuilder - Can't write light BVH cache file '" + filename + "'.");
+                return;
+            }
+            file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            file.write(static_cast<const char*>(bvh.mAlignedAllocator.getStartPointer()), nodeByteSize);
+            file.write(reinterpret_cast<const char*>(triangleBitmasks.data()), triangleBitmasks.size() * sizeof(uint64_t));
+            if (!file)
+            {
+                file.close();
+                std::filesystem::remove(tempFilename, ec);
+                logWarning("LightBVHBuilder - Can't write light BVH cache file '" + filename + "'.");
+                return;
+            }
+        }
+        std::filesystem::rename(tempFilename, filename, ec);
+        if (ec)
+        {
+            std::filesystem::remove(tempFilename, ec);
+            return;
+        }
+        trimCache(std::filesystem::path(filename).parent_path(), filename);
     }
 
     bool LightBVHBuilder::renderUI(Gui::Widgets& widget)
     {
         // Render the build options.
-        return renderOptions(widget, mOptions);
+        bool optionsChanged = renderOptions(widget, mOptions);
+        widget.text("Last build time: " + std::to_string(mLastBuildTime) + " ms" + (mLastBuildFromCache ? " (loaded from cache)" : ""));
+        return optionsChanged;
     }
 
     bool LightBVHBuilder::renderOptions(Gui::Widgets& widget, Options& options) const
@@ -295,6 +660,9 @@ namespace Falcor
         optionsChanged |= widget.checkbox("Allow refitting", options.allowRefitting);
         optionsChanged |= widget.var("Max triangle count per leaf", options.maxTriangleCountPerLeaf, 1u);
         optionsChanged |= widget.dropdown("Split heuristic", kSplitHeuristicList, (uint32_t&)options.splitHeuristicSelection);
+        optionsChanged |= widget.checkbox("Parallel build", options.useParallelBuild);
+        optionsChanged |= widget.checkbox("Use available light data", options.useAvailableLightData);
+        widget.tooltip("Build from the most recent light data read back from the GPU, instead of waiting for the current data.", true);
 
         Gui::Group splitGroup(widget, "Split Options", true);
         if (splitGroup.open())
@@ -330,24 +698,26 @@ namespace Falcor
     {
     }
 
-    void* LightBVHBuilder::buildInternal(const Options& options, const SplitHeuristicFunction& splitHeuristic, uint64_t bitmask, uint32_t depth, const Range& triangleRange, BuildingData& data)
+    std::unique_ptr<LightBVHBuilder::BuildNode> LightBVHBuilder::buildInternal(const Options& options, const SplitHeuristicFunction& splitHeuristic, uint32_t depth, const Range& triangleRange, BuildingData& data)
     {
         assert(triangleRange.begin < triangleRange.end);
 
+        auto pNode = std::make_unique<BuildNode>();
+
         // Compute the AABB and total flux of the node.
         float nodeFlux = 0.f;
-        BBox nodeBounds;
+        BBox nodeBounds = unionBoxes(&data.trianglesData[triangleRange.begin].bounds, triangleRange.length(), sizeof(TriangleSortData));
         for (uint32_t dataIndex = triangleRange.begin; dataIndex < triangleRange.end; ++dataIndex)
         {
-            nodeBounds |= data.trianglesData[dataIndex].bounds;
             nodeFlux += data.trianglesData[dataIndex].flux;
         }
         assert(nodeBounds.valid());
 
-        data.currentNodeFlux = nodeFlux;
+        pNode->bounds = nodeBounds;
+        pNode->flux = nodeFlux;
 
         const bool trySplitting = triangleRange.length() > (options.createLeavesASAP ? options.maxTriangleCountPerLeaf : 1u);
-        const SplitResult splitResult = trySplitting ? splitHeuristic(data, triangleRange, nodeBounds, options) : SplitResult();
+        const SplitResult splitResult = trySplitting ? splitHeuristic(data, triangleRange, nodeBounds, nodeFlux, options) : SplitResult();
 
         // If we should split, then create an internal node and split.
         if (splitResult.isValid())
@@ -358,11 +728,6 @@ namespace Falcor
             auto comp = [dim = splitResult.axis](const TriangleSortData& d1, const TriangleSortData& d2) { return d1.bounds.centroid()[dim] < d2.bounds.centroid()[dim]; };
             std::nth_element(std::begin(data.trianglesData) + triangleRange.begin, std::begin(data.trianglesData) + splitResult.triangleIndex, std::begin(data.trianglesData) + triangleRange.end, comp);
 
-            LightBVH::InternalNode* pNode = data.alignedAllocator.allocate<LightBVH::InternalNode>();
-            pNode->aabbMin = nodeBounds.minPoint;
-            pNode->aabbMax = nodeBounds.maxPoint;
-            pNode->luminousFlux = nodeFlux;
-
             if (depth >= kMaxBVHDepth)
             {
                 // This is an unrecoverable error since we use bit masks to represent the traversal path from
@@ -370,9 +735,44 @@ namespace Falcor
                 logFatal("BVH depth of " + std::to_string(depth + 1u) + " reached; maximum of " + std::to_string(kMaxBVHDepth) + " allowed.");
             }
 
-            uint32_t currentByteOffset = static_cast<uint32_t>(data.alignedAllocator.offsetOf(pNode));
-            void* pLeft = buildInternal(options, splitHeuristic, bitmask | (0ull << depth), depth + 1u, Range(triangleRange.begin, splitResult.triangleIndex), data);
-            void* pRight = buildInternal(options, splitHeuristic, bitmask | (1ull << depth), depth + 1u, Range(splitResult.triangleIndex, triangleRange.end), data);
+            // The children work on disjoint ranges of the triangle data, so they can be built concurrently.
+            const Range childRanges[2] = { Range(triangleRange.begin, splitResult.triangleIndex), Range(splitResult.triangleIndex, triangleRange.end) };
+            std::unique_ptr<BuildNode> pChildren[2];
+            auto buildChild = [&](uint32_t i) { pChildren[i] = buildInternal(options, splitHeuristic, depth + 1u, childRanges[i], data); };
+
+            if (options.useParallelBuild && triangleRange.length() >= kParallelBuildCutoff) Threading::parallelFor(0u, 2u, buildChild);
+            else for (uint32_t i = 0; i < 2; i++) buildChild(i);
+
+            pNode->pLeft = std::move(pChildren[0]);
+            pNode->pRight = std::move(pChildren[1]);
+        }
+        else // No split => create leaf node
+        {
+            if (triangleRange.length() > options.maxTriangleCountPerLeaf)
+            {
+                logFatal("Trying to create a leaf node with more triangles than allowed!");
+            }
+
+            pNode->triangleRange = triangleRange;
+
+            // Compute the lighting normal bounding cone.
+            pNode->coneDirection = computeLightingCone(triangleRange, data, pNode->cosConeAngle);
+        }
+
+        return pNode;
+    }
+
+    void* LightBVHBuilder::writeNodes(const BuildNode& node, uint64_t bitmask, uint32_t depth, BuildingData& data)
+    {
+        if (!node.isLeaf())
+        {
+            LightBVH::InternalNode* pNode = data.alignedAllocator.allocate<LightBVH::InternalNode>();
+            pNode->aabbMin = node.bounds.minPoint;
+            pNode->aabbMax = node.bounds.maxPoint;
+            pNode->luminousFlux = node.flux;
+
+            void* pLeft = writeNodes(*node.pLeft, bitmask | (0ull << depth), depth + 1u, data);
+            void* pRight = writeNodes(*node.pRight, bitmask | (1ull << depth), depth + 1u, data);
 
             if (data.alignedAllocator.offsetOf(pLeft) > std::numeric_limits<uint32_t>::max() ||
                 data.alignedAllocator.offsetOf(pRight) > std::numeric_limits<uint32_t>::max())
@@ -385,19 +785,15 @@ namespace Falcor
 
             return pNode;
         }
-        else // No split => create leaf node
+        else
         {
-            if (triangleRange.length() > options.maxTriangleCountPerLeaf)
-            {
-                logFatal("Trying to create a leaf node with more triangles than allowed!");
-            }
-
+            const Range& triangleRange = node.triangleRange;
             size_t allocSize = sizeof(LightBVH::LeafNode) + (triangleRange.length() - 1) * sizeof(uint32_t);
             LightBVH::LeafNode* pNode = data.alignedAllocator.allocateSized<LightBVH::LeafNode>(allocSize);
-            pNode->aabbMin = nodeBounds.minPoint;
+            pNode->aabbMin = node.bounds.minPoint;
             pNode->triangleCount = triangleRange.length();
-            pNode->aabbMax = nodeBounds.maxPoint;
-            pNode->luminousFlux = nodeFlux;
+            pNode->aabbMax = node.bounds.maxPoint;
+            pNode->luminousFlux = node.flux;
 
             for (uint32_t triangleIdx = triangleRange.begin, index = 0u; triangleIdx < triangleRange.end; ++triangleIdx, ++index)
             {
@@ -406,10 +802,8 @@ namespace Falcor
                 data.triangleBitmasks[globalTriangleIndex] = bitmask;
             }
 
-            // Compute the lighting normal bounding cone.
-            float cosTheta;
-            pNode->coneDirection = computeLightingCone(triangleRange, data, cosTheta);
-            pNode->cosConeAngle = cosTheta;
+            pNode->coneDirection = node.coneDirection;
+            pNode->cosConeAngle = node.cosConeAngle;
 
             return pNode;
         }
@@ -472,7 +866,7 @@ namespace Falcor
         return coneDirection;
     }
 
-    LightBVHBuilder::SplitResult LightBVHBuilder::computeSplitWithEqual(const BuildingData& /*data*/, const Range& triangleRange, const BBox& nodeBounds, const Options& /*parameters*/)
+    LightBVHBuilder::SplitResult LightBVHBuilder::computeSplitWithEqual(const BuildingData& /*data*/, const Range& triangleRange, const BBox& nodeBounds, float /*nodeFlux*/, const Options& /*parameters*/)
     {
         // Find the largest dimension.
         const float3 dimensions = nodeBounds.dimensions();
@@ -487,6 +881,32 @@ namespace Falcor
         return result;
     }
 
+    /** Returns the candidate split with the lower cost, or the current best if the candidate is invalid or not cheaper.
+        Candidates are pairs of cost and split result.
+    */
+    template<typename SplitCandidate>
+    static SplitCandidate selectBestSplit(const SplitCandidate& best, const SplitCandidate& candidate)
+    {
+        return candidate.second.isValid() && candidate.first < best.first ? candidate : best;
+    }
+
+    /** Bins along all three dimensions and returns the best candidate split.
+        Large nodes bin the dimensions in parallel. The candidates are compared in the same order as in a serial build, so the result is identical.
+    */
+    template<typename BinFunc>
+    static auto binAllDimensions(const BinFunc& binAlongDimension, uint32_t triangleCount, const LightBVHBuilder::Options& parameters)
+    {
+        using SplitCandidate = decltype(binAlongDimension(0u));
+        SplitCandidate candidates[3];
+        auto bin = [&](uint32_t dimension) { candidates[dimension] = binAlongDimension(dimension); };
+        if (parameters.useParallelBuild && triangleCount >= kParallelBinningCutoff) Threading::parallelFor(0u, 3u, bin);
+        else for (uint32_t dimension = 0u; dimension < 3u; ++dimension) bin(dimension);
+
+        SplitCandidate best = std::make_pair(std::numeric_limits<float>::infinity(), typename SplitCandidate::second_type());
+        for (const auto& candidate : candidates) best = selectBestSplit(best, candidate);
+        return best;
+    }
+
     /** Evaluates the SAH cost metric for a node.
         If the node is empty (invalid bounds), the cost evaluates to zero.
         See Eqn 15 in Moreau and Clarberg, "Importance Sampling of Many Lights on the GPU", Ray Tracing Gems, Ch. 18, 2019.
@@ -499,7 +919,7 @@ namespace Falcor
         return cost;
     }
 
-    LightBVHBuilder::SplitResult LightBVHBuilder::computeSplitWithBinnedSAH(const BuildingData& data, const Range& triangleRange, const BBox& nodeBounds, const Options& parameters)
+    LightBVHBuilder::SplitResult LightBVHBuilder::computeSplitWithBinnedSAH(const BuildingData& data, const Range& triangleRange, const BBox& nodeBounds, float nodeFlux, const Options& parameters)
     {
         std::pair<float, SplitResult> overallBestSplit = std::make_pair(std::numeric_limits<float>::infinity(), SplitResult());
         assert(!overallBestSplit.second.isValid());
@@ -520,15 +940,17 @@ namespace Falcor
         };
 
         assert(parameters.binCount > 1);
-        std::vector<Bin> bins(parameters.binCount);
-        std::vector<float> costs(parameters.binCount - 1u);
 
         /** Helper function that computes the best split along the given dimension using the SAH metric.
             The triangles are binned to n bins, storing only the aggregate parameters (triangle count and bounds).
             Then the cost metric is evaluated for each of the n-1 potential splits.
+            Returns an invalid split if all lights fall on either side of the best split.
         */
-        const auto binAlongDimension = [&bins, &costs, &triangleRange, &data, &parameters, &overallBestSplit, &nodeBounds](uint32_t dimension)
+        const auto binAlongDimension = [&triangleRange, &data, &parameters, &nodeBounds](uint32_t dimension)
         {
+            std::vector<Bin> bins(parameters.binCount);
+            std::vector<float> costs(parameters.binCount - 1u);
+
             // Helper to compute the bin id for a given triangle.
             auto getBinId = [&](const TriangleSortData& td)
             {
@@ -540,9 +962,6 @@ namespace Falcor
                 return std::min((uint32_t)((p - bmin) * scale), parameters.binCount - 1);
             };
 
-            // Reset the bins.
-            for (Bin& bin : bins) bin = Bin();
-
             // Fill the bins with all triangles.
             for (uint32_t i = triangleRange.begin; i < triangleRange.end; ++i)
             {
@@ -581,13 +1000,9 @@ namespace Falcor
 
             // Early out if all lights fall on either side of the split.
             if (axisBestSplit.second.triangleIndex == triangleRange.begin ||
-                axisBestSplit.second.triangleIndex == triangleRange.end) return;
+                axisBestSplit.second.triangleIndex == triangleRange.end) return std::make_pair(axisBestSplit.first, SplitResult());
 
-            if (axisBestSplit.first < overallBestSplit.first)
-            {
-                overallBestSplit = axisBestSplit;
-                assert(triangleRange.begin < overallBestSplit.second.triangleIndex && overallBestSplit.second.triangleIndex < triangleRange.end);
-            }
+            return axisBestSplit;
         };
 
         if (parameters.splitAlongLargest)
@@ -597,14 +1012,11 @@ namespace Falcor
             const uint32_t largestDimension = dimensions[2u] >= dimensions[0u] && dimensions[2u] >= dimensions[1u] ?
                 2u : (dimensions[1u] >= dimensions[0u] && dimensions[1u] >= dimensions[2u] ? 1u : 0u);
 
-            binAlongDimension(largestDimension);
+            overallBestSplit = selectBestSplit(overallBestSplit, binAlongDimension(largestDimension));
         }
         else
         {
-            for (uint32_t dimension = 0u; dimension < 3u; ++dimension)
-            {
-                binAlongDimension(dimension);
-            }
+            overallBestSplit = binAllDimensions(binAlongDimension, triangleRange.length(), parameters);
         }
 
         // If we couldn't find a valid split, create leaf node immediately if possible or revert to equal splitting.
@@ -612,7 +1024,7 @@ namespace Falcor
         {
             if (triangleRange.length() <= parameters.maxTriangleCountPerLeaf) return SplitResult();
             logWarning("LightBVHBuilder::computeSplitWithBinnedSAH() was not able to compute a proper split: reverting to LightBVHBuilder::computeSplitWithEqual()");
-            return computeSplitWithEqual(data, triangleRange, nodeBounds, parameters);
+            return computeSplitWithEqual(data, triangleRange, nodeBounds, nodeFlux, parameters);
         }
 
         // If the best split we found is more expensive than the cost of a leaf node (and we can create one), then create a leaf node.
@@ -654,7 +1066,7 @@ namespace Falcor
         return cost;
     }
 
-    LightBVHBuilder::SplitResult LightBVHBuilder::computeSplitWithBinnedSAOH(const BuildingData& data, const Range& triangleRange, const BBox& nodeBounds, const Options& parameters)
+    LightBVHBuilder::SplitResult LightBVHBuilder::computeSplitWithBinnedSAOH(const BuildingData& data, const Range& triangleRange, const BBox& nodeBounds, float nodeFlux, const Options& parameters)
     {
         std::pair<float, SplitResult> overallBestSplit = std::make_pair(std::numeric_limits<float>::infinity(), SplitResult());
         assert(!overallBestSplit.second.isValid());
@@ -686,8 +1098,6 @@ namespace Falcor
         };
 
         assert(parameters.binCount > 1);
-        std::vector<Bin> bins(parameters.binCount);
-        std::vector<float> costs(parameters.binCount - 1u);
 
         /** Helper function that computes the best split along the given dimension using the SAOH metric.
             The triangles are binned to n bins, storing only the aggregate parameters (triangle count, bounds, flux, and cone direction).
@@ -695,9 +1105,13 @@ namespace Falcor
             Note that while the bounds and flux are accurately represented by the aggregated parameters,
             the bounding cones are approximates based on the bins' bounding cones. This is less expensive,
             but also less precise than computing them directly from the triangles.
+            Returns an invalid split if all lights fall on either side of the best split.
         */
-        const auto binAlongDimension = [&bins, &costs, &triangleRange, &data, &parameters, &overallBestSplit, &nodeBounds, largestDimension, dimensions](uint32_t dimension)
+        const auto binAlongDimension = [&triangleRange, &data, &parameters, &nodeBounds, largestDimension, dimensions](uint32_t dimension)
         {
+            std::vector<Bin> bins(parameters.binCount);
+            std::vector<float> costs(parameters.binCount - 1u);
+
             // Helper to compute the bin id for a given triangle.
             auto getBinId = [&](const TriangleSortData& td)
             {
@@ -710,9 +1124,6 @@ namespace Falcor
                 return std::min((uint32_t)((p - bmin) * scale), parameters.binCount - 1);
             };
 
-            // Reset the bins.
-            for (Bin& bin : bins) bin = Bin();
-
             // Fill the bins with all triangles.
             for (uint32_t i = triangleRange.begin; i < triangleRange.end; ++i)
             {
@@ -796,26 +1207,19 @@ namespace Falcor
 
             // Early out if all lights fall on either side of the split.
             if (axisBestSplit.second.triangleIndex == triangleRange.begin ||
-                axisBestSplit.second.triangleIndex == triangleRange.end) return;
+                axisBestSplit.second.triangleIndex == triangleRange.end) return std::make_pair(axisBestSplit.first, SplitResult());
 
-            if (axisBestSplit.first < overallBestSplit.first)
-            {
-                overallBestSplit = axisBestSplit;
-                assert(triangleRange.begin < overallBestSplit.second.triangleIndex && overallBestSplit.second.triangleIndex < triangleRange.end);
-            }
+            return axisBestSplit;
         };
 
         // Compute the best split.
         if (parameters.splitAlongLargest)
         {
-            binAlongDimension(largestDimension);
+            overallBestSplit = selectBestSplit(overallBestSplit, binAlongDimension(largestDimension));
         }
         else
         {
-            for (uint32_t dimension = 0u; dimension < 3u; ++dimension)
-            {
-                binAlongDimension(dimension);
-            }
+            overallBestSplit = binAllDimensions(binAlongDimension, triangleRange.length(), parameters);
         }
 
         // If we couldn't find a valid split, create leaf node immediately if possible or revert to equal splitting.
@@ -823,7 +1227,7 @@ namespace Falcor
         {
             if (triangleRange.length() <= parameters.maxTriangleCountPerLeaf) return SplitResult();
             logWarning("LightBVHBuilder::computeSplitWithBinnedSAOH() was not able to compute a proper split: reverting to LightBVHBuilder::computeSplitWithEqual()");
-            return computeSplitWithEqual(data, triangleRange, nodeBounds, parameters);
+            return computeSplitWithEqual(data, triangleRange, nodeBounds, nodeFlux, parameters);
         }
 
         // If the best split we found is more expensive than the cost of a leaf node (and we can create one), then create a leaf node.
@@ -833,7 +1237,7 @@ namespace Falcor
             // Evaluate the cost metric for the node. This requires us to first compute the cone angle.
             float cosTheta = kInvalidCosConeAngle;
             computeLightingCone(triangleRange, data, cosTheta);
-            float leafCost = evalSAOH(nodeBounds, data.currentNodeFlux, cosTheta, parameters);
+            float leafCost = evalSAOH(nodeBounds, nodeFlux, cosTheta, parameters);
             if (leafCost <= overallBestSplit.first) return SplitResult();
         }
 
@@ -877,6 +1281,8 @@ namespace Falcor
         options.field(allowRefitting);
         options.field(usePreintegration);
         options.field(useLightingCones);
+        options.field(useParallelBuild);
+        options.field(useAvailableLightData);
 #undef field
     }
 }
@@ -34,6 +34,7 @@
 #include "Utils/UI/Gui.h"
 
 #include <limits>
+#include <memory>
 #include <vector>
 
 namespace Falcor
@@ -74,6 +75,8 @@ namespace Falcor
             bool           allowRefitting = true;                                ///< Rather than always rebuilding the BVH from scratch, keep the hierarchy but update the bounds and lighting cones.
             bool           usePreintegration = true;                             ///< Use pre-integration for culling out emissive triangles and use their flux when computing the splits. Only valid when using the BinnedSAOH split heuristic.
             bool           useLightingCones = true;                              ///< Use lighting cones when computing the splits. Only valid when using the BinnedSAOH split heuristic.
+            bool           useParallelBuild = true;                              ///< Build large subtrees and bin large nodes on multiple threads. The resulting BVH is identical to the serial build.
+            bool           useAvailableLightData = true;                         ///< Build from the most recent light data read back from the GPU, instead of waiting for the current data. The BVH may then lag behind animated lights by a few frames.
         };
 
         /** Creates a new object.
@@ -86,10 +89,51 @@ namespace Falcor
         */
         void build(LightBVH& bvh);
 
+        /** Build the BVH, or load it from the cache if it was built before with the same lights and options.
+            Cache files are named after a hash of the emissive triangle data and the options that affect the hierarchy,
+            and are validated when loaded. After a build, the BVH is written to the cache,
+            and the least recently used files are removed if the cache directory grows beyond a fixed size.
+            \param[in,out] bvh The light BVH to build.
+            \param[in] cacheDirectory Directory holding the cache files. It is created if needed.
+            \return True if the BVH was loaded from the cache, false if it was built.
+        */
+        bool buildCached(LightBVH& bvh, const std::string& cacheDirectory);
+
         virtual bool renderUI(Gui::Widgets& widget);
 
         const Options& getOptions() const { return mOptions; }
 
+        /** Get the duration of the last call to build() in milliseconds.
+        */
+        double getLastBuildTime() const { return mLastBuildTime; }
+
+        /** Result of benchmarkBuildScaling().
+        */
+        struct ScalingBenchmarkResult
+        {
+            struct Entry
+            {
+                uint32_t threadCount = 0;   ///< Number of threads the build was limited to.
+                double buildTime = 0.0;     ///< Fastest build time in milliseconds.
+                double speedup = 0.0;       ///< Build time with one thread divided by buildTime.
+            };
+
+            uint32_t triangleCount = 0;     ///< Number of emissive triangles in the light collection.
+            std::vector<Entry> entries;     ///< One entry per thread count, in increasing order.
+
+            std::string toString() const;
+        };
+
+        /** Measure how the parallel build scales with the number of threads.
+            The BVH is built with the parallel build enabled while Threading::parallelFor() is limited to 1, 2, ..., maxThreadCount threads.
+            The fastest of the iterations is kept for each thread count. The BVH holds the result of the last build on return.
+            \param[in,out] bvh The light BVH to build.
+            \param[in] maxThreadCount Largest thread count to measure, or 0 to use the number of logical cores.
+            \param[in] iterations Number of builds per thread count.
+            \return The build time and speedup for each thread count.
+        */
+        ScalingBenchmarkResult benchmarkBuildScaling(LightBVH& bvh, uint32_t maxThreadCount = 0, uint32_t iterations = 3);
+
     protected:
         struct Range
         {
@@ -128,18 +172,35 @@ namespace Falcor
             AlignedAllocator& alignedAllocator;                                 ///< Allocator used for allocating the BVH nodes.
             std::vector<TriangleSortData> trianglesData;                        ///< Compact list of triangles to include in build.
             std::vector<uint64_t> triangleBitmasks;                             ///< Array containing the per triangle bit pattern retracing the tree traversal to reach the triangle: 0=left child, 1=right child; this array gets filled in during the build process. Indexed by global triangle index.
-            float currentNodeFlux = 0.f;                                        ///< Used by computeSAOHSplit() as the leaf creation cost.
 
             BuildingData(AlignedAllocator& _allocator) : alignedAllocator(_allocator) {}
         };
 
+        /** Node of the temporary tree created by buildInternal().
+            Subtrees are built concurrently, so the nodes are only written to the BVH's allocator afterwards by writeNodes(),
+            in the same depth-first order as a serial build.
+        */
+        struct BuildNode
+        {
+            BBox bounds;
+            float flux = 0.f;
+            std::unique_ptr<BuildNode> pLeft;                                   ///< Left child, nullptr for leaf nodes.
+            std::unique_ptr<BuildNode> pRight;                                  ///< Right child, nullptr for leaf nodes.
+            Range triangleRange = Range(0u, 0u);                                ///< Triangles of a leaf node.
+            float3 coneDirection = {};                                          ///< Lighting cone of a leaf node.
+            float cosConeAngle = kInvalidCosConeAngle;
+
+            bool isLeaf() const { return pLeft == nullptr; }
+        };
+
         /** Compute the split according to a specified heuristic.
             \param[in] data Prepared light data.
             \param[in] triangleRange Range of triangles to process.
             \param[in] nodeBounds Bounds for the node to be splitted.
+            \param[in] nodeFlux Total flux of the node to be splitted.
             \param[in] parameters Various parameters defining how the building should occur.
         */
-        using SplitHeuristicFunction = std::function<SplitResult(const BuildingData& data, const Range& triangleRange, const BBox& nodeBounds, const Options& parameters)>;
+        using SplitHeuristicFunction = std::function<SplitResult(const BuildingData& data, const Range& triangleRange, const BBox& nodeBounds, float nodeFlux, const Options& parameters)>;
 
         LightBVHBuilder(const Options& options);
 
@@ -147,15 +208,23 @@ namespace Falcor
         */
         bool renderOptions(Gui::Widgets& widget, Options& options) const;
 
-        /** Recursive BVH build.
+        /** Recursive BVH build. Children of large nodes are built in parallel when enabled in the options.
             \param[in] splitHeuristic The splitting heuristic to be used.
-            \param[in] bitmask Bit pattern retracing the tree traversal to reach the node to be built: 0=left child, 1=right child.
             \param[in] depth Depth of the node to be built
             \param[in] triangleRange Range of triangles to process.
-            \param[in,out] data Prepared light data.
+            \param[in,out] data Prepared light data. Only the given range of triangles is reordered.
+            \return The node.
+        */
+        static std::unique_ptr<BuildNode> buildInternal(const Options& options, const SplitHeuristicFunction& splitHeuristic, uint32_t depth, const Range& triangleRange, BuildingData& data);
+
+        /** Recursively write the nodes built by buildInternal() to the BVH in depth-first order.
+            \param[in] node The node to write.
+            \param[in] bitmask Bit pattern retracing the tree traversal to reach the node: 0=left child, 1=right child.
+            \param[in] depth Depth of the node.
+            \param[in,out] data Prepared light data. The triangle bitmasks are filled in.
             \return pointer to the allocated node.
         */
-        static void* buildInternal(const Options& options, const SplitHeuristicFunction& splitHeuristic, uint64_t bitmask, uint32_t depth, const Range& triangleRange, BuildingData& data);
+        static void* writeNodes(const BuildNode& node, uint64_t bitmask, uint32_t depth, BuildingData& data);
 
         /** Recursive computation of lighting cones for all internal nodes.
             \param[in] nodesCurrentByteOffset Current offset to the start of the next free node (= size of current node data).
@@ -173,14 +242,35 @@ namespace Falcor
         static float3 computeLightingCone(const Range& triangleRange, const BuildingData& data, float& cosTheta);
 
         // See the documentation of SplitHeuristicFunction.
-        static SplitResult computeSplitWithEqual(const BuildingData& /*data*/, const Range& triangleRange, const BBox& nodeBounds, const Options& /*parameters*/);
-        static SplitResult computeSplitWithBinnedSAH(const BuildingData& data, const Range& triangleRange, const BBox& nodeBounds, const Options& parameters);
-        static SplitResult computeSplitWithBinnedSAOH(const BuildingData& data, const Range& triangleRange, const BBox& nodeBounds, const Options& parameters);
+        static SplitResult computeSplitWithEqual(const BuildingData& /*data*/, const Range& triangleRange, const BBox& nodeBounds, float /*nodeFlux*/, const Options& /*parameters*/);
+        static SplitResult computeSplitWithBinnedSAH(const BuildingData& data, const Range& triangleRange, const BBox& nodeBounds, float /*nodeFlux*/, const Options& parameters);
+        static SplitResult computeSplitWithBinnedSAOH(const BuildingData& data, const Range& triangleRange, const BBox& nodeBounds, float nodeFlux, const Options& parameters);
 
         static SplitHeuristicFunction getSplitFunction(SplitHeuristic heuristic);
 
+        /** Compute the cache key from the current emissive triangles of the BVH's light collection and the options.
+        */
+        uint64_t computeCacheKey(const LightBVH& bvh) const;
+
+        /** Returns the emissive triangles to build from, see Options::useAvailableLightData.
+        */
+        const std::vector<LightCollection::MeshLightTriangle>& getTriangles(const LightBVH& bvh) const;
+
+        /** Load the BVH from a cache file.
+            \return True if the file exists and matches the key and options, false otherwise. The BVH is left untouched on failure.
+        */
+        bool loadFromCache(LightBVH& bvh, const std::string& filename, uint64_t key);
+
+        /** Write the BVH to a cache file.
+        */
+        void writeToCache(const LightBVH& bvh, const std::string& filename, uint64_t key) const;
+
         // Configuration
         Options mOptions;
+
+        // Statistics
+        double mLastBuildTime = 0.0;        ///< Duration of the last build in milliseconds.
+        bool mLastBuildFromCache = false;   ///< True if the last build was loaded from the cache.
     };
 
 #define str(a) case LightBVHBuilder::SplitHeuristic::a: return #a
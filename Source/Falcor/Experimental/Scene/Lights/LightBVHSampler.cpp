@@ -27,6 +27,7 @@
  **************************************************************************/
 #include "stdafx.h"
 #include "LightBVHSampler.h"
+#include "LightBVHSamplerCPU.h"
 #include <glm/gtc/constants.hpp>
 #include <glm/gtx/io.hpp>
 #include <algorithm>
@@ -42,6 +43,9 @@ namespace Falcor
             { (uint32_t)SolidAngleBoundMethod::BoxToAverage, "Cone around average dir." },
             { (uint32_t)SolidAngleBoundMethod::BoxToCenter, "Cone around vec. to center" },
         };
+
+        // Cache directory for built BVHs, relative to the application data directory.
+        const char kBuildCacheDirectory[] = "/NVIDIA/Falcor/LightBVHCache";
     }
 
     LightBVHSampler::SharedPtr LightBVHSampler::create(RenderContext* pRenderContext, Scene::SharedPtr pScene, const Options& options)
@@ -63,19 +67,42 @@ namespace Falcor
             else mNeedsRebuild = true;
         }
 
+        // When building from the available light data, keep a readback of the current data in flight instead of waiting for it.
+        // Once it has arrived, rebuild if the BVH was built from older data, e.g. after the lights stopped moving.
+        const auto& pLights = mpBVH->getLightCollection();
+        if (mOptions.buildOptions.useAvailableLightData && !needsRefit)
+        {
+            auto data = pLights->requestCPUData(pRenderContext);
+            if (!mNeedsRebuild && mBuiltDataVersion < data.getVersion() && data.isReady()) mNeedsRebuild = true;
+        }
+
         // Rebuild BVH if it's marked as dirty.
         if (mNeedsRebuild)
         {
-            mpBVHBuilder->build(*mpBVH);
+            if (mOptions.useBuildCache) mpBVHBuilder->buildCached(*mpBVH, getAppDataDirectory() + kBuildCacheDirectory);
+            else mpBVHBuilder->build(*mpBVH);
+            mBuiltDataVersion = pLights->getCPUDataVersion();
             mNeedsRebuild = false;
             samplerChanged = true;
         }
         else if (needsRefit)
         {
-            mpBVH->refit(pRenderContext);
+            // The GPU refit updates all nodes from the current data. The CPU refit only updates the nodes of the lights updated this frame,
+            // so the BVH matches the current data only if it matched the data before this frame's update.
+            if (mOptions.useCPURefit)
+            {
+                mpBVH->refitCPU(pLights->getUpdatedLights());
+                if (mBuiltDataVersion == mLastDataVersion) mBuiltDataVersion = pLights->getDataVersion();
+            }
+            else
+            {
+                mpBVH->refit(pRenderContext);
+                mBuiltDataVersion = pLights->getDataVersion();
+            }
             samplerChanged = true;
         }
 
+        mLastDataVersion = pLights->getDataVersion();
         return samplerChanged;
     }
 
@@ -124,6 +151,18 @@ namespace Falcor
                 mOptions.buildOptions = mpBVHBuilder->getOptions();
                 mNeedsRebuild = optionsChanged = true;
             }
+            buildGroup.checkbox("Use build cache", mOptions.useBuildCache);
+            buildGroup.tooltip("Load the BVH from the on-disk cache if it was built before for the same lights and build options.", true);
+            buildGroup.checkbox("Refit on CPU", mOptions.useCPURefit);
+            buildGroup.tooltip("Refit only the nodes affected by updated lights on the CPU, instead of all nodes on the GPU.", true);
+
+            // Rebuild with 1..N threads to see how well the parallel build scales on this machine.
+            if (buildGroup.button("Benchmark build scaling"))
+            {
+                mBuildScalingReport = mpBVHBuilder->benchmarkBuildScaling(*mpBVH).toString();
+                mNeedsRebuild = true;
+            }
+            if (!mBuildScalingReport.empty()) buildGroup.text(mBuildScalingReport);
 
             buildGroup.release();
         }
@@ -151,6 +190,15 @@ namespace Falcor
         if (statGroup.open())
         {
             mpBVH->renderUI(statGroup);
+
+            // Measure sampling quality with the current options on the CPU, e.g. to compare build options.
+            if (statGroup.button("Evaluate sampling on CPU") && mpBVH->isValid())
+            {
+                auto pCPUSampler = LightBVHSamplerCPU::create(mpBVH, mpBVH->getLightCollection(), mOptions);
+                if (pCPUSampler) mEvaluationReport = pCPUSampler->evaluate().toString();
+            }
+            if (!mEvaluationReport.empty()) statGroup.text(mEvaluationReport);
+
             statGroup.release();
         }
 
@@ -185,6 +233,8 @@ namespace Falcor
         auto options = m.class_<LightBVHSampler::Options>("LightBVHSamplerOptions");
 #define field(f_) rwField(#f_, &LightBVHSampler::Options::f_)
         options.field(buildOptions);
+        options.field(useCPURefit);
+        options.field(useBuildCache);
         options.field(useBoundingCone);
         options.field(useLightingCone);
         options.field(disableNodeFlux);
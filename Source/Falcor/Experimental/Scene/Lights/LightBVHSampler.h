@@ -59,6 +59,8 @@ namespace Falcor
         {
             // Build options
             LightBVHBuilder::Options buildOptions;
+            bool        useCPURefit = false;                ///< Refit only the nodes affected by updated lights on the CPU, instead of all nodes on the GPU.
+            bool        useBuildCache = true;               ///< Load the BVH from the on-disk cache if it was built before for the same lights and build options.
 
             // Traversal options
             bool        useBoundingCone = true;             ///< Use bounding cone to BVH nodes to bound NdotL when computing probabilities.
@@ -122,5 +124,9 @@ namespace Falcor
         LightBVHBuilder::SharedPtr      mpBVHBuilder;           ///< The light BVH builder.
         LightBVH::SharedPtr             mpBVH;                  ///< The light BVH.
         bool                            mNeedsRebuild = true;   ///< Trigger rebuild on the next call to update(). We should always build on the first call, so the initial value is true.
+        uint64_t                        mBuiltDataVersion = 0;  ///< Version of the light data the BVH was last built from, see LightCollection::getDataVersion().
+        uint64_t                        mLastDataVersion = 0;   ///< Version of the light data at the end of the previous call to update().
+        std::string                     mEvaluationReport;      ///< Result of the last CPU sampling evaluation, shown in the UI.
+        std::string                     mBuildScalingReport;    ///< Result of the last build scaling benchmark, shown in the UI.
     };
 }
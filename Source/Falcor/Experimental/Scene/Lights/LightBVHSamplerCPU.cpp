@@ -0,0 +1,424 @@
+/***************************************************************************
+ # Copyright (c) 2020, NVIDIA CORPORATION. All rights reserved.
+ #
+ # Redistribution and use in source and binary forms, with or without
+ # modification, are permitted provided that the following conditions
+ # are met:
+ #  * Redistributions of source code must retain the above copyright
+ #    notice, this list of conditions and the following disclaimer.
+ #  * Redistributions in binary form must reproduce the above copyright
+ #    notice, this list of conditions and the following disclaimer in the
+ #    documentation and/or other materials provided with the distribution.
+ #  * Neither the name of NVIDIA CORPORATION nor the names of its
+ #    contributors may be used to endorse or promote products derived
+ #    from this software without specific prior written permission.
+ #
+ # THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ # EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ # IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ # PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ # CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ # EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ # PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ # PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ # OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ # (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ # OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **************************************************************************/
+#include "stdafx.h"
+#include "LightBVHSamplerCPU.h"
+#include "LightBVHSamplerHelpers.h"
+
+#include <cmath>
+#include <iomanip>
+#include <random>
+#include <sstream>
+
+namespace
+{
+    using namespace Falcor;
+
+    const uint64_t kInvalidBitmask = std::numeric_limits<uint64_t>::max();
+
+    // Triangle importances of leaves up to this size are kept on the stack, larger leaves recompute them.
+    const uint32_t kMaxCachedTriangleImportances = 64;
+
+    // Number of samples per shading point that are checked against evalPdf() during the evaluation.
+    const uint32_t kPdfChecksPerPoint = 64;
+
+    float luminance(const float3& rgb)
+    {
+        return glm::dot(rgb, float3(0.2126f, 0.7152f, 0.0722f));
+    }
+
+    /** Computes the projected solid angle of an emissive triangle as seen from a shading point.
+        Only the front face of the triangle emits, and only the part above the tangent plane of the shading point contributes.
+        The result times the emitted radiance is the irradiance at the shading point.
+    */
+    double computeProjectedSolidAngle(const float3& posW, const float3& normalW, const float3 vertices[3], const float3& triangleNormal)
+    {
+        if (glm::dot(triangleNormal, posW - vertices[0]) <= 0.f) return 0.0;
+
+        // Clip the triangle against the tangent plane. A triangle clipped by a plane has at most four vertices.
+        float3 polygon[4];
+        uint32_t count = 0;
+        for (uint32_t i = 0; i < 3; i++)
+        {
+            const float3 a = vertices[i] - posW;
+            const float3 b = vertices[(i + 1) % 3] - posW;
+            const float da = glm::dot(normalW, a);
+            const float db = glm::dot(normalW, b);
+            if (da >= 0.f) polygon[count++] = a;
+            if ((da >= 0.f) != (db >= 0.f)) polygon[count++] = a + (b - a) * (da / (da - db));
+        }
+        if (count < 3) return 0.0;
+
+        // Lambert's formula for the projected solid angle of a polygon.
+        double sum = 0.0;
+        for (uint32_t i = 0; i < count; i++)
+        {
+            const float3 v0 = polygon[i];
+            const float3 v1 = polygon[(i + 1) % count];
+            if (glm::dot(v0, v0) == 0.f || glm::dot(v1, v1) == 0.f) continue;
+
+            const glm::dvec3 d0 = glm::normalize(glm::dvec3(v0));
+            const glm::dvec3 d1 = glm::normalize(glm::dvec3(v1));
+            const glm::dvec3 c = glm::cross(d0, d1);
+            const double length = glm::length(c);
+            if (length == 0.0) continue;
+
+            const double theta = std::acos(glm::clamp(glm::dot(d0, d1), -1.0, 1.0));
+            sum += theta * glm::dot(glm::dvec3(normalW), c / length);
+        }
+        return 0.5 * std::abs(sum);
+    }
+}
+
+namespace Falcor
+{
+    LightBVHSamplerCPU::SharedPtr LightBVHSamplerCPU::create(const LightBVH::SharedConstPtr& pBVH, const LightCollection::SharedConstPtr& pLightCollection, const LightBVHSampler::Options& options)
+    {
+        if (!pBVH || !pBVH->isValid() || !pLightCollection)
+        {
+            logError("LightBVHSamplerCPU::create() - The light BVH must be built before it can be sampled.");
+            return nullptr;
+        }
+        return SharedPtr(new LightBVHSamplerCPU(pBVH, pLightCollection, options));
+    }
+
+    LightBVHSamplerCPU::LightBVHSamplerCPU(const LightBVH::SharedConstPtr& pBVH, const LightCollection::SharedConstPtr& pLightCollection, const LightBVHSampler::Options& options)
+        : mpBVH(pBVH)
+        , mpLightCollection(pLightCollection)
+        , mOptions(options)
+    {
+    }
+
+    float LightBVHSamplerCPU::computeNodeImportance(uint32_t nodeOffset, const float3& posW, const float3& normalW) const
+    {
+        auto eval = [&](const auto* pNode)
+        {
+            return LightBVHSamplerHelpers::computeNodeImportance(posW, normalW, pNode->aabbMin, pNode->aabbMax, pNode->luminousFlux, pNode->coneDirection, pNode->cosConeAngle, mOptions);
+        };
+
+        if (const LightBVH::InternalNode* pNode = mpBVH->getInternalNode(nodeOffset)) return eval(pNode);
+        return eval(mpBVH->getLeafNode(nodeOffset));
+    }
+
+    float LightBVHSamplerCPU::computeTriangleImportance(uint32_t triangleIndex, const float3& posW, const float3& normalW) const
+    {
+        const auto& triangle = mpLightCollection->getMeshLightTriangles()[triangleIndex];
+        const float3 vertices[3] = { triangle.vtx[0].pos, triangle.vtx[1].pos, triangle.vtx[2].pos };
+        return LightBVHSamplerHelpers::computeTriangleImportance(posW, normalW, vertices);
+    }
+
+    bool LightBVHSamplerCPU::pickTriangle(const LightBVH::LeafNode* pLeaf, const float3& posW, const float3& normalW, float u, uint32_t& triangleIndex, float& pdf) const
+    {
+        const uint32_t triangleCount = pLeaf->triangleCount;
+        if (mOptions.useUniformTriangleSampling)
+        {
+            triangleIndex = pLeaf->triangleIndices[std::min((uint32_t)(u * triangleCount), triangleCount - 1)];
+            pdf = 1.f / (float)triangleCount;
+            return true;
+        }
+
+        float importances[kMaxCachedTriangleImportances];
+        auto getImportance = [&](uint32_t i)
+        {
+            return i < kMaxCachedTriangleImportances ? importances[i] : computeTriangleImportance(pLeaf->triangleIndices[i], posW, normalW);
+        };
+
+        float totalImportance = 0.f;
+        for (uint32_t i = 0; i < triangleCount; i++)
+        {
+            const float importance = computeTriangleImportance(pLeaf->triangleIndices[i], posW, normalW);
+            if (i < kMaxCachedTriangleImportances) importances[i] = importance;
+            totalImportance += importance;
+        }
+        if (totalImportance == 0.f) return false;
+
+        const float uScaled = u * totalImportance;
+        float cdf = 0.f;
+        uint32_t idx = 0;
+        for (; idx < triangleCount; idx++)
+        {
+            cdf += getImportance(idx);
+            if (uScaled < cdf) break;
+        }
+        idx = std::min(idx, triangleCount - 1);
+
+        triangleIndex = pLeaf->triangleIndices[idx];
+        pdf = getImportance(idx) / totalImportance;
+        return true;
+    }
+
+    bool LightBVHSamplerCPU::sampleLight(const float3& posW, const float3& normalW, float u, uint32_t& triangleIndex, float& pdf) const
+    {
+        uint32_t nodeOffset = 0;
+        pdf = 1.f;
+
+        while (const LightBVH::InternalNode* pNode = mpBVH->getInternalNode(nodeOffset))
+        {
+            const float leftNodeImportance = computeNodeImportance(pNode->leftNodeOffset, posW, normalW);
+            const float rightNodeImportance = computeNodeImportance(pNode->rightNodeOffset, posW, normalW);
+            const float totalImportance = leftNodeImportance + rightNodeImportance;
+            if (totalImportance == 0.f) return false;
+
+            const float pLeft = leftNodeImportance / totalImportance;
+            const float pRight = 1.f - pLeft;
+            if (u < pLeft)
+            {
+                u = u / pLeft;
+                pdf *= pLeft;
+                nodeOffset = pNode->leftNodeOffset;
+            }
+            else
+            {
+                u = (u - pLeft) / pRight;
+                pdf *= pRight;
+                nodeOffset = pNode->rightNodeOffset;
+            }
+        }
+
+        float trianglePdf;
+        if (!pickTriangle(mpBVH->getLeafNode(nodeOffset), posW, normalW, u, triangleIndex, trianglePdf)) return false;
+        pdf *= trianglePdf;
+        return true;
+    }
+
+    void LightBVHSamplerCPU::sampleLights(uint32_t count, const float3* pPositions, const float3* pNormals, const float* pU, uint32_t* pTriangleIndices, float* pPdfs) const
+    {
+        // Make sure the CPU copies are up-to-date before going wide, so that no thread triggers a readback.
+        mpBVH->getNodeType(0);
+        mpLightCollection->getMeshLightTriangles();
+
+        Threading::parallelFor(0, count, [&](uint32_t i)
+        {
+            if (!sampleLight(pPositions[i], pNormals[i], pU[i], pTriangleIndices[i], pPdfs[i]))
+            {
+                pTriangleIndices[i] = kInvalidIndex;
+                pPdfs[i] = 0.f;
+            }
+        }, 256);
+    }
+
+    float LightBVHSamplerCPU::evalPdf(const float3& posW, const float3& normalW, uint32_t triangleIndex) const
+    {
+        const auto& triangleBitmasks = mpBVH->getTriangleBitmasks();
+        if (triangleIndex >= triangleBitmasks.size() || triangleBitmasks[triangleIndex] == kInvalidBitmask) return 0.f;
+
+        // Follow the bitmask from the root and multiply the probabilities of the visited children.
+        uint64_t bitmask = triangleBitmasks[triangleIndex];
+        uint32_t nodeOffset = 0;
+        float pdf = 1.f;
+
+        while (const LightBVH::InternalNode* pNode = mpBVH->getInternalNode(nodeOffset))
+        {
+            const float leftNodeImportance = computeNodeImportance(pNode->leftNodeOffset, posW, normalW);
+            const float rightNodeImportance = computeNodeImportance(pNode->rightNodeOffset, posW, normalW);
+            const float totalImportance = leftNodeImportance + rightNodeImportance;
+            if (totalImportance == 0.f) return 0.f;
+
+            const float pLeft = leftNodeImportance / totalImportance;
+            const bool chooseLeftNode = (bitmask & 0x1) == 0u;
+            pdf *= chooseLeftNode ? pLeft : 1.f - pLeft;
+            nodeOffset = chooseLeftNode ? pNode->leftNodeOffset : pNode->rightNodeOffset;
+            bitmask >>= 1;
+        }
+
+        const LightBVH::LeafNode* pLeaf = mpBVH->getLeafNode(nodeOffset);
+        if (mOptions.useUniformTriangleSampling) return pdf / (float)pLeaf->triangleCount;
+
+        float importance = 0.f;
+        float totalImportance = 0.f;
+        for (uint32_t i = 0; i < pLeaf->triangleCount; i++)
+        {
+            const float triangleImportance = computeTriangleImportance(pLeaf->triangleIndices[i], posW, normalW);
+            if (pLeaf->triangleIndices[i] == triangleIndex) importance = triangleImportance;
+            totalImportance += triangleImportance;
+        }
+        return totalImportance > 0.f ? pdf * importance / totalImportance : 0.f;
+    }
+
+    LightBVHSamplerCPU::EvaluationResult LightBVHSamplerCPU::evaluate(const EvaluationDesc& desc) const
+    {
+        EvaluationResult result;
+        if (desc.pointCount == 0 || desc.samplesPerPoint == 0) return result;
+
+        const auto& triangles = mpLightCollection->getMeshLightTriangles();
+
+        // Place the shading points uniformly in the scaled BVH bounds, with uniformly distributed normals.
+        float3 aabbMin, aabbMax;
+        if (const LightBVH::InternalNode* pRoot = mpBVH->getInternalNode(0)) aabbMin = pRoot->aabbMin, aabbMax = pRoot->aabbMax;
+        else aabbMin = mpBVH->getLeafNode(0)->aabbMin, aabbMax = mpBVH->getLeafNode(0)->aabbMax;
+        const float3 center = (aabbMin + aabbMax) * 0.5f;
+        const float3 extent = (aabbMax - aabbMin) * 0.5f * desc.boundsScale;
+
+        std::mt19937 rng(desc.seed);
+        std::uniform_real_distribution<float> dist(0.f, 1.f);
+        std::vector<float3> positions(desc.pointCount);
+        std::vector<float3> normals(desc.pointCount);
+        for (uint32_t i = 0; i < desc.pointCount; i++)
+        {
+            positions[i] = center + extent * float3(dist(rng) * 2.f - 1.f, dist(rng) * 2.f - 1.f, dist(rng) * 2.f - 1.f);
+            const float z = 1.f - 2.f * dist(rng);
+            const float r = std::sqrt(std::max(0.f, 1.f - z * z));
+            const float phi = 2.f * glm::pi<float>() * dist(rng);
+            normals[i] = float3(r * std::cos(phi), r * std::sin(phi), z);
+        }
+
+        // Compute the ground truth irradiance at each shading point analytically.
+        std::vector<double> groundTruth(desc.pointCount, 0.0);
+        Threading::parallelFor(0, desc.pointCount, [&](uint32_t i)
+        {
+            double irradiance = 0.0;
+            for (const auto& triangle : triangles)
+            {
+                const float radiance = luminance(triangle.averageRadiance);
+                if (radiance <= 0.f) continue;
+                const float3 vertices[3] = { triangle.vtx[0].pos, triangle.vtx[1].pos, triangle.vtx[2].pos };
+                irradiance += radiance * computeProjectedSolidAngle(positions[i], normals[i], vertices, triangle.normal);
+            }
+            groundTruth[i] = irradiance;
+        });
+
+        // Select the lights for all samples with the batch API and measure its throughput.
+        const size_t sampleCount = (size_t)desc.pointCount * desc.samplesPerPoint;
+        std::vector<float3> samplePositions(sampleCount);
+        std::vector<float3> sampleNormals(sampleCount);
+        std::vector<float> sampleU(sampleCount);
+        for (size_t s = 0; s < sampleCount; s++)
+        {
+            samplePositions[s] = positions[s / desc.samplesPerPoint];
+            sampleNormals[s] = normals[s / desc.samplesPerPoint];
+            sampleU[s] = std::min(dist(rng), std::nextafter(1.f, 0.f));
+        }
+        std::vector<uint32_t> triangleIndices(sampleCount);
+        std::vector<float> pdfs(sampleCount);
+
+        CpuTimer timer;
+        timer.update();
+        sampleLights((uint32_t)sampleCount, samplePositions.data(), sampleNormals.data(), sampleU.data(), triangleIndices.data(), pdfs.data());
+        timer.update();
+        result.nsPerSample = timer.delta() * 1e9 / (double)sampleCount;
+
+        // Estimate the irradiance at each shading point from its samples, sampling a uniform point on each selected triangle.
+        struct PointStats
+        {
+            double mean = 0.0;
+            double variance = 0.0;
+            uint32_t failedCount = 0;
+            double maxPdfError = 0.0;
+        };
+        std::vector<PointStats> pointStats(desc.pointCount);
+
+        Threading::parallelFor(0, desc.pointCount, [&](uint32_t i)
+        {
+            std::mt19937 pointRng(desc.seed ^ (0x9e3779b9u * (i + 1)));
+            std::uniform_real_distribution<float> pointDist(0.f, 1.f);
+            const float3& posW = positions[i];
+            const float3& normalW = normals[i];
+
+            PointStats stats;
+            double m2 = 0.0;
+            for (uint32_t j = 0; j < desc.samplesPerPoint; j++)
+            {
+                const size_t s = (size_t)i * desc.samplesPerPoint + j;
+                double value = 0.0;
+                if (triangleIndices[s] == kInvalidIndex)
+                {
+                    stats.failedCount++;
+                }
+                else
+                {
+                    const auto& triangle = triangles[triangleIndices[s]];
+                    if (j < kPdfChecksPerPoint)
+                    {
+                        const double evalPdfValue = evalPdf(posW, normalW, triangleIndices[s]);
+                        stats.maxPdfError = std::max(stats.maxPdfError, std::abs(evalPdfValue - pdfs[s]) / pdfs[s]);
+                    }
+
+                    // Uniformly sample a point on the triangle, see sample_triangle() in MathHelpers.slang.
+                    const float su = std::sqrt(pointDist(pointRng));
+                    const float b1 = 1.f - su;
+                    const float b2 = pointDist(pointRng) * su;
+                    const float3 p = triangle.vtx[0].pos * (1.f - b1 - b2) + triangle.vtx[1].pos * b1 + triangle.vtx[2].pos * b2;
+
+                    const float3 toLight = p - posW;
+                    const float distSqr = glm::dot(toLight, toLight);
+                    if (distSqr > 0.f)
+                    {
+                        const float3 L = toLight / std::sqrt(distSqr);
+                        const float cosShading = glm::dot(normalW, L);
+                        const float cosLight = glm::dot(triangle.normal, -L);
+                        if (cosShading > 0.f && cosLight > 0.f)
+                        {
+                            value = (double)luminance(triangle.averageRadiance) * cosShading * cosLight / distSqr * triangle.area / pdfs[s];
+                        }
+                    }
+                }
+
+                // Welford's online mean and variance.
+                const double delta = value - stats.mean;
+                stats.mean += delta / (j + 1);
+                m2 += delta * (value - stats.mean);
+            }
+            stats.variance = desc.samplesPerPoint > 1 ? m2 / (desc.samplesPerPoint - 1) : 0.0;
+            pointStats[i] = stats;
+        });
+
+        // Combine the per-point statistics relative to the ground truth.
+        uint64_t failedCount = 0;
+        for (uint32_t i = 0; i < desc.pointCount; i++)
+        {
+            const PointStats& stats = pointStats[i];
+            failedCount += stats.failedCount;
+            result.maxPdfError = std::max(result.maxPdfError, stats.maxPdfError);
+            if (groundTruth[i] <= 0.0) continue;
+
+            const double relativeError = (stats.mean - groundTruth[i]) / groundTruth[i];
+            result.relativeVariance += stats.variance / (groundTruth[i] * groundTruth[i]);
+            result.relativeRMSE += relativeError * relativeError;
+            result.pointCount++;
+        }
+        if (result.pointCount > 0)
+        {
+            result.relativeVariance /= result.pointCount;
+            result.relativeRMSE = std::sqrt(result.relativeRMSE / result.pointCount);
+        }
+        result.failedSampleRatio = (double)failedCount / (double)sampleCount;
+
+        return result;
+    }
+
+    std::string LightBVHSamplerCPU::EvaluationResult::toString() const
+    {
+        std::ostringstream oss;
+        oss << "  Shading points:      " << pointCount << std::endl
+            << "  Relative variance:   " << relativeVariance << std::endl
+            << "  Relative RMSE:       " << relativeRMSE << std::endl
+            << "  Failed samples:      " << std::fixed << std::setprecision(2) << (failedSampleRatio * 100.0) << "%" << std::endl
+            << "  Max pdf error:       " << std::scientific << std::setprecision(3) << maxPdfError << std::endl
+            << "  Selection time:      " << std::fixed << std::setprecision(1) << nsPerSample << " ns/sample";
+        return oss.str();
+    }
+}
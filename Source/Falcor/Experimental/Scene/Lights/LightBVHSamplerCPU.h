@@ -0,0 +1,134 @@
+/***************************************************************************
+ # Copyright (c) 2020, NVIDIA CORPORATION. All rights reserved.
+ #
+ # Redistribution and use in source and binary forms, with or without
+ # modification, are permitted provided that the following conditions
+ # are met:
+ #  * Redistributions of source code must retain the above copyright
+ #    notice, this list of conditions and the following disclaimer.
+ #  * Redistributions in binary form must reproduce the above copyright
+ #    notice, this list of conditions and the following disclaimer in the
+ #    documentation and/or other materials provided with the distribution.
+ #  * Neither the name of NVIDIA CORPORATION nor the names of its
+ #    contributors may be used to endorse or promote products derived
+ #    from this software without specific prior written permission.
+ #
+ # THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ # EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ # IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ # PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ # CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ # EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ # PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ # PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ # OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ # (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ # OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **************************************************************************/
+#pragma once
+#include "LightBVH.h"
+#include "LightBVHSampler.h"
+#include "LightCollection.h"
+
+#include <limits>
+#include <string>
+#include <vector>
+
+namespace Falcor
+{
+    /** CPU implementation of light selection with a light BVH.
+
+        This mirrors LightBVHSampler.slang: for the same BVH and options it selects triangles with the same
+        probabilities as the GPU sampler. It is meant for measuring sampling quality and cost offline, e.g. when
+        tuning the BVH build options, and for validating BVH variants without a GPU.
+
+        Only the light selection is mirrored. Sampling a point on the selected triangle is left to the caller.
+    */
+    class dlldecl LightBVHSamplerCPU
+    {
+    public:
+        using SharedPtr = std::shared_ptr<LightBVHSamplerCPU>;
+        using SharedConstPtr = std::shared_ptr<const LightBVHSamplerCPU>;
+
+        static const uint32_t kInvalidIndex = std::numeric_limits<uint32_t>::max();
+
+        /** Configuration of the sampling quality evaluation.
+        */
+        struct EvaluationDesc
+        {
+            uint32_t pointCount = 256;              ///< Number of random shading points.
+            uint32_t samplesPerPoint = 1024;        ///< Number of light samples per shading point.
+            uint32_t seed = 0;                      ///< Seed of the random number generator.
+            float boundsScale = 1.5f;               ///< Shading points are placed uniformly in the BVH bounds scaled by this factor around their center.
+        };
+
+        /** Result of the sampling quality evaluation.
+            The integrand is the unshadowed irradiance from all emissive triangles, each emitting its average radiance from its front face.
+            The ground truth is computed analytically per shading point.
+        */
+        struct EvaluationResult
+        {
+            uint32_t pointCount = 0;                ///< Number of shading points with non-zero ground truth.
+            double relativeVariance = 0.0;          ///< Per-sample variance divided by the squared ground truth, averaged over the shading points.
+            double relativeRMSE = 0.0;              ///< RMS of the relative error of the per-point estimates.
+            double failedSampleRatio = 0.0;         ///< Fraction of samples for which no light was selected.
+            double maxPdfError = 0.0;               ///< Largest relative difference between the pdf of a sample and evalPdf() for the same triangle.
+            double nsPerSample = 0.0;               ///< Average light selection time per sample in nanoseconds, using the batch API.
+
+            std::string toString() const;
+        };
+
+        /** Creates a CPU sampler for a built light BVH.
+            \param[in] pBVH The light BVH. It must be valid.
+            \param[in] pLightCollection The light collection the BVH was built over.
+            \param[in] options The sampler options. The build options are ignored.
+            \return The sampler, or nullptr if the BVH is not valid.
+        */
+        static SharedPtr create(const LightBVH::SharedConstPtr& pBVH, const LightCollection::SharedConstPtr& pLightCollection, const LightBVHSampler::Options& options = LightBVHSampler::Options());
+
+        /** Selects a triangle by traversing the BVH. See sampleLightViaBVH() in LightBVHSampler.slang.
+            \param[in] posW Shading point in world space.
+            \param[in] normalW Normal at the shading point in world space.
+            \param[in] u Uniform random number in [0,1).
+            \param[out] triangleIndex Global index of the selected triangle, only valid if true is returned.
+            \param[out] pdf Probability of selecting the triangle, only valid if true is returned.
+            \return True if a triangle was selected, false otherwise.
+        */
+        bool sampleLight(const float3& posW, const float3& normalW, float u, uint32_t& triangleIndex, float& pdf) const;
+
+        /** Selects one triangle for each shading point of a batch. The batch is processed in parallel.
+            \param[in] count Number of shading points.
+            \param[in] pPositions Shading points in world space.
+            \param[in] pNormals Normals at the shading points in world space.
+            \param[in] pU Uniform random numbers in [0,1), one per shading point.
+            \param[out] pTriangleIndices Selected triangles, kInvalidIndex if no triangle was selected.
+            \param[out] pPdfs Probabilities of the selected triangles, 0 if no triangle was selected.
+        */
+        void sampleLights(uint32_t count, const float3* pPositions, const float3* pNormals, const float* pU, uint32_t* pTriangleIndices, float* pPdfs) const;
+
+        /** Evaluates the probability of selecting a triangle. See evalBVHTraversalPdf() in LightBVHSampler.slang.
+            \param[in] posW Shading point in world space.
+            \param[in] normalW Normal at the shading point in world space.
+            \param[in] triangleIndex Global triangle index.
+            \return Probability of selecting the triangle.
+        */
+        float evalPdf(const float3& posW, const float3& normalW, uint32_t triangleIndex) const;
+
+        /** Measures the variance and cost of light selection against ground truth direct lighting at random shading points.
+        */
+        EvaluationResult evaluate(const EvaluationDesc& desc = EvaluationDesc()) const;
+
+        const LightBVHSampler::Options& getOptions() const { return mOptions; }
+
+    protected:
+        LightBVHSamplerCPU(const LightBVH::SharedConstPtr& pBVH, const LightCollection::SharedConstPtr& pLightCollection, const LightBVHSampler::Options& options);
+
+        float computeNodeImportance(uint32_t nodeOffset, const float3& posW, const float3& normalW) const;
+        float computeTriangleImportance(uint32_t triangleIndex, const float3& posW, const float3& normalW) const;
+        bool pickTriangle(const LightBVH::LeafNode* pLeaf, const float3& posW, const float3& normalW, float u, uint32_t& triangleIndex, float& pdf) const;
+
+        LightBVH::SharedConstPtr        mpBVH;
+        LightCollection::SharedConstPtr mpLightCollection;
+        LightBVHSampler::Options        mOptions;
+    };
+}
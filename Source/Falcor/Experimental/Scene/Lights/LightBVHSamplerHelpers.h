@@ -0,0 +1,279 @@
+/***************************************************************************
+ # Copyright (c) 2020, NVIDIA CORPORATION. All rights reserved.
+ #
+ # Redistribution and use in source and binary forms, with or without
+ # modification, are permitted provided that the following conditions
+ # are met:
+ #  * Redistributions of source code must retain the above copyright
+ #    notice, this list of conditions and the following disclaimer.
+ #  * Redistributions in binary form must reproduce the above copyright
+ #    notice, this list of conditions and the following disclaimer in the
+ #    documentation and/or other materials provided with the distribution.
+ #  * Neither the name of NVIDIA CORPORATION nor the names of its
+ #    contributors may be used to endorse or promote products derived
+ #    from this software without specific prior written permission.
+ #
+ # THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ # EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ # IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ # PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ # CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ # EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ # PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ # PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ # OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ # (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ # OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **************************************************************************/
+#pragma once
+#include "LightBVHSampler.h"
+#include "Utils/Math/Vector.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+namespace Falcor
+{
+    /** Host-side versions of the light BVH importance functions.
+
+        These mirror the functions in LightBVHSampler.slang and MathHelpers.slang so that
+        BVH variants can be sampled and validated on the CPU with the same probabilities as on the GPU.
+        IMPORTANT: keep these in sync with the shader code.
+    */
+    namespace LightBVHSamplerHelpers
+    {
+        /** Compute cos(max(0, a - b)) given the sine and cosine of a and b.
+        */
+        inline float cosSubClamped(float sinThetaA, float cosThetaA, float sinThetaB, float cosThetaB)
+        {
+            if (cosThetaA > cosThetaB) return 1.f;
+            return cosThetaA * cosThetaB + sinThetaA * sinThetaB;
+        }
+
+        /** Compute sin(max(0, a - b)) given the sine and cosine of a and b.
+        */
+        inline float sinSubClamped(float sinThetaA, float cosThetaA, float sinThetaB, float cosThetaB)
+        {
+            if (cosThetaA > cosThetaB) return 0.f;
+            return sinThetaA * cosThetaB - cosThetaA * sinThetaB;
+        }
+
+        /** Bounding cone of an AABB as seen from a point, using the central direction to the AABB center.
+            See boundBoxSubtendedConeAngleCenter() in MathHelpers.slang.
+        */
+        inline void boundBoxSubtendedConeAngleCenter(const float3& origin, const float3& aabbMin, const float3& aabbMax, float& sinTheta, float& cosTheta)
+        {
+            const float3 center = (aabbMax + aabbMin) * 0.5f;
+            const float3 extent = (aabbMax - aabbMin) * 0.5f;
+            const float3 dir = center - origin;
+            const float extSqr = glm::dot(extent, extent);
+            const float distSqr = glm::dot(dir, dir);
+
+            const float3 e[4] =
+            {
+                float3(extent.x, extent.y, extent.z),
+                float3(extent.x, extent.y, -extent.z),
+                float3(extent.x, -extent.y, extent.z),
+                float3(extent.x, -extent.y, -extent.z),
+            };
+
+            cosTheta = 1.f;
+            sinTheta = 0.f;
+            for (uint32_t i = 0; i < 4; i++)
+            {
+                float d = std::abs(glm::dot(dir, e[i]));
+                float x = distSqr - d;
+                if (x < 1e-5f)
+                {
+                    cosTheta = -1.f;
+                    sinTheta = 0.f;
+                    return;
+                }
+                float y = std::sqrt(std::max(0.f, distSqr * extSqr - d * d));
+                float z = std::sqrt(x * x + y * y);
+                cosTheta = std::min(cosTheta, x / z);
+                sinTheta = std::max(sinTheta, y / z);
+            }
+        }
+
+        /** Bounding cone of an AABB as seen from a point, using the average direction to the AABB corners.
+            See boundBoxSubtendedConeAngleAverage() in MathHelpers.slang.
+        */
+        inline void boundBoxSubtendedConeAngleAverage(const float3& origin, const float3& aabbMin, const float3& aabbMax, float& sinTheta, float& cosTheta)
+        {
+            if (glm::all(glm::greaterThanEqual(origin, aabbMin)) && glm::all(glm::lessThanEqual(origin, aabbMax)))
+            {
+                sinTheta = 0.f;
+                cosTheta = -1.f;
+                return;
+            }
+
+            float3 cornerDirs[8];
+            float3 dirSum(0.f);
+            for (uint32_t i = 0; i < 8; i++)
+            {
+                const float3 corner((i & 1) ? aabbMin.x : aabbMax.x, (i & 2) ? aabbMin.y : aabbMax.y, (i & 4) ? aabbMin.z : aabbMax.z);
+                cornerDirs[i] = glm::normalize(corner - origin);
+                dirSum += cornerDirs[i];
+            }
+            const float3 coneDir = glm::normalize(dirSum);
+
+            cosTheta = 1.f;
+            for (uint32_t i = 0; i < 8; i++) cosTheta = std::min(cosTheta, glm::dot(cornerDirs[i], coneDir));
+            sinTheta = std::sqrt(std::max(0.f, 1.f - cosTheta * cosTheta));
+        }
+
+        /** Bounding cone of a sphere centered at 'center' relative to the viewpoint.
+            See boundSphereSubtendedConeAngle() in MathHelpers.slang.
+        */
+        inline void boundSphereSubtendedConeAngle(const float3& center, float radius, float& sinTheta, float& cosTheta)
+        {
+            const float centerDistance2 = glm::dot(center, center);
+            if (centerDistance2 < radius * radius)
+            {
+                sinTheta = 0.f;
+                cosTheta = -1.f;
+            }
+            else
+            {
+                const float sin2Theta = radius * radius / centerDistance2;
+                cosTheta = std::sqrt(std::max(0.f, 1.f - sin2Theta));
+                sinTheta = std::sqrt(sin2Theta);
+            }
+        }
+
+        /** Squared minimum distance between a point and a triangle.
+            See computeSquaredMinDistanceToTriangle() in MathHelpers.slang.
+        */
+        inline float computeSquaredMinDistanceToTriangle(const float3 vertices[3], const float3& p)
+        {
+            const float3 n = glm::normalize(glm::cross(vertices[1] - vertices[0], vertices[2] - vertices[0]));
+            const float projDistance = glm::dot(n, p - vertices[0]);
+            const float3 pProj = p - projDistance * n;
+
+            const float3 edges[3] =
+            {
+                glm::normalize(vertices[1] - vertices[0]),
+                glm::normalize(vertices[2] - vertices[1]),
+                glm::normalize(vertices[0] - vertices[2])
+            };
+            float sqrPlanarDistance = FLT_MAX;
+            uint32_t insideMask = 0;
+            for (uint32_t i = 0; i < 3; i++)
+            {
+                const float3 edgeN = glm::cross(n, edges[i]);
+                const float edgeProjDistance = glm::dot(edgeN, pProj - vertices[i]);
+                if (edgeProjDistance >= 0.f) insideMask |= 1u << i;
+                else sqrPlanarDistance = std::min(edgeProjDistance * edgeProjDistance, sqrPlanarDistance);
+            }
+
+            auto distSqr = [&pProj](const float3& v) { return glm::dot(pProj - v, pProj - v); };
+            if (insideMask == 0x7) sqrPlanarDistance = 0.f;
+            else if (insideMask == 1u) sqrPlanarDistance = distSqr(vertices[2]);
+            else if (insideMask == 2u) sqrPlanarDistance = distSqr(vertices[0]);
+            else if (insideMask == 4u) sqrPlanarDistance = distSqr(vertices[1]);
+
+            return projDistance * projDistance + sqrPlanarDistance;
+        }
+
+        /** Conservative bound on dot(N,L) for L towards any point in an AABB.
+            See boundCosineTerm() in LightBVHSampler.slang.
+            \param[out] cosThetaCone Cosine of the half angle of the cone bounding the AABB.
+        */
+        inline float boundCosineTerm(const float3& posW, const float3& normalW, const float3& aabbMin, const float3& aabbMax, SolidAngleBoundMethod method, float& cosThetaCone)
+        {
+            const float3 center = (aabbMax + aabbMin) * 0.5f;
+            float sinThetaCone = 0.f;
+            cosThetaCone = 0.f;
+
+            switch (method)
+            {
+            case SolidAngleBoundMethod::Sphere:
+            {
+                const float3 extent = (aabbMax - aabbMin) * 0.5f;
+                boundSphereSubtendedConeAngle(center - posW, std::sqrt(glm::dot(extent, extent)), sinThetaCone, cosThetaCone);
+                break;
+            }
+            case SolidAngleBoundMethod::BoxToAverage:
+                boundBoxSubtendedConeAngleAverage(posW, aabbMin, aabbMax, sinThetaCone, cosThetaCone);
+                break;
+            case SolidAngleBoundMethod::BoxToCenter:
+                boundBoxSubtendedConeAngleCenter(posW, aabbMin, aabbMax, sinThetaCone, cosThetaCone);
+                break;
+            default:
+                return 0.f;
+            }
+
+            const float3 L = glm::normalize(center - posW);
+            const float cosThetaL = glm::clamp(glm::dot(normalW, L), -1.f, 1.f);
+            const float sinThetaL = std::sqrt(std::max(0.f, 1.f - cosThetaL * cosThetaL));
+            return glm::clamp(cosSubClamped(sinThetaL, cosThetaL, sinThetaCone, cosThetaCone), 0.f, 1.f);
+        }
+
+        /** Computes the importance of a BVH node as seen from a shading point.
+            See computeImportance() in LightBVHSampler.slang.
+            \param[in] posW Shading point in world space.
+            \param[in] normalW Normal at the shading point in world space.
+            \param[in] aabbMin Node AABB min-corner.
+            \param[in] aabbMax Node AABB max-corner.
+            \param[in] flux Node luminous flux.
+            \param[in] coneDirection Normalized dominant light direction of the node.
+            \param[in] cosConeAngle Cosine of the node's light cone angle, or kInvalidCosConeAngle.
+            \param[in] options Sampler options selecting which terms are used.
+            \return Relative importance of the node.
+        */
+        inline float computeNodeImportance(const float3& posW, const float3& normalW, const float3& aabbMin, const float3& aabbMax,
+            float flux, const float3& coneDirection, float cosConeAngle, const LightBVHSampler::Options& options)
+        {
+            if (options.disableNodeFlux) flux = 1.f;
+
+            const float3 center = (aabbMin + aabbMax) * 0.5f;
+            float distance = glm::length(posW - center);
+
+            float NdotL = 1.f;
+            float cosThetaBoundingCone = 0.f;
+            if (options.useBoundingCone || options.useLightingCone)
+            {
+                NdotL = boundCosineTerm(posW, normalW, aabbMin, aabbMax, options.solidAngleBoundMethod, cosThetaBoundingCone);
+            }
+            if (!options.useBoundingCone) NdotL = 1.f;
+
+            float orientationWeight = 1.f;
+            if (options.useLightingCone && cosConeAngle != kInvalidCosConeAngle && cosConeAngle > 0.f)
+            {
+                const float sinConeAngle = std::sqrt(std::max(0.f, 1.f - cosConeAngle * cosConeAngle));
+                const float3 dirToAabb = (center - posW) / distance;
+                const float cosTheta = glm::dot(coneDirection, -dirToAabb);
+                const float sinTheta = std::sqrt(std::max(0.f, 1.f - cosTheta * cosTheta));
+                const float sinThetaBoundingCone = std::sqrt(std::max(0.f, 1.f - cosThetaBoundingCone * cosThetaBoundingCone));
+
+                const float cosTheta0 = cosSubClamped(sinTheta, cosTheta, sinConeAngle, cosConeAngle);
+                const float sinTheta0 = sinSubClamped(sinTheta, cosTheta, sinConeAngle, cosConeAngle);
+                const float cosThetaPrime = cosSubClamped(sinTheta0, cosTheta0, sinThetaBoundingCone, cosThetaBoundingCone);
+                orientationWeight = std::max(0.f, cosThetaPrime);
+            }
+
+            // Clamp the distance by half the AABB's largest extent, as the center is not representative of the emitters at short distances.
+            const float3 aabbExtent = aabbMax - aabbMin;
+            const float halfRadius = std::max(aabbExtent.x, std::max(aabbExtent.y, aabbExtent.z)) * 0.5f;
+            distance = std::max(halfRadius, distance);
+
+            return (flux * NdotL) * orientationWeight / (distance * distance);
+        }
+
+        /** Computes the importance of an emissive triangle as seen from a shading point.
+            See computeTriangleImportance() in LightBVHSampler.slang.
+        */
+        inline float computeTriangleImportance(const float3& posW, const float3& normalW, const float3 vertices[3])
+        {
+            const float distSqr = std::max(1e-5f, computeSquaredMinDistanceToTriangle(vertices, posW));
+
+            float NdotL = 0.f;
+            for (uint32_t i = 0; i < 3; i++) NdotL = std::max(NdotL, glm::dot(normalW, glm::normalize(vertices[i] - posW)));
+            NdotL = glm::clamp(NdotL, 0.f, 1.f);
+
+            return NdotL / distSqr;
+        }
+    }
+}
@@ -30,6 +30,7 @@
 #include "LightCollectionShared.slang"
 #include "Scene/Scene.h"
 #include <sstream>
+#include <numeric>
 
 namespace Falcor
 {
@@ -62,8 +63,8 @@ namespace Falcor
 
         // Update transform matrices and check for updates.
         // TODO: Move per-mesh instance update flags into Scene. Return just a list of mesh lights that have changed.
-        std::vector<uint32_t> updatedLights;
-        updatedLights.reserve(mMeshLights.size());
+        mUpdatedLights.clear();
+        mUpdatedLights.reserve(mMeshLights.size());
 
         for (uint32_t lightIdx = 0; lightIdx < mMeshLights.size(); ++lightIdx)
         {
@@ -84,18 +85,34 @@ namespace Falcor
             if (mpScene->getAnimationController()->didMatrixChanged(instanceData.globalMatrixID)) updateFlags |= UpdateFlags::MatrixChanged;
 
             // Store update status.
-            if (updateFlags != UpdateFlags::None) updatedLights.push_back(lightIdx);
+            if (updateFlags != UpdateFlags::None) mUpdatedLights.push_back(lightIdx);
             if (pUpdateStatus) pUpdateStatus->lightsUpdateInfo.push_back(updateFlags);
         }
 
         // Update light data if needed.
-        if (!updatedLights.empty())
+        bool lightsChanged = false;
+        if (!mUpdatedLights.empty())
         {
-            updateTrianglePositions(pRenderContext, updatedLights);
-            return true;
+            updateTrianglePositions(pRenderContext, mUpdatedLights);
+            lightsChanged = true;
         }
 
-        return false;
+        // Re-integrate the emissive triangles if materials changed, as their emissive color or texture may have changed.
+        // This is only done when the CPU integrator is active, where just the (mesh, material) pairs whose texture has changed
+        // are integrated again. The GPU raster pass would re-integrate all triangles on every material change.
+        if (mLastIntegrationOnCPU && mTriangleCount > 0 && is_set(mpScene->getUpdates(), Scene::UpdateFlags::MaterialsChanged))
+        {
+            integrateEmissive(pRenderContext);
+            markGPUDataChanged(CPUOutOfDateFlags::TriangleData);
+            mStatsValid = false;
+
+            // The flux of any light may have changed.
+            mUpdatedLights.resize(mMeshLights.size());
+            std::iota(mUpdatedLights.begin(), mUpdatedLights.end(), 0);
+            lightsChanged = true;
+        }
+
+        return lightsChanged;
     }
 
     void LightCollection::renderUI(Gui::Widgets& widget)
@@ -113,7 +130,26 @@ namespace Falcor
             << " Triangles (culled)     : " << stats.trianglesCulled << std::endl
             << " Triangles (active)     : " << stats.trianglesActive << std::endl
             << " -> uniform emissive    : " << stats.trianglesActiveUniform << std::endl
-            << " -> textured emissive   : " << stats.trianglesActiveTextured << std::endl;
+            << " -> textured emissive   : " << stats.trianglesActiveTextured << std::endl
+            << std::endl
+            << "Readback" << std::endl
+            << " Data version (GPU/CPU) : " << mDataVersion << "/" << mCPUDataVersion << std::endl
+            << " Readbacks              : " << mReadbackStats.readbackCount << std::endl
+            << " Stalls                 : " << mReadbackStats.stallCount << std::endl
+            << " Stall time (total)     : " << mReadbackStats.stallTime * 1000.0 << " ms" << std::endl
+            << " Stall time (last)      : " << mReadbackStats.lastStallTime * 1000.0 << " ms" << std::endl;
+
+        if (mLastIntegrationOnCPU)
+        {
+            const auto& integratorStats = mpCPUIntegrator->getStats();
+            oss << std::endl
+                << "Emissive integration (CPU)" << std::endl
+                << " Meshes (integrated)    : " << integratorStats.meshesIntegrated << std::endl
+                << " Meshes (cached)        : " << integratorStats.meshesCached << std::endl
+                << " Triangles (texels)     : " << integratorStats.trianglesIntegrated << std::endl
+                << " Triangles (constant)   : " << integratorStats.trianglesConstant << std::endl
+                << " Time                   : " << integratorStats.time * 1000.0 << " ms" << std::endl;
+        }
 
         widget.text(oss.str().c_str());
     }
@@ -126,6 +162,14 @@ namespace Falcor
         // Setup the lights.
         if (!setupMeshLights()) return false;
 
+        // Create the CPU integrator for emissive textures. Textures are integrated on the GPU if it doesn't support the sampler.
+        const Sampler::AddressMode addressModeU = mpSamplerState ? mpSamplerState->getAddressModeU() : Sampler::AddressMode::Wrap;
+        const Sampler::AddressMode addressModeV = mpSamplerState ? mpSamplerState->getAddressModeV() : Sampler::AddressMode::Wrap;
+        if (EmissiveIntegratorCPU::isSupported(addressModeU) && EmissiveIntegratorCPU::isSupported(addressModeV))
+        {
+            mpCPUIntegrator = EmissiveIntegratorCPU::create(addressModeU, addressModeV);
+        }
+
         // Create program for integrating emissive textures.
         // This should be done after lights are setup, so that we know which sampler state etc. to use.
         if (!initIntegrator()) return false;
@@ -250,7 +294,8 @@ namespace Falcor
             mMeshLightStats = MeshLightStats();
 
             mCPUInvalidData = CPUOutOfDateFlags::None;
-            mStagingBufferValid = true;
+            mChangedSinceLastCopy = CPUOutOfDateFlags::None;
+            mCPUDataVersion = mScheduledDataVersion = ++mDataVersion;
             mStatsValid = true;
         }
         else
@@ -259,12 +304,14 @@ namespace Falcor
             prepareTriangleData(pRenderContext);
             prepareMeshData();
 
+            // The triangle list has been built on the GPU. Mark it as changed, so that the CPU integrator can read back the texture coordinates.
+            markGPUDataChanged(CPUOutOfDateFlags::All);
+
             // Pre-integrate emissive triangles.
             // TODO: We might want to redo this in update() for animated meshes or after scale changes as that affects the flux.
             integrateEmissive(pRenderContext);
 
-            mCPUInvalidData = CPUOutOfDateFlags::All;
-            mStagingBufferValid = false;
+            markGPUDataChanged(CPUOutOfDateFlags::TriangleData);
             mStatsValid = false;
 
             prepareSyncCPUData(pRenderContext);
@@ -332,17 +379,20 @@ namespace Falcor
         assert(mTriangleCount > 0);
         assert(mMeshLights.size() > 0);
 
-        // 1st pass: Rasterize emissive triangles in texture space to sum up their texels.
+        // Re-allocate result buffer if needed.
+        const uint32_t bufSize = mTriangleCount * sizeof(float4);
+        if (!mIntegrator.pResultBuffer || mIntegrator.pResultBuffer->getSize() < bufSize)
         {
-            // Re-allocate result buffer if needed.
-            const uint32_t bufSize = mTriangleCount * sizeof(float4);
-            if (!mIntegrator.pResultBuffer || mIntegrator.pResultBuffer->getSize() < bufSize)
-            {
-                mIntegrator.pResultBuffer = Buffer::create(bufSize, Resource::BindFlags::ShaderResource | Resource::BindFlags::UnorderedAccess, Buffer::CpuAccess::None);
-                mIntegrator.pResultBuffer->setName("LightCollection_IntegratorResults");
-                assert(mIntegrator.pResultBuffer);
-            }
+            mIntegrator.pResultBuffer = Buffer::create(bufSize, Resource::BindFlags::ShaderResource | Resource::BindFlags::UnorderedAccess, Buffer::CpuAccess::None);
+            mIntegrator.pResultBuffer->setName("LightCollection_IntegratorResults");
+            assert(mIntegrator.pResultBuffer);
+        }
 
+        // 1st pass: Sum up the texels covered by each textured emissive triangle. This is done on the CPU if possible,
+        // otherwise the triangles are rasterized in texture space on the GPU.
+        mLastIntegrationOnCPU = integrateEmissiveCPU();
+        if (!mLastIntegrationOnCPU)
+        {
             // Clear to zero before we start.
             pRenderContext->clearUAV(mIntegrator.pResultBuffer->getUAV().get(), float4(0.f));
 
@@ -381,12 +431,58 @@ namespace Falcor
         }
     }
 
+    bool LightCollection::integrateEmissiveCPU()
+    {
+        if (!mpCPUIntegrator) return false;
+
+        // The texture coordinates are computed on the GPU when building the triangle list. Read them back if needed.
+        const auto& triangles = (mCPUInvalidData & CPUOutOfDateFlags::TexCoords) != CPUOutOfDateFlags::None ? getMeshLightTriangles() : mMeshLightTriangles;
+        assert(triangles.size() == mTriangleCount);
+
+        // Gather the textured mesh lights.
+        std::vector<EmissiveIntegratorCPU::MeshInput> meshes;
+        for (const auto& meshLight : mMeshLights)
+        {
+            const auto& pTexture = mpScene->getMaterial(meshLight.materialID)->getEmissiveTexture();
+            if (!pTexture) continue;
+
+            EmissiveIntegratorCPU::MeshInput mesh;
+            mesh.meshID = mpScene->getMeshInstance(meshLight.meshInstanceID).meshID;
+            mesh.materialID = meshLight.materialID;
+            mesh.pTexture = pTexture;
+            mesh.texCoords.reserve(meshLight.triangleCount * 3);
+            for (uint32_t i = 0; i < meshLight.triangleCount; i++)
+            {
+                const auto& tri = triangles[meshLight.triangleOffset + i];
+                for (uint32_t j = 0; j < 3; j++) mesh.texCoords.push_back(tri.vtx[j].uv);
+            }
+            meshes.push_back(std::move(mesh));
+        }
+
+        if (!mpCPUIntegrator->integrate(meshes)) return false;
+
+        // Assemble the texel sums of all triangles. Non-textured triangles are ignored by the finalize pass.
+        std::vector<float4> texelSums(mTriangleCount, float4(0.f));
+        for (const auto& meshLight : mMeshLights)
+        {
+            if (!mpScene->getMaterial(meshLight.materialID)->getEmissiveTexture()) continue;
+
+            const uint32_t meshID = mpScene->getMeshInstance(meshLight.meshInstanceID).meshID;
+            const auto pSums = mpCPUIntegrator->getTexelSums(meshID, meshLight.materialID);
+            if (!pSums || pSums->size() != meshLight.triangleCount) return false;
+            std::copy(pSums->begin(), pSums->end(), texelSums.begin() + meshLight.triangleOffset);
+        }
+
+        mIntegrator.pResultBuffer->setBlob(texelSums.data(), 0, texelSums.size() * sizeof(float4));
+        return true;
+    }
+
     void LightCollection::computeStats() const
     {
         if (mStatsValid) return;
 
         // Read back the current data. This is potentially expensive.
-        syncCPUData();
+        syncCPUData(mDataVersion);
 
         // Stats on input data.
         MeshLightStats stats;
@@ -482,8 +578,7 @@ namespace Falcor
         // Run compute pass to update all triangles.
         mpTrianglePositionUpdater->execute(pRenderContext, mTriangleCount, 1u, 1u);
 
-        mCPUInvalidData |= (CPUOutOfDateFlags::Positions | CPUOutOfDateFlags::TriangleData);
-        mStagingBufferValid = false;
+        markGPUDataChanged(CPUOutOfDateFlags::Positions | CPUOutOfDateFlags::TriangleData);
     }
 
     bool LightCollection::setShaderData(const ShaderVar& var) const
@@ -521,20 +616,40 @@ namespace Falcor
         return true;
     }
 
+    const std::vector<LightCollection::MeshLightTriangle>& LightCollection::getAvailableMeshLightTriangles() const
+    {
+        // Pick up the most recent readback that has finished. We only wait if nothing was ever read back.
+        updateCPUData();
+        if (mCPUDataVersion == 0) syncCPUData(mDataVersion);
+        return mMeshLightTriangles;
+    }
+
+    void LightCollection::markGPUDataChanged(CPUOutOfDateFlags flags)
+    {
+        mDataVersion++;
+        mCPUInvalidData |= flags;
+        mChangedSinceLastCopy |= flags;
+    }
+
     void LightCollection::copyDataToStagingBuffer(RenderContext* pRenderContext) const
     {
-        if (mStagingBufferValid) return;
+        // Nothing to do if the current GPU data has already been scheduled for readback.
+        if (mScheduledDataVersion == mDataVersion) return;
+
+        // Use the next slot in the ring. If it is still pending, its data is older than any other pending slot
+        // and can be dropped. The GPU executes the copies in order, so the new copy lands after the old one.
+        ReadbackSlot& slot = mReadbackRing[mNextReadbackSlot];
+        mNextReadbackSlot = (mNextReadbackSlot + 1) % kReadbackRingSize;
 
         // Allocate staging buffer for readback. The data from our different GPU buffers is stored consecutively.
         const size_t stagingSize = mpMeshLightsVertexPos->getSize() + mpMeshLightsTexCoords->getSize() + mpTriangleData->getSize();
-        if (!mpStagingBuffer || mpStagingBuffer->getSize() < stagingSize)
+        if (!slot.pStagingBuffer || slot.pStagingBuffer->getSize() < stagingSize)
         {
-            mpStagingBuffer = Buffer::create(stagingSize, Resource::BindFlags::None, Buffer::CpuAccess::Read);
-            mpStagingBuffer->setName("LightCollection_StagingBuffer");
-            mCPUInvalidData = CPUOutOfDateFlags::All;
+            slot.pStagingBuffer = Buffer::create(stagingSize, Resource::BindFlags::None, Buffer::CpuAccess::Read);
+            slot.pStagingBuffer->setName("LightCollection_StagingBuffer");
         }
 
-        // Schedule the copy operations for data that is invalid.
+        // Schedule the copy operations for data that is invalid on the CPU.
         // Note that the staging buffer is allocated for the worst-case encountered so far.
         // If the number of triangles ever decreases, we'll be copying unnecessary data. This currently doesn't happen as geometry is not added/removed from the scene.
         // TODO: Update this code if we start removing geometry dynamically.
@@ -543,37 +658,100 @@ namespace Falcor
         bool copyTexCoords = (mCPUInvalidData & CPUOutOfDateFlags::TexCoords) == CPUOutOfDateFlags::TexCoords;
         bool copyTriangleData = (mCPUInvalidData & CPUOutOfDateFlags::TriangleData) == CPUOutOfDateFlags::TriangleData;
 
-        if (copyPositions) pRenderContext->copyBufferRegion(mpStagingBuffer.get(), 0, mpMeshLightsVertexPos.get(), 0, mpMeshLightsVertexPos->getSize());
-        if (copyTexCoords) pRenderContext->copyBufferRegion(mpStagingBuffer.get(), mpMeshLightsVertexPos->getSize(), mpMeshLightsTexCoords.get(), 0, mpMeshLightsTexCoords->getSize());
-        if (copyTriangleData) pRenderContext->copyBufferRegion(mpStagingBuffer.get(), mpMeshLightsVertexPos->getSize() + mpMeshLightsTexCoords->getSize(), mpTriangleData.get(), 0, mpTriangleData->getSize());
+        Buffer* pStagingBuffer = slot.pStagingBuffer.get();
+        if (copyPositions) pRenderContext->copyBufferRegion(pStagingBuffer, 0, mpMeshLightsVertexPos.get(), 0, mpMeshLightsVertexPos->getSize());
+        if (copyTexCoords) pRenderContext->copyBufferRegion(pStagingBuffer, mpMeshLightsVertexPos->getSize(), mpMeshLightsTexCoords.get(), 0, mpMeshLightsTexCoords->getSize());
+        if (copyTriangleData) pRenderContext->copyBufferRegion(pStagingBuffer, mpMeshLightsVertexPos->getSize() + mpMeshLightsTexCoords->getSize(), mpTriangleData.get(), 0, mpTriangleData->getSize());
 
-        // Submit command list and insert signal.
+        // Submit command list and insert signal. This does not wait for the GPU.
         pRenderContext->flush(false);
-        mpStagingFence->gpuSignal(pRenderContext->getLowLevelData()->getCommandQueue());
+        slot.fenceValue = mpStagingFence->gpuSignal(pRenderContext->getLowLevelData()->getCommandQueue());
+        slot.dataVersion = mDataVersion;
+        slot.copiedData = mCPUInvalidData;
+        slot.changedData = mChangedSinceLastCopy;
+        slot.pending = true;
+
+        mChangedSinceLastCopy = CPUOutOfDateFlags::None;
+        mScheduledDataVersion = mDataVersion;
+        mReadbackStats.readbackCount++;
 
-        // Resize the CPU-side triangle list (array-of-structs) buffer and mark the data as invalid.
+        // Resize the CPU-side triangle list (array-of-structs) buffer.
         mMeshLightTriangles.resize(mTriangleCount);
+    }
+
+    bool LightCollection::isCPUDataReady(uint64_t version) const
+    {
+        if (mCPUDataVersion >= version) return true;
 
-        mStagingBufferValid = true;
+        // Check if a readback of the requested version or newer has finished.
+        const uint64_t completedValue = mpStagingFence->getGpuValue();
+        for (const auto& slot : mReadbackRing)
+        {
+            if (slot.pending && slot.dataVersion >= version && slot.fenceValue <= completedValue) return true;
+        }
+        return false;
     }
 
-    void LightCollection::syncCPUData() const
+    void LightCollection::updateCPUData() const
     {
-        if (mCPUInvalidData == CPUOutOfDateFlags::None) return;
+        // Find the newest readback that has finished on the GPU.
+        const uint64_t completedValue = mpStagingFence->getGpuValue();
+        uint32_t newestSlot = kReadbackRingSize;
+        for (uint32_t i = 0; i < kReadbackRingSize; i++)
+        {
+            const auto& slot = mReadbackRing[i];
+            if (!slot.pending || slot.fenceValue > completedValue) continue;
+            if (newestSlot == kReadbackRingSize || slot.dataVersion > mReadbackRing[newestSlot].dataVersion) newestSlot = i;
+        }
+
+        if (newestSlot != kReadbackRingSize) resolveReadback(newestSlot);
+    }
+
+    void LightCollection::syncCPUData(uint64_t version) const
+    {
+        if (mCPUDataVersion >= version) return;
+
+        // Use finished readbacks first, they may already hold the requested data.
+        updateCPUData();
+        if (mCPUDataVersion >= version) return;
+
+        // If the data has not yet been scheduled for readback, we have to do that first.
+        // This should normally have done by calling prepareSyncCPUData() or requestCPUData().
+        if (mScheduledDataVersion < version) prepareSyncCPUData(gpDevice->getRenderContext());
 
-        // If the data has not yet been copied to the staging buffer, we have to do that first.
-        // This should normally have done by calling prepareSyncCPUData().
-        if (!mStagingBufferValid)
+        // Find the oldest pending readback holding the requested version.
+        uint32_t slotIndex = kReadbackRingSize;
+        for (uint32_t i = 0; i < kReadbackRingSize; i++)
         {
-            logWarning("LightCollection::syncCPUData() performance warning - Call LightCollection::prepareSyncCPUData() ahead of time if possible");
-            prepareSyncCPUData(gpDevice->getRenderContext());
+            const auto& slot = mReadbackRing[i];
+            if (!slot.pending || slot.dataVersion < version) continue;
+            if (slotIndex == kReadbackRingSize || slot.dataVersion < mReadbackRing[slotIndex].dataVersion) slotIndex = i;
         }
+        assert(slotIndex != kReadbackRingSize);
 
         // Wait for signal.
-        mpStagingFence->syncCpu();
+        const uint64_t fenceValue = mReadbackRing[slotIndex].fenceValue;
+        if (mpStagingFence->getGpuValue() < fenceValue)
+        {
+            CpuTimer timer;
+            timer.update();
+            mpStagingFence->syncCpu(fenceValue);
+            timer.update();
+
+            mReadbackStats.stallCount++;
+            mReadbackStats.lastStallTime = timer.delta();
+            mReadbackStats.stallTime += mReadbackStats.lastStallTime;
+        }
+
+        resolveReadback(slotIndex);
+    }
 
-        assert(mStagingBufferValid);
-        const void* mappedData = mpStagingBuffer->map(Buffer::MapType::Read);
+    void LightCollection::resolveReadback(uint32_t slotIndex) const
+    {
+        ReadbackSlot& readback = mReadbackRing[slotIndex];
+        assert(readback.pending && readback.dataVersion > mCPUDataVersion);
+
+        const void* mappedData = readback.pStagingBuffer->map(Buffer::MapType::Read);
         const float3* vertexPos = reinterpret_cast<const float3*>(mappedData);
         const float2* vertexTexCrd = reinterpret_cast<const float2*>(reinterpret_cast<uintptr_t>(mappedData) + mpMeshLightsVertexPos->getSize());
         assert(mpTriangleData);
@@ -581,9 +759,9 @@ namespace Falcor
         const EmissiveTriangle* triangleData = reinterpret_cast<const EmissiveTriangle*>(reinterpret_cast<uintptr_t>(mappedData) + mpMeshLightsVertexPos->getSize() + mpMeshLightsTexCoords->getSize());
 
         assert(mTriangleCount > 0);
-        const bool updatePositions = (mCPUInvalidData & CPUOutOfDateFlags::Positions) == CPUOutOfDateFlags::Positions;
-        const bool updateTexCoords = (mCPUInvalidData & CPUOutOfDateFlags::TexCoords) == CPUOutOfDateFlags::TexCoords;
-        const bool updateTriangleData = (mCPUInvalidData & CPUOutOfDateFlags::TriangleData) == CPUOutOfDateFlags::TriangleData;
+        const bool updatePositions = (readback.copiedData & CPUOutOfDateFlags::Positions) == CPUOutOfDateFlags::Positions;
+        const bool updateTexCoords = (readback.copiedData & CPUOutOfDateFlags::TexCoords) == CPUOutOfDateFlags::TexCoords;
+        const bool updateTriangleData = (readback.copiedData & CPUOutOfDateFlags::TriangleData) == CPUOutOfDateFlags::TriangleData;
 
         assert(mMeshLightTriangles.size() == (size_t)mTriangleCount);
         for (uint32_t triIdx = 0; triIdx < mTriangleCount; triIdx++)
@@ -613,8 +791,17 @@ namespace Falcor
             }
         }
 
-        mpStagingBuffer->unmap();
+        readback.pStagingBuffer->unmap();
+        mCPUDataVersion = readback.dataVersion;
 
-        mCPUInvalidData = CPUOutOfDateFlags::None;
+        // Readbacks of older data are no longer needed. The CPU data is now out of date only
+        // with respect to what changed after this readback was scheduled.
+        mCPUInvalidData = mChangedSinceLastCopy;
+        for (auto& slot : mReadbackRing)
+        {
+            if (!slot.pending) continue;
+            if (slot.dataVersion <= mCPUDataVersion) slot.pending = false;
+            else mCPUInvalidData |= slot.changedData;
+        }
     }
 }
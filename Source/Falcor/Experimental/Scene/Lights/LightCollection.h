@@ -27,6 +27,7 @@
  **************************************************************************/
 #pragma once
 #include "MeshLightData.slang"
+#include "EmissiveIntegratorCPU.h"
 
 namespace Falcor
 {
@@ -104,6 +105,51 @@ namespace Falcor
             }
         };
 
+        /** Statistics for reading back the mesh light data from the GPU.
+        */
+        struct ReadbackStats
+        {
+            uint64_t readbackCount = 0;                 ///< Number of readbacks scheduled.
+            uint64_t stallCount = 0;                    ///< Number of times the CPU had to wait for a readback to finish.
+            double   stallTime = 0.0;                   ///< Total time in seconds spent waiting for readbacks.
+            double   lastStallTime = 0.0;               ///< Time in seconds of the last wait.
+        };
+
+        /** Future-like handle to mesh light data that is being read back from the GPU.
+            The handle refers to the version of the GPU data at the time it was requested.
+            It is only valid as long as the light collection it was obtained from.
+        */
+        class CPUDataHandle
+        {
+        public:
+            CPUDataHandle() = default;
+
+            /** Returns true if the handle refers to a light collection.
+            */
+            bool isValid() const { return mpCollection != nullptr; }
+
+            /** Returns true if the data can be accessed with get() without waiting for the GPU.
+            */
+            bool isReady() const { assert(isValid()); return mpCollection->isCPUDataReady(mVersion); }
+
+            /** Returns the mesh light triangles of the requested version or newer.
+                This waits for the GPU if the data is not ready yet.
+            */
+            const std::vector<MeshLightTriangle>& get() const { assert(isValid()); mpCollection->syncCPUData(mVersion); return mpCollection->mMeshLightTriangles; }
+
+            /** Returns the version of the GPU data the handle refers to.
+            */
+            uint64_t getVersion() const { return mVersion; }
+
+        private:
+            CPUDataHandle(const LightCollection* pCollection, uint64_t version) : mpCollection(pCollection), mVersion(version) {}
+
+            const LightCollection* mpCollection = nullptr;
+            uint64_t mVersion = 0;
+
+            friend class LightCollection;
+        };
+
 
         ~LightCollection() = default;
 
@@ -149,13 +195,23 @@ namespace Falcor
             Note that update() must have been called before for the data to be valid.
             Call prepareSyncCPUData() ahead of time to avoid stalling the GPU.
         */
-        const std::vector<MeshLightTriangle>& getMeshLightTriangles() const { syncCPUData(); return mMeshLightTriangles; }
+        const std::vector<MeshLightTriangle>& getMeshLightTriangles() const { syncCPUData(mDataVersion); return mMeshLightTriangles; }
+
+        /** Returns a CPU buffer with the most recent emissive triangles that have been read back from the GPU.
+            The data may be a few frames older than the GPU data, see getCPUDataVersion(). This only waits
+            for the GPU if no data has been read back at all yet.
+        */
+        const std::vector<MeshLightTriangle>& getAvailableMeshLightTriangles() const;
 
         /** Returns a CPU buffer with all mesh lights.
             Note that update() must have been called before for the data to be valid.
         */
         const std::vector<MeshLightData>& getMeshLights() const { return mMeshLights; }
 
+        /** Returns the indices of the mesh lights whose triangles were updated by the last call to update().
+        */
+        const std::vector<uint32_t>& getUpdatedLights() const { return mUpdatedLights; }
+
         /** Prepare for syncing the CPU data.
             If the mesh light triangles will be accessed with getMeshLightTriangles()
             performance can be improved by calling this function ahead of time.
@@ -163,6 +219,24 @@ namespace Falcor
         */
         void prepareSyncCPUData(RenderContext* pRenderContext) const { copyDataToStagingBuffer(pRenderContext); }
 
+        /** Schedule a readback of the current GPU data, unless one is already in flight, and return a handle to it.
+            \param[in] pRenderContext The render context.
+            \return Handle to the data.
+        */
+        CPUDataHandle requestCPUData(RenderContext* pRenderContext) const { copyDataToStagingBuffer(pRenderContext); return CPUDataHandle(this, mDataVersion); }
+
+        /** Returns the version of the GPU data. It is incremented every time the mesh light triangles change.
+        */
+        uint64_t getDataVersion() const { return mDataVersion; }
+
+        /** Returns the version of the GPU data currently stored on the CPU.
+        */
+        uint64_t getCPUDataVersion() const { return mCPUDataVersion; }
+
+        /** Returns statistics for reading back the data from the GPU.
+        */
+        const ReadbackStats& getReadbackStats() const { return mReadbackStats; }
+
         // Internal update flags. This only public for enum_class_operators() to work.
         enum class CPUOutOfDateFlags : uint32_t
         {
@@ -183,17 +257,23 @@ namespace Falcor
         void prepareTriangleData(RenderContext* pRenderContext);
         void prepareMeshData();
         void integrateEmissive(RenderContext* pRenderContext);
+        bool integrateEmissiveCPU();
         void computeStats() const;
         void buildTriangleList(RenderContext* pRenderContext);
         void updateTrianglePositions(RenderContext* pRenderContext, const std::vector<uint32_t>& updatedLights);
 
+        void markGPUDataChanged(CPUOutOfDateFlags flags);
         void copyDataToStagingBuffer(RenderContext* pRenderContext) const;
-        void syncCPUData() const;
+        bool isCPUDataReady(uint64_t version) const;
+        void updateCPUData() const;
+        void syncCPUData(uint64_t version) const;
+        void resolveReadback(uint32_t slotIndex) const;
 
         // Internal state
         std::shared_ptr<Scene>                  mpScene;
 
         std::vector<MeshLightData>              mMeshLights;            ///< List of all mesh lights.
+        std::vector<uint32_t>                   mUpdatedLights;         ///< Indices of the mesh lights updated by the last call to update().
         uint32_t                                mTriangleCount = 0;     ///< Total number of triangles in all mesh lights (= mMeshLightTriangles.size()). This may include culled triangles.
 
         mutable std::vector<MeshLightTriangle>  mMeshLightTriangles;    ///< List of all pre-processed mesh light triangles.
@@ -209,10 +289,28 @@ namespace Falcor
         Buffer::SharedPtr                       mpMeshData;             ///< Per-mesh data for emissive meshes (mMeshLights.size() elements).
         Buffer::SharedPtr                       mpPerMeshInstanceOffset; ///< Per-mesh instance offset into emissive triangles array (Scene::getMeshInstanceCount() elements).
 
-        mutable Buffer::SharedPtr               mpStagingBuffer;        ///< Staging buffer used for retrieving the vertex positions, texture coordinates and light IDs from the GPU.
-        GpuFence::SharedPtr                     mpStagingFence;         ///< Fence used for waiting on the staging buffer being filled in.
+        // Readback of the mesh light data. Copies are made into a ring of staging buffers so that the
+        // CPU can pick up the data a few frames later, instead of waiting for the GPU right away.
+        static const uint32_t kReadbackRingSize = 3;
+
+        struct ReadbackSlot
+        {
+            Buffer::SharedPtr   pStagingBuffer;                             ///< Staging buffer holding the vertex positions, texture coordinates and triangle data.
+            uint64_t            fenceValue = 0;                             ///< Fence value signaled when the copy has finished.
+            uint64_t            dataVersion = 0;                            ///< Version of the GPU data that was copied.
+            CPUOutOfDateFlags   copiedData = CPUOutOfDateFlags::None;       ///< Data that was copied, i.e. everything that was out of date on the CPU at the time.
+            CPUOutOfDateFlags   changedData = CPUOutOfDateFlags::None;      ///< Data that changed on the GPU since the previous copy was scheduled.
+            bool                pending = false;                            ///< True if the copy has been scheduled but not read back yet.
+        };
+
+        mutable std::array<ReadbackSlot, kReadbackRingSize> mReadbackRing; ///< Staging buffers used for retrieving the mesh light data from the GPU.
+        mutable uint32_t                        mNextReadbackSlot = 0;  ///< Index of the slot used for the next readback.
+        GpuFence::SharedPtr                     mpStagingFence;         ///< Fence used for waiting on the staging buffers being filled in.
+        mutable ReadbackStats                   mReadbackStats;         ///< Readback statistics.
 
         Sampler::SharedPtr                      mpSamplerState;         ///< Material sampler for emissive textures.
+        EmissiveIntegratorCPU::SharedPtr        mpCPUIntegrator;        ///< CPU integrator for emissive textures, or nullptr if the sampler's address modes are not supported.
+        bool                                    mLastIntegrationOnCPU = false; ///< True if the last integration of emissive textures ran on the CPU.
 
         // Shader programs.
         struct
@@ -228,8 +326,11 @@ namespace Falcor
         ComputePass::SharedPtr                  mpTrianglePositionUpdater;
         ComputePass::SharedPtr                  mpFinalizeIntegration;
 
-        mutable CPUOutOfDateFlags               mCPUInvalidData = CPUOutOfDateFlags::None;  ///< Flags indicating which CPU data is valid.
-        mutable bool                            mStagingBufferValid = true;                 ///< Flag to indicate if the contents of the staging buffer is up-to-date.
+        mutable CPUOutOfDateFlags               mCPUInvalidData = CPUOutOfDateFlags::None;  ///< Flags indicating which CPU data is out of date with respect to the GPU data.
+        mutable CPUOutOfDateFlags               mChangedSinceLastCopy = CPUOutOfDateFlags::None; ///< Flags indicating which GPU data changed since the last readback was scheduled.
+        uint64_t                                mDataVersion = 0;                           ///< Version of the GPU data.
+        mutable uint64_t                        mCPUDataVersion = 0;                        ///< Version of the GPU data stored on the CPU. Zero if nothing has been read back yet.
+        mutable uint64_t                        mScheduledDataVersion = 0;                  ///< Version of the GPU data of the most recent readback.
     };
 
     enum_class_operators(LightCollection::CPUOutOfDateFlags);
@@ -0,0 +1,453 @@
+/***************************************************************************
+ # Copyright (c) 2020, NVIDIA CORPORATION. All rights reserved.
+ #
+ # Redistribution and use in source and binary forms, with or without
+ # modification, are permitted provided that the following conditions
+ # are met:
+ #  * Redistributions of source code must retain the above copyright
+ #    notice, this list of conditions and the following disclaimer.
+ #  * Redistributions in binary form must reproduce the above copyright
+ #    notice, this list of conditions and the following disclaimer in the
+ #    documentation and/or other materials provided with the distribution.
+ #  * Neither the name of NVIDIA CORPORATION nor the names of its
+ #    contributors may be used to endorse or promote products derived
+ #    from this software without specific prior written permission.
+ #
+ # THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ # EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ # IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ # PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ # CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ # EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ # PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ # PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ # OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ # (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ # OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **************************************************************************/
+#include "stdafx.h"
+#include "WideLightBVH.h"
+#include "LightBVHSamplerHelpers.h"
+
+#include <cmath>
+
+namespace
+{
+    using namespace Falcor;
+
+    const uint32_t kQuantizationSteps = 65534;  // One step of headroom so rounding up never runs out of range.
+    const float kSnormScale = 32767.f;
+
+    float exponentScale(int8_t exponent)
+    {
+        return std::ldexp(1.f, exponent);
+    }
+
+    float signNotZero(float v)
+    {
+        return v >= 0.f ? 1.f : -1.f;
+    }
+
+    uint32_t encodeOctahedral(const float3& dir)
+    {
+        float2 p = float2(dir.x, dir.y) / (std::abs(dir.x) + std::abs(dir.y) + std::abs(dir.z));
+        if (dir.z < 0.f) p = float2((1.f - std::abs(p.y)) * signNotZero(p.x), (1.f - std::abs(p.x)) * signNotZero(p.y));
+        uint32_t x = uint32_t(std::lround(glm::clamp(p.x * 0.5f + 0.5f, 0.f, 1.f) * 65535.f));
+        uint32_t y = uint32_t(std::lround(glm::clamp(p.y * 0.5f + 0.5f, 0.f, 1.f) * 65535.f));
+        return x | (y << 16);
+    }
+
+    float3 decodeOctahedral(uint32_t packed)
+    {
+        float2 p = float2(float(packed & 0xffff), float(packed >> 16)) / 65535.f * 2.f - 1.f;
+        float3 n(p.x, p.y, 1.f - std::abs(p.x) - std::abs(p.y));
+        if (n.z < 0.f) n = float3((1.f - std::abs(p.y)) * signNotZero(p.x), (1.f - std::abs(p.x)) * signNotZero(p.y), n.z);
+        return glm::normalize(n);
+    }
+
+    void decodeChildBounds(const WideLightBVH::Node& node, uint32_t slot, float3& aabbMin, float3& aabbMax)
+    {
+        for (uint32_t axis = 0; axis < 3; axis++)
+        {
+            const float scale = exponentScale(node.scaleExponent[axis]);
+            aabbMin[axis] = node.origin[axis] + float(node.childMin[axis][slot]) * scale;
+            aabbMax[axis] = node.origin[axis] + float(node.childMax[axis][slot]) * scale;
+        }
+    }
+
+    void decodeChildCone(const WideLightBVH::Node& node, uint32_t slot, float3& coneDirection, float& cosConeAngle)
+    {
+        if (node.childCosConeAngle[slot] <= -(int16_t)kSnormScale)
+        {
+            coneDirection = float3(0.f);
+            cosConeAngle = kInvalidCosConeAngle;
+            return;
+        }
+        coneDirection = decodeOctahedral(node.childConeDirection[slot]);
+        cosConeAngle = float(node.childCosConeAngle[slot]) / kSnormScale;
+    }
+}
+
+namespace Falcor
+{
+    struct WideLightBVH::ChildInfo
+    {
+        BBox bounds;
+        float flux = 0.f;
+        float3 coneDirection = float3(0.f);
+        float cosConeAngle = kInvalidCosConeAngle;
+        uint32_t nodeOffset = LightBVH::kInvalidOffset;    ///< Byte offset of the node in the binary BVH.
+        const LightBVH::LeafNode* pLeaf = nullptr;          ///< Non-null if the node is a leaf.
+    };
+
+    WideLightBVH::ChildInfo WideLightBVH::getChildInfo(const LightBVH& bvh, uint32_t nodeOffset)
+    {
+        auto fill = [](ChildInfo& info, const auto* pNode)
+        {
+            info.bounds.minPoint = pNode->aabbMin;
+            info.bounds.maxPoint = pNode->aabbMax;
+            info.flux = pNode->luminousFlux;
+            info.coneDirection = pNode->coneDirection;
+            info.cosConeAngle = pNode->cosConeAngle;
+        };
+
+        ChildInfo info;
+        info.nodeOffset = nodeOffset;
+        if (const LightBVH::InternalNode* pNode = bvh.getInternalNode(nodeOffset))
+        {
+            fill(info, pNode);
+        }
+        else
+        {
+            info.pLeaf = bvh.getLeafNode(nodeOffset);
+            fill(info, info.pLeaf);
+        }
+        return info;
+    }
+
+    WideLightBVH::SharedPtr WideLightBVH::create(const LightBVH::SharedConstPtr& pBVH, const LightCollection::SharedConstPtr& pLightCollection)
+    {
+        if (!pBVH || !pBVH->isValid() || !pLightCollection)
+        {
+            logError("WideLightBVH::create() - The light BVH must be built before it can be collapsed.");
+            return nullptr;
+        }
+
+        const auto& bvhStats = pBVH->getStats();
+        if (bvhStats.leafCountPerTriangleCount.size() > kMaxTrianglesPerLeaf + 1)
+        {
+            logError("WideLightBVH::create() - Leaf nodes must not hold more than " + std::to_string(kMaxTrianglesPerLeaf) + " triangles.");
+            return nullptr;
+        }
+
+        SharedPtr pWideBVH = SharedPtr(new WideLightBVH(pLightCollection));
+        pWideBVH->mTriangleLocations.assign(pLightCollection->getTotalLightCount(), kInvalidIndex);
+        pWideBVH->mNodes.reserve(bvhStats.internalNodeCount / 2 + 1);
+        pWideBVH->mNodeParents.reserve(bvhStats.internalNodeCount / 2 + 1);
+        pWideBVH->mTriangleIndices.reserve(bvhStats.triangleCount);
+        pWideBVH->collapse(*pBVH, getChildInfo(*pBVH, 0), kInvalidIndex, 1);
+
+        auto& stats = pWideBVH->mStats;
+        stats.nodeCount = (uint32_t)pWideBVH->mNodes.size();
+        stats.triangleCount = (uint32_t)pWideBVH->mTriangleIndices.size();
+        stats.byteSize = pWideBVH->mNodes.size() * sizeof(Node) + pWideBVH->mTriangleIndices.size() * sizeof(uint32_t);
+        for (const Node& node : pWideBVH->mNodes)
+        {
+            stats.emptySlotCount += kWidth - node.childCount;
+            for (uint32_t slot = 0; slot < node.childCount; slot++) stats.leafCount += node.isLeaf(slot) ? 1 : 0;
+        }
+
+        return pWideBVH;
+    }
+
+    uint32_t WideLightBVH::collapse(const LightBVH& bvh, const ChildInfo& root, uint32_t parentRef, uint32_t depth)
+    {
+        // Open up the internal node with the largest surface area until all child slots are used.
+        std::vector<ChildInfo> children = { root };
+        while (children.size() < kWidth)
+        {
+            int bestChild = -1;
+            float bestArea = -1.f;
+            for (size_t i = 0; i < children.size(); i++)
+            {
+                if (children[i].pLeaf) continue;
+                float area = children[i].bounds.surfaceArea();
+                if (area > bestArea)
+                {
+                    bestArea = area;
+                    bestChild = (int)i;
+                }
+            }
+            if (bestChild < 0) break;
+
+            const LightBVH::InternalNode* pNode = bvh.getInternalNode(children[bestChild].nodeOffset);
+            children[bestChild] = getChildInfo(bvh, pNode->leftNodeOffset);
+            children.insert(children.begin() + bestChild + 1, getChildInfo(bvh, pNode->rightNodeOffset));
+        }
+
+        const uint32_t nodeIndex = (uint32_t)mNodes.size();
+        mNodes.emplace_back();
+        mNodeParents.push_back(parentRef);
+        mStats.treeHeight = std::max(mStats.treeHeight, depth);
+        encodeNode(mNodes[nodeIndex], children);
+
+        for (uint32_t slot = 0; slot < (uint32_t)children.size(); slot++)
+        {
+            const ChildInfo& child = children[slot];
+            const uint32_t childRef = (nodeIndex << 2) | slot;
+            if (child.pLeaf)
+            {
+                assert(child.pLeaf->triangleCount > 0 && child.pLeaf->triangleCount <= kMaxTrianglesPerLeaf);
+                mNodes[nodeIndex].childTriangleCount[slot] = (uint8_t)child.pLeaf->triangleCount;
+                mNodes[nodeIndex].childOffset[slot] = (uint32_t)mTriangleIndices.size();
+                for (uint32_t i = 0; i < child.pLeaf->triangleCount; i++)
+                {
+                    const uint32_t triangleIndex = child.pLeaf->triangleIndices[i];
+                    mTriangleIndices.push_back(triangleIndex);
+                    if (triangleIndex < mTriangleLocations.size()) mTriangleLocations[triangleIndex] = childRef;
+                }
+            }
+            else
+            {
+                // Note: the recursion may reallocate mNodes, so the node is only accessed by index.
+                const uint32_t childIndex = collapse(bvh, child, childRef, depth + 1);
+                mNodes[nodeIndex].childTriangleCount[slot] = 0;
+                mNodes[nodeIndex].childOffset[slot] = childIndex;
+            }
+        }
+
+        return nodeIndex;
+    }
+
+    void WideLightBVH::encodeNode(Node& node, const std::vector<ChildInfo>& children) const
+    {
+        assert(!children.empty() && children.size() <= kWidth);
+
+        BBox nodeBounds;
+        for (const ChildInfo& child : children) nodeBounds |= child.bounds;
+
+        node = Node();
+        node.origin = nodeBounds.minPoint;
+        node.childCount = (uint8_t)children.size();
+        node.pad = 0;
+
+        for (uint32_t axis = 0; axis < 3; axis++)
+        {
+            // Pick the smallest power-of-two step that covers the node extent.
+            const float extent = nodeBounds.maxPoint[axis] - nodeBounds.minPoint[axis];
+            int exponent = extent > 0.f ? (int)std::ceil(std::log2(extent / kQuantizationSteps)) : std::numeric_limits<int8_t>::min();
+            exponent = glm::clamp(exponent, (int)std::numeric_limits<int8_t>::min(), (int)std::numeric_limits<int8_t>::max());
+            node.scaleExponent[axis] = (int8_t)exponent;
+
+            const float origin = node.origin[axis];
+            const float scale = exponentScale(node.scaleExponent[axis]);
+            auto decode = [origin, scale](uint32_t q) { return origin + float(q) * scale; };
+
+            for (uint32_t slot = 0; slot < kWidth; slot++)
+            {
+                if (slot >= children.size())
+                {
+                    node.childMin[axis][slot] = 0;
+                    node.childMax[axis][slot] = 0;
+                    continue;
+                }
+
+                // Round outwards, then correct for floating-point rounding in the decode so the bounds stay conservative.
+                const float childMin = children[slot].bounds.minPoint[axis];
+                const float childMax = children[slot].bounds.maxPoint[axis];
+                uint32_t qMin = (uint32_t)glm::clamp(std::floor((childMin - origin) / scale), 0.f, 65535.f);
+                uint32_t qMax = (uint32_t)glm::clamp(std::ceil((childMax - origin) / scale), 0.f, 65535.f);
+                while (qMin > 0 && decode(qMin) > childMin) qMin--;
+                while (qMax < 65535 && decode(qMax) < childMax) qMax++;
+                node.childMin[axis][slot] = (uint16_t)qMin;
+                node.childMax[axis][slot] = (uint16_t)qMax;
+            }
+        }
+
+        for (uint32_t slot = 0; slot < (uint32_t)children.size(); slot++)
+        {
+            const ChildInfo& child = children[slot];
+            node.childFlux[slot] = child.flux;
+
+            if (child.cosConeAngle == kInvalidCosConeAngle)
+            {
+                node.childConeDirection[slot] = 0;
+                node.childCosConeAngle[slot] = -(int16_t)kSnormScale;
+                continue;
+            }
+
+            // Widen the cone by the angular error of the encoded direction so it still bounds all emitter normals.
+            node.childConeDirection[slot] = encodeOctahedral(child.coneDirection);
+            const float3 decodedDirection = decodeOctahedral(node.childConeDirection[slot]);
+            const float errorAngle = std::acos(glm::clamp(glm::dot(glm::normalize(child.coneDirection), decodedDirection), -1.f, 1.f));
+            const float coneAngle = std::acos(glm::clamp(child.cosConeAngle, -1.f, 1.f)) + errorAngle;
+            const float cosConeAngle = coneAngle >= glm::pi<float>() ? -1.f : std::cos(coneAngle);
+
+            int q = glm::clamp((int)std::floor(cosConeAngle * kSnormScale), -(int)kSnormScale, (int)kSnormScale);
+            while (q > -(int)kSnormScale && float(q) / kSnormScale > cosConeAngle) q--;
+            node.childCosConeAngle[slot] = (int16_t)q;
+        }
+    }
+
+    void WideLightBVH::getChildBounds(uint32_t nodeIndex, uint32_t slot, float3& aabbMin, float3& aabbMax) const
+    {
+        decodeChildBounds(mNodes[nodeIndex], slot, aabbMin, aabbMax);
+    }
+
+    void WideLightBVH::getChildCone(uint32_t nodeIndex, uint32_t slot, float3& coneDirection, float& cosConeAngle) const
+    {
+        decodeChildCone(mNodes[nodeIndex], slot, coneDirection, cosConeAngle);
+    }
+
+    float WideLightBVH::computeChildImportance(const Node& node, uint32_t slot, const float3& posW, const float3& normalW, const LightBVHSampler::Options& options) const
+    {
+        float3 aabbMin, aabbMax, coneDirection;
+        float cosConeAngle;
+        decodeChildBounds(node, slot, aabbMin, aabbMax);
+        decodeChildCone(node, slot, coneDirection, cosConeAngle);
+        return LightBVHSamplerHelpers::computeNodeImportance(posW, normalW, aabbMin, aabbMax, node.childFlux[slot], coneDirection, cosConeAngle, options);
+    }
+
+    float WideLightBVH::computeChildProbability(uint32_t nodeIndex, uint32_t slot, const float3& posW, const float3& normalW, const LightBVHSampler::Options& options) const
+    {
+        const Node& node = mNodes[nodeIndex];
+        float importance = 0.f;
+        float totalImportance = 0.f;
+        for (uint32_t i = 0; i < node.childCount; i++)
+        {
+            float childImportance = computeChildImportance(node, i, posW, normalW, options);
+            if (i == slot) importance = childImportance;
+            totalImportance += childImportance;
+        }
+        return totalImportance > 0.f ? importance / totalImportance : 0.f;
+    }
+
+    float WideLightBVH::computeTriangleImportance(uint32_t triangleIndex, const float3& posW, const float3& normalW) const
+    {
+        const auto& triangle = mpLightCollection->getMeshLightTriangles()[triangleIndex];
+        const float3 vertices[3] = { triangle.vtx[0].pos, triangle.vtx[1].pos, triangle.vtx[2].pos };
+        return LightBVHSamplerHelpers::computeTriangleImportance(posW, normalW, vertices);
+    }
+
+    float WideLightBVH::computeTriangleProbability(uint32_t nodeIndex, uint32_t slot, uint32_t triangleIndex, const float3& posW, const float3& normalW, const LightBVHSampler::Options& options) const
+    {
+        const Node& node = mNodes[nodeIndex];
+        const uint32_t triangleCount = node.childTriangleCount[slot];
+        if (options.useUniformTriangleSampling) return 1.f / (float)triangleCount;
+
+        float importance = 0.f;
+        float totalImportance = 0.f;
+        for (uint32_t i = 0; i < triangleCount; i++)
+        {
+            const uint32_t index = mTriangleIndices[node.childOffset[slot] + i];
+            float triangleImportance = computeTriangleImportance(index, posW, normalW);
+            if (index == triangleIndex) importance = triangleImportance;
+            totalImportance += triangleImportance;
+        }
+        return totalImportance > 0.f ? importance / totalImportance : 0.f;
+    }
+
+    bool WideLightBVH::sampleLight(const float3& posW, const float3& normalW, float u, const LightBVHSampler::Options& options, uint32_t& triangleIndex, float& pdf) const
+    {
+        if (mNodes.empty()) return false;
+
+        // Pick a slot proportionally to the given importances and rescale u to [0,1) for the next decision.
+        // Zero-importance slots are never picked, even if u lands on the upper end due to rounding.
+        auto pick = [&u](const float* importance, uint32_t count, float totalImportance, float& p)
+        {
+            const float uScaled = u * totalImportance;
+            float cdf = 0.f;
+            uint32_t picked = kInvalidIndex;
+            float cdfBefore = 0.f;
+            for (uint32_t i = 0; i < count; i++)
+            {
+                if (importance[i] <= 0.f) continue;
+                picked = i;
+                cdfBefore = cdf;
+                cdf += importance[i];
+                if (uScaled < cdf) break;
+            }
+            p = importance[picked] / totalImportance;
+            u = glm::clamp((uScaled - cdfBefore) / importance[picked], 0.f, std::nextafter(1.f, 0.f));
+            return picked;
+        };
+
+        uint32_t nodeIndex = 0;
+        pdf = 1.f;
+        while (true)
+        {
+            const Node& node = mNodes[nodeIndex];
+
+            float importance[kWidth];
+            float totalImportance = 0.f;
+            for (uint32_t slot = 0; slot < node.childCount; slot++)
+            {
+                importance[slot] = computeChildImportance(node, slot, posW, normalW, options);
+                totalImportance += importance[slot];
+            }
+            if (!(totalImportance > 0.f)) return false;
+
+            float p;
+            const uint32_t slot = pick(importance, node.childCount, totalImportance, p);
+            pdf *= p;
+
+            if (!node.isLeaf(slot))
+            {
+                nodeIndex = node.childOffset[slot];
+                continue;
+            }
+
+            // Pick a triangle within the leaf.
+            const uint32_t triangleCount = node.childTriangleCount[slot];
+            const uint32_t* pTriangles = mTriangleIndices.data() + node.childOffset[slot];
+            if (options.useUniformTriangleSampling)
+            {
+                triangleIndex = pTriangles[std::min((uint32_t)(u * triangleCount), triangleCount - 1)];
+                pdf /= (float)triangleCount;
+                return true;
+            }
+
+            float triangleImportance[kMaxTrianglesPerLeaf];
+            float totalTriangleImportance = 0.f;
+            for (uint32_t i = 0; i < triangleCount; i++)
+            {
+                triangleImportance[i] = computeTriangleImportance(pTriangles[i], posW, normalW);
+                totalTriangleImportance += triangleImportance[i];
+            }
+            if (!(totalTriangleImportance > 0.f)) return false;
+
+            const uint32_t picked = pick(triangleImportance, triangleCount, totalTriangleImportance, p);
+            triangleIndex = pTriangles[picked];
+            pdf *= p;
+            return true;
+        }
+    }
+
+    float WideLightBVH::evalPdf(const float3& posW, const float3& normalW, uint32_t triangleIndex, const LightBVHSampler::Options& options) const
+    {
+        if (triangleIndex >= mTriangleLocations.size() || mTriangleLocations[triangleIndex] == kInvalidIndex) return 0.f;
+
+        // Walk from the triangle's leaf up to the root, multiplying the selection probabilities along the path.
+        uint32_t location = mTriangleLocations[triangleIndex];
+        float pdf = computeTriangleProbability(location >> 2, location & 3, triangleIndex, posW, normalW, options);
+        while (location != kInvalidIndex && pdf > 0.f)
+        {
+            const uint32_t nodeIndex = location >> 2;
+            pdf *= computeChildProbability(nodeIndex, location & 3, posW, normalW, options);
+            location = mNodeParents[nodeIndex];
+        }
+        return pdf;
+    }
+
+    void WideLightBVH::renderUI(Gui::Widgets& widget) const
+    {
+        const std::string statsStr =
+            "  Tree height:         " + std::to_string(mStats.treeHeight) + "\n" +
+            "  Size:                " + std::to_string(mStats.byteSize) + " bytes\n" +
+            "  Node count:          " + std::to_string(mStats.nodeCount) + "\n" +
+            "  Leaf count:          " + std::to_string(mStats.leafCount) + "\n" +
+            "  Empty slot count:    " + std::to_string(mStats.emptySlotCount) + "\n" +
+            "  Triangle count:      " + std::to_string(mStats.triangleCount);
+        widget.text(statsStr.c_str());
+    }
+}
@@ -0,0 +1,156 @@
+/***************************************************************************
+ # Copyright (c) 2020, NVIDIA CORPORATION. All rights reserved.
+ #
+ # Redistribution and use in source and binary forms, with or without
+ # modification, are permitted provided that the following conditions
+ # are met:
+ #  * Redistributions of source code must retain the above copyright
+ #    notice, this list of conditions and the following disclaimer.
+ #  * Redistributions in binary form must reproduce the above copyright
+ #    notice, this list of conditions and the following disclaimer in the
+ #    documentation and/or other materials provided with the distribution.
+ #  * Neither the name of NVIDIA CORPORATION nor the names of its
+ #    contributors may be used to endorse or promote products derived
+ #    from this software without specific prior written permission.
+ #
+ # THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ # EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ # IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ # PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ # CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ # EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ # PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ # PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ # OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ # (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ # OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **************************************************************************/
+#pragma once
+#include "LightBVH.h"
+#include "LightBVHSampler.h"
+#include "LightCollection.h"
+
+#include <limits>
+#include <vector>
+
+namespace Falcor
+{
+    /** Compressed 4-wide light BVH.
+
+        The tree is produced by collapsing a binary LightBVH: every wide node stores its (up to) four children
+        directly, with child bounds quantized to 16 bits relative to the parent, octahedral cone directions and
+        snorm cone angles. A node is 128 bytes and the tree is roughly half as deep as the binary one, so a
+        traversal does half as many dependent node fetches.
+
+        Quantization is conservative: decoded child bounds always enclose the exact bounds and decoded
+        light cones always enclose the exact cones. Flux is stored at full precision, since rounding small
+        children to zero would make their lights impossible to sample.
+
+        The class currently provides the CPU layout, the collapse pass and a reference implementation of
+        sampling and pdf evaluation that matches LightBVHSampler.slang for the given options.
+    */
+    class dlldecl WideLightBVH
+    {
+    public:
+        using SharedPtr = std::shared_ptr<WideLightBVH>;
+        using SharedConstPtr = std::shared_ptr<const WideLightBVH>;
+
+        static const uint32_t kWidth = 4;
+        static const uint32_t kInvalidIndex = std::numeric_limits<uint32_t>::max();
+        static const uint32_t kMaxTrianglesPerLeaf = std::numeric_limits<uint8_t>::max();
+
+        struct Node
+        {
+            float3   origin;                            ///< Min-corner of the node bounds; the quantization origin of the children.
+            int8_t   scaleExponent[3];                  ///< Per-axis quantization step is 2^scaleExponent.
+            uint8_t  childCount = 0;                    ///< Number of valid child slots.
+
+            uint16_t childMin[3][kWidth];               ///< Quantized child AABB min-corners, per axis (rounded down).
+            uint16_t childMax[3][kWidth];               ///< Quantized child AABB max-corners, per axis (rounded up).
+
+            float    childFlux[kWidth];                 ///< Luminous flux of each child.
+            uint32_t childConeDirection[kWidth];        ///< Octahedral encoded cone directions, 2x16 bits.
+            int16_t  childCosConeAngle[kWidth];         ///< Snorm cone angle cosines, rounded down. -1 is kInvalidCosConeAngle.
+            uint8_t  childTriangleCount[kWidth];        ///< Number of triangles if the child is a leaf, 0 if it is a wide node.
+            uint32_t childOffset[kWidth];               ///< Node index for wide node children, offset into the triangle index array for leaves.
+            uint32_t pad;
+
+            bool isLeaf(uint32_t slot) const { return childTriangleCount[slot] > 0; }
+        };
+        static_assert(sizeof(Node) == 128, "WideLightBVH::Node must be 128 bytes");
+
+        struct Stats
+        {
+            uint32_t nodeCount = 0;                     ///< Number of wide nodes.
+            uint32_t leafCount = 0;                     ///< Number of leaf children.
+            uint32_t triangleCount = 0;                 ///< Number of triangles referenced by leaves.
+            uint32_t treeHeight = 0;                    ///< Number of wide nodes on the longest path from the root to a leaf.
+            uint32_t emptySlotCount = 0;                ///< Number of unused child slots.
+            uint64_t byteSize = 0;                      ///< Bytes occupied by the nodes and triangle indices.
+        };
+
+        /** Creates a wide BVH by collapsing a built binary light BVH.
+            \param[in] pBVH The binary light BVH. It must be valid.
+            \param[in] pLightCollection The light collection the BVH was built over.
+            \return The wide BVH, or nullptr if the binary BVH cannot be collapsed.
+        */
+        static SharedPtr create(const LightBVH::SharedConstPtr& pBVH, const LightCollection::SharedConstPtr& pLightCollection);
+
+        /** Samples a triangle by traversing the wide BVH.
+            \param[in] posW Shading point in world space.
+            \param[in] normalW Normal at the shading point in world space.
+            \param[in] u Uniform random number in [0,1).
+            \param[in] options Sampler options; the same options as the GPU sampler produce the same probabilities.
+            \param[out] triangleIndex Global index of the sampled triangle, only valid if true is returned.
+            \param[out] pdf Probability of selecting the triangle, only valid if true is returned.
+            \return True if a triangle was sampled, false otherwise.
+        */
+        bool sampleLight(const float3& posW, const float3& normalW, float u, const LightBVHSampler::Options& options, uint32_t& triangleIndex, float& pdf) const;
+
+        /** Evaluates the probability of selecting a triangle with sampleLight().
+            \param[in] posW Shading point in world space.
+            \param[in] normalW Normal at the shading point in world space.
+            \param[in] triangleIndex Global triangle index.
+            \param[in] options Sampler options.
+            \return Probability of selecting the triangle.
+        */
+        float evalPdf(const float3& posW, const float3& normalW, uint32_t triangleIndex, const LightBVHSampler::Options& options) const;
+
+        /** Decodes the bounds of a child.
+        */
+        void getChildBounds(uint32_t nodeIndex, uint32_t slot, float3& aabbMin, float3& aabbMax) const;
+
+        /** Decodes the light cone of a child.
+        */
+        void getChildCone(uint32_t nodeIndex, uint32_t slot, float3& coneDirection, float& cosConeAngle) const;
+
+        const std::vector<Node>& getNodes() const { return mNodes; }
+        const std::vector<uint32_t>& getTriangleIndices() const { return mTriangleIndices; }
+        const Stats& getStats() const { return mStats; }
+
+        /** Render the stats.
+        */
+        void renderUI(Gui::Widgets& widget) const;
+
+    protected:
+        WideLightBVH(const LightCollection::SharedConstPtr& pLightCollection) : mpLightCollection(pLightCollection) {}
+
+        struct ChildInfo;
+
+        static ChildInfo getChildInfo(const LightBVH& bvh, uint32_t nodeOffset);
+        uint32_t collapse(const LightBVH& bvh, const ChildInfo& root, uint32_t parentRef, uint32_t depth);
+        void encodeNode(Node& node, const std::vector<ChildInfo>& children) const;
+        float computeChildImportance(const Node& node, uint32_t slot, const float3& posW, const float3& normalW, const LightBVHSampler::Options& options) const;
+        float computeChildProbability(uint32_t nodeIndex, uint32_t slot, const float3& posW, const float3& normalW, const LightBVHSampler::Options& options) const;
+        float computeTriangleProbability(uint32_t nodeIndex, uint32_t slot, uint32_t triangleIndex, const float3& posW, const float3& normalW, const LightBVHSampler::Options& options) const;
+        float computeTriangleImportance(uint32_t triangleIndex, const float3& posW, const float3& normalW) const;
+
+        const LightCollection::SharedConstPtr mpLightCollection;
+
+        std::vector<Node>       mNodes;                 ///< Wide nodes in depth-first order; the root is node 0.
+        std::vector<uint32_t>   mTriangleIndices;       ///< Global triangle indices of all leaves.
+        std::vector<uint32_t>   mNodeParents;           ///< Per node: (parent node index << 2) | slot, kInvalidIndex for the root.
+        std::vector<uint32_t>   mTriangleLocations;     ///< Per global triangle: (node index << 2) | slot of its leaf, kInvalidIndex if not in the tree.
+        Stats                   mStats;
+    };
+}
@@ -110,6 +110,7 @@
 #include "Scene/Importers/SceneImporter.h"
 #include "Scene/Camera/Camera.h"
 #include "Scene/Camera/CameraController.h"
+#include "Scene/Camera/CameraPath.h"
 #include "Scene/Lights/Light.h"
 #include "Scene/Lights/LightProbe.h"
 #include "Scene/Material/Material.h"
@@ -131,6 +132,8 @@
 #include "Utils/Algorithm/DirectedGraphTraversal.h"
 #include "Utils/Algorithm/ParallelReduction.h"
 #include "Utils/Image/Bitmap.h"
+#include "Utils/Image/ExrImageIO.h"
+#include "Utils/Image/ImageWriteQueue.h"
 #include "Utils/Math/CubicSpline.h"
 #include "Utils/Math/FalcorMath.h"
 #include "Utils/Scripting/Dictionary.h"
@@ -29,3 +29,4 @@
 #include "Experimental/Scene/Lights/EnvProbe.h"
 #include "Experimental/Scene/Lights/EmissiveLightSampler.h"
 #include "Experimental/Scene/Lights/EmissiveUniformSampler.h"
+#include "Experimental/Scene/Lights/EmissivePowerSampler.h"
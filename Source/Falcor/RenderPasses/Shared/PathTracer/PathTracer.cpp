@@ -68,6 +68,7 @@ namespace Falcor
         {
             { (uint32_t)EmissiveLightSamplerType::Uniform, "Uniform" },
             { (uint32_t)EmissiveLightSamplerType::LightBVH, "LightBVH" },
+            { (uint32_t)EmissiveLightSamplerType::Power, "Power" },
         };
     };
 
@@ -284,6 +285,9 @@ namespace Falcor
                     case EmissiveLightSamplerType::LightBVH:
                         mLightBVHSamplerOptions = std::static_pointer_cast<LightBVHSampler>(mpEmissiveSampler)->getOptions();
                         break;
+                    case EmissiveLightSamplerType::Power:
+                        mPowerSamplerOptions = std::static_pointer_cast<EmissivePowerSampler>(mpEmissiveSampler)->getOptions();
+                        break;
                     default:
                         should_not_get_here();
                     }
@@ -439,6 +443,9 @@ namespace Falcor
                     case EmissiveLightSamplerType::LightBVH:
                         mpEmissiveSampler = LightBVHSampler::create(pRenderContext, mpScene, mLightBVHSamplerOptions);
                         break;
+                    case EmissiveLightSamplerType::Power:
+                        mpEmissiveSampler = EmissivePowerSampler::create(pRenderContext, mpScene, mPowerSamplerOptions);
+                        break;
                     default:
                         logError("Unknown emissive light sampler type");
                     }
@@ -33,6 +33,7 @@
 #include "Experimental/Scene/Lights/EnvProbe.h"
 #include "Experimental/Scene/Lights/EmissiveUniformSampler.h"
 #include "Experimental/Scene/Lights/LightBVHSampler.h"
+#include "Experimental/Scene/Lights/EmissivePowerSampler.h"
 #include "RenderGraph/RenderPassHelpers.h"
 #include "PathTracerParams.slang"
 #include "PixelStats.h"
@@ -92,6 +93,7 @@ namespace Falcor
 
         EmissiveUniformSampler::Options     mUniformSamplerOptions;         ///< Current options for the uniform sampler.
         LightBVHSampler::Options            mLightBVHSamplerOptions;        ///< Current options for the light BVH sampler.
+        EmissivePowerSampler::Options       mPowerSamplerOptions;           ///< Current options for the power sampler.
 
         // Runtime data
         bool                                mOptionsChanged = false;        ///< True if the config has changed since last frame.
@@ -117,6 +119,7 @@ namespace Falcor
             serialize(mSelectedEmissiveSampler);
             serialize(mUniformSamplerOptions);
             serialize(mLightBVHSamplerOptions);
+            serialize(mPowerSamplerOptions);
 
             if constexpr (loadFromDict)
             {
@@ -28,11 +28,192 @@
 #include "stdafx.h"
 #include "Animation.h"
 #include "glm/gtc/quaternion.hpp"
-#include "glm/gtx/transform.hpp"
 #include "AnimationController.h"
 
+#include <iomanip>
+#include <limits>
+#include <random>
+#include <sstream>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#define FALCOR_ANIMATION_USE_SSE 1
+#include <emmintrin.h>
+#else
+#define FALCOR_ANIMATION_USE_SSE 0
+#endif
+
 namespace Falcor
 {
+    namespace
+    {
+        const size_t kChannelBatchSize = 4;         // Number of channels interpolated together.
+        const uint32_t kParallelBatchCount = 64;    // Minimum number of batches to evaluate an animation on multiple threads.
+        const uint32_t kBatchesPerTask = 16;        // Number of batches evaluated by a worker at a time.
+
+        /** Keyframes of a batch of channels, stored per component. Index 0 is the keyframe before the current time, index 1 the one after it.
+        */
+        struct ChannelBatch
+        {
+            alignas(16) float factor[kChannelBatchSize] = {};
+            alignas(16) float translation[2][3][kChannelBatchSize] = {};
+            alignas(16) float scaling[2][3][kChannelBatchSize] = {};
+            alignas(16) float rotation[2][4][kChannelBatchSize] = {};   // x, y, z, w
+
+            ChannelBatch()
+            {
+                for (size_t lane = 0; lane < kChannelBatchSize; lane++)
+                {
+                    setLane(lane, 0, float3(0), float3(1), glm::quat(1, 0, 0, 0));
+                    setLane(lane, 1, float3(0), float3(1), glm::quat(1, 0, 0, 0));
+                }
+            }
+
+            void setLane(size_t lane, size_t key, const float3& t, const float3& s, const glm::quat& q)
+            {
+                for (int i = 0; i < 3; i++)
+                {
+                    translation[key][i][lane] = t[i];
+                    scaling[key][i][lane] = s[i];
+                }
+                rotation[key][0][lane] = q.x;
+                rotation[key][1][lane] = q.y;
+                rotation[key][2][lane] = q.z;
+                rotation[key][3][lane] = q.w;
+            }
+        };
+
+        /** Affine transforms of a batch of channels, stored per component.
+        */
+        struct TransformBatch
+        {
+            alignas(16) float linear[3][3][kChannelBatchSize];  // [column][row]
+            alignas(16) float translation[3][kChannelBatchSize];
+
+            glm::mat4 getLane(size_t lane) const
+            {
+                glm::mat4 m;
+                for (int c = 0; c < 3; c++) m[c] = float4(linear[c][0][lane], linear[c][1][lane], linear[c][2][lane], 0.f);
+                m[3] = float4(translation[0][lane], translation[1][lane], translation[2][lane], 1.f);
+                return m;
+            }
+        };
+
+        /** Computes the slerp weights of the two rotations, given the cosine of the angle between them (after flipping to the shortest path).
+            Nearly identical rotations are interpolated linearly, as in glm::slerp().
+        */
+        void computeSlerpWeights(float cosTheta, float a, float& w0, float& w1)
+        {
+            if (cosTheta > 1.f - std::numeric_limits<float>::epsilon())
+            {
+                w0 = 1.f - a;
+                w1 = a;
+            }
+            else
+            {
+                float angle = std::acos(cosTheta);
+                float invSinAngle = 1.f / std::sin(angle);
+                w0 = std::sin((1.f - a) * angle) * invSinAngle;
+                w1 = std::sin(a * angle) * invSinAngle;
+            }
+        }
+
+        /** Interpolates the keyframes of a batch and composes the transforms T * R * S without full matrix products.
+            The result matches lerp() of the translation and scaling and slerp() of the rotation within floating-point tolerance.
+        */
+        void interpolateBatch(const ChannelBatch& b, TransformBatch& result)
+        {
+#if FALCOR_ANIMATION_USE_SSE
+            const __m128 one = _mm_set1_ps(1.f);
+            const __m128 two = _mm_set1_ps(2.f);
+            const __m128 a = _mm_load_ps(b.factor);
+            const __m128 oneMinusA = _mm_sub_ps(one, a);
+            auto mix = [&](const float* x, const float* y) { return _mm_add_ps(_mm_mul_ps(_mm_load_ps(x), oneMinusA), _mm_mul_ps(_mm_load_ps(y), a)); };
+
+            __m128 s[3];
+            for (int i = 0; i < 3; i++)
+            {
+                _mm_store_ps(result.translation[i], mix(b.translation[0][i], b.translation[1][i]));
+                s[i] = mix(b.scaling[0][i], b.scaling[1][i]);
+            }
+
+            // Slerp. Flip the second rotation if needed to interpolate along the shortest path.
+            __m128 x[4], y[4];
+            for (int i = 0; i < 4; i++)
+            {
+                x[i] = _mm_load_ps(b.rotation[0][i]);
+                y[i] = _mm_load_ps(b.rotation[1][i]);
+            }
+            __m128 cosTheta = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x[0], y[0]), _mm_mul_ps(x[1], y[1])), _mm_add_ps(_mm_mul_ps(x[2], y[2]), _mm_mul_ps(x[3], y[3])));
+            const __m128 sign = _mm_and_ps(_mm_cmplt_ps(cosTheta, _mm_setzero_ps()), _mm_set1_ps(-0.f));
+            cosTheta = _mm_xor_ps(cosTheta, sign);
+
+            // The weights need the angle, which we compute per lane.
+            alignas(16) float cosThetaLanes[kChannelBatchSize], w0Lanes[kChannelBatchSize], w1Lanes[kChannelBatchSize];
+            _mm_store_ps(cosThetaLanes, cosTheta);
+            for (size_t lane = 0; lane < kChannelBatchSize; lane++) computeSlerpWeights(cosThetaLanes[lane], b.factor[lane], w0Lanes[lane], w1Lanes[lane]);
+            const __m128 w0 = _mm_load_ps(w0Lanes);
+            const __m128 w1 = _mm_xor_ps(_mm_load_ps(w1Lanes), sign);
+
+            __m128 q[4];
+            for (int i = 0; i < 4; i++) q[i] = _mm_add_ps(_mm_mul_ps(x[i], w0), _mm_mul_ps(y[i], w1));
+
+            // Rotation matrix from the quaternion (see glm::mat3_cast()), with the columns scaled.
+            const __m128 qxx = _mm_mul_ps(q[0], q[0]), qyy = _mm_mul_ps(q[1], q[1]), qzz = _mm_mul_ps(q[2], q[2]);
+            const __m128 qxz = _mm_mul_ps(q[0], q[2]), qxy = _mm_mul_ps(q[0], q[1]), qyz = _mm_mul_ps(q[1], q[2]);
+            const __m128 qwx = _mm_mul_ps(q[3], q[0]), qwy = _mm_mul_ps(q[3], q[1]), qwz = _mm_mul_ps(q[3], q[2]);
+
+            auto store = [&](int column, int row, __m128 value) { _mm_store_ps(result.linear[column][row], _mm_mul_ps(value, s[column])); };
+            store(0, 0, _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(qyy, qzz))));
+            store(0, 1, _mm_mul_ps(two, _mm_add_ps(qxy, qwz)));
+            store(0, 2, _mm_mul_ps(two, _mm_sub_ps(qxz, qwy)));
+            store(1, 0, _mm_mul_ps(two, _mm_sub_ps(qxy, qwz)));
+            store(1, 1, _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(qxx, qzz))));
+            store(1, 2, _mm_mul_ps(two, _mm_add_ps(qyz, qwx)));
+            store(2, 0, _mm_mul_ps(two, _mm_add_ps(qxz, qwy)));
+            store(2, 1, _mm_mul_ps(two, _mm_sub_ps(qyz, qwx)));
+            store(2, 2, _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(qxx, qyy))));
+#else
+            for (size_t lane = 0; lane < kChannelBatchSize; lane++)
+            {
+                const float a = b.factor[lane];
+                float3 s;
+                for (int i = 0; i < 3; i++)
+                {
+                    result.translation[i][lane] = b.translation[0][i][lane] * (1.f - a) + b.translation[1][i][lane] * a;
+                    s[i] = b.scaling[0][i][lane] * (1.f - a) + b.scaling[1][i][lane] * a;
+                }
+
+                glm::quat x(b.rotation[0][3][lane], b.rotation[0][0][lane], b.rotation[0][1][lane], b.rotation[0][2][lane]);
+                glm::quat y(b.rotation[1][3][lane], b.rotation[1][0][lane], b.rotation[1][1][lane], b.rotation[1][2][lane]);
+                float cosTheta = dot(x, y);
+                if (cosTheta < 0.f)
+                {
+                    y = -y;
+                    cosTheta = -cosTheta;
+                }
+                float w0, w1;
+                computeSlerpWeights(cosTheta, a, w0, w1);
+                glm::quat q = w0 * x + w1 * y;
+
+                const float qxx = q.x * q.x, qyy = q.y * q.y, qzz = q.z * q.z;
+                const float qxz = q.x * q.z, qxy = q.x * q.y, qyz = q.y * q.z;
+                const float qwx = q.w * q.x, qwy = q.w * q.y, qwz = q.w * q.z;
+
+                const float3 columns[3] =
+                {
+                    float3(1.f - 2.f * (qyy + qzz), 2.f * (qxy + qwz), 2.f * (qxz - qwy)) * s.x,
+                    float3(2.f * (qxy - qwz), 1.f - 2.f * (qxx + qzz), 2.f * (qyz + qwx)) * s.y,
+                    float3(2.f * (qxz + qwy), 2.f * (qyz - qwx), 1.f - 2.f * (qxx + qyy)) * s.z,
+                };
+                for (int c = 0; c < 3; c++)
+                {
+                    for (int r = 0; r < 3; r++) result.linear[c][r][lane] = columns[c][r];
+                }
+            }
+#endif
+        }
+    }
+
     Animation::SharedPtr Animation::create(const std::string& name, double durationInSeconds)
     {
         return SharedPtr(new Animation(name, durationInSeconds));
@@ -40,123 +221,229 @@ namespace Falcor
 
     Animation::Animation(const std::string& name, double durationInSeconds) : mName(name), mDurationInSeconds(durationInSeconds) {}
 
+    Animation::Keyframe Animation::Channel::getKeyframe(size_t index) const
+    {
+        Keyframe keyframe;
+        keyframe.time = times[index];
+        keyframe.translation = translations[index];
+        keyframe.scaling = scalings[index];
+        keyframe.rotation = rotations[index];
+        return keyframe;
+    }
+
+    void Animation::Channel::setKeyframe(size_t index, const Keyframe& keyframe)
+    {
+        times[index] = keyframe.time;
+        translations[index] = keyframe.translation;
+        scalings[index] = keyframe.scaling;
+        rotations[index] = keyframe.rotation;
+    }
+
+    void Animation::Channel::insertKeyframe(size_t index, const Keyframe& keyframe)
+    {
+        times.insert(times.begin() + index, keyframe.time);
+        translations.insert(translations.begin() + index, keyframe.translation);
+        scalings.insert(scalings.begin() + index, keyframe.scaling);
+        rotations.insert(rotations.begin() + index, keyframe.rotation);
+    }
+
     size_t Animation::findChannelFrame(const Channel& c, double time) const
     {
-        size_t frameID = (time < c.lastUpdateTime) ? 0 : c.lastKeyframeUsed;
-        while (frameID < c.keyframes.size() - 1)
+        // Find the last keyframe at or before the requested time, or the first keyframe if there is none.
+        // We gallop from the last keyframe used, so sequential playback takes O(1) and random access O(log n).
+        const auto& times = c.times;
+        const size_t count = times.size();
+        assert(count > 0);
+        size_t cursor = std::min(c.lastKeyframeUsed, count - 1);
+
+        size_t lo, hi; // The result is in [lo, hi).
+        if (times[cursor] <= time)
         {
-            if (c.keyframes[frameID + 1].time > time) break;
-            frameID++;
+            // Gallop forward until we pass the requested time.
+            lo = cursor;
+            hi = cursor + 1;
+            size_t step = 1;
+            while (hi < count && times[hi] <= time)
+            {
+                lo = hi;
+                hi = std::min(lo + step, count);
+                step *= 2;
+            }
+        }
+        else
+        {
+            // Gallop backward until we reach the requested time.
+            hi = cursor;
+            lo = cursor;
+            size_t step = 1;
+            while (lo > 0 && times[lo] > time)
+            {
+                hi = lo;
+                lo = lo > step ? lo - step : 0;
+                step *= 2;
+            }
+            if (times[lo] > time) return 0;
         }
-        return frameID;
-    }
 
-    glm::mat4 Animation::interpolate(const Keyframe& start, const Keyframe& end, double curTime) const
-    {
-        double localTime = curTime - start.time;
-        double keyframeDuration = end.time - start.time;
-        if (keyframeDuration < 0) keyframeDuration += mDurationInSeconds;
-        float factor = keyframeDuration != 0 ? (float)(localTime / keyframeDuration) : 1;
-
-        float3 translation = lerp(start.translation, end.translation, factor);
-        float3 scaling = lerp(start.scaling, end.scaling, factor);
-        glm::quat rotation = slerp(start.rotation, end.rotation, factor);
-
-        glm::mat4 T;
-        T[3] = float4(translation, 1);
-        glm::mat4 R = glm::mat4_cast(rotation);
-        glm::mat4 S = scale(scaling);
-        glm::mat4 transform = T * R * S;
-        return transform;
+        // Binary search in the bracket. times[lo] <= time holds, so the result is at least lo.
+        auto it = std::upper_bound(times.begin() + lo + 1, times.begin() + hi, time);
+        return (size_t)(it - times.begin()) - 1;
     }
 
-    glm::mat4 Animation::animateChannel(Channel& c, double time)
+    void Animation::animateBatch(size_t firstChannel, size_t channelCount, double time, std::vector<glm::mat4>& matrices)
     {
-        size_t curKeyIndex = findChannelFrame(c, time);
-        size_t nextKeyIndex = curKeyIndex + 1;
-        if (nextKeyIndex == c.keyframes.size()) nextKeyIndex = 0;
+        assert(channelCount <= kChannelBatchSize);
 
-        c.lastUpdateTime = time;
-        c.lastKeyframeUsed = curKeyIndex;
+        // Gather the keyframes surrounding the current time. Unused lanes keep the identity transform.
+        ChannelBatch batch;
+        for (size_t lane = 0; lane < channelCount; lane++)
+        {
+            auto& c = mChannels[firstChannel + lane];
+            size_t curKeyIndex = findChannelFrame(c, time);
+            size_t nextKeyIndex = curKeyIndex + 1;
+            if (nextKeyIndex == c.getKeyframeCount()) nextKeyIndex = 0;
+            c.lastKeyframeUsed = curKeyIndex;
+
+            double localTime = time - c.times[curKeyIndex];
+            double keyframeDuration = c.times[nextKeyIndex] - c.times[curKeyIndex];
+            if (keyframeDuration < 0) keyframeDuration += mDurationInSeconds;
+            batch.factor[lane] = keyframeDuration != 0 ? (float)(localTime / keyframeDuration) : 1;
+            batch.setLane(lane, 0, c.translations[curKeyIndex], c.scalings[curKeyIndex], c.rotations[curKeyIndex]);
+            batch.setLane(lane, 1, c.translations[nextKeyIndex], c.scalings[nextKeyIndex], c.rotations[nextKeyIndex]);
+        }
+
+        TransformBatch transforms;
+        interpolateBatch(batch, transforms);
 
-        return interpolate(c.keyframes[curKeyIndex], c.keyframes[nextKeyIndex], time);
+        for (size_t lane = 0; lane < channelCount; lane++)
+        {
+            matrices[mChannels[firstChannel + lane].matrixID] = transforms.getLane(lane);
+        }
     }
 
     void Animation::animate(double totalTime, std::vector<glm::mat4>& matrices)
     {
         // Calculate the relative time
         double modTime = fmod(totalTime, mDurationInSeconds);
-        for (auto& c : mChannels)
+
+        // Batches of channels can be evaluated in parallel if the channels drive distinct matrices.
+        // Otherwise, they are evaluated in order so that the last channel driving a matrix wins.
+        const uint32_t batchCount = (uint32_t)div_round_up(mChannels.size(), kChannelBatchSize);
+        auto animateBatchAt = [&](uint32_t batchIndex)
         {
-            matrices[c.matrixID] = animateChannel(c, modTime);
-        }
+            size_t firstChannel = batchIndex * kChannelBatchSize;
+            animateBatch(firstChannel, std::min(kChannelBatchSize, mChannels.size() - firstChannel), modTime, matrices);
+        };
+
+        if (batchCount >= kParallelBatchCount && hasDistinctChannelMatrices()) Threading::parallelFor(0, batchCount, animateBatchAt, kBatchesPerTask);
+        else for (uint32_t i = 0; i < batchCount; i++) animateBatchAt(i);
     }
 
     size_t Animation::addChannel(size_t matrixID)
     {
         mChannels.push_back(Channel(matrixID));
+        mChannelMatricesChecked = false;
         return mChannels.size() - 1;
     }
 
+    bool Animation::hasDistinctChannelMatrices()
+    {
+        if (!mChannelMatricesChecked)
+        {
+            std::vector<size_t> matrixIDs(mChannels.size());
+            for (size_t i = 0; i < mChannels.size(); i++) matrixIDs[i] = mChannels[i].matrixID;
+            std::sort(matrixIDs.begin(), matrixIDs.end());
+            mDistinctChannelMatrices = std::adjacent_find(matrixIDs.begin(), matrixIDs.end()) == matrixIDs.end();
+            mChannelMatricesChecked = true;
+        }
+        return mDistinctChannelMatrices;
+    }
+
     void Animation::addKeyframe(size_t channelID, const Keyframe& keyframe)
     {
         assert(channelID < mChannels.size());
         assert(keyframe.time <= mDurationInSeconds);
 
-        mChannels[channelID].lastKeyframeUsed = 0;
-        auto& channelFrames = mChannels[channelID].keyframes;
+        auto& channel = mChannels[channelID];
+        channel.lastKeyframeUsed = 0;
 
-        if (channelFrames.size() == 0 || channelFrames[0].time > keyframe.time)
-        {
-            channelFrames.insert(channelFrames.begin(), keyframe);
-            return;
-        }
-        else
-        {
-            for (size_t i = 0; i < channelFrames.size(); i++)
-            {
-                auto& current = channelFrames[i];
-                // If we already have a key-frame at the same time, replace it
-                if (current.time == keyframe.time)
-                {
-                    current = keyframe;
-                    return;
-                }
-
-                // If this is not the last frame, Check if we are in between frames
-                if (i < channelFrames.size() - 1)
-                {
-                    auto& Next = channelFrames[i + 1];
-                    if (current.time < keyframe.time && Next.time > keyframe.time)
-                    {
-                        channelFrames.insert(channelFrames.begin() + i + 1, keyframe);
-                        return;
-                    }
-                }
-            }
-
-            // If we got here, need to push it to the end of the list
-            channelFrames.push_back(keyframe);
-        }
+        // If we already have a key-frame at the same time, replace it. Otherwise insert it in order.
+        auto it = std::lower_bound(channel.times.begin(), channel.times.end(), keyframe.time);
+        size_t index = (size_t)(it - channel.times.begin());
+        if (it != channel.times.end() && *it == keyframe.time) channel.setKeyframe(index, keyframe);
+        else channel.insertKeyframe(index, keyframe);
     }
 
-    const Animation::Keyframe& Animation::getKeyframe(size_t channelID, double time) const
+    Animation::Keyframe Animation::getKeyframe(size_t channelID, double time) const
     {
         assert(channelID < mChannels.size());
-        for (const auto& k : mChannels[channelID].keyframes)
-        {
-            if (k.time == time) return k;
-        }
+        const auto& channel = mChannels[channelID];
+        auto it = std::lower_bound(channel.times.begin(), channel.times.end(), time);
+        if (it != channel.times.end() && *it == time) return channel.getKeyframe((size_t)(it - channel.times.begin()));
         throw std::runtime_error(("Animation::getKeyframe() - can't find a keyframe at time " + to_string(time)).c_str());
     }
 
     bool Animation::doesKeyframeExists(size_t channelID, double time) const
     {
         assert(channelID < mChannels.size());
-        for (const auto& k : mChannels[channelID].keyframes)
+        const auto& times = mChannels[channelID].times;
+        return std::binary_search(times.begin(), times.end(), time);
+    }
+
+    Animation::BenchmarkResult Animation::benchmark(const BenchmarkDesc& desc)
+    {
+        BenchmarkResult result;
+        result.channelCount = desc.channelCount;
+        result.keyframeCount = desc.keyframeCount;
+        if (desc.channelCount == 0 || desc.keyframeCount == 0 || desc.evaluationCount == 0) return result;
+
+        // Create a rig with random keyframes. Each channel drives its own matrix.
+        const double duration = 10.0;
+        std::mt19937 rng(desc.seed);
+        std::uniform_real_distribution<float> dist(-1.f, 1.f);
+        auto pAnimation = Animation::create("Benchmark", duration);
+        for (uint32_t i = 0; i < desc.channelCount; i++)
         {
-            if (k.time == time) return true;
+            size_t channelID = pAnimation->addChannel(i);
+            for (uint32_t k = 0; k < desc.keyframeCount; k++)
+            {
+                Keyframe keyframe;
+                keyframe.time = duration * k / desc.keyframeCount;
+                keyframe.translation = float3(dist(rng), dist(rng), dist(rng));
+                keyframe.rotation = glm::normalize(glm::quat(dist(rng), dist(rng), dist(rng), dist(rng)));
+                pAnimation->addKeyframe(channelID, keyframe);
+            }
         }
-        return false;
+        std::vector<glm::mat4> matrices(desc.channelCount);
+
+        auto measure = [&](const std::vector<double>& times)
+        {
+            CpuTimer timer;
+            timer.update();
+            for (double t : times) pAnimation->animate(t, matrices);
+            timer.update();
+            return timer.delta() * 1e9 / ((double)times.size() * desc.channelCount);
+        };
+
+        // Sequential playback steps through the animation twice, so it loops once.
+        std::vector<double> times(desc.evaluationCount);
+        for (uint32_t i = 0; i < desc.evaluationCount; i++) times[i] = 2.0 * duration * i / desc.evaluationCount;
+        result.sequentialNsPerChannel = measure(times);
+
+        std::uniform_real_distribution<double> timeDist(0.0, duration);
+        for (auto& t : times) t = timeDist(rng);
+        result.randomNsPerChannel = measure(times);
+
+        return result;
+    }
+
+    std::string Animation::BenchmarkResult::toString() const
+    {
+        std::ostringstream oss;
+        oss << "  Channels:            " << channelCount << std::endl
+            << "  Keyframes/channel:   " << keyframeCount << std::endl
+            << "  Sequential:          " << std::fixed << std::setprecision(1) << sequentialNsPerChannel << " ns/channel" << std::endl
+            << "  Random:              " << std::fixed << std::setprecision(1) << randomNsPerChannel << " ns/channel";
+        return oss.str();
     }
 }
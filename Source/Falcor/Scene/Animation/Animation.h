@@ -70,7 +70,7 @@ namespace Falcor
         /** Get the keyframe from a specific time.
             If the keyframe doesn't exists, the function will throw an exception. If you don't want to handle exceptions, call doesKeyframeExist() first
         */
-        const Keyframe& getKeyframe(size_t channelID, double time) const;
+        Keyframe getKeyframe(size_t channelID, double time) const;
 
         /** Check if a keyframe exists in a specific time
         */
@@ -86,24 +86,66 @@ namespace Falcor
         */
         size_t getChannelMatrixID(size_t channel) const { return mChannels[channel].matrixID; }
 
+        /** Describes the keyframe lookup benchmark.
+        */
+        struct BenchmarkDesc
+        {
+            uint32_t channelCount = 10000;          ///< Number of channels in the rig.
+            uint32_t keyframeCount = 256;           ///< Number of keyframes per channel.
+            uint32_t evaluationCount = 256;         ///< Number of times the whole rig is evaluated, for each access pattern.
+            uint32_t seed = 0;                      ///< Seed of the random number generator.
+        };
+
+        /** Result of the keyframe lookup benchmark.
+        */
+        struct BenchmarkResult
+        {
+            uint32_t channelCount = 0;              ///< Number of channels in the rig.
+            uint32_t keyframeCount = 0;             ///< Number of keyframes per channel.
+            double sequentialNsPerChannel = 0.0;    ///< Average evaluation time per channel in nanoseconds when playing the animation forward and looping.
+            double randomNsPerChannel = 0.0;        ///< Average evaluation time per channel in nanoseconds when evaluating at random times.
+
+            std::string toString() const;
+        };
+
+        /** Measures the evaluation time of a synthetic rig for sequential playback and random access.
+            \param[in] desc Benchmark description.
+            \return The timings.
+        */
+        static BenchmarkResult benchmark(const BenchmarkDesc& desc = BenchmarkDesc());
+
     private:
         Animation(const std::string& name, double durationInSeconds);
 
+        /** Keyframes of a channel, stored as separate arrays sorted by time.
+        */
         struct Channel
         {
             Channel(size_t matID) : matrixID(matID) {};
             size_t matrixID;
-            std::vector<Keyframe> keyframes;
-            size_t lastKeyframeUsed = 0;
-            double lastUpdateTime = 0;
+            std::vector<double> times;
+            std::vector<float3> translations;
+            std::vector<float3> scalings;
+            std::vector<glm::quat> rotations;
+            size_t lastKeyframeUsed = 0;    ///< Cursor for sequential playback. Lookups start searching from this keyframe.
+
+            size_t getKeyframeCount() const { return times.size(); }
+            Keyframe getKeyframe(size_t index) const;
+            void setKeyframe(size_t index, const Keyframe& keyframe);
+            void insertKeyframe(size_t index, const Keyframe& keyframe);
         };
 
         std::vector<Channel> mChannels;
         const std::string mName;
         double mDurationInSeconds = 0;
+        bool mChannelMatricesChecked = false;   ///< True if mDistinctChannelMatrices is up to date with the channels.
+        bool mDistinctChannelMatrices = false;  ///< True if no two channels drive the same matrix, see hasDistinctChannelMatrices().
 
-        glm::mat4 animateChannel(Channel& c, double time);
         size_t findChannelFrame(const Channel& c, double time) const;
-        glm::mat4 interpolate(const Keyframe& start, const Keyframe& end, double curTime) const;
+        void animateBatch(size_t firstChannel, size_t channelCount, double time, std::vector<glm::mat4>& matrices);
+
+        /** Check if every channel drives a different matrix, in which case batches of channels can be evaluated in parallel.
+        */
+        bool hasDistinctChannelMatrices();
     };
 }
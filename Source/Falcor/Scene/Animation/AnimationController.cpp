@@ -27,7 +27,9 @@
  **************************************************************************/
 #include "stdafx.h"
 #include "AnimationController.h"
+#include <algorithm>
 #include <fstream>
+#include <iterator>
 
 namespace Falcor
 {
@@ -36,10 +38,67 @@ namespace Falcor
         const static std::string kWorldMatricesBufferName = "worldMatrices";
         const static std::string kInverseTransposeWorldMatrices = "inverseTransposeWorldMatrices";
         const static std::string kPreviousWorldMatrices = "previousFrameWorldMatrices";
+
+        const uint32_t kParallelNodeCount = 1024;   // Minimum number of nodes in a level to update it on multiple threads.
+        const uint32_t kNodesPerTask = 256;         // Number of nodes updated by a worker at a time.
+        const size_t kMaxUploadRanges = 1024;       // Maximum number of ranges uploaded separately before uploading the whole buffer.
+
+        /** Computes transpose(inverse(m)), using the cofactors of the 3x3 part for affine matrices.
+        */
+        glm::mat4 inverseTranspose(const glm::mat4& m)
+        {
+            if (m[0][3] != 0.f || m[1][3] != 0.f || m[2][3] != 0.f || m[3][3] != 1.f) return transpose(inverse(m));
+
+            const float3 a0(m[0]), a1(m[1]), a2(m[2]), t(m[3]);
+            float3 c0 = cross(a1, a2);
+            float3 c1 = cross(a2, a0);
+            float3 c2 = cross(a0, a1);
+            const float invDet = 1.f / dot(a0, c0);
+            c0 *= invDet;
+            c1 *= invDet;
+            c2 *= invDet;
+
+            glm::mat4 result;
+            result[0] = float4(c0, -dot(c0, t));
+            result[1] = float4(c1, -dot(c1, t));
+            result[2] = float4(c2, -dot(c2, t));
+            result[3] = float4(0.f, 0.f, 0.f, 1.f);
+            return result;
+        }
+
+        /** Uploads the matrices of a sorted list of nodes, merging consecutive nodes into ranges.
+            The whole buffer is uploaded if pNodes is nullptr or the nodes are too scattered.
+        */
+        void uploadMatrixRanges(Buffer* pBuffer, const std::vector<glm::mat4>& matrices, const std::vector<uint32_t>* pNodes)
+        {
+            assert(pBuffer->getSize() == matrices.size() * sizeof(glm::mat4));
+
+            std::vector<std::pair<uint32_t, uint32_t>> ranges; // [first, end) node pairs
+            if (pNodes)
+            {
+                const auto& nodes = *pNodes;
+                for (size_t i = 0; i < nodes.size() && ranges.size() <= kMaxUploadRanges; i++)
+                {
+                    if (!ranges.empty() && ranges.back().second == nodes[i]) ranges.back().second++;
+                    else ranges.push_back({ nodes[i], nodes[i] + 1 });
+                }
+            }
+
+            if (!pNodes || ranges.size() > kMaxUploadRanges)
+            {
+                pBuffer->setBlob(matrices.data(), 0, pBuffer->getSize());
+                return;
+            }
+
+            for (const auto& r : ranges)
+            {
+                pBuffer->setBlob(&matrices[r.first], r.first * sizeof(glm::mat4), (r.second - r.first) * sizeof(glm::mat4));
+            }
+        }
     }
 
     AnimationController::AnimationController(Scene* pScene, const StaticVertexVector& staticVertexData, const DynamicVertexVector& dynamicVertexData) :
-        mpScene(pScene), mLocalMatrices(pScene->mSceneGraph.size()), mInvTransposeGlobalMatrices(pScene->mSceneGraph.size()), mMatricesChanged(pScene->mSceneGraph.size())
+        mpScene(pScene), mLocalMatrices(pScene->mSceneGraph.size()), mGlobalMatrices(pScene->mSceneGraph.size()), mInvTransposeGlobalMatrices(pScene->mSceneGraph.size()), mMatricesChanged(pScene->mSceneGraph.size())
     {
         assert(mLocalMatrices.size() * 4 <= UINT32_MAX);
         uint32_t float4Count = (uint32_t)mLocalMatrices.size() * 4;
@@ -48,6 +107,7 @@ namespace Falcor
         mpPrevWorldMatricesBuffer = mpWorldMatricesBuffer;
         mpInvTransposeWorldMatricesBuffer = Buffer::createStructured(sizeof(float4), float4Count, Resource::BindFlags::ShaderResource, Buffer::CpuAccess::None, nullptr, false);
         createSkinningPass(staticVertexData, dynamicVertexData);
+        buildNodeLevels();
     }
 
     AnimationController::UniquePtr AnimationController::create(Scene* pScene, const StaticVertexVector& staticVertexData, const DynamicVertexVector& dynamicVertexData)
@@ -67,6 +127,7 @@ namespace Falcor
         {
             mMeshes[i].activeAnimation = animate ? 0 : kBindPoseAnimationId;
         }
+        mAnimationChanged = true;
     }
 
     void AnimationController::initLocalMatrices()
@@ -78,7 +139,9 @@ namespace Falcor
     {
         PROFILE("animate");
 
-        mMatricesChanged.assign(mMatricesChanged.size(), false);
+        mMatricesChanged.assign(mMatricesChanged.size(), 0);
+        mPrevDirtyNodes.swap(mDirtyNodes);
+        mDirtyNodes.clear();
 
         if (mAnimationChanged == false)
         {
@@ -90,31 +153,63 @@ namespace Falcor
                 return false;
             }
         }
-        else initLocalMatrices();
+        else
+        {
+            initLocalMatrices();
+            updateActiveAnimations();
+        }
 
+        // All local matrices were reset if the animations changed.
+        const bool fullUpdate = mAnimationChanged;
         mAnimationChanged = false;
         mLastAnimationTime = currentTime;
 
-        for (const auto& a : mMeshes)
+        // Animations that drive distinct matrices are evaluated in parallel. Otherwise, the last animation wins as before.
+        auto animateAt = [&](uint32_t i) { mActiveAnimations[i]->animate(currentTime, mLocalMatrices); };
+        const uint32_t animationCount = (uint32_t)mActiveAnimations.size();
+        if (mParallelAnimations) Threading::parallelFor(0, animationCount, animateAt);
+        else for (uint32_t i = 0; i < animationCount; i++) animateAt(i);
+
+        for (const auto& pAnimation : mActiveAnimations)
         {
-            const auto& mesh = a.second;
-            if (mesh.activeAnimation == kBindPoseAnimationId) continue; // Bind pose was pre-computed
-            auto& pAnimation = mesh.pAnimations[mesh.activeAnimation];
-            pAnimation->animate(currentTime, mLocalMatrices);
             for (size_t i = 0; i < pAnimation->getChannelCount(); i++)
             {
-                mMatricesChanged[pAnimation->getChannelMatrixID(i)] = true;
+                mMatricesChanged[pAnimation->getChannelMatrixID(i)] = 1;
             }
         }
 
         swap(mpPrevWorldMatricesBuffer, mpWorldMatricesBuffer);
-        updateMatrices();
+        updateMatrices(fullUpdate);
         bindBuffers();
         executeSkinningPass(pContext);
 
         return true;
     }
 
+    void AnimationController::updateActiveAnimations()
+    {
+        mActiveAnimations.clear();
+        for (const auto& a : mMeshes)
+        {
+            const auto& mesh = a.second;
+            if (mesh.activeAnimation == kBindPoseAnimationId) continue; // Bind pose was pre-computed
+            mActiveAnimations.push_back(mesh.pAnimations[mesh.activeAnimation]);
+        }
+
+        // Check if the active animations drive distinct matrices.
+        std::vector<bool> driven(mLocalMatrices.size(), false);
+        mParallelAnimations = mActiveAnimations.size() > 1;
+        for (const auto& pAnimation : mActiveAnimations)
+        {
+            for (size_t i = 0; i < pAnimation->getChannelCount() && mParallelAnimations; i++)
+            {
+                size_t matrixID = pAnimation->getChannelMatrixID(i);
+                if (driven[matrixID]) mParallelAnimations = false;
+                driven[matrixID] = true;
+            }
+        }
+    }
+
     bool AnimationController::validateIndices(uint32_t meshID, uint32_t animID, const std::string& warningPrefix) const
     {
         const auto& m = mMeshes.find(meshID);
@@ -176,31 +271,118 @@ namespace Falcor
                 setActiveAnimation(0, active ? 0 : kBindPoseAnimationId);
             }
         }
+
+        auto benchmarkGroup = Gui::Group(widget, "Keyframe lookup benchmark");
+        if (benchmarkGroup.open())
+        {
+            // Measures a synthetic rig, independent of the scene's animations.
+            if (benchmarkGroup.button("Run")) mBenchmarkReport = Animation::benchmark().toString();
+            if (!mBenchmarkReport.empty()) benchmarkGroup.text(mBenchmarkReport);
+            benchmarkGroup.release();
+        }
     }
 
-    void AnimationController::updateMatrices()
+    void AnimationController::buildNodeLevels()
     {
-        // We can optimize this
-        mGlobalMatrices = mLocalMatrices;
-
-        for (size_t i = 0; i < mGlobalMatrices.size(); i++)
+        const auto& sceneGraph = mpScene->mSceneGraph;
+        const uint32_t nodeCount = (uint32_t)sceneGraph.size();
+
+        // Compute the depth of each node, walking up to the first node of known depth.
+        const uint32_t kUnknownDepth = UINT32_MAX;
+        std::vector<uint32_t> depth(nodeCount, kUnknownDepth);
+        std::vector<uint32_t> path;
+        uint32_t levelCount = 0;
+        for (uint32_t i = 0; i < nodeCount; i++)
         {
-            if (mpScene->mSceneGraph[i].parent != SceneBuilder::kInvalidNode)
+            path.clear();
+            uint32_t node = i;
+            while (node != SceneBuilder::kInvalidNode && depth[node] == kUnknownDepth)
             {
-                mGlobalMatrices[i] = mGlobalMatrices[mpScene->mSceneGraph[i].parent] * mGlobalMatrices[i];
-                mMatricesChanged[i] = mMatricesChanged[i] || mMatricesChanged[mpScene->mSceneGraph[i].parent];
+                path.push_back(node);
+                node = sceneGraph[node].parent;
             }
+            uint32_t d = node == SceneBuilder::kInvalidNode ? 0 : depth[node] + 1;
+            for (auto it = path.rbegin(); it != path.rend(); it++) depth[*it] = d++;
+            levelCount = std::max(levelCount, d);
+        }
+
+        // Sort the nodes by depth, keeping the index order within each level.
+        mLevelOffsets.assign(levelCount + 1, 0);
+        for (uint32_t i = 0; i < nodeCount; i++) mLevelOffsets[depth[i] + 1]++;
+        for (uint32_t level = 0; level < levelCount; level++) mLevelOffsets[level + 1] += mLevelOffsets[level];
 
-            mInvTransposeGlobalMatrices[i] = transpose(inverse(mGlobalMatrices[i]));
+        std::vector<uint32_t> next(mLevelOffsets.begin(), mLevelOffsets.end() - 1);
+        mNodeOrder.resize(nodeCount);
+        for (uint32_t i = 0; i < nodeCount; i++) mNodeOrder[next[depth[i]]++] = i;
+    }
+
+    void AnimationController::updateMatrices(bool fullUpdate)
+    {
+        const auto& sceneGraph = mpScene->mSceneGraph;
+
+        // All nodes changed if the local matrices were reset.
+        if (fullUpdate) mMatricesChanged.assign(mMatricesChanged.size(), 1);
 
-            if(mpSkinningPass)
+        // Propagate the transforms level by level, so that parents are updated before their children.
+        // Only nodes whose own or ancestor matrices changed are updated.
+        auto updateNode = [&](uint32_t orderIndex)
+        {
+            const uint32_t i = mNodeOrder[orderIndex];
+            const uint32_t parent = sceneGraph[i].parent;
+            if (parent != SceneBuilder::kInvalidNode) mMatricesChanged[i] |= mMatricesChanged[parent];
+            if (!mMatricesChanged[i]) return;
+
+            mGlobalMatrices[i] = parent != SceneBuilder::kInvalidNode ? mGlobalMatrices[parent] * mLocalMatrices[i] : mLocalMatrices[i];
+            mInvTransposeGlobalMatrices[i] = inverseTranspose(mGlobalMatrices[i]);
+
+            if (mpSkinningPass)
             {
-                mSkinningMatrices[i] = mGlobalMatrices[i] * mpScene->mSceneGraph[i].localToBindSpace;
-                mInvTransposeSkinningMatrices[i] = transpose(inverse(mSkinningMatrices[i]));
+                mSkinningMatrices[i] = mGlobalMatrices[i] * sceneGraph[i].localToBindSpace;
+                mInvTransposeSkinningMatrices[i] = inverseTranspose(mSkinningMatrices[i]);
             }
+        };
+
+        for (size_t level = 0; level + 1 < mLevelOffsets.size(); level++)
+        {
+            const uint32_t begin = mLevelOffsets[level];
+            const uint32_t end = mLevelOffsets[level + 1];
+            if (end - begin >= kParallelNodeCount) Threading::parallelFor(begin, end, updateNode, kNodesPerTask);
+            else for (uint32_t i = begin; i < end; i++) updateNode(i);
+        }
+
+        // Collect the updated nodes in index order.
+        for (uint32_t i = 0; i < (uint32_t)mMatricesChanged.size(); i++)
+        {
+            if (mMatricesChanged[i]) mDirtyNodes.push_back(i);
+        }
+
+        uploadMatrices(fullUpdate);
+    }
+
+    void AnimationController::uploadMatrices(bool fullUpdate)
+    {
+        // The world matrices alternate between two buffers, so the buffer we write holds the matrices from two frames ago.
+        // Upload the nodes updated in this frame or the previous one, or everything for two frames after a full update.
+        if (fullUpdate) mFullWorldUploadCount = 2;
+        if (mFullWorldUploadCount > 0)
+        {
+            uploadMatrixRanges(mpWorldMatricesBuffer.get(), mGlobalMatrices, nullptr);
+            mFullWorldUploadCount--;
+        }
+        else
+        {
+            mWorldUploadNodes.clear();
+            std::set_union(mDirtyNodes.begin(), mDirtyNodes.end(), mPrevDirtyNodes.begin(), mPrevDirtyNodes.end(), std::back_inserter(mWorldUploadNodes));
+            uploadMatrixRanges(mpWorldMatricesBuffer.get(), mGlobalMatrices, &mWorldUploadNodes);
+        }
+
+        uploadMatrixRanges(mpInvTransposeWorldMatricesBuffer.get(), mInvTransposeGlobalMatrices, &mDirtyNodes);
+
+        if (mpSkinningPass)
+        {
+            uploadMatrixRanges(mpSkinningMatricesBuffer.get(), mSkinningMatrices, &mDirtyNodes);
+            uploadMatrixRanges(mpInvTransposeSkinningMatricesBuffer.get(), mInvTransposeSkinningMatrices, &mDirtyNodes);
         }
-        mpWorldMatricesBuffer->setBlob(mGlobalMatrices.data(), 0, mpWorldMatricesBuffer->getSize());
-        mpInvTransposeWorldMatricesBuffer->setBlob(mInvTransposeGlobalMatrices.data(), 0, mpInvTransposeWorldMatricesBuffer->getSize());
     }
 
     void AnimationController::bindBuffers()
@@ -218,6 +400,7 @@ namespace Falcor
             if (mpWorldMatricesBuffer == mpPrevWorldMatricesBuffer)
             {
                 mpPrevWorldMatricesBuffer = Buffer::createStructured(sizeof(float4), mpWorldMatricesBuffer->getElementCount(), Resource::BindFlags::ShaderResource, Buffer::CpuAccess::None, nullptr, false);
+                mFullWorldUploadCount = 2;
             }
         }
         else mpPrevWorldMatricesBuffer = mpWorldMatricesBuffer;
@@ -225,10 +408,11 @@ namespace Falcor
 
     void AnimationController::createSkinningPass(const std::vector<PackedStaticVertexData>& staticVertexData, const std::vector<DynamicVertexData>& dynamicVertexData)
     {
-        // We always copy the static data, to initialize the non-skinned vertices
+        // We always copy the static data, to initialize the non-skinned vertices.
+        // With geometry streaming, the buffers also hold the streaming pool after the static data. It is filled as meshes are loaded.
         Buffer::ConstSharedPtrRef pVB = mpScene->mpVao->getVertexBuffer(Scene::kStaticDataBufferIndex);
-        assert(pVB->getSize() == staticVertexData.size() * sizeof(staticVertexData[0]));
-        pVB->setBlob(staticVertexData.data(), 0, pVB->getSize());
+        assert(pVB->getSize() >= staticVertexData.size() * sizeof(staticVertexData[0]));
+        pVB->setBlob(staticVertexData.data(), 0, staticVertexData.size() * sizeof(staticVertexData[0]));
 
         // Initialize the previous positions for non-skinned vertices.
         std::vector<PrevVertexData> prevVertexData(staticVertexData.size());
@@ -237,8 +421,8 @@ namespace Falcor
             prevVertexData[i].position = staticVertexData[i].position;
         }
         Buffer::ConstSharedPtrRef pPrevVB = mpScene->mpVao->getVertexBuffer(Scene::kPrevVertexBufferIndex);
-        assert(pPrevVB->getSize() == prevVertexData.size() * sizeof(prevVertexData[0]));
-        pPrevVB->setBlob(prevVertexData.data(), 0, pPrevVB->getSize());
+        assert(pPrevVB->getSize() >= prevVertexData.size() * sizeof(prevVertexData[0]));
+        pPrevVB->setBlob(prevVertexData.data(), 0, prevVertexData.size() * sizeof(prevVertexData[0]));
 
         if (dynamicVertexData.size())
         {
@@ -276,8 +460,6 @@ namespace Falcor
     void AnimationController::executeSkinningPass(RenderContext* pContext)
     {
         if (!mpSkinningPass) return;
-        mpSkinningMatricesBuffer->setBlob(mSkinningMatrices.data(), 0, mpSkinningMatricesBuffer->getSize());
-        mpInvTransposeSkinningMatricesBuffer->setBlob(mInvTransposeSkinningMatrices.data(), 0, mpInvTransposeSkinningMatricesBuffer->getSize());
         mpSkinningPass->execute(pContext, mSkinningDispatchSize, 1, 1);
     }
 }
@@ -109,9 +109,13 @@ namespace Falcor
         */
         const std::vector<glm::mat4>& getGlobalMatrices() const { return mGlobalMatrices; }
 
+        /** Get the IDs of the matrices changed by the last call to animate(), in increasing order
+        */
+        const std::vector<uint32_t>& getChangedMatrices() const { return mDirtyNodes; }
+
         /** Check if a matrix changed
         */
-        bool didMatrixChanged(size_t matrixID) const { return mMatricesChanged[matrixID]; }
+        bool didMatrixChanged(size_t matrixID) const { return mMatricesChanged[matrixID] != 0; }
 
     private:
         friend class SceneBuilder;
@@ -119,8 +123,11 @@ namespace Falcor
 
         void allocatePrevWorldMatrixBuffer();
         void bindBuffers();
-        void updateMatrices();
+        void buildNodeLevels();
+        void updateMatrices(bool fullUpdate);
+        void uploadMatrices(bool fullUpdate);
         bool validateIndices(uint32_t meshID, uint32_t animID, const std::string& warningPrefix) const;
+        void updateActiveAnimations();
 
         struct MeshAnimation
         {
@@ -129,15 +136,26 @@ namespace Falcor
         };
 
         std::map<uint32_t, MeshAnimation> mMeshes;
+        std::vector<Animation::SharedPtr> mActiveAnimations;    ///< Active animations in mesh order. Updated when the active animations change.
+        bool mParallelAnimations = false;                       ///< True if the active animations drive distinct matrices and can be evaluated in parallel.
         std::vector<glm::mat4> mLocalMatrices;
         std::vector<glm::mat4> mGlobalMatrices;
         std::vector<glm::mat4> mInvTransposeGlobalMatrices;
-        std::vector<bool> mMatricesChanged;
+        std::vector<uint8_t> mMatricesChanged;  ///< Per-node flags. Bytes rather than bits, so that nodes can be updated in parallel.
+
+        // Transform propagation
+        std::vector<uint32_t> mNodeOrder;       ///< Scene graph nodes sorted by their depth in the graph.
+        std::vector<uint32_t> mLevelOffsets;    ///< Offset of each depth level in mNodeOrder, followed by the node count.
+        std::vector<uint32_t> mDirtyNodes;      ///< Nodes updated by the last call to animate(), in index order.
+        std::vector<uint32_t> mPrevDirtyNodes;  ///< Nodes updated by the call before that.
+        std::vector<uint32_t> mWorldUploadNodes; ///< Scratch list of the world matrices to upload.
+        uint32_t mFullWorldUploadCount = 0;     ///< Number of frames for which the whole world matrix buffer must be uploaded. The buffer is double-buffered.
 
         bool mHasAnimations = false;
         bool mAnimationChanged = true;
         uint32_t mActiveAnimationCount = 0;
         double mLastAnimationTime = 0;
+        std::string mBenchmarkReport;
         Scene* mpScene = nullptr;
 
         Buffer::SharedPtr mpWorldMatricesBuffer;
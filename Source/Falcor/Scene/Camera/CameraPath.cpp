@@ -0,0 +1,421 @@
+/***************************************************************************
+ # Copyright (c) 2020, NVIDIA CORPORATION. All rights reserved.
+ #
+ # Redistribution and use in source and binary forms, with or without
+ # modification, are permitted provided that the following conditions
+ # are met:
+ #  * Redistributions of source code must retain the above copyright
+ #    notice, this list of conditions and the following disclaimer.
+ #  * Redistributions in binary form must reproduce the above copyright
+ #    notice, this list of conditions and the following disclaimer in the
+ #    documentation and/or other materials provided with the distribution.
+ #  * Neither the name of NVIDIA CORPORATION nor the names of its
+ #    contributors may be used to endorse or promote products derived
+ #    from this software without specific prior written permission.
+ #
+ # THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ # EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ # IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ # PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ # CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ # EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ # PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ # PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ # OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ # (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ # OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **************************************************************************/
+#include "stdafx.h"
+#include "CameraPath.h"
+#include "Utils/Timing/Profiler.h"
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+namespace Falcor
+{
+    namespace
+    {
+        const uint32_t kMagic = 0x54504346; // "FCPT"
+        const uint32_t kVersion = 1;
+        const uint32_t kArcLengthSamplesPerSection = 32;
+
+        // The profiler double-buffers its GPU timers. During frame i it resolves the timers of frame i - 1 (see Profiler::getGpuTime()).
+        const uint32_t kGpuTimeLatency = 1;
+
+        struct FileHeader
+        {
+            uint32_t magic;
+            uint32_t version;
+            uint32_t keyframeCount;
+            uint32_t reserved;
+        };
+
+        struct FileKeyframe
+        {
+            double time;
+            float3 position;
+            float3 target;
+            float3 up;
+            float focalLength;
+        };
+
+        static_assert(sizeof(FileHeader) == 16, "FileHeader size changed, bump kVersion");
+        static_assert(sizeof(FileKeyframe) == 48, "FileKeyframe size changed, bump kVersion");
+
+        CameraPathBenchmark::Stats calcStats(std::vector<double> times)
+        {
+            CameraPathBenchmark::Stats stats;
+            if (times.empty()) return stats;
+
+            std::sort(times.begin(), times.end());
+            auto percentile = [&times](double p)
+            {
+                size_t rank = (size_t)std::ceil(p * times.size());
+                return times[std::min(std::max(rank, size_t(1)), times.size()) - 1];
+            };
+
+            double sum = 0.0;
+            for (double t : times) sum += t;
+            stats.meanMs = sum / times.size();
+            stats.p50Ms = percentile(0.50);
+            stats.p95Ms = percentile(0.95);
+            stats.p99Ms = percentile(0.99);
+            stats.maxMs = times.back();
+            return stats;
+        }
+    }
+
+    CameraPath::SharedPtr CameraPath::create()
+    {
+        return SharedPtr(new CameraPath());
+    }
+
+    CameraPath::SharedPtr CameraPath::createFromFile(const std::string& filename)
+    {
+        std::ifstream stream(filename, std::ios::binary);
+        if (!stream)
+        {
+            logError("CameraPath::createFromFile() - Can't open '" + filename + "'.");
+            return nullptr;
+        }
+
+        FileHeader header = {};
+        stream.read((char*)&header, sizeof(header));
+        if (!stream || header.magic != kMagic || header.version != kVersion)
+        {
+            logError("CameraPath::createFromFile() - '" + filename + "' is not a camera path file.");
+            return nullptr;
+        }
+
+        std::vector<FileKeyframe> keyframes(header.keyframeCount);
+        stream.read((char*)keyframes.data(), keyframes.size() * sizeof(FileKeyframe));
+        if (!stream)
+        {
+            logError("CameraPath::createFromFile() - '" + filename + "' is truncated.");
+            return nullptr;
+        }
+
+        auto pPath = create();
+        pPath->mKeyframes.reserve(keyframes.size());
+        for (const auto& k : keyframes)
+        {
+            pPath->addKeyframe({ k.time, k.position, k.target, k.up, k.focalLength });
+        }
+        if (pPath->getKeyframeCount() != header.keyframeCount)
+        {
+            logWarning("CameraPath::createFromFile() - '" + filename + "' has keyframes out of time order. They were ignored.");
+        }
+        return pPath;
+    }
+
+    bool CameraPath::write(const std::string& filename) const
+    {
+        std::ofstream stream(filename, std::ios::binary | std::ios::trunc);
+        if (!stream)
+        {
+            logError("CameraPath::write() - Can't create '" + filename + "'.");
+            return false;
+        }
+
+        FileHeader header = {};
+        header.magic = kMagic;
+        header.version = kVersion;
+        header.keyframeCount = (uint32_t)mKeyframes.size();
+        stream.write((const char*)&header, sizeof(header));
+
+        for (const auto& k : mKeyframes)
+        {
+            FileKeyframe record = { k.time, k.position, k.target, k.up, k.focalLength };
+            stream.write((const char*)&record, sizeof(record));
+        }
+
+        if (!stream)
+        {
+            logError("CameraPath::write() - Can't write to '" + filename + "'.");
+            return false;
+        }
+        return true;
+    }
+
+    void CameraPath::addKeyframe(const Keyframe& keyframe)
+    {
+        if (!mKeyframes.empty() && keyframe.time <= mKeyframes.back().time) return;
+        mKeyframes.push_back(keyframe);
+        mSplinesDirty = true;
+    }
+
+    void CameraPath::record(const Camera* pCamera, double time, double minInterval)
+    {
+        if (!mKeyframes.empty() && time - mKeyframes.back().time < minInterval) return;
+
+        Keyframe keyframe;
+        keyframe.time = time;
+        keyframe.position = pCamera->getPosition();
+        keyframe.target = pCamera->getTarget();
+        keyframe.up = pCamera->getUpVector();
+        keyframe.focalLength = pCamera->getFocalLength();
+        addKeyframe(keyframe);
+    }
+
+    void CameraPath::clear()
+    {
+        mKeyframes.clear();
+        mSplinesDirty = true;
+    }
+
+    void CameraPath::updateSplines() const
+    {
+        mSplinesDirty = false;
+        mpPositionSpline = nullptr;
+        mpTargetSpline = nullptr;
+        mpUpSpline = nullptr;
+        mpFocalLengthSpline = nullptr;
+
+        const size_t count = mKeyframes.size();
+        if (count < 2) return;
+
+        std::vector<float3> positions(count), targets(count), ups(count);
+        std::vector<float> focalLengths(count), durations(count - 1);
+        for (size_t i = 0; i < count; i++)
+        {
+            positions[i] = mKeyframes[i].position;
+            targets[i] = mKeyframes[i].target;
+            ups[i] = mKeyframes[i].up;
+            focalLengths[i] = mKeyframes[i].focalLength;
+            if (i + 1 < count) durations[i] = float(mKeyframes[i + 1].time - mKeyframes[i].time);
+        }
+
+        mpPositionSpline = std::make_unique<CubicSpline<float3>>(positions.data(), (uint32_t)count, durations.data());
+        mpTargetSpline = std::make_unique<CubicSpline<float3>>(targets.data(), (uint32_t)count, durations.data());
+        mpUpSpline = std::make_unique<CubicSpline<float3>>(ups.data(), (uint32_t)count, durations.data());
+        mpFocalLengthSpline = std::make_unique<CubicSpline<float>>(focalLengths.data(), (uint32_t)count, durations.data());
+        mpPositionSpline->buildArcLengthTable(kArcLengthSamplesPerSection);
+    }
+
+    CameraPath::Keyframe CameraPath::evaluate(double time) const
+    {
+        if (mKeyframes.empty()) return {};
+        if (time <= mKeyframes.front().time || mKeyframes.size() == 1) return mKeyframes.front();
+        if (time >= mKeyframes.back().time) return mKeyframes.back();
+
+        // Find the section that contains the time and the time's parameter within it.
+        auto it = std::upper_bound(mKeyframes.begin(), mKeyframes.end(), time, [](double t, const Keyframe& k) { return t < k.time; });
+        const size_t section = std::distance(mKeyframes.begin(), it) - 1;
+        const Keyframe& k0 = mKeyframes[section];
+        const Keyframe& k1 = mKeyframes[section + 1];
+        const float u = std::min(float((time - k0.time) / (k1.time - k0.time)), 1.f);
+        return evaluateAtParameter(float(section) + u, time);
+    }
+
+    CameraPath::Keyframe CameraPath::evaluateAtDistance(float distance) const
+    {
+        if (mKeyframes.empty()) return {};
+        if (mKeyframes.size() == 1) return mKeyframes.front();
+        if (mSplinesDirty) updateSplines();
+
+        // Report the time at which the recorded camera passed the same point.
+        float t = mpPositionSpline->getParameterAtArcLength(distance);
+        const size_t section = std::min((size_t)t, mKeyframes.size() - 2);
+        const Keyframe& k0 = mKeyframes[section];
+        const Keyframe& k1 = mKeyframes[section + 1];
+        double time = k0.time + (t - float(section)) * (k1.time - k0.time);
+        return evaluateAtParameter(t, time);
+    }
+
+    CameraPath::Keyframe CameraPath::evaluateAtParameter(float t, double time) const
+    {
+        if (mSplinesDirty) updateSplines();
+
+        Keyframe keyframe;
+        keyframe.time = time;
+        keyframe.position = mpPositionSpline->evaluate(t);
+        keyframe.target = mpTargetSpline->evaluate(t);
+        keyframe.focalLength = mpFocalLengthSpline->evaluate(t);
+
+        // The interpolated up vector isn't unit length, and can vanish if the camera rolls quickly between keyframes.
+        float3 up = mpUpSpline->evaluate(t);
+        float upLength = glm::length(up);
+        if (upLength > 1e-6f) keyframe.up = up / upLength;
+        else keyframe.up = mKeyframes[std::min((size_t)std::round(t), mKeyframes.size() - 1)].up;
+        return keyframe;
+    }
+
+    float CameraPath::getLength() const
+    {
+        if (mKeyframes.size() < 2) return 0.f;
+        if (mSplinesDirty) updateSplines();
+        return mpPositionSpline->getArcLength();
+    }
+
+    void CameraPath::apply(Camera* pCamera, double time) const
+    {
+        if (mKeyframes.empty()) return;
+        applyKeyframe(pCamera, evaluate(time));
+    }
+
+    void CameraPath::applyKeyframe(Camera* pCamera, const Keyframe& keyframe)
+    {
+        pCamera->setPosition(keyframe.position);
+        pCamera->setTarget(keyframe.target);
+        pCamera->setUpVector(keyframe.up);
+        pCamera->setFocalLength(keyframe.focalLength);
+    }
+
+    CameraPathBenchmark::SharedPtr CameraPathBenchmark::create(const CameraPath::SharedPtr& pPath, const Desc& desc)
+    {
+        if (!pPath || pPath->getKeyframeCount() == 0)
+        {
+            logError("CameraPathBenchmark::create() - The camera path is empty.");
+            return nullptr;
+        }
+        if (desc.timeStep <= 0.0)
+        {
+            logError("CameraPathBenchmark::create() - The time step must be positive.");
+            return nullptr;
+        }
+        return SharedPtr(new CameraPathBenchmark(pPath, desc));
+    }
+
+    bool CameraPathBenchmark::start()
+    {
+        stop();
+        if (!gProfileEnabled)
+        {
+            logWarning("CameraPathBenchmark::start() - The profiler is disabled. Enable it to benchmark the camera path.");
+            return false;
+        }
+
+        // Frame i shows the path at time i * timeStep, up to and including the end of the path.
+        mFrameCount = (uint32_t)std::floor(mpPath->getDuration() / mDesc.timeStep + 1e-6) + 1;
+        if (mFrameCount <= mDesc.warmupFrames)
+        {
+            logWarning("CameraPathBenchmark::start() - The path is not longer than the warmup. No frames will be timed.");
+        }
+
+        mFrame = 0;
+        mFrameTimes.clear();
+        mGpuTimes.clear();
+        mFrameTimes.reserve(mFrameCount);
+        mGpuTimes.reserve(mFrameCount);
+
+        mRunning = true;
+        return true;
+    }
+
+    void CameraPathBenchmark::stop()
+    {
+        mRunning = false;
+    }
+
+    void CameraPathBenchmark::recordFrameTimes()
+    {
+        // Called at the start of frame mFrame. The wall-clock time since the start of the previous frame is the frame time of mFrame - 1,
+        // and the GPU time the profiler reports now is that of frame mFrame - kGpuTimeLatency. Each is recorded for the frames after the warmup.
+        CpuTimer::TimePoint now = CpuTimer::getCurrentTimePoint();
+        if (mFrame > mDesc.warmupFrames && mFrame <= mFrameCount)
+        {
+            mFrameTimes.push_back(CpuTimer::calcDuration(mLastFrameStart, now));
+        }
+        if (mFrame >= mDesc.warmupFrames + kGpuTimeLatency && mFrame < mFrameCount + kGpuTimeLatency)
+        {
+            const std::string eventName = "#" + mDesc.gpuEvent;
+            mGpuTimes.push_back(Profiler::isEventRegistered(eventName) ? Profiler::getEventGpuTime(eventName) : 0.0);
+        }
+        mLastFrameStart = now;
+    }
+
+    double CameraPathBenchmark::beginFrame(Camera* pCamera)
+    {
+        if (!mRunning) return -1.0;
+        if (!gProfileEnabled)
+        {
+            logWarning("CameraPathBenchmark::beginFrame() - The profiler was disabled during the replay. Stopping the benchmark.");
+            stop();
+            return -1.0;
+        }
+
+        // Keep rendering the end of the path until the times of its last frame are available.
+        recordFrameTimes();
+        if (mFrame == mFrameCount - 1 + kGpuTimeLatency)
+        {
+            stop();
+            return -1.0;
+        }
+
+        const uint32_t pathFrame = std::min(mFrame, mFrameCount - 1);
+        double time = mpPath->getStartTime() + pathFrame * mDesc.timeStep;
+        if (mDesc.constantSpeed && mpPath->getLength() > 0.f)
+        {
+            const double duration = mpPath->getDuration();
+            const float distance = float(mpPath->getLength() * std::min(pathFrame * mDesc.timeStep / duration, 1.0));
+            CameraPath::Keyframe keyframe = mpPath->evaluateAtDistance(distance);
+            CameraPath::applyKeyframe(pCamera, keyframe);
+            time = keyframe.time;
+        }
+        else
+        {
+            mpPath->apply(pCamera, time);
+        }
+        mFrame++;
+        return time;
+    }
+
+    CameraPathBenchmark::Report CameraPathBenchmark::getReport() const
+    {
+        Report report;
+        report.frameCount = (uint32_t)mFrameTimes.size();
+        report.timeStep = mDesc.timeStep;
+        report.frameTime = calcStats(mFrameTimes);
+        report.gpuTime = calcStats(mGpuTimes);
+        return report;
+    }
+
+    std::string CameraPathBenchmark::Report::toString() const
+    {
+        auto printStats = [](std::ostringstream& oss, const Stats& stats)
+        {
+            oss << "mean " << stats.meanMs << " ms, p50 " << stats.p50Ms << " ms, p95 " << stats.p95Ms << " ms, p99 " << stats.p99Ms << " ms, max " << stats.maxMs << " ms";
+        };
+
+        std::ostringstream oss;
+        oss << std::fixed << std::setprecision(2)
+            << "  Frames:              " << frameCount << " (time step " << timeStep * 1000.0 << " ms)" << std::endl
+            << "  Frame time:          ";
+        printStats(oss, frameTime);
+        oss << std::endl << "  GPU time:            ";
+        printStats(oss, gpuTime);
+        return oss.str();
+    }
+
+    SCRIPT_BINDING(CameraPath)
+    {
+        auto cameraPath = m.regClass(CameraPath);
+        cameraPath.ctor(&CameraPath::createFromFile, "filename"_a);
+        cameraPath.func_("write", &CameraPath::write, "filename"_a);
+        cameraPath.func_("apply", &CameraPath::apply, "camera"_a, "time"_a);
+        cameraPath.roProperty("duration", &CameraPath::getDuration);
+        cameraPath.roProperty("length", &CameraPath::getLength);
+        cameraPath.roProperty("keyframeCount", &CameraPath::getKeyframeCount);
+    }
+}
@@ -0,0 +1,207 @@
+/***************************************************************************
+ # Copyright (c) 2020, NVIDIA CORPORATION. All rights reserved.
+ #
+ # Redistribution and use in source and binary forms, with or without
+ # modification, are permitted provided that the following conditions
+ # are met:
+ #  * Redistributions of source code must retain the above copyright
+ #    notice, this list of conditions and the following disclaimer.
+ #  * Redistributions in binary form must reproduce the above copyright
+ #    notice, this list of conditions and the following disclaimer in the
+ #    documentation and/or other materials provided with the distribution.
+ #  * Neither the name of NVIDIA CORPORATION nor the names of its
+ #    contributors may be used to endorse or promote products derived
+ #    from this software without specific prior written permission.
+ #
+ # THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ # EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ # IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ # PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ # CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ # EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ # PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ # PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ # OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ # (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ # OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **************************************************************************/
+#pragma once
+#include "Camera.h"
+#include "Utils/Math/CubicSpline.h"
+#include "Utils/Timing/CpuTimer.h"
+
+namespace Falcor
+{
+    /** A recorded camera path.
+        The path stores keyframes of the camera position, target, up vector and focal length over time, and replays them by interpolating
+        each quantity with a time-based cubic spline. Paths are saved in a compact binary file.
+    */
+    class dlldecl CameraPath
+    {
+    public:
+        using SharedPtr = std::shared_ptr<CameraPath>;
+
+        struct Keyframe
+        {
+            double time = 0.0;          ///< Time in seconds.
+            float3 position;
+            float3 target;
+            float3 up;
+            float focalLength = 0.f;
+        };
+
+        /** Create an empty path.
+        */
+        static SharedPtr create();
+
+        /** Load a path from a file written by write().
+            \return A new object, or nullptr if the file can't be read.
+        */
+        static SharedPtr createFromFile(const std::string& filename);
+
+        /** Write the path to a file.
+            \return True if the file was written.
+        */
+        bool write(const std::string& filename) const;
+
+        /** Append a keyframe. Keyframes must be added in increasing time order, a keyframe not later than the last one is ignored.
+        */
+        void addKeyframe(const Keyframe& keyframe);
+
+        /** Sample a camera into the path. Call every frame while recording.
+            \param[in] pCamera The camera to sample.
+            \param[in] time Current time in seconds.
+            \param[in] minInterval Minimum time between keyframes. Samples closer to the last keyframe are dropped to keep the path compact.
+        */
+        void record(const Camera* pCamera, double time, double minInterval = 0.1);
+
+        /** Evaluate the path. Times outside the path are clamped to its ends.
+        */
+        Keyframe evaluate(double time) const;
+
+        /** Evaluate the path at a distance travelled by the camera along it, measured from the first keyframe.
+            Stepping the distance uniformly moves the camera at constant speed, regardless of the timing of the keyframes.
+            Distances outside [0, getLength()] are clamped to the ends of the path.
+        */
+        Keyframe evaluateAtDistance(float distance) const;
+
+        /** Move a camera to its position on the path at a given time.
+        */
+        void apply(Camera* pCamera, double time) const;
+
+        /** Move a camera to a keyframe.
+        */
+        static void applyKeyframe(Camera* pCamera, const Keyframe& keyframe);
+
+        /** Remove all keyframes.
+        */
+        void clear();
+
+        double getStartTime() const { return mKeyframes.empty() ? 0.0 : mKeyframes.front().time; }
+        double getDuration() const { return mKeyframes.empty() ? 0.0 : mKeyframes.back().time - mKeyframes.front().time; }
+
+        /** Get the distance travelled by the camera along the path.
+        */
+        float getLength() const;
+
+        uint32_t getKeyframeCount() const { return (uint32_t)mKeyframes.size(); }
+        const std::vector<Keyframe>& getKeyframes() const { return mKeyframes; }
+
+    private:
+        CameraPath() = default;
+        void updateSplines() const;
+        Keyframe evaluateAtParameter(float t, double time) const;
+
+        std::vector<Keyframe> mKeyframes;
+
+        // The splines are built on the first evaluation after the keyframes change. All of them have one section per pair of keyframes,
+        // so a global spline parameter indexes the same point in time on each. The position spline also has an arc length table.
+        mutable bool mSplinesDirty = true;
+        mutable std::unique_ptr<CubicSpline<float3>> mpPositionSpline;
+        mutable std::unique_ptr<CubicSpline<float3>> mpTargetSpline;
+        mutable std::unique_ptr<CubicSpline<float3>> mpUpSpline;
+        mutable std::unique_ptr<CubicSpline<float>> mpFocalLengthSpline;
+    };
+
+    /** Replays a camera path with a fixed time step and collects per-frame timings.
+        Stepping the path by a fixed time per frame, rather than by wall-clock time, renders the same sequence of views on every run,
+        so the timings of different runs and builds can be compared.
+    */
+    class dlldecl CameraPathBenchmark
+    {
+    public:
+        using SharedPtr = std::shared_ptr<CameraPathBenchmark>;
+
+        struct Desc
+        {
+            double timeStep = 1.0 / 60.0;       ///< Path time advanced per frame, in seconds.
+            uint32_t warmupFrames = 16;         ///< Frames rendered at the start of the path before timings are collected.
+            bool constantSpeed = false;         ///< Move the camera at constant speed over the duration of the path, instead of following the recorded timing. Keeps the per-frame change in view, and so the workload, even.
+            std::string gpuEvent = "onFrameRender"; ///< Profiler event whose GPU time is reported. Nested events are named with their parents, e.g. "onFrameRender#myPass".
+        };
+
+        struct Stats
+        {
+            double meanMs = 0.0;
+            double p50Ms = 0.0;
+            double p95Ms = 0.0;
+            double p99Ms = 0.0;
+            double maxMs = 0.0;
+        };
+
+        struct Report
+        {
+            uint32_t frameCount = 0;
+            double timeStep = 0.0;
+            Stats frameTime;                    ///< Wall-clock time between frames.
+            Stats gpuTime;                      ///< GPU time of the profiler event. Zero if the event was not profiled.
+
+            std::string toString() const;
+        };
+
+        /** Create a benchmark for a path.
+            \param[in] pPath The path to replay. Must have at least one keyframe.
+            \param[in] desc Replay settings.
+        */
+        static SharedPtr create(const CameraPath::SharedPtr& pPath, const Desc& desc);
+
+        /** Start the replay from the beginning of the path.
+            The GPU times come from the profiler, which must already be enabled. The benchmark doesn't enable it itself, because
+            toggling the profiler while a profiled event is open unbalances its event stack.
+            \return False if the profiler is disabled.
+        */
+        bool start();
+
+        /** Stop the replay.
+        */
+        void stop();
+
+        /** Advance the replay by one frame and move the camera along the path. Call once per frame, before the scene is updated.
+            The times of a frame are recorded at the start of the next one, so the replay stops one frame after the last frame of the path.
+            It also stops if the profiler is disabled during the replay.
+            \param[in] pCamera The camera to move.
+            \return The path time of the frame, or a negative value if the replay is not running.
+        */
+        double beginFrame(Camera* pCamera);
+
+        bool isRunning() const { return mRunning; }
+
+        /** Get the report of the last run. Percentiles are nearest-rank over the frames after the warmup.
+        */
+        Report getReport() const;
+
+    private:
+        CameraPathBenchmark(const CameraPath::SharedPtr& pPath, const Desc& desc) : mpPath(pPath), mDesc(desc) {}
+        void recordFrameTimes();
+
+        CameraPath::SharedPtr mpPath;
+        Desc mDesc;
+
+        bool mRunning = false;
+        uint32_t mFrame = 0;
+        uint32_t mFrameCount = 0;
+        CpuTimer::TimePoint mLastFrameStart;
+        std::vector<double> mFrameTimes;
+        std::vector<double> mGpuTimes;
+    };
+}
@@ -0,0 +1,260 @@
+/***************************************************************************
+ # Copyright (c) 2020, NVIDIA CORPORATION. All rights reserved.
+ #
+ # Redistribution and use in source and binary forms, with or without
+ # modification, are permitted provided that the following conditions
+ # are met:
+ #  * Redistributions of source code must retain the above copyright
+ #    notice, this list of conditions and the following disclaimer.
+ #  * Redistributions in binary form must reproduce the above copyright
+ #    notice, this list of conditions and the following disclaimer in the
+ #    documentation and/or other materials provided with the distribution.
+ #  * Neither the name of NVIDIA CORPORATION nor the names of its
+ #    contributors may be used to endorse or promote products derived
+ #    from this software without specific prior written permission.
+ #
+ # THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ # EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ # IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ # PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ # CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ # EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ # PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ # PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ # OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ # (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ # OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **************************************************************************/
+#include "stdafx.h"
+#include "GeometryPageFile.h"
+#include "Utils/Math/BoxBatch.h"
+
+namespace Falcor
+{
+    namespace
+    {
+        const uint32_t kMagic = 0x46504746; // "FGPF"
+        const uint32_t kVersion = 1;
+
+        struct FileHeader
+        {
+            uint32_t magic;
+            uint32_t version;
+            uint32_t pageSize;
+            uint32_t vertexStride;
+            uint32_t meshCount;
+            uint32_t reserved;
+            uint64_t pageCount;         ///< Number of pages, including the header page. The mesh table starts after the last page.
+        };
+
+        struct MeshRecord
+        {
+            float3 boundsMin;
+            float3 boundsMax;
+            uint32_t vertexCount;
+            uint32_t indexCount;
+            uint64_t firstPage;
+            uint32_t pageCount;
+            uint32_t reserved;
+        };
+
+        static_assert(sizeof(FileHeader) == 32, "FileHeader size changed, bump kVersion");
+        static_assert(sizeof(MeshRecord) == 48, "MeshRecord size changed, bump kVersion");
+
+        uint64_t getMeshBytes(uint32_t vertexCount, uint32_t indexCount, uint32_t vertexStride)
+        {
+            return uint64_t(vertexCount) * vertexStride + uint64_t(indexCount) * sizeof(uint32_t);
+        }
+    }
+
+    GeometryPageFile::Writer::UniquePtr GeometryPageFile::Writer::create(const std::string& filename, uint32_t vertexStride, uint32_t pageSize)
+    {
+        if (vertexStride < sizeof(float3) || pageSize == 0 || pageSize % 4096 != 0)
+        {
+            logError("GeometryPageFile::Writer::create() - Invalid vertex stride or page size.");
+            return nullptr;
+        }
+
+        auto pWriter = UniquePtr(new Writer(filename, vertexStride, pageSize));
+        if (!pWriter->mStream)
+        {
+            logError("GeometryPageFile::Writer::create() - Can't create '" + filename + "'.");
+            return nullptr;
+        }
+        return pWriter;
+    }
+
+    GeometryPageFile::Writer::Writer(const std::string& filename, uint32_t vertexStride, uint32_t pageSize)
+        : mFilename(filename)
+        , mVertexStride(vertexStride)
+        , mPageSize(pageSize)
+        , mPadding(pageSize, 0)
+    {
+        // Reserve the header page. The header is written by finish(), once the page count is known.
+        mStream.open(filename, std::ios::binary | std::ios::out | std::ios::trunc);
+        mStream.write((const char*)mPadding.data(), mPageSize);
+    }
+
+    GeometryPageFile::Writer::~Writer()
+    {
+        if (mFinished) return;
+        mStream.close();
+        std::remove(mFilename.c_str());
+    }
+
+    uint32_t GeometryPageFile::Writer::addMesh(const void* pVertices, uint32_t vertexCount, const uint32_t* pIndices, uint32_t indexCount)
+    {
+        assert(!mFinished);
+        if (mFinished || !mStream) return kInvalidMesh;
+
+        const uint64_t vertexBytes = uint64_t(vertexCount) * mVertexStride;
+        const uint64_t indexBytes = uint64_t(indexCount) * sizeof(uint32_t);
+        const uint64_t meshBytes = vertexBytes + indexBytes;
+        const uint64_t pageCount = (meshBytes + mPageSize - 1) / mPageSize;
+        if (pageCount > UINT32_MAX || mMeshes.size() >= UINT32_MAX)
+        {
+            logError("GeometryPageFile::Writer::addMesh() - The mesh is too large.");
+            return kInvalidMesh;
+        }
+
+        MeshInfo info;
+        info.bounds = boundPoints((const float3*)pVertices, vertexCount, mVertexStride);
+        info.vertexCount = vertexCount;
+        info.indexCount = indexCount;
+        info.firstPage = mPageCount;
+        info.pageCount = (uint32_t)pageCount;
+
+        mStream.write((const char*)pVertices, vertexBytes);
+        mStream.write((const char*)pIndices, indexBytes);
+        mStream.write((const char*)mPadding.data(), pageCount * mPageSize - meshBytes);
+        if (!mStream)
+        {
+            logError("GeometryPageFile::Writer::addMesh() - Can't write to '" + mFilename + "'.");
+            return kInvalidMesh;
+        }
+
+        mPageCount += pageCount;
+        mMeshes.push_back(info);
+        return (uint32_t)mMeshes.size() - 1;
+    }
+
+    bool GeometryPageFile::Writer::finish()
+    {
+        if (mFinished) return false;
+        mFinished = true;
+
+        for (const auto& mesh : mMeshes)
+        {
+            MeshRecord record = {};
+            record.boundsMin = mesh.bounds.minPoint;
+            record.boundsMax = mesh.bounds.maxPoint;
+            record.vertexCount = mesh.vertexCount;
+            record.indexCount = mesh.indexCount;
+            record.firstPage = mesh.firstPage;
+            record.pageCount = mesh.pageCount;
+            mStream.write((const char*)&record, sizeof(record));
+        }
+
+        FileHeader header = {};
+        header.magic = kMagic;
+        header.version = kVersion;
+        header.pageSize = mPageSize;
+        header.vertexStride = mVertexStride;
+        header.meshCount = (uint32_t)mMeshes.size();
+        header.pageCount = mPageCount;
+        mStream.seekp(0);
+        mStream.write((const char*)&header, sizeof(header));
+        mStream.close();
+
+        if (mStream.fail())
+        {
+            logError("GeometryPageFile::Writer::finish() - Can't write to '" + mFilename + "'.");
+            return false;
+        }
+        return true;
+    }
+
+    GeometryPageFile::SharedPtr GeometryPageFile::open(const std::string& filename, bool deleteOnClose)
+    {
+        auto pFile = SharedPtr(new GeometryPageFile());
+        pFile->mFilename = filename;
+        pFile->mDeleteOnClose = deleteOnClose;
+        auto& stream = pFile->mStream;
+        stream.open(filename, std::ios::binary | std::ios::in);
+
+        FileHeader header = {};
+        stream.read((char*)&header, sizeof(header));
+        if (!stream)
+        {
+            logError("GeometryPageFile::open() - Can't read '" + filename + "'.");
+            return nullptr;
+        }
+        if (header.magic != kMagic || header.version != kVersion || header.pageSize == 0 || header.vertexStride < sizeof(float3) || header.pageCount == 0)
+        {
+            logError("GeometryPageFile::open() - '" + filename + "' is not a geometry page file of version " + std::to_string(kVersion) + ".");
+            return nullptr;
+        }
+
+        pFile->mPageSize = header.pageSize;
+        pFile->mVertexStride = header.vertexStride;
+        pFile->mPageCount = header.pageCount;
+
+        std::vector<MeshRecord> records(header.meshCount);
+        stream.seekg(header.pageCount * header.pageSize);
+        stream.read((char*)records.data(), records.size() * sizeof(MeshRecord));
+        if (!stream)
+        {
+            logError("GeometryPageFile::open() - The mesh table of '" + filename + "' is truncated.");
+            return nullptr;
+        }
+
+        pFile->mMeshes.resize(records.size());
+        for (size_t i = 0; i < records.size(); i++)
+        {
+            const auto& record = records[i];
+            uint64_t meshBytes = getMeshBytes(record.vertexCount, record.indexCount, header.vertexStride);
+            if (record.firstPage == 0 || record.firstPage + record.pageCount > header.pageCount || meshBytes > uint64_t(record.pageCount) * header.pageSize)
+            {
+                logError("GeometryPageFile::open() - Mesh " + std::to_string(i) + " of '" + filename + "' has an invalid page range.");
+                return nullptr;
+            }
+
+            auto& mesh = pFile->mMeshes[i];
+            mesh.bounds.minPoint = record.boundsMin;
+            mesh.bounds.maxPoint = record.boundsMax;
+            mesh.vertexCount = record.vertexCount;
+            mesh.indexCount = record.indexCount;
+            mesh.firstPage = record.firstPage;
+            mesh.pageCount = record.pageCount;
+            pFile->mVertexBytes += uint64_t(record.vertexCount) * header.vertexStride;
+            pFile->mIndexBytes += uint64_t(record.indexCount) * sizeof(uint32_t);
+        }
+
+        return pFile;
+    }
+
+    GeometryPageFile::~GeometryPageFile()
+    {
+        mStream.close();
+        if (mDeleteOnClose) std::remove(mFilename.c_str());
+    }
+
+    bool GeometryPageFile::readMesh(uint32_t meshID, std::vector<uint8_t>& data)
+    {
+        assert(meshID < mMeshes.size());
+        const auto& mesh = mMeshes[meshID];
+        data.resize(size_t(mesh.pageCount) * mPageSize);
+
+        std::lock_guard<std::mutex> lock(mMutex);
+        mStream.clear();
+        mStream.seekg(mesh.firstPage * mPageSize);
+        mStream.read((char*)data.data(), data.size());
+        if (!mStream)
+        {
+            logError("GeometryPageFile::readMesh() - Can't read mesh " + std::to_string(meshID) + " from '" + mFilename + "'.");
+            data.clear();
+            return false;
+        }
+        return true;
+    }
+}
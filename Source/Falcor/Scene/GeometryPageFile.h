@@ -0,0 +1,155 @@
+/***************************************************************************
+ # Copyright (c) 2020, NVIDIA CORPORATION. All rights reserved.
+ #
+ # Redistribution and use in source and binary forms, with or without
+ # modification, are permitted provided that the following conditions
+ # are met:
+ #  * Redistributions of source code must retain the above copyright
+ #    notice, this list of conditions and the following disclaimer.
+ #  * Redistributions in binary form must reproduce the above copyright
+ #    notice, this list of conditions and the following disclaimer in the
+ #    documentation and/or other materials provided with the distribution.
+ #  * Neither the name of NVIDIA CORPORATION nor the names of its
+ #    contributors may be used to endorse or promote products derived
+ #    from this software without specific prior written permission.
+ #
+ # THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ # EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ # IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ # PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ # CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ # EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ # PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ # PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ # OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ # (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ # OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **************************************************************************/
+#pragma once
+#include "Utils/Math/BBox.h"
+#include <fstream>
+#include <mutex>
+
+namespace Falcor
+{
+    /** Paged file holding the vertex and index data of meshes, read back one mesh at a time for streaming.
+
+        The file is a sequence of fixed-size pages. Page 0 holds the header. Each mesh is stored in consecutive pages,
+        its vertices followed by its 32-bit indices, and padded to a page boundary so that pages never span meshes.
+        The mesh table follows the last page. Meshes are appended as they are added, so a scene never needs to hold
+        all of its geometry in memory while writing the file.
+        This class does not use the device.
+    */
+    class dlldecl GeometryPageFile
+    {
+    public:
+        using SharedPtr = std::shared_ptr<GeometryPageFile>;
+
+        static const uint32_t kDefaultPageSize = 64 * 1024;
+        static const uint32_t kInvalidMesh = -1;
+
+        struct MeshInfo
+        {
+            BBox bounds;                ///< Object space bounds of the vertex positions.
+            uint32_t vertexCount = 0;
+            uint32_t indexCount = 0;
+            uint64_t firstPage = 0;     ///< First page of the mesh data.
+            uint32_t pageCount = 0;     ///< Number of pages of the mesh data.
+        };
+
+        /** Writes a page file. Meshes are written to disk as they are added.
+        */
+        class dlldecl Writer
+        {
+        public:
+            using UniquePtr = std::unique_ptr<Writer>;
+
+            /** Create a page file, replacing an existing file.
+                \param[in] filename The file to write.
+                \param[in] vertexStride Size of a vertex in bytes. The vertex must start with its float3 position.
+                \param[in] pageSize Page size in bytes. Must be a multiple of 4096.
+                \return A new object, or nullptr if the file can't be created.
+            */
+            static UniquePtr create(const std::string& filename, uint32_t vertexStride, uint32_t pageSize = kDefaultPageSize);
+
+            /** Destructor. Deletes the file if it was not finished.
+            */
+            ~Writer();
+
+            /** Append a mesh.
+                \param[in] pVertices vertexCount vertices of vertexStride bytes.
+                \param[in] vertexCount Number of vertices.
+                \param[in] pIndices Indices, relative to the first vertex of the mesh.
+                \param[in] indexCount Number of indices.
+                \return The ID of the mesh in the file, or kInvalidMesh if writing failed.
+            */
+            uint32_t addMesh(const void* pVertices, uint32_t vertexCount, const uint32_t* pIndices, uint32_t indexCount);
+
+            /** Write the mesh table and the header and close the file. No meshes can be added afterwards.
+                \return True if the whole file was written.
+            */
+            bool finish();
+
+            /** Get the meshes written so far.
+            */
+            const std::vector<MeshInfo>& getMeshes() const { return mMeshes; }
+
+            const std::string& getFilename() const { return mFilename; }
+
+        private:
+            Writer(const std::string& filename, uint32_t vertexStride, uint32_t pageSize);
+
+            std::ofstream mStream;
+            std::string mFilename;
+            uint32_t mVertexStride;
+            uint32_t mPageSize;
+            uint64_t mPageCount = 1;    ///< Page 0 holds the header.
+            std::vector<MeshInfo> mMeshes;
+            std::vector<uint8_t> mPadding;
+            bool mFinished = false;
+        };
+
+        /** Open a page file for reading.
+            \param[in] filename The file to open.
+            \param[in] deleteOnClose Delete the file when the object is destroyed. Used for temporary files.
+            \return A new object, or nullptr if the file can't be opened or is not a valid page file.
+        */
+        static SharedPtr open(const std::string& filename, bool deleteOnClose = false);
+
+        ~GeometryPageFile();
+
+        /** Read the data of a mesh: its vertices followed by its indices.
+            The call is thread safe.
+            \param[in] meshID The mesh to read.
+            \param[out] data Receives the mesh data, resized to a whole number of pages.
+            \return True if the data was read.
+        */
+        bool readMesh(uint32_t meshID, std::vector<uint8_t>& data);
+
+        uint32_t getMeshCount() const { return (uint32_t)mMeshes.size(); }
+        const MeshInfo& getMesh(uint32_t meshID) const { return mMeshes[meshID]; }
+        uint32_t getVertexStride() const { return mVertexStride; }
+        uint32_t getPageSize() const { return mPageSize; }
+        uint64_t getPageCount() const { return mPageCount; }
+        const std::string& getFilename() const { return mFilename; }
+
+        /** Get the total size of the vertex and index data of all meshes in bytes, not counting page padding.
+        */
+        uint64_t getVertexBytes() const { return mVertexBytes; }
+        uint64_t getIndexBytes() const { return mIndexBytes; }
+
+    private:
+        GeometryPageFile() = default;
+
+        std::ifstream mStream;
+        std::mutex mMutex;          ///< Serializes reads of mStream.
+        std::string mFilename;
+        bool mDeleteOnClose = false;
+        uint32_t mVertexStride = 0;
+        uint32_t mPageSize = 0;
+        uint64_t mPageCount = 0;
+        uint64_t mVertexBytes = 0;
+        uint64_t mIndexBytes = 0;
+        std::vector<MeshInfo> mMeshes;
+    };
+}
@@ -0,0 +1,335 @@
+/***************************************************************************
+ # Copyright (c) 2020, NVIDIA CORPORATION. All rights reserved.
+ #
+ # Redistribution and use in source and binary forms, with or without
+ # modification, are permitted provided that the following conditions
+ # are met:
+ #  * Redistributions of source code must retain the above copyright
+ #    notice, this list of conditions and the following disclaimer.
+ #  * Redistributions in binary form must reproduce the above copyright
+ #    notice, this list of conditions and the following disclaimer in the
+ #    documentation and/or other materials provided with the distribution.
+ #  * Neither the name of NVIDIA CORPORATION nor the names of its
+ #    contributors may be used to endorse or promote products derived
+ #    from this software without specific prior written permission.
+ #
+ # THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ # EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ # IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ # PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ # CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ # EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ # PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ # PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ # OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ # (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ # OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **************************************************************************/
+#include "stdafx.h"
+#include "GeometryStreamer.h"
+#include <algorithm>
+
+namespace Falcor
+{
+    void GeometryStreamer::RangeAllocator::init(uint32_t capacity)
+    {
+        mCapacity = capacity;
+        mFreeRanges.clear();
+        if (capacity > 0) mFreeRanges[0] = capacity;
+    }
+
+    uint32_t GeometryStreamer::RangeAllocator::allocate(uint32_t count)
+    {
+        if (count == 0) return 0;
+        for (auto it = mFreeRanges.begin(); it != mFreeRanges.end(); ++it)
+        {
+            if (it->second < count) continue;
+            uint32_t offset = it->first;
+            uint32_t remaining = it->second - count;
+            mFreeRanges.erase(it);
+            if (remaining > 0) mFreeRanges[offset + count] = remaining;
+            return offset;
+        }
+        return kInvalidOffset;
+    }
+
+    void GeometryStreamer::RangeAllocator::release(uint32_t offset, uint32_t count)
+    {
+        if (count == 0) return;
+        assert(offset + count <= mCapacity);
+
+        auto next = mFreeRanges.lower_bound(offset);
+        assert(next == mFreeRanges.end() || next->first >= offset + count);
+
+        // Merge with the previous and the next free range.
+        if (next != mFreeRanges.begin())
+        {
+            auto prev = std::prev(next);
+            assert(prev->first + prev->second <= offset);
+            if (prev->first + prev->second == offset)
+            {
+                offset = prev->first;
+                count += prev->second;
+                mFreeRanges.erase(prev);
+            }
+        }
+        if (next != mFreeRanges.end() && next->first == offset + count)
+        {
+            count += next->second;
+            mFreeRanges.erase(next);
+        }
+        mFreeRanges[offset] = count;
+    }
+
+    GeometryStreamer::UniquePtr GeometryStreamer::create(const GeometryPageFile::SharedPtr& pFile, const Desc& desc)
+    {
+        assert(pFile);
+        return UniquePtr(new GeometryStreamer(pFile, desc));
+    }
+
+    GeometryStreamer::GeometryStreamer(const GeometryPageFile::SharedPtr& pFile, const Desc& desc)
+        : mpFile(pFile)
+        , mDesc(desc)
+        , mMeshes(pFile->getMeshCount())
+    {
+        // Split the budget so that both pools fill up at the same rate on average.
+        uint64_t vertexBytes = pFile->getVertexBytes();
+        uint64_t indexBytes = pFile->getIndexBytes();
+        double vertexRatio = vertexBytes + indexBytes > 0 ? double(vertexBytes) / double(vertexBytes + indexBytes) : 0.5;
+        uint64_t vertexCapacity = uint64_t(desc.budget * vertexRatio) / pFile->getVertexStride();
+        uint64_t indexCapacity = uint64_t(desc.budget * (1.0 - vertexRatio)) / sizeof(uint32_t);
+        mVertexPool.init((uint32_t)std::min<uint64_t>(vertexCapacity, UINT32_MAX));
+        mIndexPool.init((uint32_t)std::min<uint64_t>(indexCapacity, UINT32_MAX));
+
+        mIoThread = std::thread(&GeometryStreamer::ioThreadMain, this);
+    }
+
+    GeometryStreamer::~GeometryStreamer()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mStop = true;
+        }
+        mWorkAvailable.notify_all();
+        mIoThread.join();
+    }
+
+    void GeometryStreamer::update(const std::vector<float>& priorities, std::vector<LoadedMesh>& loaded, std::vector<uint32_t>& evicted)
+    {
+        assert(priorities.size() == mMeshes.size());
+        loaded.clear();
+        evicted.clear();
+        mFrame++;
+
+        // Collect the completed loads.
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            loaded.swap(mCompleted);
+        }
+        auto loadedEnd = std::remove_if(loaded.begin(), loaded.end(), [this](LoadedMesh& mesh)
+        {
+            auto& state = mMeshes[mesh.meshID];
+            const auto& info = mpFile->getMesh(mesh.meshID);
+            assert(state.state == State::Loading);
+            mStats.pendingLoadCount--;
+            if (mesh.data.empty() && info.pageCount > 0)
+            {
+                // The read failed. The page file logged the error.
+                release(mesh.meshID);
+                return true;
+            }
+
+            state.state = State::Resident;
+            state.lruIt = mLru.insert(mLru.end(), mesh.meshID);
+            mesh.vertexOffset = state.vertexOffset;
+            mesh.indexOffset = state.indexOffset;
+
+            mStats.residentMeshCount++;
+            mStats.residentBytes += uint64_t(info.vertexCount) * mpFile->getVertexStride() + uint64_t(info.indexCount) * sizeof(uint32_t);
+            mStats.residentPageCount += info.pageCount;
+            mStats.loadCount++;
+            mStats.loadedBytes += mesh.data.size();
+            return false;
+        });
+        loaded.erase(loadedEnd, loaded.end());
+
+        // Mark the wanted meshes as recently used.
+        std::vector<uint32_t> candidates;
+        for (uint32_t meshID = 0; meshID < (uint32_t)mMeshes.size(); meshID++)
+        {
+            auto& state = mMeshes[meshID];
+            state.priority = priorities[meshID];
+            if (state.priority < mDesc.minPriority) continue;
+
+            state.lastWantedFrame = mFrame;
+            if (state.state == State::Resident) mLru.splice(mLru.end(), mLru, state.lruIt);
+            else if (state.state == State::NotResident) candidates.push_back(meshID);
+        }
+
+        // Cancel the queued loads that are no longer wanted, and reprioritize the others.
+        std::vector<uint32_t> cancelled;
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            auto queueEnd = std::remove_if(mQueue.begin(), mQueue.end(), [&](Request& request)
+            {
+                request.priority = mMeshes[request.meshID].priority;
+                if (request.priority >= mDesc.minPriority) return false;
+                cancelled.push_back(request.meshID);
+                return true;
+            });
+            mQueue.erase(queueEnd, mQueue.end());
+        }
+        for (uint32_t meshID : cancelled)
+        {
+            release(meshID);
+            mStats.pendingLoadCount--;
+        }
+
+        // Schedule the loads with the highest priority.
+        std::sort(candidates.begin(), candidates.end(), [this](uint32_t a, uint32_t b) { return mMeshes[a].priority > mMeshes[b].priority; });
+        std::vector<Request> requests;
+        for (uint32_t meshID : candidates)
+        {
+            if (mStats.pendingLoadCount >= mDesc.maxPendingLoads) break;
+            if (!allocate(meshID, mMeshes[meshID].priority, evicted)) continue;
+            mMeshes[meshID].state = State::Loading;
+            mStats.pendingLoadCount++;
+            requests.push_back({ meshID, mMeshes[meshID].priority });
+        }
+
+        // A mesh loaded by this update may have been evicted again to make room. The caller never sees it.
+        std::vector<uint32_t> dropped;
+        loadedEnd = std::remove_if(loaded.begin(), loaded.end(), [&](const LoadedMesh& mesh)
+        {
+            if (mMeshes[mesh.meshID].state == State::Resident) return false;
+            dropped.push_back(mesh.meshID);
+            return true;
+        });
+        loaded.erase(loadedEnd, loaded.end());
+        if (!dropped.empty())
+        {
+            auto evictedEnd = std::remove_if(evicted.begin(), evicted.end(), [&](uint32_t meshID) { return std::find(dropped.begin(), dropped.end(), meshID) != dropped.end(); });
+            evicted.erase(evictedEnd, evicted.end());
+        }
+
+        if (!requests.empty())
+        {
+            {
+                std::lock_guard<std::mutex> lock(mMutex);
+                mQueue.insert(mQueue.end(), requests.begin(), requests.end());
+            }
+            mWorkAvailable.notify_one();
+        }
+    }
+
+    void GeometryStreamer::waitIdle()
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        mWorkDone.wait(lock, [this]() { return mQueue.empty() && mReadingCount == 0; });
+    }
+
+    bool GeometryStreamer::allocate(uint32_t meshID, float priority, std::vector<uint32_t>& evicted)
+    {
+        const auto& info = mpFile->getMesh(meshID);
+        if (info.vertexCount > mVertexPool.getCapacity() || info.indexCount > mIndexPool.getCapacity())
+        {
+            if (!mReportedOversizedMesh) logWarning("GeometryStreamer: Mesh " + std::to_string(meshID) + " is larger than the streaming budget and will not be loaded.");
+            mReportedOversizedMesh = true;
+            return false;
+        }
+
+        auto& state = mMeshes[meshID];
+        while (true)
+        {
+            uint32_t vertexOffset = mVertexPool.allocate(info.vertexCount);
+            uint32_t indexOffset = mIndexPool.allocate(info.indexCount);
+            if (vertexOffset != RangeAllocator::kInvalidOffset && indexOffset != RangeAllocator::kInvalidOffset)
+            {
+                state.vertexOffset = vertexOffset;
+                state.indexOffset = indexOffset;
+                return true;
+            }
+            if (vertexOffset != RangeAllocator::kInvalidOffset) mVertexPool.release(vertexOffset, info.vertexCount);
+            if (indexOffset != RangeAllocator::kInvalidOffset) mIndexPool.release(indexOffset, info.indexCount);
+
+            uint32_t victim = findEvictionCandidate(priority);
+            if (victim == GeometryPageFile::kInvalidMesh) return false;
+            evict(victim, evicted);
+        }
+    }
+
+    void GeometryStreamer::release(uint32_t meshID)
+    {
+        const auto& info = mpFile->getMesh(meshID);
+        auto& state = mMeshes[meshID];
+        mVertexPool.release(state.vertexOffset, info.vertexCount);
+        mIndexPool.release(state.indexOffset, info.indexCount);
+        state.state = State::NotResident;
+    }
+
+    void GeometryStreamer::evict(uint32_t meshID, std::vector<uint32_t>& evicted)
+    {
+        auto& state = mMeshes[meshID];
+        assert(state.state == State::Resident);
+        mLru.erase(state.lruIt);
+        release(meshID);
+        evicted.push_back(meshID);
+
+        const auto& info = mpFile->getMesh(meshID);
+        mStats.residentMeshCount--;
+        mStats.residentBytes -= uint64_t(info.vertexCount) * mpFile->getVertexStride() + uint64_t(info.indexCount) * sizeof(uint32_t);
+        mStats.residentPageCount -= info.pageCount;
+        mStats.evictionCount++;
+    }
+
+    uint32_t GeometryStreamer::findEvictionCandidate(float priority) const
+    {
+        if (mLru.empty()) return GeometryPageFile::kInvalidMesh;
+
+        // Meshes not wanted this frame are at the front of the list.
+        uint32_t leastRecent = mLru.front();
+        if (mMeshes[leastRecent].lastWantedFrame < mFrame) return leastRecent;
+
+        // All resident meshes are wanted. Only give up one with a much lower priority, so that meshes of similar priority don't evict each other every frame.
+        uint32_t victim = GeometryPageFile::kInvalidMesh;
+        float victimPriority = priority / mDesc.evictionHysteresis;
+        for (uint32_t meshID : mLru)
+        {
+            if (mMeshes[meshID].priority < victimPriority)
+            {
+                victim = meshID;
+                victimPriority = mMeshes[meshID].priority;
+            }
+        }
+        return victim;
+    }
+
+    void GeometryStreamer::ioThreadMain()
+    {
+        while (true)
+        {
+            Request request;
+            {
+                std::unique_lock<std::mutex> lock(mMutex);
+                mWorkAvailable.wait(lock, [this]() { return mStop || !mQueue.empty(); });
+                if (mStop) return;
+
+                auto it = std::max_element(mQueue.begin(), mQueue.end(), [](const Request& a, const Request& b) { return a.priority < b.priority; });
+                request = *it;
+                mQueue.erase(it);
+                mReadingCount++;
+            }
+
+            LoadedMesh mesh;
+            mesh.meshID = request.meshID;
+            mpFile->readMesh(request.meshID, mesh.data);
+
+            {
+                std::lock_guard<std::mutex> lock(mMutex);
+                mCompleted.push_back(std::move(mesh));
+                mReadingCount--;
+            }
+            mWorkDone.notify_all();
+        }
+    }
+}
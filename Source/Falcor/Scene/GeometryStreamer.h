@@ -0,0 +1,193 @@
+/***************************************************************************
+ # Copyright (c) 2020, NVIDIA CORPORATION. All rights reserved.
+ #
+ # Redistribution and use in source and binary forms, with or without
+ # modification, are permitted provided that the following conditions
+ # are met:
+ #  * Redistributions of source code must retain the above copyright
+ #    notice, this list of conditions and the following disclaimer.
+ #  * Redistributions in binary form must reproduce the above copyright
+ #    notice, this list of conditions and the following disclaimer in the
+ #    documentation and/or other materials provided with the distribution.
+ #  * Neither the name of NVIDIA CORPORATION nor the names of its
+ #    contributors may be used to endorse or promote products derived
+ #    from this software without specific prior written permission.
+ #
+ # THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ # EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ # IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ # PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ # CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ # EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ # PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ # PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ # OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ # (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ # OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **************************************************************************/
+#pragma once
+#include "GeometryPageFile.h"
+#include <condition_variable>
+#include <list>
+#include <map>
+#include <thread>
+
+namespace Falcor
+{
+    /** Decides which meshes of a geometry page file are resident, and reads them on a background thread.
+
+        Resident meshes live in a vertex pool and an index pool whose sizes are set by a memory budget.
+        Each update, the caller passes a priority per mesh. Wanted meshes (priority at least Desc::minPriority)
+        are loaded in priority order. When a pool is full, meshes that were not wanted recently are evicted first,
+        in least recently used order. A wanted mesh is only evicted for a mesh with a much higher priority.
+        The caller copies loaded meshes to its own storage at the offsets chosen by the streamer.
+        This class does not use the device.
+    */
+    class dlldecl GeometryStreamer
+    {
+    public:
+        using UniquePtr = std::unique_ptr<GeometryStreamer>;
+
+        struct Desc
+        {
+            uint64_t budget = 512ull << 20;     ///< Bytes of vertex and index data that can be resident. Split between the pools in the ratio of the vertex and index data in the file.
+            uint32_t maxPendingLoads = 16;      ///< Maximum number of meshes queued or being read.
+            float minPriority = 1e-3f;          ///< Meshes with a lower priority are not wanted. They are not loaded, and are evicted first.
+            float evictionHysteresis = 2.f;     ///< A wanted mesh is only evicted for a mesh whose priority is this many times higher.
+        };
+
+        /** First-fit allocator of ranges in a pool. Adjacent free ranges are merged.
+        */
+        class dlldecl RangeAllocator
+        {
+        public:
+            static const uint32_t kInvalidOffset = -1;
+
+            /** Reset to a single free range.
+                \param[in] capacity Number of elements in the pool.
+            */
+            void init(uint32_t capacity);
+
+            /** Allocate a range from the first free range that is large enough.
+                \param[in] count Number of elements.
+                \return The offset of the range, or kInvalidOffset if no free range is large enough.
+            */
+            uint32_t allocate(uint32_t count);
+
+            /** Release a range returned by allocate().
+                \param[in] offset Offset of the range.
+                \param[in] count Number of elements, as passed to allocate().
+            */
+            void release(uint32_t offset, uint32_t count);
+
+            uint32_t getCapacity() const { return mCapacity; }
+
+        private:
+            std::map<uint32_t, uint32_t> mFreeRanges;   ///< Offset to size of each free range.
+            uint32_t mCapacity = 0;
+        };
+
+        struct LoadedMesh
+        {
+            uint32_t meshID = 0;
+            uint32_t vertexOffset = 0;      ///< First vertex of the mesh in the vertex pool.
+            uint32_t indexOffset = 0;       ///< First index of the mesh in the index pool.
+            std::vector<uint8_t> data;      ///< Vertices followed by the indices, as stored in the page file.
+        };
+
+        struct Stats
+        {
+            uint32_t residentMeshCount = 0;
+            uint32_t pendingLoadCount = 0;  ///< Meshes queued or being read.
+            uint64_t residentBytes = 0;     ///< Vertex and index bytes of the resident meshes.
+            uint64_t residentPageCount = 0; ///< Pages of the resident meshes in the page file.
+            uint64_t loadCount = 0;         ///< Meshes loaded since creation.
+            uint64_t loadedBytes = 0;       ///< Bytes read from the page file since creation.
+            uint64_t evictionCount = 0;     ///< Meshes evicted since creation.
+        };
+
+        /** Create a streamer. Starts the I/O thread.
+            \param[in] pFile The page file to stream from.
+            \param[in] desc Streaming options.
+            \return A new object.
+        */
+        static UniquePtr create(const GeometryPageFile::SharedPtr& pFile, const Desc& desc);
+
+        ~GeometryStreamer();
+
+        /** Collect the meshes read since the last update, and schedule loads and evictions for new priorities.
+            Evictions take effect immediately: the pool ranges of evicted meshes can be handed out in the same call.
+            \param[in] priorities Priority of each mesh in the file, usually its projected size on screen.
+            \param[out] loaded Receives the meshes that became resident. Cleared first.
+            \param[out] evicted Receives the IDs of the meshes that are no longer resident. Cleared first.
+        */
+        void update(const std::vector<float>& priorities, std::vector<LoadedMesh>& loaded, std::vector<uint32_t>& evicted);
+
+        /** Block until all scheduled loads have been read. The next call to update() returns them.
+        */
+        void waitIdle();
+
+        bool isResident(uint32_t meshID) const { return mMeshes[meshID].state == State::Resident; }
+
+        /** Get the number of vertices and indices the pools can hold.
+        */
+        uint32_t getVertexCapacity() const { return mVertexPool.getCapacity(); }
+        uint32_t getIndexCapacity() const { return mIndexPool.getCapacity(); }
+
+        const GeometryPageFile::SharedPtr& getFile() const { return mpFile; }
+        const Desc& getDesc() const { return mDesc; }
+        const Stats& getStats() const { return mStats; }
+
+    private:
+        GeometryStreamer(const GeometryPageFile::SharedPtr& pFile, const Desc& desc);
+
+        enum class State
+        {
+            NotResident,
+            Loading,
+            Resident,
+        };
+
+        struct MeshState
+        {
+            State state = State::NotResident;
+            uint32_t vertexOffset = 0;
+            uint32_t indexOffset = 0;
+            float priority = 0.f;
+            uint64_t lastWantedFrame = 0;
+            std::list<uint32_t>::iterator lruIt;    ///< Position in mLru if resident.
+        };
+
+        struct Request
+        {
+            uint32_t meshID;
+            float priority;
+        };
+
+        bool allocate(uint32_t meshID, float priority, std::vector<uint32_t>& evicted);
+        void release(uint32_t meshID);
+        void evict(uint32_t meshID, std::vector<uint32_t>& evicted);
+        uint32_t findEvictionCandidate(float priority) const;
+        void ioThreadMain();
+
+        GeometryPageFile::SharedPtr mpFile;
+        Desc mDesc;
+        std::vector<MeshState> mMeshes;
+        std::list<uint32_t> mLru;               ///< Resident meshes, least recently wanted first.
+        RangeAllocator mVertexPool;
+        RangeAllocator mIndexPool;
+        uint64_t mFrame = 0;
+        Stats mStats;
+        bool mReportedOversizedMesh = false;
+
+        // Shared with the I/O thread
+        std::thread mIoThread;
+        std::mutex mMutex;
+        std::condition_variable mWorkAvailable;
+        std::condition_variable mWorkDone;
+        std::vector<Request> mQueue;            ///< Loads not started yet. The I/O thread takes the highest priority first.
+        std::vector<LoadedMesh> mCompleted;     ///< Loads read since the last update.
+        uint32_t mReadingCount = 0;             ///< Loads taken by the I/O thread and not completed.
+        bool mStop = false;
+    };
+}
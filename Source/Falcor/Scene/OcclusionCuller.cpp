@@ -0,0 +1,400 @@
+/***************************************************************************
+ # Copyright (c) 2020, NVIDIA CORPORATION. All rights reserved.
+ #
+ # Redistribution and use in source and binary forms, with or without
+ # modification, are permitted provided that the following conditions
+ # are met:
+ #  * Redistributions of source code must retain the above copyright
+ #    notice, this list of conditions and the following disclaimer.
+ #  * Redistributions in binary form must reproduce the above copyright
+ #    notice, this list of conditions and the following disclaimer in the
+ #    documentation and/or other materials provided with the distribution.
+ #  * Neither the name of NVIDIA CORPORATION nor the names of its
+ #    contributors may be used to endorse or promote products derived
+ #    from this software without specific prior written permission.
+ #
+ # THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ # EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ # IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ # PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ # CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ # EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ # PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ # PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ # OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ # (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ # OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **************************************************************************/
+#include "stdafx.h"
+#include "OcclusionCuller.h"
+#include <iomanip>
+#include <limits>
+#include <sstream>
+#include <unordered_map>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#define FALCOR_OCCLUSION_CULLER_USE_SSE 1
+#include <emmintrin.h>
+#else
+#define FALCOR_OCCLUSION_CULLER_USE_SSE 0
+#endif
+
+namespace Falcor
+{
+    namespace
+    {
+        const float kClearDepth = std::numeric_limits<float>::max();
+        const float kMinW = 1e-5f;  ///< Vertices with a smaller clip space w are treated as crossing the near plane.
+        const uint32_t kTilePixelCount = OcclusionCuller::kTileWidth * OcclusionCuller::kTileHeight;
+        const uint32_t kNoVertex = std::numeric_limits<uint32_t>::max();
+
+        /** Project a clip space position to the depth buffer. y points down, depth is z/w.
+        */
+        float3 toScreen(const float4& clip, uint32_t width, uint32_t height)
+        {
+            float invW = 1.f / clip.w;
+            return float3((clip.x * invW * 0.5f + 0.5f) * width, (0.5f - clip.y * invW * 0.5f) * height, clip.z * invW);
+        }
+
+        /** Edge function E(x, y) = a * x + b * y + c, evaluated at pixel centers.
+        */
+        struct Edge
+        {
+            float a, b, c;
+        };
+
+        /** Create the edge function of the line through p and q that is positive on the side of r.
+            With shrink set, the edge is moved inwards by half a pixel, so that E >= 0 at a pixel center only if the whole pixel is on the positive side.
+        */
+        Edge makeEdge(const float3& p, const float3& q, const float3& r, bool shrink)
+        {
+            Edge edge;
+            edge.a = p.y - q.y;
+            edge.b = q.x - p.x;
+            edge.c = -(edge.a * p.x + edge.b * p.y);
+            if (edge.a * r.x + edge.b * r.y + edge.c < 0.f)
+            {
+                edge.a = -edge.a;
+                edge.b = -edge.b;
+                edge.c = -edge.c;
+            }
+            if (shrink) edge.c -= 0.5f * (std::abs(edge.a) + std::abs(edge.b));
+            return edge;
+        }
+
+        /** A set of edge functions that must all be non-negative for a pixel to be written.
+        */
+        struct CoverageTest
+        {
+            Edge edges[5];
+            uint32_t edgeCount = 0;
+        };
+    }
+
+    OcclusionCuller::UniquePtr OcclusionCuller::create(const Desc& desc)
+    {
+        return UniquePtr(new OcclusionCuller(desc));
+    }
+
+    OcclusionCuller::OcclusionCuller(const Desc& desc)
+    {
+        mTileCountX = std::max((desc.width + kTileWidth - 1) / kTileWidth, 1u);
+        mTileCountY = std::max((desc.height + kTileHeight - 1) / kTileHeight, 1u);
+        mWidth = mTileCountX * kTileWidth;
+        mHeight = mTileCountY * kTileHeight;
+        mDepth.resize(mWidth * mHeight, kClearDepth);
+        mTileMaxDepth.resize(mTileCountX * mTileCountY, kClearDepth);
+    }
+
+    uint32_t OcclusionCuller::addOccluderMesh(std::vector<float3> positions, std::vector<uint32_t> indices)
+    {
+        assert(indices.size() % 3 == 0);
+
+        // Find the triangle across each edge. Edges with more than two triangles only keep the first pair.
+        std::vector<uint32_t> opposite(indices.size(), kNoVertex);
+        std::unordered_map<uint64_t, uint32_t> openEdges;
+        for (uint32_t i = 0; i < (uint32_t)indices.size(); i++)
+        {
+            uint32_t triangle = i - i % 3;
+            uint32_t v0 = indices[i];
+            uint32_t v1 = indices[triangle + (i + 1) % 3];
+            if (v0 == v1) continue;
+            uint64_t key = ((uint64_t)std::min(v0, v1) << 32) | std::max(v0, v1);
+            auto it = openEdges.find(key);
+            if (it == openEdges.end())
+            {
+                openEdges[key] = i;
+                continue;
+            }
+            uint32_t other = it->second;
+            uint32_t otherTriangle = other - other % 3;
+            opposite[i] = indices[otherTriangle + (other + 2) % 3];
+            opposite[other] = indices[triangle + (i + 2) % 3];
+            openEdges.erase(it);
+        }
+
+        mMeshes.push_back({ std::move(positions), std::move(indices), std::move(opposite) });
+        return (uint32_t)mMeshes.size() - 1;
+    }
+
+    void OcclusionCuller::beginFrame(const glm::mat4& viewProj)
+    {
+        mViewProj = viewProj;
+        std::fill(mDepth.begin(), mDepth.end(), kClearDepth);
+        std::fill(mTileMaxDepth.begin(), mTileMaxDepth.end(), kClearDepth);
+        mStats = Stats();
+    }
+
+    void OcclusionCuller::rasterize(uint32_t occluderMeshID, const glm::mat4& world)
+    {
+        CpuTimer timer;
+        timer.update();
+
+        const Mesh& mesh = mMeshes[occluderMeshID];
+        const glm::mat4 worldViewProj = mViewProj * world;
+        mClipPositions.resize(mesh.positions.size());
+        for (size_t i = 0; i < mesh.positions.size(); i++) mClipPositions[i] = worldViewProj * float4(mesh.positions[i], 1.f);
+
+        for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3)
+        {
+            const float4* v[3];
+            const float4* opposite[3];
+            for (size_t j = 0; j < 3; j++)
+            {
+                v[j] = &mClipPositions[mesh.indices[i + j]];
+                opposite[j] = mesh.opposite[i + j] != kNoVertex ? &mClipPositions[mesh.opposite[i + j]] : nullptr;
+            }
+            rasterizeTriangle(v, opposite);
+        }
+
+        timer.update();
+        mStats.occluderCount++;
+        mStats.triangleCount += (uint32_t)mesh.indices.size() / 3;
+        mStats.rasterTime += timer.delta() * 1000.0;
+    }
+
+    void OcclusionCuller::rasterizeTriangle(const float4* v[3], const float4* opposite[3])
+    {
+        // Skip triangles crossing the near plane. Dropping occluder triangles only makes the culling more conservative.
+        if (v[0]->w < kMinW || v[1]->w < kMinW || v[2]->w < kMinW) return;
+
+        float3 p[3];
+        for (int i = 0; i < 3; i++) p[i] = toScreen(*v[i], mWidth, mHeight);
+        float area = (p[1].x - p[0].x) * (p[2].y - p[0].y) - (p[1].y - p[0].y) * (p[2].x - p[0].x);
+        if (std::abs(area) < 1e-8f) return;
+
+        // Only pixels the occluder fully covers are written, otherwise geometry seen through slivers or gaps narrower than a pixel would be culled.
+        // Occluders are not backface culled, so each edge is oriented towards the opposite vertex.
+        // The first test keeps the pixels inside the triangle shrunk by half a pixel.
+        CoverageTest tests[4];
+        uint32_t testCount = 1;
+        Edge shrunk[3];
+        for (int e = 0; e < 3; e++)
+        {
+            shrunk[e] = makeEdge(p[e], p[(e + 1) % 3], p[(e + 2) % 3], true);
+            tests[0].edges[tests[0].edgeCount++] = shrunk[e];
+        }
+
+        // The whole triangle is written at the depth of its farthest vertex.
+        float depth = std::max(std::max(p[0].z, p[1].z), p[2].z);
+
+        // Shrinking every edge would leave the pixels along edges shared by two triangles of the mesh empty.
+        // A pixel straddling such an edge is covered if the pixel is inside the union of both triangles, which is tested by
+        // shrinking all edges of both triangles except the shared one. The triangle is then written at the farthest depth of both.
+        for (int e = 0; e < 3; e++)
+        {
+            if (!opposite[e] || opposite[e]->w < kMinW) continue;
+            const float3& pa = p[e];
+            const float3& pb = p[(e + 1) % 3];
+            float3 q = toScreen(*opposite[e], mWidth, mHeight);
+
+            // The adjacent triangle must be on the other side of the shared edge on screen.
+            Edge shared = makeEdge(pa, pb, p[(e + 2) % 3], false);
+            if (shared.a * q.x + shared.b * q.y + shared.c >= 0.f) continue;
+
+            CoverageTest& test = tests[testCount++];
+            test.edges[test.edgeCount++] = shared;
+            test.edges[test.edgeCount++] = shrunk[(e + 1) % 3];
+            test.edges[test.edgeCount++] = shrunk[(e + 2) % 3];
+            test.edges[test.edgeCount++] = makeEdge(pb, q, pa, true);
+            test.edges[test.edgeCount++] = makeEdge(q, pa, pb, true);
+            depth = std::max(depth, q.z);
+        }
+
+        // Pixel bounds of the triangle, clamped to the depth buffer.
+        float minX = std::min(std::min(p[0].x, p[1].x), p[2].x);
+        float maxX = std::max(std::max(p[0].x, p[1].x), p[2].x);
+        float minY = std::min(std::min(p[0].y, p[1].y), p[2].y);
+        float maxY = std::max(std::max(p[0].y, p[1].y), p[2].y);
+        if (maxX < 0.f || maxY < 0.f || minX >= (float)mWidth || minY >= (float)mHeight) return;
+        uint32_t tileX0 = (uint32_t)std::max(minX, 0.f) / kTileWidth;
+        uint32_t tileY0 = (uint32_t)std::max(minY, 0.f) / kTileHeight;
+        uint32_t tileX1 = (uint32_t)std::min(maxX, (float)(mWidth - 1)) / kTileWidth;
+        uint32_t tileY1 = (uint32_t)std::min(maxY, (float)(mHeight - 1)) / kTileHeight;
+
+        for (uint32_t tileY = tileY0; tileY <= tileY1; tileY++)
+        {
+            for (uint32_t tileX = tileX0; tileX <= tileX1; tileX++)
+            {
+                // A triangle behind everything in the tile cannot change it.
+                uint32_t tileIndex = tileY * mTileCountX + tileX;
+                if (depth >= mTileMaxDepth[tileIndex]) continue;
+
+                float* pTileDepth = &mDepth[tileIndex * kTilePixelCount];
+                for (uint32_t row = 0; row < kTileHeight; row++)
+                {
+                    float y = (float)(tileY * kTileHeight + row) + 0.5f;
+                    for (uint32_t quad = 0; quad < kTileWidth; quad += 4)
+                    {
+                        float x = (float)(tileX * kTileWidth + quad) + 0.5f;
+                        float* pDepth = pTileDepth + row * kTileWidth + quad;
+#if FALCOR_OCCLUSION_CULLER_USE_SSE
+                        const __m128 xs = _mm_add_ps(_mm_set1_ps(x), _mm_set_ps(3.f, 2.f, 1.f, 0.f));
+                        __m128 inside = _mm_setzero_ps();
+                        for (uint32_t t = 0; t < testCount; t++)
+                        {
+                            __m128 passed = _mm_castsi128_ps(_mm_set1_epi32(-1));
+                            for (uint32_t e = 0; e < tests[t].edgeCount; e++)
+                            {
+                                const Edge& edge = tests[t].edges[e];
+                                __m128 value = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(edge.a), xs), _mm_set1_ps(edge.b * y + edge.c));
+                                passed = _mm_and_ps(passed, _mm_cmpge_ps(value, _mm_setzero_ps()));
+                            }
+                            inside = _mm_or_ps(inside, passed);
+                        }
+                        if (_mm_movemask_ps(inside) == 0) continue;
+
+                        __m128 stored = _mm_loadu_ps(pDepth);
+                        __m128 written = _mm_min_ps(stored, _mm_set1_ps(depth));
+                        _mm_storeu_ps(pDepth, _mm_or_ps(_mm_and_ps(inside, written), _mm_andnot_ps(inside, stored)));
+#else
+                        for (uint32_t i = 0; i < 4; i++)
+                        {
+                            float px = x + (float)i;
+                            bool inside = false;
+                            for (uint32_t t = 0; t < testCount && !inside; t++)
+                            {
+                                bool passed = true;
+                                for (uint32_t e = 0; e < tests[t].edgeCount; e++)
+                                {
+                                    const Edge& edge = tests[t].edges[e];
+                                    passed = passed && (edge.a * px + edge.b * y + edge.c >= 0.f);
+                                }
+                                inside = passed;
+                            }
+                            if (inside) pDepth[i] = std::min(pDepth[i], depth);
+                        }
+#endif
+                    }
+                }
+
+                updateTileDepth(tileIndex);
+            }
+        }
+    }
+
+    void OcclusionCuller::updateTileDepth(uint32_t tileIndex)
+    {
+        const float* pTileDepth = &mDepth[tileIndex * kTilePixelCount];
+#if FALCOR_OCCLUSION_CULLER_USE_SSE
+        __m128 maxDepth = _mm_loadu_ps(pTileDepth);
+        for (uint32_t i = 4; i < kTilePixelCount; i += 4) maxDepth = _mm_max_ps(maxDepth, _mm_loadu_ps(pTileDepth + i));
+        maxDepth = _mm_max_ps(maxDepth, _mm_shuffle_ps(maxDepth, maxDepth, _MM_SHUFFLE(1, 0, 3, 2)));
+        maxDepth = _mm_max_ps(maxDepth, _mm_shuffle_ps(maxDepth, maxDepth, _MM_SHUFFLE(2, 3, 0, 1)));
+        mTileMaxDepth[tileIndex] = _mm_cvtss_f32(maxDepth);
+#else
+        mTileMaxDepth[tileIndex] = *std::max_element(pTileDepth, pTileDepth + kTilePixelCount);
+#endif
+    }
+
+    bool OcclusionCuller::isVisible(const BoundingBox& box) const
+    {
+        // Project the corners. Boxes crossing the near plane are always visible.
+        float minX = std::numeric_limits<float>::max(), minY = minX, minDepth = minX;
+        float maxX = -minX, maxY = -minX;
+        for (uint32_t i = 0; i < 8; i++)
+        {
+            float3 corner = box.center + box.extent * float3((i & 1) ? 1.f : -1.f, (i & 2) ? 1.f : -1.f, (i & 4) ? 1.f : -1.f);
+            float4 clip = mViewProj * float4(corner, 1.f);
+            if (clip.w < kMinW) return true;
+
+            float3 p = toScreen(clip, mWidth, mHeight);
+            minX = std::min(minX, p.x);
+            maxX = std::max(maxX, p.x);
+            minY = std::min(minY, p.y);
+            maxY = std::max(maxY, p.y);
+            minDepth = std::min(minDepth, p.z);
+        }
+
+        // Leave boxes outside the depth buffer to the frustum test.
+        if (maxX < 0.f || maxY < 0.f || minX >= (float)mWidth || minY >= (float)mHeight) return true;
+
+        // The box is hidden if every pixel it touches has an occluder closer than the closest point of the box.
+        uint32_t pixelX0 = (uint32_t)std::max(minX, 0.f);
+        uint32_t pixelY0 = (uint32_t)std::max(minY, 0.f);
+        uint32_t pixelX1 = (uint32_t)std::min(maxX, (float)(mWidth - 1));
+        uint32_t pixelY1 = (uint32_t)std::min(maxY, (float)(mHeight - 1));
+
+        for (uint32_t tileY = pixelY0 / kTileHeight; tileY <= pixelY1 / kTileHeight; tileY++)
+        {
+            for (uint32_t tileX = pixelX0 / kTileWidth; tileX <= pixelX1 / kTileWidth; tileX++)
+            {
+                uint32_t tileIndex = tileY * mTileCountX + tileX;
+                if (mTileMaxDepth[tileIndex] < minDepth) continue;
+
+                const float* pTileDepth = &mDepth[tileIndex * kTilePixelCount];
+                uint32_t rowBegin = std::max(pixelY0, tileY * kTileHeight) - tileY * kTileHeight;
+                uint32_t rowEnd = std::min(pixelY1 + 1, (tileY + 1) * kTileHeight) - tileY * kTileHeight;
+                for (uint32_t row = rowBegin; row < rowEnd; row++)
+                {
+                    for (uint32_t quad = 0; quad < kTileWidth; quad += 4)
+                    {
+                        const float* pDepth = pTileDepth + row * kTileWidth + quad;
+                        uint32_t x = tileX * kTileWidth + quad;
+#if FALCOR_OCCLUSION_CULLER_USE_SSE
+                        const __m128 xs = _mm_add_ps(_mm_set1_ps((float)x), _mm_set_ps(3.f, 2.f, 1.f, 0.f));
+                        __m128 inRange = _mm_and_ps(_mm_cmpge_ps(xs, _mm_set1_ps((float)pixelX0)), _mm_cmple_ps(xs, _mm_set1_ps((float)pixelX1)));
+                        __m128 notOccluded = _mm_cmpge_ps(_mm_loadu_ps(pDepth), _mm_set1_ps(minDepth));
+                        if (_mm_movemask_ps(_mm_and_ps(inRange, notOccluded))) return true;
+#else
+                        for (uint32_t i = 0; i < 4; i++)
+                        {
+                            if (x + i >= pixelX0 && x + i <= pixelX1 && pDepth[i] >= minDepth) return true;
+                        }
+#endif
+                    }
+                }
+            }
+        }
+
+        return false;
+    }
+
+    std::vector<float> OcclusionCuller::getDepthBuffer() const
+    {
+        std::vector<float> depth(mWidth * mHeight);
+        for (uint32_t y = 0; y < mHeight; y++)
+        {
+            for (uint32_t x = 0; x < mWidth; x++)
+            {
+                uint32_t tileIndex = (y / kTileHeight) * mTileCountX + x / kTileWidth;
+                depth[y * mWidth + x] = mDepth[tileIndex * kTilePixelCount + (y % kTileHeight) * kTileWidth + x % kTileWidth];
+            }
+        }
+        return depth;
+    }
+
+    std::string OcclusionCuller::BenchmarkResult::toString() const
+    {
+        std::ostringstream oss;
+        oss << "  Views:               " << viewCount << std::endl
+            << "  Occluders:           " << occluderCount << std::endl
+            << "  Triangles:           " << std::fixed << std::setprecision(0) << trianglesPerView << " /view" << std::endl
+            << "  Raster time:         " << std::fixed << std::setprecision(3) << rasterMsPerView << " ms/view" << std::endl
+            << "  Raster throughput:   " << std::fixed << std::setprecision(0) << trianglesPerMs << " triangles/ms" << std::endl
+            << "  Test time:           " << std::fixed << std::setprecision(3) << testMsPerView << " ms/view" << std::endl
+            << "  In frustum:          " << std::fixed << std::setprecision(1) << frustumVisibleRatio * 100.0 << " %" << std::endl
+            << "  Occluded:            " << std::fixed << std::setprecision(1) << occludedRatio * 100.0 << " % of in frustum";
+        return oss.str();
+    }
+}
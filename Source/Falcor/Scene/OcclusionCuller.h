@@ -0,0 +1,151 @@
+/***************************************************************************
+ # Copyright (c) 2020, NVIDIA CORPORATION. All rights reserved.
+ #
+ # Redistribution and use in source and binary forms, with or without
+ # modification, are permitted provided that the following conditions
+ # are met:
+ #  * Redistributions of source code must retain the above copyright
+ #    notice, this list of conditions and the following disclaimer.
+ #  * Redistributions in binary form must reproduce the above copyright
+ #    notice, this list of conditions and the following disclaimer in the
+ #    documentation and/or other materials provided with the distribution.
+ #  * Neither the name of NVIDIA CORPORATION nor the names of its
+ #    contributors may be used to endorse or promote products derived
+ #    from this software without specific prior written permission.
+ #
+ # THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ # EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ # IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ # PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ # CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ # EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ # PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ # PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ # OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ # (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ # OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **************************************************************************/
+#pragma once
+#include "Utils/Math/AABB.h"
+
+namespace Falcor
+{
+    /** CPU occlusion culling with a low-resolution software depth buffer.
+        Occluder meshes are rasterized into a tiled depth buffer, and bounding boxes are tested against it.
+        The depth buffer keeps the farthest depth of each tile, so most boxes are accepted or rejected without touching pixels.
+        Pixels are processed four at a time with SSE2. This class does not use the device.
+
+        The culling is conservative: occluders only write pixels they fully cover, so geometry seen through slivers or gaps
+        narrower than a pixel stays visible. Pixels straddling an edge shared by two triangles of a mesh are written if the
+        two triangles cover them together, but pixels around vertices shared by more triangles are left empty.
+        Each occluder triangle is written at the depth of its farthest vertex, and triangles crossing the near plane are skipped,
+        so an occluder never hides geometry in front of it.
+    */
+    class dlldecl OcclusionCuller
+    {
+    public:
+        using UniquePtr = std::unique_ptr<OcclusionCuller>;
+
+        static const uint32_t kTileWidth = 8;
+        static const uint32_t kTileHeight = 4;
+
+        struct Desc
+        {
+            uint32_t width = 256;   ///< Depth buffer width. Rounded up to a multiple of kTileWidth.
+            uint32_t height = 128;  ///< Depth buffer height. Rounded up to a multiple of kTileHeight.
+        };
+
+        struct Stats
+        {
+            uint32_t occluderCount = 0;     ///< Number of occluders rasterized since the last call to beginFrame().
+            uint32_t triangleCount = 0;     ///< Number of occluder triangles rasterized since the last call to beginFrame().
+            double rasterTime = 0.0;        ///< Time spent rasterizing occluders since the last call to beginFrame() in ms.
+        };
+
+        struct BenchmarkResult
+        {
+            uint32_t viewCount = 0;
+            uint32_t occluderCount = 0;
+            double trianglesPerView = 0.0;      ///< Average number of occluder triangles rasterized per view.
+            double rasterMsPerView = 0.0;       ///< Average time to rasterize the occluders of a view.
+            double trianglesPerMs = 0.0;        ///< Raster throughput.
+            double testMsPerView = 0.0;         ///< Average time to test all instances of a view against the frustum and the occluders.
+            double frustumVisibleRatio = 0.0;   ///< Average fraction of the instances inside the frustum.
+            double occludedRatio = 0.0;         ///< Average fraction of the instances inside the frustum that are hidden by occluders.
+
+            std::string toString() const;
+        };
+
+        static UniquePtr create(const Desc& desc);
+
+        /** Add the geometry of an occluder mesh.
+            \param[in] positions Object space vertex positions.
+            \param[in] indices Triangle list indices.
+            \return The ID of the occluder mesh.
+        */
+        uint32_t addOccluderMesh(std::vector<float3> positions, std::vector<uint32_t> indices);
+
+        /** Get the number of occluder meshes.
+        */
+        uint32_t getOccluderMeshCount() const { return (uint32_t)mMeshes.size(); }
+
+        /** Get the number of triangles of an occluder mesh.
+        */
+        uint32_t getTriangleCount(uint32_t occluderMeshID) const { return (uint32_t)mMeshes[occluderMeshID].indices.size() / 3; }
+
+        /** Clear the depth buffer and set the view for the following calls.
+            \param[in] viewProj The view-projection matrix.
+        */
+        void beginFrame(const glm::mat4& viewProj);
+
+        /** Rasterize an instance of an occluder mesh into the depth buffer.
+            \param[in] occluderMeshID The occluder mesh.
+            \param[in] world The world matrix of the instance.
+        */
+        void rasterize(uint32_t occluderMeshID, const glm::mat4& world);
+
+        /** Test a world space bounding box against the depth buffer. Can be called from several threads at once.
+            \return False if the box is hidden behind the occluders.
+        */
+        bool isVisible(const BoundingBox& box) const;
+
+        /** Get the statistics of the current frame.
+        */
+        const Stats& getStats() const { return mStats; }
+
+        /** Get the depth buffer in row-major order, for debugging. Depth is z/w, smaller values are closer.
+        */
+        std::vector<float> getDepthBuffer() const;
+
+        /** Get the farthest depth of each tile in row-major order, for debugging.
+        */
+        const std::vector<float>& getTileMaxDepth() const { return mTileMaxDepth; }
+
+        uint32_t getWidth() const { return mWidth; }
+        uint32_t getHeight() const { return mHeight; }
+
+    private:
+        OcclusionCuller(const Desc& desc);
+
+        void rasterizeTriangle(const float4* v[3], const float4* opposite[3]);
+        void updateTileDepth(uint32_t tileIndex);
+
+        struct Mesh
+        {
+            std::vector<float3> positions;
+            std::vector<uint32_t> indices;
+            std::vector<uint32_t> opposite;     ///< For each triangle edge, the vertex of the adjacent triangle opposite to it, or UINT32_MAX for open edges.
+        };
+
+        uint32_t mWidth;
+        uint32_t mHeight;
+        uint32_t mTileCountX;
+        uint32_t mTileCountY;
+        std::vector<float> mDepth;          ///< Depth of each pixel, stored tile by tile, each tile in row-major order.
+        std::vector<float> mTileMaxDepth;   ///< Farthest depth of each tile.
+        glm::mat4 mViewProj;
+        std::vector<Mesh> mMeshes;
+        std::vector<float4> mClipPositions; ///< Scratch clip space positions of the occluder being rasterized.
+        Stats mStats;
+    };
+}
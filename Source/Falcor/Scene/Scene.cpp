@@ -30,6 +30,8 @@
 #include "HitInfo.h"
 #include "Raytracing/RtProgram/RtProgram.h"
 #include "Raytracing/RtProgramVars.h"
+#include "Utils/Math/BoxBatch.h"
+#include <iomanip>
 #include <sstream>
 
 namespace Falcor
@@ -61,6 +63,23 @@ namespace Falcor
         const std::string kAddViewpoint = "addViewpoint";
         const std::string kRemoveViewpoint = "kRemoveViewpoint";
         const std::string kSelectViewpoint = "selectViewpoint";
+
+        const size_t kMaxInstanceDescUploadRanges = 64; // Maximum number of separate uploads of patched instance descs per TLAS update.
+
+        // Occluder selection
+        const float kMinOccluderAreaRatio = 0.01f;      // Minimum surface area of an occluder's bounds, relative to the scene bounds.
+        const uint32_t kMaxOccluderTriangles = 4096;    // Meshes with more triangles are never occluders.
+        const uint32_t kMaxOccluderCount = 256;
+        const uint32_t kOccluderTriangleBudget = 65536; // Maximum number of occluder triangles rasterized per view.
+
+        float getSurfaceArea(const BoundingBox& box)
+        {
+            const float3& e = box.extent;
+            return 8.f * (e.x * e.y + e.y * e.z + e.z * e.x);
+        }
+
+        // Geometry streaming
+        const float kOffscreenStreamingPriority = 0.25f;    // Priority scale of instances outside the view frustum, which are loaded after the visible ones so that turning the camera doesn't show placeholders.
     }
 
     const FileDialogFilterVec Scene::kFileExtensionFilters =
@@ -139,22 +158,31 @@ namespace Falcor
     {
         PROFILE("renderScene");
 
+        const DrawArgs* pDrawCounterClockwise = &mDrawCounterClockwiseMeshes;
+        const DrawArgs* pDrawClockwise = &mDrawClockwiseMeshes;
+        if (mFrustumCulling)
+        {
+            updateCulledDrawLists(pContext);
+            pDrawCounterClockwise = &mCulledCounterClockwiseMeshes;
+            pDrawClockwise = &mCulledClockwiseMeshes;
+        }
+
         pState->setVao(mpVao);
         pVars->setParameterBlock("gScene", mpSceneBlock);
 
         bool overrideRS = !is_set(flags, RenderFlags::UserRasterizerState);
         auto pCurrentRS = pState->getRasterizerState();
 
-        if (mDrawCounterClockwiseMeshes.count)
+        if (pDrawCounterClockwise->count)
         {
             if (overrideRS) pState->setRasterizerState(nullptr);
-            pContext->drawIndexedIndirect(pState, pVars, mDrawCounterClockwiseMeshes.count, mDrawCounterClockwiseMeshes.pBuffer.get(), 0, nullptr, 0);
+            pContext->drawIndexedIndirect(pState, pVars, pDrawCounterClockwise->count, pDrawCounterClockwise->pBuffer.get(), pDrawCounterClockwise->offset, nullptr, 0);
         }
 
-        if (mDrawClockwiseMeshes.count)
+        if (pDrawClockwise->count)
         {
             if (overrideRS) pState->setRasterizerState(mpFrontClockwiseRS);
-            pContext->drawIndexedIndirect(pState, pVars, mDrawClockwiseMeshes.count, mDrawClockwiseMeshes.pBuffer.get(), 0, nullptr, 0);
+            pContext->drawIndexedIndirect(pState, pVars, pDrawClockwise->count, pDrawClockwise->pBuffer.get(), pDrawClockwise->offset, nullptr, 0);
         }
 
         if (overrideRS) pState->setRasterizerState(pCurrentRS);
@@ -246,35 +274,62 @@ namespace Falcor
 
     void Scene::updateBounds()
     {
-        const auto& globalMatrices = mpAnimationController->getGlobalMatrices();
-        std::vector<BoundingBox> instanceBBs;
-        instanceBBs.reserve(mMeshInstanceData.size());
+        const uint32_t instanceCount = (uint32_t)mMeshInstanceData.size();
+        mInstanceTree.clear();
+        mInstanceLeaves.resize(instanceCount);
 
-        for (const auto& inst : mMeshInstanceData)
+        // The culler keeps its own copy of the instance bounds, laid out for testing several instances at once.
+        if (!mpCuller) mpCuller = SceneCuller::create();
+        mpCuller->resize(instanceCount);
+
+        // Transform the bounds of all instances in one batch.
+        const auto& globalMatrices = mpAnimationController->getGlobalMatrices();
+        std::vector<BoundingBox> instanceBBs(instanceCount);
+        std::vector<glm::mat4> instanceMatrices(instanceCount);
+        for (uint32_t instanceID = 0; instanceID < instanceCount; instanceID++)
         {
-            const BoundingBox& meshBB = mMeshBBs[inst.meshID];
-            const glm::mat4& transform = globalMatrices[inst.globalMatrixID];
-            instanceBBs.push_back(meshBB.transform(transform));
+            const auto& inst = mMeshInstanceData[instanceID];
+            instanceBBs[instanceID] = mMeshBBs[inst.meshID];
+            instanceMatrices[instanceID] = globalMatrices[inst.globalMatrixID];
         }
+        transformBoxes(instanceMatrices.data(), instanceBBs.data(), instanceBBs.data(), instanceCount);
 
-        mSceneBB = instanceBBs.front();
-        for (const BoundingBox& bb : instanceBBs)
+        for (uint32_t instanceID = 0; instanceID < instanceCount; instanceID++)
         {
-            mSceneBB = BoundingBox::fromUnion(mSceneBB, bb);
+            mInstanceLeaves[instanceID] = mInstanceTree.insert(instanceBBs[instanceID], instanceID);
+            mpCuller->setInstanceBounds(instanceID, instanceBBs[instanceID]);
         }
+
+        mSceneBB = mInstanceTree.getBounds();
+        mCulledDrawListsDirty = true;
+    }
+
+    BoundingBox Scene::computeInstanceBounds(uint32_t instanceID) const
+    {
+        const auto& inst = mMeshInstanceData[instanceID];
+        return mMeshBBs[inst.meshID].transform(mpAnimationController->getGlobalMatrices()[inst.globalMatrixID]);
     }
 
     void Scene::updateMeshInstanceFlags()
     {
-        for (auto& inst : mMeshInstanceData)
+        for (uint32_t instanceID = 0; instanceID < (uint32_t)mMeshInstanceData.size(); instanceID++)
         {
-            inst.flags = MeshInstanceFlags::None;
-
-            const glm::mat4& transform = mpAnimationController->getGlobalMatrices()[inst.globalMatrixID];
-            if (doesTransformFlip(transform)) inst.flags |= MeshInstanceFlags::Flipped;
+            updateMeshInstanceFlags(instanceID);
         }
     }
 
+    bool Scene::updateMeshInstanceFlags(uint32_t instanceID)
+    {
+        auto& inst = mMeshInstanceData[instanceID];
+        uint32_t prevFlags = inst.flags;
+        inst.flags = MeshInstanceFlags::None;
+
+        const glm::mat4& transform = mpAnimationController->getGlobalMatrices()[inst.globalMatrixID];
+        if (doesTransformFlip(transform)) inst.flags |= MeshInstanceFlags::Flipped;
+
+        return inst.flags != prevFlags;
+    }
+
     void Scene::finalize()
     {
         sortMeshes();
@@ -304,18 +359,30 @@ namespace Falcor
         mGeometryStats = {};
         auto& s = mGeometryStats;
 
+        // Streamed meshes are counted with their full geometry, whether it is resident or not.
+        std::vector<uint32_t> vertexCounts(getMeshCount());
+        std::vector<uint32_t> indexCounts(getMeshCount());
         for (uint32_t meshID = 0; meshID < getMeshCount(); meshID++)
         {
-            const auto& mesh = getMesh(meshID);
-            s.uniqueVertexCount += mesh.vertexCount;
-            s.uniqueTriangleCount += mesh.indexCount / 3;
+            if (isMeshStreamed(meshID))
+            {
+                const auto& info = mpGeometryStreamer->getFile()->getMesh(mMeshStreamIDs[meshID]);
+                vertexCounts[meshID] = info.vertexCount;
+                indexCounts[meshID] = info.indexCount;
+            }
+            else
+            {
+                vertexCounts[meshID] = getMesh(meshID).vertexCount;
+                indexCounts[meshID] = getMesh(meshID).indexCount;
+            }
+            s.uniqueVertexCount += vertexCounts[meshID];
+            s.uniqueTriangleCount += indexCounts[meshID] / 3;
         }
         for (uint32_t instanceID = 0; instanceID < getMeshInstanceCount(); instanceID++)
         {
             const auto& instance = getMeshInstance(instanceID);
-            const auto& mesh = getMesh(instance.meshID);
-            s.instancedVertexCount += mesh.vertexCount;
-            s.instancedTriangleCount += mesh.indexCount / 3;
+            s.instancedVertexCount += vertexCounts[instance.meshID];
+            s.instancedTriangleCount += indexCounts[instance.meshID] / 3;
         }
     }
 
@@ -433,15 +500,21 @@ namespace Falcor
     Scene::UpdateFlags Scene::update(RenderContext* pContext, double currentTime)
     {
         mUpdates = UpdateFlags::None;
+        mChangedMeshInstances.clear();
         if (mpAnimationController->animate(pContext, currentTime))
         {
             mUpdates |= UpdateFlags::SceneGraphChanged;
-            for (const auto& inst : mMeshInstanceData)
+
+            // Find the instances transformed by the changed matrices.
+            for (uint32_t matrixID : mpAnimationController->getChangedMatrices())
             {
-                if (mpAnimationController->didMatrixChanged(inst.globalMatrixID))
-                {
-                    mUpdates |= UpdateFlags::MeshesMoved;
-                }
+                const auto& instanceIDs = mMatrixIdToInstanceIds[matrixID];
+                mChangedMeshInstances.insert(mChangedMeshInstances.end(), instanceIDs.begin(), instanceIDs.end());
+            }
+            if (!mChangedMeshInstances.empty())
+            {
+                std::sort(mChangedMeshInstances.begin(), mChangedMeshInstances.end());
+                mUpdates |= UpdateFlags::MeshesMoved;
             }
         }
 
@@ -451,14 +524,34 @@ namespace Falcor
         pContext->flush();
         if (is_set(mUpdates, UpdateFlags::MeshesMoved))
         {
-            mTlasCache.clear();
-            updateMeshInstanceFlags();
+            // Patch the transforms of the cached TLASes. They are refit or rebuilt in place on their next use.
+            for (auto& it : mTlasCache)
+            {
+                auto& tlas = it.second;
+                if (tlas.instanceDescs.patchTransforms(mpAnimationController->getChangedMatrices(), mpAnimationController->getGlobalMatrices())) tlas.outOfDate = true;
+            }
+
+            // Only moved instances can change their flags and bounds. Upload the flags that changed.
+            for (uint32_t instanceID : mChangedMeshInstances)
+            {
+                if (updateMeshInstanceFlags(instanceID)) mpMeshInstancesBuffer->setElement(instanceID, mMeshInstanceData[instanceID]);
+
+                const BoundingBox bounds = computeInstanceBounds(instanceID);
+                mInstanceTree.update(mInstanceLeaves[instanceID], bounds);
+                mpCuller->setInstanceBounds(instanceID, bounds);
+            }
+            mSceneBB = mInstanceTree.getBounds();
+            mCulledDrawListsDirty = true;
         }
 
+        // Load and evict streamed meshes for the new camera and instance bounds
+        if (mpGeometryStreamer && updateGeometryStreaming(pContext)) mUpdates |= UpdateFlags::GeometryChanged;
+
         // If a transform in the scene changed, update BLASes with skinned meshes
         if (mBlasData.size() && mHasSkinnedMesh && is_set(mUpdates, UpdateFlags::SceneGraphChanged))
         {
-            mTlasCache.clear();
+            // The BLASes are updated in place, so the instance descs stay valid.
+            for (auto& it : mTlasCache) it.second.outOfDate = true;
             buildBlas(pContext);
         }
 
@@ -568,6 +661,54 @@ namespace Falcor
             statsGroup.release();
         }
 
+        auto cullingGroup = Gui::Group(widget, "Culling");
+        if (cullingGroup.open())
+        {
+            if (cullingGroup.checkbox("Frustum culling", mFrustumCulling)) mCulledDrawListsDirty = true;
+            if (cullingGroup.checkbox("Occlusion culling", mOcclusionCulling)) mCulledDrawListsDirty = true;
+            if (cullingGroup.checkbox("Sort draws by material", mSortDrawsByMaterial)) mCulledDrawListsDirty = true;
+
+            if (mFrustumCulling)
+            {
+                const auto& stats = mpCuller->getStats();
+                std::ostringstream oss;
+                oss << "Visible instances: " << stats.visibleCount << " / " << stats.instanceCount << std::endl
+                    << "Occluded instances: " << stats.occludedCount << std::endl
+                    << "Occluders: " << mOccluders.size() << std::endl
+                    << "Cull time: " << std::fixed << std::setprecision(3) << stats.cullTime << " ms" << std::endl
+                    << "Draw list time: " << std::fixed << std::setprecision(3) << stats.drawListTime << " ms";
+                cullingGroup.text(oss.str());
+            }
+
+            if (cullingGroup.button("Benchmark culling")) mCullingBenchmarkReport = benchmarkCulling().toString();
+            if (!mCullingBenchmarkReport.empty()) cullingGroup.text(mCullingBenchmarkReport);
+
+            if (cullingGroup.button("Benchmark occlusion culling")) mOcclusionBenchmarkReport = benchmarkOcclusionCulling().toString();
+            cullingGroup.tooltip("Runs over the saved viewpoints and the current camera.");
+            if (!mOcclusionBenchmarkReport.empty()) cullingGroup.text(mOcclusionBenchmarkReport);
+
+            cullingGroup.release();
+        }
+
+        if (mpGeometryStreamer)
+        {
+            auto streamingGroup = Gui::Group(widget, "Geometry Streaming");
+            if (streamingGroup.open())
+            {
+                const auto& stats = mpGeometryStreamer->getStats();
+                const auto& desc = mpGeometryStreamer->getDesc();
+                std::ostringstream oss;
+                oss << "Resident meshes: " << stats.residentMeshCount << " / " << mStreamedMeshes.size() << std::endl
+                    << "Resident data: " << std::fixed << std::setprecision(1) << stats.residentBytes / double(1 << 20) << " / " << desc.budget / double(1 << 20) << " MB" << std::endl
+                    << "Resident pages: " << stats.residentPageCount << " / " << mpGeometryStreamer->getFile()->getPageCount() << std::endl
+                    << "Pending loads: " << stats.pendingLoadCount << std::endl
+                    << "Loads: " << stats.loadCount << " (" << std::fixed << std::setprecision(1) << stats.loadedBytes / double(1 << 20) << " MB)" << std::endl
+                    << "Evictions: " << stats.evictionCount;
+                streamingGroup.text(oss.str());
+                streamingGroup.release();
+            }
+        }
+
         // Filtering mode
         // Camera controller
     }
@@ -659,8 +800,8 @@ namespace Falcor
     void Scene::createDrawList()
     {
         std::vector<D3D12_DRAW_INDEXED_ARGUMENTS> drawClockwiseMeshes, drawCounterClockwiseMeshes;
-        auto pMatricesBuffer = mpSceneBlock->getBuffer("worldMatrices");
-        const glm::mat4* matrices = (glm::mat4*)pMatricesBuffer->map(Buffer::MapType::Read); // #SCENEV2 This will cause the pipeline to flush and sync, but it's probably not too bad as this only happens once
+        // The draw lists are rebuilt when streamed meshes change, so the matrices are read from the CPU copy rather than the GPU buffer.
+        const auto& matrices = mpAnimationController->getGlobalMatrices();
 
         for (const auto& instance : mMeshInstanceData)
         {
@@ -694,6 +835,244 @@ namespace Falcor
         assert(drawCount <= UINT32_MAX);
     }
 
+    void Scene::updateCulledDrawLists(RenderContext* pContext)
+    {
+        const glm::mat4& viewProj = mCamera.pObject->getViewProjMatrix();
+        if (!mCulledDrawListsDirty && viewProj == mCulledViewProj) return;
+
+        PROFILE("cullScene");
+        const OcclusionCuller* pOcclusionCuller = nullptr;
+        if (mOcclusionCulling && !mOccluders.empty())
+        {
+            rasterizeOccluders(viewProj);
+            pOcclusionCuller = mpOcclusionCuller.get();
+        }
+        mpCuller->buildDrawLists(viewProj, mMeshDesc, mMeshInstanceData, mSortDrawsByMaterial, mCulledDrawLists, pOcclusionCuller);
+        mCulledViewProj = viewProj;
+        mCulledDrawListsDirty = false;
+
+        // Retire the buffer in use. All draws reading it have been recorded, so a single signal after submitting them covers all of them.
+        if (!mpCulledDrawFence) mpCulledDrawFence = GpuFence::create();
+        auto& retiredBuffer = mCulledDrawBuffers[mCulledDrawBufferIndex];
+        if (retiredBuffer.pBuffer)
+        {
+            pContext->flush(false);
+            retiredBuffer.fenceValue = mpCulledDrawFence->gpuSignal(pContext->getLowLevelData()->getCommandQueue());
+        }
+
+        // Wait until the GPU is done with the next buffer in the ring. The buffers are sized for all instances, so they are never reallocated.
+        mCulledDrawBufferIndex = (mCulledDrawBufferIndex + 1) % (uint32_t)mCulledDrawBuffers.size();
+        auto& drawBuffer = mCulledDrawBuffers[mCulledDrawBufferIndex];
+        if (drawBuffer.fenceValue > mpCulledDrawFence->getGpuValue()) mpCulledDrawFence->syncCpu(drawBuffer.fenceValue);
+        if (!drawBuffer.pBuffer)
+        {
+            size_t size = sizeof(D3D12_DRAW_INDEXED_ARGUMENTS) * std::max<size_t>(mMeshInstanceData.size(), 1);
+            drawBuffer.pBuffer = Buffer::create(size, Resource::BindFlags::IndirectArg, Buffer::CpuAccess::Write);
+        }
+
+        // Write the draws in place, counter-clockwise draws first.
+        const auto& counterClockwise = mCulledDrawLists.counterClockwise;
+        const auto& clockwise = mCulledDrawLists.clockwise;
+        const size_t clockwiseOffset = sizeof(D3D12_DRAW_INDEXED_ARGUMENTS) * counterClockwise.size();
+        uint8_t* pData = (uint8_t*)drawBuffer.pBuffer->map(Buffer::MapType::Write);
+        if (!counterClockwise.empty()) std::memcpy(pData, counterClockwise.data(), clockwiseOffset);
+        if (!clockwise.empty()) std::memcpy(pData + clockwiseOffset, clockwise.data(), sizeof(D3D12_DRAW_INDEXED_ARGUMENTS) * clockwise.size());
+        drawBuffer.pBuffer->unmap();
+
+        mCulledCounterClockwiseMeshes = { drawBuffer.pBuffer, (uint32_t)counterClockwise.size(), 0 };
+        mCulledClockwiseMeshes = { drawBuffer.pBuffer, (uint32_t)clockwise.size(), clockwiseOffset };
+    }
+
+    SceneCuller::BenchmarkResult Scene::benchmarkCulling(const SceneCuller::BenchmarkDesc& desc) const
+    {
+        return mpCuller->benchmark(mSceneBB, desc);
+    }
+
+    std::vector<uint32_t> Scene::selectOccluders() const
+    {
+        if (mpVao->getPrimitiveTopology() != Vao::Topology::TriangleList) return {};
+
+        // Rank the instances by the surface area of their bounds relative to the scene. Large instances hide the most.
+        // Skinned meshes are skipped, as their CPU geometry is the bind pose.
+        const float sceneArea = std::max(getSurfaceArea(mSceneBB), FLT_MIN);
+        std::vector<std::pair<float, uint32_t>> candidates;
+        for (uint32_t instanceID = 0; instanceID < (uint32_t)mMeshInstanceData.size(); instanceID++)
+        {
+            const auto& inst = mMeshInstanceData[instanceID];
+            // Streamed meshes have no CPU geometry, and their placeholder boxes would hide what is behind them.
+            if (mMeshHasDynamicData[inst.meshID] || isMeshStreamed(inst.meshID) || mMeshDesc[inst.meshID].indexCount / 3 > kMaxOccluderTriangles) continue;
+
+            float areaRatio = getSurfaceArea(computeInstanceBounds(instanceID)) / sceneArea;
+            if (areaRatio >= kMinOccluderAreaRatio) candidates.push_back({ areaRatio, instanceID });
+        }
+        std::sort(candidates.begin(), candidates.end(), std::greater<>());
+
+        std::vector<uint32_t> occluders;
+        uint32_t triangleCount = 0;
+        for (const auto& candidate : candidates)
+        {
+            if (occluders.size() >= kMaxOccluderCount) break;
+            uint32_t meshTriangleCount = mMeshDesc[mMeshInstanceData[candidate.second].meshID].indexCount / 3;
+            if (triangleCount + meshTriangleCount > kOccluderTriangleBudget) continue;
+            triangleCount += meshTriangleCount;
+            occluders.push_back(candidate.second);
+        }
+        return occluders;
+    }
+
+    void Scene::rasterizeOccluders(const glm::mat4& viewProj)
+    {
+        const auto& globalMatrices = mpAnimationController->getGlobalMatrices();
+        mpOcclusionCuller->beginFrame(viewProj);
+        for (const auto& occluder : mOccluders)
+        {
+            mpOcclusionCuller->rasterize(occluder.occluderMeshID, globalMatrices[mMeshInstanceData[occluder.instanceID].globalMatrixID]);
+        }
+    }
+
+    OcclusionCuller::BenchmarkResult Scene::benchmarkOcclusionCulling(const std::vector<glm::mat4>& viewProjs)
+    {
+        OcclusionCuller::BenchmarkResult result;
+        result.viewCount = (uint32_t)viewProjs.size();
+        result.occluderCount = (uint32_t)mOccluders.size();
+        if (!mpOcclusionCuller || viewProjs.empty() || mMeshInstanceData.empty()) return result;
+
+        std::vector<uint8_t> visible;
+        uint64_t triangleCount = 0, frustumVisibleCount = 0, occludedCount = 0;
+        double rasterTime = 0.0, testTime = 0.0;
+        for (const auto& viewProj : viewProjs)
+        {
+            rasterizeOccluders(viewProj);
+            triangleCount += mpOcclusionCuller->getStats().triangleCount;
+            rasterTime += mpOcclusionCuller->getStats().rasterTime;
+
+            CpuTimer timer;
+            timer.update();
+            uint32_t viewVisibleCount = mpCuller->cull(viewProj, visible);
+            uint32_t viewOccludedCount = mpCuller->cullOccluded(*mpOcclusionCuller, visible);
+            timer.update();
+            testTime += timer.delta() * 1000.0;
+            frustumVisibleCount += viewVisibleCount;
+            occludedCount += viewOccludedCount;
+        }
+
+        const double viewCount = (double)viewProjs.size();
+        result.trianglesPerView = triangleCount / viewCount;
+        result.rasterMsPerView = rasterTime / viewCount;
+        result.trianglesPerMs = rasterTime > 0.0 ? triangleCount / rasterTime : 0.0;
+        result.testMsPerView = testTime / viewCount;
+        result.frustumVisibleRatio = frustumVisibleCount / (viewCount * mMeshInstanceData.size());
+        result.occludedRatio = frustumVisibleCount > 0 ? (double)occludedCount / frustumVisibleCount : 0.0;
+        return result;
+    }
+
+    OcclusionCuller::BenchmarkResult Scene::benchmarkOcclusionCulling()
+    {
+        const glm::mat4& proj = mCamera.pObject->getProjMatrix();
+        std::vector<glm::mat4> viewProjs;
+        for (const auto& viewpoint : mViewpoints) viewProjs.push_back(proj * glm::lookAt(viewpoint.position, viewpoint.target, viewpoint.up));
+        viewProjs.push_back(mCamera.pObject->getViewProjMatrix());
+        return benchmarkOcclusionCulling(viewProjs);
+    }
+
+    bool Scene::updateGeometryStreaming(RenderContext* pContext)
+    {
+        PROFILE("updateGeometryStreaming");
+
+        // Prioritize each mesh by the largest angle subtended by the bounding sphere of one of its instances.
+        const auto& pCamera = mCamera.pObject;
+        const float3 cameraPos = pCamera->getPosition();
+        mpCuller->cull(pCamera->getViewProjMatrix(), mStreamVisibility);
+        mStreamPriorities.assign(mStreamedMeshes.size(), 0.f);
+        for (uint32_t instanceID = 0; instanceID < (uint32_t)mMeshInstanceData.size(); instanceID++)
+        {
+            uint32_t streamID = mMeshStreamIDs[mMeshInstanceData[instanceID].meshID];
+            if (streamID == GeometryPageFile::kInvalidMesh) continue;
+
+            const BBox& bounds = mInstanceTree.getLeafBounds(mInstanceLeaves[instanceID]);
+            float radius = 0.5f * glm::length(bounds.dimensions());
+            float distance = std::max(glm::length(bounds.centroid() - cameraPos), radius);
+            float priority = distance > 0.f ? radius / distance : 1.f;
+            if (!mStreamVisibility[instanceID]) priority *= kOffscreenStreamingPriority;
+            mStreamPriorities[streamID] = std::max(mStreamPriorities[streamID], priority);
+        }
+
+        mpGeometryStreamer->update(mStreamPriorities, mLoadedMeshes, mEvictedMeshes);
+        if (mLoadedMeshes.empty() && mEvictedMeshes.empty()) return false;
+
+        // Evicted meshes fall back to their placeholder boxes.
+        for (uint32_t streamID : mEvictedMeshes)
+        {
+            const auto& streamedMesh = mStreamedMeshes[streamID];
+            setMeshGeometry(streamedMesh.meshID, streamedMesh.placeholder);
+        }
+
+        // Copy the loaded meshes to the pools. The copies execute after the draws of earlier frames, so pool ranges freed by evictions can be reused right away.
+        const auto& pFile = mpGeometryStreamer->getFile();
+        const Buffer::SharedPtr& pVb = mpVao->getVertexBuffer(kStaticDataBufferIndex);
+        const Buffer::SharedPtr& pPrevVb = mpVao->getVertexBuffer(kPrevVertexBufferIndex);
+        const Buffer::SharedPtr& pIb = mpVao->getIndexBuffer();
+        std::vector<PrevVertexData> prevVertices;
+        for (const auto& loadedMesh : mLoadedMeshes)
+        {
+            const auto& info = pFile->getMesh(loadedMesh.meshID);
+            const PackedStaticVertexData* pVertices = reinterpret_cast<const PackedStaticVertexData*>(loadedMesh.data.data());
+            const size_t vertexBytes = info.vertexCount * sizeof(PackedStaticVertexData);
+
+            MeshDesc geometry = {};
+            geometry.vbOffset = mStreamVertexOffset + loadedMesh.vertexOffset;
+            geometry.ibOffset = mStreamIndexOffset + loadedMesh.indexOffset;
+            geometry.vertexCount = info.vertexCount;
+            geometry.indexCount = info.indexCount;
+
+            pVb->setBlob(pVertices, geometry.vbOffset * sizeof(PackedStaticVertexData), vertexBytes);
+            pIb->setBlob(loadedMesh.data.data() + vertexBytes, geometry.ibOffset * sizeof(uint32_t), info.indexCount * sizeof(uint32_t));
+
+            prevVertices.resize(info.vertexCount);
+            for (uint32_t v = 0; v < info.vertexCount; v++) prevVertices[v].position = pVertices[v].position;
+            pPrevVb->setBlob(prevVertices.data(), geometry.vbOffset * sizeof(PrevVertexData), info.vertexCount * sizeof(PrevVertexData));
+
+            setMeshGeometry(mStreamedMeshes[loadedMesh.meshID].meshID, geometry);
+        }
+
+        // Rebuild what depends on the mesh geometry. Only the BLASes holding changed meshes are rebuilt, and the TLASes are recreated as those BLASes moved.
+        createDrawList();
+        mCulledDrawListsDirty = true;
+        if (!mBlasData.empty())
+        {
+            mTlasCache.clear();
+            buildBlas(pContext);
+        }
+        return true;
+    }
+
+    void Scene::setMeshGeometry(uint32_t meshID, const MeshDesc& geometry)
+    {
+        auto& mesh = mMeshDesc[meshID];
+        mesh.vbOffset = geometry.vbOffset;
+        mesh.ibOffset = geometry.ibOffset;
+        mesh.vertexCount = geometry.vertexCount;
+        mesh.indexCount = geometry.indexCount;
+        mpMeshesBuffer->setElement(meshID, mesh);
+
+        for (uint32_t instanceID : mMeshIdToInstanceIds[meshID])
+        {
+            auto& inst = mMeshInstanceData[instanceID];
+            inst.vbOffset = mesh.vbOffset;
+            inst.ibOffset = mesh.ibOffset;
+            mpMeshInstancesBuffer->setElement(instanceID, inst);
+        }
+
+        if (!mBlasData.empty())
+        {
+            const uint2 index = mMeshGeomDescs[meshID];
+            auto& blas = mBlasData[index.x];
+            setGeomDescBuffers(blas.geomDescs[index.y], mesh);
+            blas.pBlas = nullptr;
+            blas.pScratchBuffer = nullptr;
+        }
+    }
+
     void Scene::sortMeshes()
     {
         // We first sort meshes into groups with the same transform.
@@ -776,18 +1155,23 @@ namespace Falcor
         {
             mMeshIdToInstanceIds[mMeshInstanceData[instId].meshID].push_back(instId);
         }
+
+        // Create mapping of global matrices to the instances they transform.
+        mMatrixIdToInstanceIds.clear();
+        mMatrixIdToInstanceIds.resize(mSceneGraph.size());
+        for (uint32_t instId = 0; instId < (uint32_t)mMeshInstanceData.size(); instId++)
+        {
+            mMatrixIdToInstanceIds[mMeshInstanceData[instId].globalMatrixID].push_back(instId);
+        }
     }
 
     void Scene::initGeomDesc()
     {
         assert(mBlasData.empty());
 
-        const VertexBufferLayout::SharedConstPtr& pVbLayout = mpVao->getVertexLayout()->getBufferLayout(kStaticDataBufferIndex);
-        const Buffer::SharedPtr& pVb = mpVao->getVertexBuffer(kStaticDataBufferIndex);
-        const Buffer::SharedPtr& pIb = mpVao->getIndexBuffer();
-
         assert(mMeshGroups.size() > 0);
         mBlasData.resize(mMeshGroups.size());
+        mMeshGeomDescs.resize(mMeshDesc.size());
 
         for (size_t i = 0; i < mBlasData.size(); i++)
         {
@@ -800,6 +1184,7 @@ namespace Falcor
             {
                 const MeshDesc& mesh = mMeshDesc[meshList[j]];
                 blas.hasSkinnedMesh |= mMeshHasDynamicData[meshList[j]];
+                mMeshGeomDescs[meshList[j]] = uint2(i, j);
 
                 D3D12_RAYTRACING_GEOMETRY_DESC& desc = geomDescs[j];
                 desc.Type = D3D12_RAYTRACING_GEOMETRY_TYPE_TRIANGLES;
@@ -810,22 +1195,31 @@ namespace Falcor
                 bool opaque = (material->getAlphaMode() == AlphaModeOpaque) && material->getSpecularTransmission() == 0.f;
                 desc.Flags = opaque ? D3D12_RAYTRACING_GEOMETRY_FLAG_OPAQUE : D3D12_RAYTRACING_GEOMETRY_FLAG_NONE;
 
-                // Set the position data
-                desc.Triangles.VertexBuffer.StartAddress = pVb->getGpuAddress() + (mesh.vbOffset * pVbLayout->getStride());
-                desc.Triangles.VertexBuffer.StrideInBytes = pVbLayout->getStride();
-                desc.Triangles.VertexCount = mesh.vertexCount;
-                desc.Triangles.VertexFormat = getDxgiFormat(pVbLayout->getElementFormat(0));
-
-                // Set index data
-                desc.Triangles.IndexBuffer = pIb->getGpuAddress() + (mesh.ibOffset * getFormatBytesPerBlock(mpVao->getIndexBufferFormat()));
-                desc.Triangles.IndexCount = mesh.indexCount;
-                desc.Triangles.IndexFormat = getDxgiFormat(mpVao->getIndexBufferFormat());
+                setGeomDescBuffers(desc, mesh);
             }
 
             mHasSkinnedMesh |= blas.hasSkinnedMesh;
         }
     }
 
+    void Scene::setGeomDescBuffers(D3D12_RAYTRACING_GEOMETRY_DESC& desc, const MeshDesc& mesh) const
+    {
+        const VertexBufferLayout::SharedConstPtr& pVbLayout = mpVao->getVertexLayout()->getBufferLayout(kStaticDataBufferIndex);
+        const Buffer::SharedPtr& pVb = mpVao->getVertexBuffer(kStaticDataBufferIndex);
+        const Buffer::SharedPtr& pIb = mpVao->getIndexBuffer();
+
+        // Set the position data
+        desc.Triangles.VertexBuffer.StartAddress = pVb->getGpuAddress() + (mesh.vbOffset * pVbLayout->getStride());
+        desc.Triangles.VertexBuffer.StrideInBytes = pVbLayout->getStride();
+        desc.Triangles.VertexCount = mesh.vertexCount;
+        desc.Triangles.VertexFormat = getDxgiFormat(pVbLayout->getElementFormat(0));
+
+        // Set index data
+        desc.Triangles.IndexBuffer = pIb->getGpuAddress() + (mesh.ibOffset * getFormatBytesPerBlock(mpVao->getIndexBufferFormat()));
+        desc.Triangles.IndexCount = mesh.indexCount;
+        desc.Triangles.IndexFormat = getDxgiFormat(mpVao->getIndexBufferFormat());
+    }
+
     void Scene::buildBlas(RenderContext* pContext)
     {
         PROFILE("buildBlas");
@@ -900,9 +1294,10 @@ namespace Falcor
         }
     }
 
-    void Scene::fillInstanceDesc(std::vector<D3D12_RAYTRACING_INSTANCE_DESC>& instanceDescs, uint32_t rayCount, bool perMeshHitEntry)
+    void Scene::fillInstanceDesc(std::vector<D3D12_RAYTRACING_INSTANCE_DESC>& instanceDescs, std::vector<uint32_t>& matrixIDs, uint32_t rayCount, bool perMeshHitEntry)
     {
         instanceDescs.clear();
+        matrixIDs.clear();
         uint32_t instanceContributionToHitGroupIndex = 0;
         uint32_t instanceId = 0;
 
@@ -928,9 +1323,9 @@ namespace Falcor
 
                 // Any instances of the mesh will get you the correct matrix, so just pick the first mesh then the first instance.
                 uint32_t matrixId = mMeshInstanceData[desc.InstanceID].globalMatrixID;
-                glm::mat4 transform4x4 = transpose(mpAnimationController->getGlobalMatrices()[matrixId]);
-                std::memcpy(desc.Transform, &transform4x4, sizeof(desc.Transform));
+                TlasInstanceDescs::setTransform(desc, mpAnimationController->getGlobalMatrices()[matrixId]);
                 instanceDescs.push_back(desc);
+                matrixIDs.push_back(matrixId);
             }
             // If only one mesh is in the BLAS, there CAN be multiple instances of it. It is either:
             // - A non-instanced mesh that was unable to be merged with others
@@ -946,9 +1341,9 @@ namespace Falcor
                     assert(instId == instanceId); // Mesh instances are sorted by instanceId
                     desc.InstanceID = instanceId++;
                     uint32_t matrixId = mMeshInstanceData[desc.InstanceID].globalMatrixID;
-                    glm::mat4 transform4x4 = transpose(mpAnimationController->getGlobalMatrices()[matrixId]);
-                    std::memcpy(desc.Transform, &transform4x4, sizeof(desc.Transform));
+                    TlasInstanceDescs::setTransform(desc, mpAnimationController->getGlobalMatrices()[matrixId]);
                     instanceDescs.push_back(desc);
+                    matrixIDs.push_back(matrixId);
                 }
             }
         }
@@ -958,16 +1353,22 @@ namespace Falcor
     {
         PROFILE("buildTlas");
 
-        TlasData tlas;
-        auto it = mTlasCache.find(rayCount);
-        if (it != mTlasCache.end()) tlas = it->second;
+        TlasData& tlas = mTlasCache[rayCount];
 
-        fillInstanceDesc(mInstanceDescs, rayCount, perMeshHitEntry);
+        // Generate the instance descs on the first build. Later builds use the descs patched in update().
+        if (tlas.pTlas == nullptr)
+        {
+            std::vector<D3D12_RAYTRACING_INSTANCE_DESC> instanceDescs;
+            std::vector<uint32_t> matrixIDs;
+            fillInstanceDesc(instanceDescs, matrixIDs, rayCount, perMeshHitEntry);
+            tlas.instanceDescs.setInstanceDescs(instanceDescs, matrixIDs, (uint32_t)mpAnimationController->getGlobalMatrices().size());
+        }
+        const auto& instanceDescs = tlas.instanceDescs.getInstanceDescs();
 
         D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS inputs = {};
         inputs.Type = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL;
         inputs.DescsLayout = D3D12_ELEMENTS_LAYOUT_ARRAY;
-        inputs.NumDescs = (uint32_t)mInstanceDescs.size();
+        inputs.NumDescs = tlas.instanceDescs.getCount();
         inputs.Flags = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_NONE;
 
         // Add build flags for dynamic scenes if TLAS should be updating instead of rebuilt
@@ -1002,17 +1403,25 @@ namespace Falcor
         {
             assert(tlas.pInstanceDescs == nullptr); // Instance desc should also be null if no TLAS
             tlas.pTlas = Buffer::create(mTlasPrebuildInfo.ResultDataMaxSizeInBytes, Buffer::BindFlags::AccelerationStructure, Buffer::CpuAccess::None);
-            tlas.pInstanceDescs = Buffer::create((uint32_t)mInstanceDescs.size() * sizeof(D3D12_RAYTRACING_INSTANCE_DESC), Buffer::BindFlags::None, Buffer::CpuAccess::Write, mInstanceDescs.data());
+            // The descs live in a default-heap buffer so that later frames can upload only the patched ranges. A partial write to an
+            // upload-heap (CpuAccess::Write) buffer would map it with WriteDiscard and lose the descs outside the range.
+            tlas.pInstanceDescs = Buffer::create((uint32_t)instanceDescs.size() * sizeof(D3D12_RAYTRACING_INSTANCE_DESC), Buffer::BindFlags::None, Buffer::CpuAccess::None, instanceDescs.data());
         }
-        // Else update instance descs and barrier TLAS buffers
+        // Else upload the patched instance descs and barrier TLAS buffers
         else
         {
             assert(mpAnimationController->hasAnimations());
             pContext->uavBarrier(tlas.pTlas.get());
             pContext->uavBarrier(mpTlasScratch.get());
-            tlas.pInstanceDescs->setBlob(mInstanceDescs.data(), 0, inputs.NumDescs * sizeof(D3D12_RAYTRACING_INSTANCE_DESC));
+            for (const auto& range : tlas.instanceDescs.getDirtyRanges(kMaxInstanceDescUploadRanges))
+            {
+                const size_t descSize = sizeof(D3D12_RAYTRACING_INSTANCE_DESC);
+                pContext->updateBuffer(tlas.pInstanceDescs.get(), &instanceDescs[range.first], range.first * descSize, (range.second - range.first) * descSize);
+            }
             asDesc.SourceAccelerationStructureData = tlas.pTlas->getGpuAddress(); // Perform the update in-place
         }
+        tlas.instanceDescs.clearDirty();
+        tlas.outOfDate = false;
 
         assert((inputs.NumDescs != 0) && tlas.pInstanceDescs->getApiHandle() && tlas.pTlas->getApiHandle() && mpTlasScratch->getApiHandle());
 
@@ -1045,8 +1454,6 @@ namespace Falcor
             ResourceWeakPtr pWeak = tlas.pTlas;
             tlas.pSrv = std::make_shared<ShaderResourceView>(pWeak, pSet, 0, 1, 0, 1);
         }
-
-        mTlasCache[rayCount] = tlas;
     }
 
     void Scene::setGeometryIndexIntoRtVars(const std::shared_ptr<RtProgramVars>& pVars)
@@ -1106,7 +1513,7 @@ namespace Falcor
         // It really seems like a first-class notion of ray types (and the number thereof) is required.
         //
         auto tlasIt = mTlasCache.find(rayTypeCount);
-        if (tlasIt == mTlasCache.end())
+        if (tlasIt == mTlasCache.end() || tlasIt->second.outOfDate)
         {
             // We need a hit entry per mesh right now to pass GeometryIndex()
             buildTlas(pContext, rayTypeCount, true);
@@ -1235,6 +1642,20 @@ namespace Falcor
         s.func_("material", &Scene::getMaterial); // PYTHONDEPRECATED
         s.func_("material", &Scene::getMaterialByName); // PYTHONDEPRECATED
 
+        // Frustum culling
+        s.func_("setFrustumCulling", &Scene::setFrustumCulling, "enabled"_a);
+        s.func_("setSortDrawsByMaterial", &Scene::setSortDrawsByMaterial, "enabled"_a);
+        s.func_("setOcclusionCulling", &Scene::setOcclusionCulling, "enabled"_a);
+        auto benchmarkCulling = [](Scene::SharedPtr pScene, uint32_t viewCount)
+        {
+            SceneCuller::BenchmarkDesc desc;
+            desc.viewCount = viewCount;
+            return pScene->benchmarkCulling(desc).toString();
+        };
+        s.func_("benchmarkCulling", benchmarkCulling, "viewCount"_a = 1024);
+        auto benchmarkOcclusionCulling = [](Scene::SharedPtr pScene) { return pScene->benchmarkOcclusionCulling().toString(); };
+        s.func_("benchmarkOcclusionCulling", benchmarkOcclusionCulling);
+
         // Viewpoints
         s.func_(kAddViewpoint.c_str(), ScriptBindings::overload_cast<>(&Scene::addViewpoint)); // add current camera as viewpoint
         s.func_(kAddViewpoint.c_str(), ScriptBindings::overload_cast<const float3&, const float3&, const float3&>(&Scene::addViewpoint), "position"_a, "target"_a, "up"_a); // add specified viewpoint
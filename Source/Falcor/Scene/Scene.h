@@ -33,8 +33,12 @@
 #include "Camera/Camera.h"
 #include "Material/Material.h"
 #include "Utils/Math/AABB.h"
+#include "Utils/Math/DynamicAABBTree.h"
 #include "Animation/AnimationController.h"
 #include "Camera/CameraController.h"
+#include "TlasInstanceDescs.h"
+#include "SceneCuller.h"
+#include "GeometryStreamer.h"
 #include "Experimental/Scene/Lights/LightCollection.h"
 #include "SceneTypes.slang"
 
@@ -106,6 +110,7 @@ namespace Falcor
             SceneGraphChanged           = 0x40, ///< Any transform in the scene graph changed.
             LightCollectionChanged      = 0x80, ///< Light collection changed (mesh lights)
             MaterialsChanged            = 0x100,///< Materials changed
+            GeometryChanged             = 0x200,///< Streamed meshes were loaded or evicted, which changes the geometry of their instances
 
             All                         = -1
         };
@@ -204,6 +209,10 @@ namespace Falcor
         */
         const MeshInstanceData& getMeshInstance(uint32_t instanceID) const { return mMeshInstanceData[instanceID]; }
 
+        /** Get the IDs of the mesh instances moved by the last call to update(), in increasing order
+        */
+        const std::vector<uint32_t>& getChangedMeshInstances() const { return mChangedMeshInstances; }
+
         /** Get the number of materials in the scene
         */
         uint32_t getMaterialCount() const { return (uint32_t)mMaterials.size(); }
@@ -224,6 +233,20 @@ namespace Falcor
         */
         const BoundingBox& getMeshBounds(uint32_t meshID) const { return mMeshBBs[meshID]; }
 
+        /** Find the mesh instances whose world space bounds overlap a box.
+            \param[in] box The box in world space.
+            \param[out] instanceIDs IDs of the overlapping instances, appended in no particular order.
+        */
+        void findInstances(const BoundingBox& box, std::vector<uint32_t>& instanceIDs) const { mInstanceTree.queryBox(box, instanceIDs); }
+
+        /** Find the mesh instances whose world space bounds are hit by a ray, e.g. as candidates for picking.
+            \param[in] origin Ray origin in world space.
+            \param[in] dir Ray direction. Does not need to be normalized.
+            \param[in] tMax Maximum distance along the ray, in units of dir.
+            \param[out] instanceIDs IDs of the hit instances, appended in no particular order.
+        */
+        void findInstances(const float3& origin, const float3& dir, float tMax, std::vector<uint32_t>& instanceIDs) const { mInstanceTree.queryRay(origin, dir, tMax, instanceIDs); }
+
         /** Get the number of lights in the scene
         */
         uint32_t getLightCount() const { return (uint32_t)mLights.size(); }
@@ -264,6 +287,45 @@ namespace Falcor
         void setBlasUpdateMode(UpdateMode mode) { mBlasUpdateMode = mode; }
         UpdateMode getBlasUpdateMode() { return mBlasUpdateMode; }
 
+        /** Enable/disable frustum culling of the mesh instances in render().
+            The instances are culled against the scene camera on the CPU. Culling is disabled by default.
+        */
+        void setFrustumCulling(bool enabled) { mFrustumCulling = enabled; mCulledDrawListsDirty = true; }
+        bool isFrustumCullingEnabled() const { return mFrustumCulling; }
+
+        /** Enable/disable sorting the culled draws by material, to reduce state changes between draws.
+            Only used when frustum culling is enabled.
+        */
+        void setSortDrawsByMaterial(bool enabled) { mSortDrawsByMaterial = enabled; mCulledDrawListsDirty = true; }
+        bool isSortDrawsByMaterialEnabled() const { return mSortDrawsByMaterial; }
+
+        /** Enable/disable occlusion culling of the mesh instances in render().
+            Large instances picked as occluders are rasterized on the CPU, and the instances hidden behind them are skipped.
+            Only used when frustum culling is enabled. Occlusion culling is disabled by default.
+        */
+        void setOcclusionCulling(bool enabled) { mOcclusionCulling = enabled; mCulledDrawListsDirty = true; }
+        bool isOcclusionCullingEnabled() const { return mOcclusionCulling; }
+
+        /** Measure the throughput of the frustum culling, for random views from the center of the scene.
+            This does not use the device, so it can run without rendering.
+        */
+        SceneCuller::BenchmarkResult benchmarkCulling(const SceneCuller::BenchmarkDesc& desc = {}) const;
+
+        /** Measure the raster throughput of the occluders and the fraction of instances they hide, for a sequence of views.
+            This does not use the device, so it can run without rendering.
+            \param[in] viewProjs View-projection matrices of the views, e.g. from a recorded camera path.
+        */
+        OcclusionCuller::BenchmarkResult benchmarkOcclusionCulling(const std::vector<glm::mat4>& viewProjs);
+
+        /** Measure the occlusion culling for the saved viewpoints, seen with the projection of the current camera.
+        */
+        OcclusionCuller::BenchmarkResult benchmarkOcclusionCulling();
+
+        /** Get the geometry streamer, or nullptr if all geometry is resident.
+            Streaming is enabled with SceneBuilder::Flags::StreamGeometry. Meshes that are not resident are drawn as their bounding boxes.
+        */
+        const GeometryStreamer* getGeometryStreamer() const { return mpGeometryStreamer.get(); }
+
         /** Update the scene. Call this once per frame to update the camera location, animations, etc.
             \param pContext
             \param currentTime The current time in seconds
@@ -372,14 +434,24 @@ namespace Falcor
         */
         void uploadMaterial(uint32_t materialID);
 
-        /** Update the scene's global bounding box.
+        /** Build the hierarchy of the instance bounds and update the scene's global bounding box.
+            Moved instances are updated in the hierarchy by update(), which keeps the scene bounds current.
         */
         void updateBounds();
 
+        /** Compute the world space bounds of a mesh instance from its current global matrix.
+        */
+        BoundingBox computeInstanceBounds(uint32_t instanceID) const;
+
         /** Update mesh instance flags
         */
         void updateMeshInstanceFlags();
 
+        /** Update the flags of a single mesh instance
+            \return True if the flags changed
+        */
+        bool updateMeshInstanceFlags(uint32_t instanceID);
+
         /** Do any additional initialization required after scene data is set and draw lists are determined.
         */
         void finalize();
@@ -388,6 +460,32 @@ namespace Falcor
         */
         void createDrawList();
 
+        /** Cull the instances against the camera if the view or the instance bounds changed, and upload the visible draws.
+        */
+        void updateCulledDrawLists(RenderContext* pContext);
+
+        /** Pick the instances to use as occluders. Large instances with few triangles are preferred.
+            \return The instance IDs of the occluders.
+        */
+        std::vector<uint32_t> selectOccluders() const;
+
+        /** Clear the occlusion depth buffer and rasterize the occluders for a view.
+        */
+        void rasterizeOccluders(const glm::mat4& viewProj);
+
+        /** Prioritize the streamed meshes for the current camera, and switch the meshes that were loaded or evicted to their new geometry.
+            \return True if the geometry of any mesh changed.
+        */
+        bool updateGeometryStreaming(RenderContext* pContext);
+
+        /** Point a mesh and its instances at new geometry in the vertex and index buffers, and mark the BLAS holding it for rebuild.
+            \param[in] meshID The mesh.
+            \param[in] geometry Offsets and counts of the new geometry. The material is ignored.
+        */
+        void setMeshGeometry(uint32_t meshID, const MeshDesc& geometry);
+
+        bool isMeshStreamed(uint32_t meshID) const { return !mMeshStreamIDs.empty() && mMeshStreamIDs[meshID] != GeometryPageFile::kInvalidMesh; }
+
         /** Sort meshes into groups by transform. Updates mMeshInstances and mMeshGroups.
         */
         void sortMeshes();
@@ -396,16 +494,23 @@ namespace Falcor
         */
         void initGeomDesc();
 
+        /** Set the vertex and index data of a BLAS geometry desc from a mesh.
+        */
+        void setGeomDescBuffers(D3D12_RAYTRACING_GEOMETRY_DESC& desc, const MeshDesc& mesh) const;
+
         /** Generate bottom level acceleration structures for all meshes
         */
         void buildBlas(RenderContext* pContext);
 
         /** Generate data for creating a TLAS.
             #SCENE TODO: Add argument to build descs based off a draw list
+            \param[out] instanceDescs The instance descs.
+            \param[out] matrixIDs Global matrix ID of each instance desc.
         */
-        void fillInstanceDesc(std::vector<D3D12_RAYTRACING_INSTANCE_DESC>& instanceDescs, uint32_t rayCount, bool perMeshHitEntry);
+        void fillInstanceDesc(std::vector<D3D12_RAYTRACING_INSTANCE_DESC>& instanceDescs, std::vector<uint32_t>& matrixIDs, uint32_t rayCount, bool perMeshHitEntry);
 
         /** Generate top level acceleration structure for the scene. Automatically determines whether to build or refit.
+            An existing TLAS is updated in place, uploading only the instance descs patched since its last build.
             \param[in] rayCount Number of ray types in the shader. Required to setup how instances index into the Shader Table
         */
         void buildTlas(RenderContext* pContext, uint32_t rayCount, bool perMeshHitEntry);
@@ -444,7 +549,8 @@ namespace Falcor
         {
             Buffer::SharedPtr pBuffer;
             uint32_t count = 0;
-        } mDrawClockwiseMeshes, mDrawCounterClockwiseMeshes;
+            uint64_t offset = 0;    ///< Offset of the first draw in the buffer
+        } mDrawClockwiseMeshes, mDrawCounterClockwiseMeshes, mCulledClockwiseMeshes, mCulledCounterClockwiseMeshes;
 
         static const uint32_t kInvalidNode = -1;
 
@@ -478,6 +584,10 @@ namespace Falcor
         // Scene Metadata (CPU Only)
         std::vector<BoundingBox> mMeshBBs;                          ///< Bounding boxes for meshes (not instances)
         std::vector<std::vector<uint32_t>> mMeshIdToInstanceIds;    ///< Mapping of what instances belong to which mesh
+        std::vector<std::vector<uint32_t>> mMatrixIdToInstanceIds;  ///< Mapping of what instances are transformed by which global matrix
+        std::vector<uint32_t> mChangedMeshInstances;                ///< Instances whose global matrix changed in the last update
+        DynamicAABBTree mInstanceTree;                              ///< Hierarchy of the world space bounds of the instances. Its root bounds are the scene bounds.
+        std::vector<uint32_t> mInstanceLeaves;                      ///< Leaf of each instance in mInstanceTree
         BoundingBox mSceneBB;                                       ///< Bounding boxes of the entire scene
         std::vector<bool> mMeshHasDynamicData;                      ///< Whether a Mesh has dynamic data, meaning it is skinned
         GeometryStats mGeometryStats;                               ///< Geometry statistics for the scene.
@@ -510,18 +620,63 @@ namespace Falcor
         UpdateFlags mUpdates = UpdateFlags::All;
         AnimationController::UniquePtr mpAnimationController;
 
+        // Frustum culling
+        struct CulledDrawBuffer
+        {
+            Buffer::SharedPtr pBuffer;      ///< Draw arguments of the visible instances, counter-clockwise draws first.
+            uint64_t fenceValue = 0;        ///< Fence value signaled once the GPU is done with the buffer.
+        };
+
+        struct Occluder
+        {
+            uint32_t instanceID;        ///< Mesh instance rasterized as an occluder.
+            uint32_t occluderMeshID;    ///< Geometry of the instance in the occlusion culler.
+        };
+
+        SceneCuller::UniquePtr mpCuller;
+        SceneCuller::DrawLists mCulledDrawLists;
+        OcclusionCuller::UniquePtr mpOcclusionCuller;       ///< Created by the scene builder, which has the occluder geometry.
+        std::vector<Occluder> mOccluders;
+        bool mFrustumCulling = false;
+        bool mSortDrawsByMaterial = false;
+        bool mOcclusionCulling = false;
+        bool mCulledDrawListsDirty = true;                  ///< True if the instance bounds or the culling options changed since the draw lists were built.
+        glm::mat4 mCulledViewProj;                          ///< View-projection matrix the draw lists were built for.
+        std::array<CulledDrawBuffer, 3> mCulledDrawBuffers; ///< Ring of upload buffers, so that the CPU never writes draws the GPU may still read.
+        uint32_t mCulledDrawBufferIndex = 0;                ///< Ring index of the buffer in use.
+        GpuFence::SharedPtr mpCulledDrawFence;
+        std::string mCullingBenchmarkReport;
+        std::string mOcclusionBenchmarkReport;
+
+        // Geometry streaming
+        struct StreamedMesh
+        {
+            uint32_t meshID;        ///< Scene mesh.
+            MeshDesc placeholder;   ///< Geometry of the box drawn while the mesh is not resident.
+        };
+
+        GeometryStreamer::UniquePtr mpGeometryStreamer;         ///< Created by the scene builder. Null if all geometry is resident.
+        std::vector<StreamedMesh> mStreamedMeshes;              ///< Indexed by mesh ID in the page file.
+        std::vector<uint32_t> mMeshStreamIDs;                   ///< Page file mesh of each scene mesh, or GeometryPageFile::kInvalidMesh if it is resident. Empty if nothing is streamed.
+        uint32_t mStreamVertexOffset = 0;                       ///< First vertex of the streaming pool in the vertex buffers. The resident vertices come first.
+        uint32_t mStreamIndexOffset = 0;                        ///< First index of the streaming pool in the index buffer.
+        std::vector<float> mStreamPriorities;
+        std::vector<uint8_t> mStreamVisibility;
+        std::vector<GeometryStreamer::LoadedMesh> mLoadedMeshes;
+        std::vector<uint32_t> mEvictedMeshes;
+
         // Raytracing Data
         UpdateMode mTlasUpdateMode = UpdateMode::Rebuild;   ///< How the TLAS should be updated when there are changes in the scene
         UpdateMode mBlasUpdateMode = UpdateMode::Refit;     ///< How the BLAS should be updated when there are changes to meshes
 
-        std::vector<D3D12_RAYTRACING_INSTANCE_DESC> mInstanceDescs; ///< Shared between TLAS builds to avoid reallocating CPU memory
-
         struct TlasData
         {
             Buffer::SharedPtr pTlas;
             ShaderResourceView::SharedPtr pSrv;         ///< Shader Resource View for binding the TLAS
             Buffer::SharedPtr pInstanceDescs;           ///< Buffer holding instance descs for the TLAS
+            TlasInstanceDescs instanceDescs;            ///< CPU copy of the instance descs, patched when meshes move.
             UpdateMode updateMode = UpdateMode::Rebuild; ///< Update mode this TLAS was created with.
+            bool outOfDate = false;                     ///< True if the TLAS must be rebuilt or refit before its next use.
         };
 
         std::unordered_map<uint32_t, TlasData> mTlasCache;  ///< Top Level Acceleration Structure for scene data cached per shader ray count
@@ -541,6 +696,7 @@ namespace Falcor
         };
 
         std::vector<BlasData> mBlasData;    ///< All data related to the scene's BLASes
+        std::vector<uint2> mMeshGeomDescs;  ///< BLAS and geometry desc index of each mesh.
         bool mHasSkinnedMesh = false;       ///< Whether the scene has a skinned mesh at all.
 
         std::string mFilename;
@@ -27,6 +27,7 @@
  **************************************************************************/
 #include "stdafx.h"
 #include "SceneBuilder.h"
+#include "Utils/Math/BoxBatch.h"
 #include "../Externals/mikktspace/mikktspace.h"
 #include <filesystem>
 
@@ -195,8 +196,6 @@ namespace Falcor
 
         // Initialize the static data
         if (mesh.indexCount == 0 || !mesh.pIndices) throw_on_missing_element("indices");
-        mBuffersData.indices.insert(mBuffersData.indices.end(), mesh.pIndices, mesh.pIndices + mesh.indexCount);
-
         if (mesh.vertexCount == 0) throw_on_missing_element("vertices");
         if (mesh.pPositions == nullptr) throw_on_missing_element("positions");
         if (mesh.pNormals == nullptr) missing_element_warning("normals");
@@ -221,6 +220,8 @@ namespace Falcor
             validateTangentSpace(mesh.pBitangents, mesh.vertexCount);
         }
 
+        std::vector<PackedStaticVertexData> staticData;
+        staticData.reserve(mesh.vertexCount);
         for (uint32_t v = 0; v < mesh.vertexCount; v++)
         {
             StaticVertexData s;
@@ -228,24 +229,77 @@ namespace Falcor
             s.normal = mesh.pNormals ? mesh.pNormals[v] : float3(0, 0, 0);
             s.texCrd = mesh.pTexCrd ? mesh.pTexCrd[v] : float2(0, 0);
             s.bitangent = bitangents.size() ? bitangents[v] : mesh.pBitangents[v];
-            mBuffersData.staticData.push_back(PackedStaticVertexData(s));
+            staticData.push_back(PackedStaticVertexData(s));
 
             if (mesh.pBoneWeights)
             {
                 DynamicVertexData d;
                 d.boneWeight = mesh.pBoneWeights[v];
                 d.boneID = mesh.pBoneIDs[v];
-                d.staticIndex = (uint32_t)mBuffersData.staticData.size() - 1;
+                d.staticIndex = spec.staticVertexOffset + v;
                 mBuffersData.dynamicData.push_back(d);
             }
         }
 
+        // Streamed meshes are written to the page file right away, so the builder never holds their data.
+        // Skinned meshes are updated on the GPU and emissive meshes are read by the light collection, so both stay resident.
+        bool stream = is_set(mFlags, Flags::StreamGeometry) && !mpGeometryFile && !spec.hasDynamicData && !mesh.pMaterial->isEmissive() && mesh.topology == Vao::Topology::TriangleList;
+        if (stream)
+        {
+            if (!mpGeometryWriter)
+            {
+                mpGeometryWriter = GeometryPageFile::Writer::create(getTempFilename(), sizeof(PackedStaticVertexData));
+                if (!mpGeometryWriter) throw std::runtime_error("Error when adding the mesh " + mesh.name + " to the scene.\nCan't create the geometry streaming file");
+            }
+            spec.streamedMeshID = mpGeometryWriter->addMesh(staticData.data(), mesh.vertexCount, mesh.pIndices, mesh.indexCount);
+            if (spec.streamedMeshID == GeometryPageFile::kInvalidMesh) throw std::runtime_error("Error when adding the mesh " + mesh.name + " to the scene.\nCan't write to the geometry streaming file");
+            addPlaceholderBox(spec, mpGeometryWriter->getMeshes()[spec.streamedMeshID].bounds);
+        }
+        else
+        {
+            mBuffersData.indices.insert(mBuffersData.indices.end(), mesh.pIndices, mesh.pIndices + mesh.indexCount);
+            mBuffersData.staticData.insert(mBuffersData.staticData.end(), staticData.begin(), staticData.end());
+        }
+
         mDirty = true;
 
         assert(mMeshes.size() <= UINT32_MAX);
         return (uint32_t)mMeshes.size() - 1;
     }
 
+    void SceneBuilder::addPlaceholderBox(MeshSpec& spec, const BBox& bounds)
+    {
+        // Counter-clockwise seen from outside. Corner i is at the max x if bit 0 is set, max y if bit 1 is set, and max z if bit 2 is set.
+        static const uint32_t kBoxIndices[] =
+        {
+            0, 6, 2, 0, 4, 6,   1, 3, 7, 1, 7, 5,
+            0, 1, 5, 0, 5, 4,   2, 7, 3, 2, 6, 7,
+            0, 3, 1, 0, 2, 3,   4, 5, 7, 4, 7, 6,
+        };
+
+        if (mPlaceholderIndexOffset == UINT32_MAX)
+        {
+            mPlaceholderIndexOffset = (uint32_t)mBuffersData.indices.size();
+            mBuffersData.indices.insert(mBuffersData.indices.end(), std::begin(kBoxIndices), std::end(kBoxIndices));
+        }
+
+        spec.staticVertexOffset = (uint32_t)mBuffersData.staticData.size();
+        spec.indexOffset = mPlaceholderIndexOffset;
+        spec.vertexCount = 8;
+        spec.indexCount = (uint32_t)std::size(kBoxIndices);
+
+        for (uint32_t i = 0; i < 8; i++)
+        {
+            float3 corner((i & 1) ? 1.f : -1.f, (i & 2) ? 1.f : -1.f, (i & 4) ? 1.f : -1.f);
+            StaticVertexData s;
+            s.position = glm::mix(bounds.minPoint, bounds.maxPoint, corner * 0.5f + 0.5f);
+            s.normal = glm::normalize(corner);
+            s.bitangent = glm::normalize(glm::cross(s.normal, float3(1, 0, 0)));
+            s.texCrd = float2(0, 0);
+            mBuffersData.staticData.push_back(PackedStaticVertexData(s));
+        }
+    }
+
     uint32_t SceneBuilder::addMaterial(const Material::SharedPtr& pMaterial, bool removeDuplicate)
     {
         assert(pMaterial);
@@ -299,15 +353,20 @@ namespace Falcor
     Vao::SharedPtr SceneBuilder::createVao(uint16_t drawCount)
     {
         for (auto& mesh : mMeshes) assert(mesh.topology == mMeshes[0].topology);
-        const size_t vertexCount = (uint32_t)mBuffersData.staticData.size();
-        size_t ibSize = sizeof(uint32_t) * mBuffersData.indices.size();
+
+        // Streamed meshes are copied to pools that follow the resident data.
+        const GeometryStreamer* pStreamer = mpScene->mpGeometryStreamer.get();
+        const size_t vertexCount = mBuffersData.staticData.size() + (pStreamer ? pStreamer->getVertexCapacity() : 0);
+        const size_t indexCount = mBuffersData.indices.size() + (pStreamer ? pStreamer->getIndexCapacity() : 0);
+        size_t ibSize = sizeof(uint32_t) * indexCount;
         size_t staticVbSize = sizeof(PackedStaticVertexData) * vertexCount;
         size_t prevVbSize = sizeof(PrevVertexData) * vertexCount;
         assert(ibSize <= UINT32_MAX && staticVbSize <= UINT32_MAX && prevVbSize <= UINT32_MAX);
 
         // Create the index buffer
         ResourceBindFlags ibBindFlags = Resource::BindFlags::Index | ResourceBindFlags::ShaderResource;
-        Buffer::SharedPtr pIB = Buffer::create((uint32_t)ibSize, ibBindFlags, Buffer::CpuAccess::None, mBuffersData.indices.data());
+        Buffer::SharedPtr pIB = Buffer::create((uint32_t)ibSize, ibBindFlags, Buffer::CpuAccess::None, nullptr);
+        pIB->setBlob(mBuffersData.indices.data(), 0, sizeof(uint32_t) * mBuffersData.indices.size());
 
         // Create the vertex data as structured buffers
         ResourceBindFlags vbBindFlags = ResourceBindFlags::ShaderResource | ResourceBindFlags::UnorderedAccess | ResourceBindFlags::Vertex;
@@ -429,10 +488,16 @@ namespace Falcor
         createGlobalMatricesBuffer(mpScene.get());
         uint32_t drawCount = createMeshData(mpScene.get());
         assert(drawCount <= UINT16_MAX);
+        if (!createGeometryStreamer(mpScene.get()))
+        {
+            mpScene = nullptr;
+            return nullptr;
+        }
         mpScene->mpVao = createVao(drawCount);
         calculateMeshBoundingBoxes(mpScene.get());
         createAnimationController(mpScene.get());
         mpScene->finalize();
+        createOcclusionCuller(mpScene.get());
         mDirty = false;
 
         return mpScene;
@@ -445,17 +510,9 @@ namespace Falcor
         for (size_t i = 0; i < mMeshes.size(); i++)
         {
             const auto& mesh = mMeshes[i];
-            float3 boxMin(FLT_MAX);
-            float3 boxMax(-FLT_MAX);
-
             const auto* staticData = &mBuffersData.staticData[mesh.staticVertexOffset];
-            for (uint32_t v = 0; v < mesh.vertexCount; v++)
-            {
-                boxMin = glm::min(boxMin, staticData[v].position);
-                boxMax = glm::max(boxMax, staticData[v].position);
-            }
-
-            pScene->mMeshBBs[i] = BoundingBox::fromMinMax(boxMin, boxMax);
+            BBox bounds = boundPoints(&staticData->position, mesh.vertexCount, sizeof(PackedStaticVertexData));
+            pScene->mMeshBBs[i] = BoundingBox::fromMinMax(bounds.minPoint, bounds.maxPoint);
         }
     }
 
@@ -480,6 +537,62 @@ namespace Falcor
         }
     }
 
+    void SceneBuilder::createOcclusionCuller(Scene* pScene)
+    {
+        // The scene picks its occluders from the instance bounds, which are only known after finalizing it.
+        // The scene has no CPU copy of the geometry, so the occluder meshes are copied from here.
+        pScene->mpOcclusionCuller = OcclusionCuller::create(OcclusionCuller::Desc());
+        pScene->mOccluders.clear();
+
+        std::unordered_map<uint32_t, uint32_t> meshToOccluderMesh;
+        for (uint32_t instanceID : pScene->selectOccluders())
+        {
+            uint32_t meshID = pScene->mMeshInstanceData[instanceID].meshID;
+            auto it = meshToOccluderMesh.find(meshID);
+            if (it == meshToOccluderMesh.end())
+            {
+                const auto& mesh = mMeshes[meshID];
+                std::vector<float3> positions(mesh.vertexCount);
+                for (uint32_t v = 0; v < mesh.vertexCount; v++) positions[v] = mBuffersData.staticData[mesh.staticVertexOffset + v].position;
+                std::vector<uint32_t> indices(mBuffersData.indices.begin() + mesh.indexOffset, mBuffersData.indices.begin() + mesh.indexOffset + mesh.indexCount);
+                it = meshToOccluderMesh.emplace(meshID, pScene->mpOcclusionCuller->addOccluderMesh(std::move(positions), std::move(indices))).first;
+            }
+            pScene->mOccluders.push_back({ instanceID, it->second });
+        }
+    }
+
+    bool SceneBuilder::createGeometryStreamer(Scene* pScene)
+    {
+        if (!mpGeometryWriter && !mpGeometryFile) return true;
+
+        // The page file is completed when the first scene is created. It is deleted once no scene streams from it.
+        if (!mpGeometryFile)
+        {
+            std::string filename = mpGeometryWriter->getFilename();
+            bool finished = mpGeometryWriter->finish();
+            mpGeometryWriter = nullptr;
+            if (finished) mpGeometryFile = GeometryPageFile::open(filename, true);
+            if (!mpGeometryFile)
+            {
+                logError("Can't build scene. The geometry streaming file could not be written.");
+                return false;
+            }
+        }
+
+        pScene->mpGeometryStreamer = GeometryStreamer::create(mpGeometryFile, mGeometryStreamingDesc);
+        pScene->mStreamVertexOffset = (uint32_t)mBuffersData.staticData.size();
+        pScene->mStreamIndexOffset = (uint32_t)mBuffersData.indices.size();
+        pScene->mMeshStreamIDs.resize(mMeshes.size());
+        pScene->mStreamedMeshes.resize(mpGeometryFile->getMeshCount());
+        for (uint32_t meshID = 0; meshID < (uint32_t)mMeshes.size(); meshID++)
+        {
+            uint32_t streamID = mMeshes[meshID].streamedMeshID;
+            pScene->mMeshStreamIDs[meshID] = streamID;
+            if (streamID != GeometryPageFile::kInvalidMesh) pScene->mStreamedMeshes[streamID] = { meshID, pScene->mMeshDesc[meshID] };
+        }
+        return true;
+    }
+
     SCRIPT_BINDING(SceneBuilder)
     {
         auto buildFlags = m.enum_<SceneBuilder::Flags>("SceneBuilderFlags");
@@ -491,6 +604,7 @@ namespace Falcor
         buildFlags.regEnumVal(SceneBuilder::Flags::BuffersAsShaderResource);
         buildFlags.regEnumVal(SceneBuilder::Flags::UseSpecGlossMaterials);
         buildFlags.regEnumVal(SceneBuilder::Flags::UseMetalRoughMaterials);
+        buildFlags.regEnumVal(SceneBuilder::Flags::StreamGeometry);
         buildFlags.addBinaryOperators();
     }
 }
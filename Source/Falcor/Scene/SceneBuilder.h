@@ -28,6 +28,7 @@
 #pragma once
 #include "Scene.h"
 #include "VertexAttrib.slangh"
+#include "GeometryStreamer.h"
 
 namespace Falcor
 {
@@ -48,6 +49,7 @@ namespace Falcor
             BuffersAsShaderResource     = 0x10,   ///< Generate the VBs and IB with the shader-resource-view bind flag
             UseSpecGlossMaterials       = 0x20,   ///< Set materials to use Spec-Gloss shading model. Otherwise default is Spec-Gloss for OBJ, Metal-Rough for everything else
             UseMetalRoughMaterials      = 0x40,   ///< Set materials to use Metal-Rough shading model. Otherwise default is Spec-Gloss for OBJ, Metal-Rough for everything else
+            StreamGeometry              = 0x80,   ///< Write the mesh data to a temporary paged file as meshes are added, and stream it in at runtime within a memory budget. Skinned, emissive and non triangle-list meshes stay resident
 
             Default = None
         };
@@ -171,6 +173,10 @@ namespace Falcor
         */
         bool hasCamera() const { return mCamera.pObject != nullptr; }
 
+        /** Set the geometry streaming options. Only used with Flags::StreamGeometry.
+        */
+        void setGeometryStreamingDesc(const GeometryStreamer::Desc& desc) { mGeometryStreamingDesc = desc; }
+
     private:
         struct InternalNode : Node
         {
@@ -191,6 +197,7 @@ namespace Falcor
             uint32_t indexCount = 0;
             uint32_t vertexCount = 0;
             bool hasDynamicData = false;
+            uint32_t streamedMeshID = GeometryPageFile::kInvalidMesh; // Mesh in the geometry page file if the mesh is streamed. The buffers then hold a placeholder box
             std::vector<uint32_t> instances; // Node IDs
             std::vector<Animation::SharedPtr> animations;
         };
@@ -222,6 +229,12 @@ namespace Falcor
         Texture::SharedPtr mpEnvMap;
         float mCameraSpeed = 1.0f;
 
+        // Geometry streaming
+        GeometryPageFile::Writer::UniquePtr mpGeometryWriter;   ///< Receives the data of streamed meshes as they are added.
+        GeometryPageFile::SharedPtr mpGeometryFile;             ///< The page file, completed when the first scene is created.
+        GeometryStreamer::Desc mGeometryStreamingDesc;
+        uint32_t mPlaceholderIndexOffset = UINT32_MAX;          ///< Offset of the placeholder box indices, shared by all streamed meshes.
+
         uint32_t addMaterial(const Material::SharedPtr& pMaterial, bool removeDuplicate);
         Vao::SharedPtr createVao(uint16_t drawCount);
 
@@ -229,6 +242,9 @@ namespace Falcor
         void createGlobalMatricesBuffer(Scene* pScene);
         void calculateMeshBoundingBoxes(Scene* pScene);
         void createAnimationController(Scene* pScene);
+        void createOcclusionCuller(Scene* pScene);
+        void addPlaceholderBox(MeshSpec& spec, const BBox& bounds);
+        bool createGeometryStreamer(Scene* pScene);
         std::string mFilename;
     };
 
@@ -245,6 +261,7 @@ namespace Falcor
             t2s(BuffersAsShaderResource);
             t2s(UseSpecGlossMaterials);
             t2s(UseMetalRoughMaterials);
+            t2s(StreamGeometry);
         default:
             should_not_get_here();
             return "";
@@ -0,0 +1,314 @@
+/***************************************************************************
+ # Copyright (c) 2020, NVIDIA CORPORATION. All rights reserved.
+ #
+ # Redistribution and use in source and binary forms, with or without
+ # modification, are permitted provided that the following conditions
+ # are met:
+ #  * Redistributions of source code must retain the above copyright
+ #    notice, this list of conditions and the following disclaimer.
+ #  * Redistributions in binary form must reproduce the above copyright
+ #    notice, this list of conditions and the following disclaimer in the
+ #    documentation and/or other materials provided with the distribution.
+ #  * Neither the name of NVIDIA CORPORATION nor the names of its
+ #    contributors may be used to endorse or promote products derived
+ #    from this software without specific prior written permission.
+ #
+ # THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ # EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ # IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ # PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ # CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ # EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ # PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ # PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ # OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ # (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ # OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **************************************************************************/
+#include "stdafx.h"
+#include "SceneCuller.h"
+#include <iomanip>
+#include <numeric>
+#include <random>
+#include <sstream>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#define FALCOR_SCENE_CULLER_USE_SSE 1
+#include <emmintrin.h>
+#else
+#define FALCOR_SCENE_CULLER_USE_SSE 0
+#endif
+
+namespace Falcor
+{
+    namespace
+    {
+        const uint32_t kChunkSize = 1024;   ///< Number of instances culled and compacted by a single task. Must be a multiple of 4.
+
+        struct FrustumPlanes
+        {
+            float4 planes[6];   ///< Plane equations. A point p is inside a plane if dot(p, xyz) + w > 0.
+        };
+
+        /** Extract the frustum planes from a view-projection matrix, the same way the camera does.
+            See: https://fgiesen.wordpress.com/2012/08/31/frustum-planes-from-the-projection-matrix/
+        */
+        FrustumPlanes extractFrustumPlanes(const glm::mat4& viewProj)
+        {
+            FrustumPlanes frustum;
+            glm::mat4 tempMat = glm::transpose(viewProj);
+            for (int i = 0; i < 6; i++)
+            {
+                float4 plane = (i & 1) ? tempMat[i >> 1] : -tempMat[i >> 1];
+                if (i != 5) plane += tempMat[3]; // Z range is [0, w]. For the 0 <= z plane we don't need to add w
+                frustum.planes[i] = plane;
+            }
+            return frustum;
+        }
+
+        /** Test the boxes [begin, end) against the frustum. begin must be a multiple of 4.
+            A box is outside a plane if its corner furthest along the plane normal is, which is center + extent * sign(normal).
+            See method 4b: https://fgiesen.wordpress.com/2010/10/17/view-frustum-culling/
+        */
+        void cullRange(const FrustumPlanes& frustum, const std::vector<float>* center, const std::vector<float>* extent, uint32_t begin, uint32_t end, uint8_t* visible)
+        {
+#if FALCOR_SCENE_CULLER_USE_SSE
+            // Test four boxes against a plane at once. The bounds are padded, so the last group can read past end.
+            __m128 nx[6], ny[6], nz[6], ax[6], ay[6], az[6], negW[6];
+            for (int p = 0; p < 6; p++)
+            {
+                const float4& plane = frustum.planes[p];
+                nx[p] = _mm_set1_ps(plane.x);
+                ny[p] = _mm_set1_ps(plane.y);
+                nz[p] = _mm_set1_ps(plane.z);
+                ax[p] = _mm_set1_ps(std::abs(plane.x));
+                ay[p] = _mm_set1_ps(std::abs(plane.y));
+                az[p] = _mm_set1_ps(std::abs(plane.z));
+                negW[p] = _mm_set1_ps(-plane.w);
+            }
+
+            for (uint32_t i = begin; i < end; i += 4)
+            {
+                __m128 cx = _mm_loadu_ps(&center[0][i]);
+                __m128 cy = _mm_loadu_ps(&center[1][i]);
+                __m128 cz = _mm_loadu_ps(&center[2][i]);
+                __m128 ex = _mm_loadu_ps(&extent[0][i]);
+                __m128 ey = _mm_loadu_ps(&extent[1][i]);
+                __m128 ez = _mm_loadu_ps(&extent[2][i]);
+
+                __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+                for (int p = 0; p < 6; p++)
+                {
+                    __m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(cx, nx[p]), _mm_mul_ps(cy, ny[p])), _mm_mul_ps(cz, nz[p]));
+                    d = _mm_add_ps(d, _mm_add_ps(_mm_add_ps(_mm_mul_ps(ex, ax[p]), _mm_mul_ps(ey, ay[p])), _mm_mul_ps(ez, az[p])));
+                    inside = _mm_and_ps(inside, _mm_cmpgt_ps(d, negW[p]));
+                }
+
+                int mask = _mm_movemask_ps(inside);
+                for (uint32_t j = 0; j < 4 && i + j < end; j++) visible[i + j] = (mask >> j) & 1;
+            }
+#else
+            for (uint32_t i = begin; i < end; i++)
+            {
+                bool inside = true;
+                for (int p = 0; p < 6; p++)
+                {
+                    const float4& plane = frustum.planes[p];
+                    float d = center[0][i] * plane.x + center[1][i] * plane.y + center[2][i] * plane.z;
+                    d += extent[0][i] * std::abs(plane.x) + extent[1][i] * std::abs(plane.y) + extent[2][i] * std::abs(plane.z);
+                    inside = inside && (d > -plane.w);
+                }
+                visible[i] = inside ? 1 : 0;
+            }
+#endif
+        }
+    }
+
+    SceneCuller::UniquePtr SceneCuller::create()
+    {
+        return UniquePtr(new SceneCuller());
+    }
+
+    void SceneCuller::resize(uint32_t instanceCount)
+    {
+        mInstanceCount = instanceCount;
+        size_t paddedCount = (instanceCount + 3) & ~3u;
+        for (int i = 0; i < 3; i++)
+        {
+            mCenter[i].resize(paddedCount, 0.f);
+            mExtent[i].resize(paddedCount, 0.f);
+        }
+    }
+
+    void SceneCuller::setInstanceBounds(uint32_t instanceID, const BoundingBox& bounds)
+    {
+        assert(instanceID < mInstanceCount);
+        for (int i = 0; i < 3; i++)
+        {
+            mCenter[i][instanceID] = bounds.center[i];
+            mExtent[i][instanceID] = bounds.extent[i];
+        }
+    }
+
+    uint32_t SceneCuller::cull(const glm::mat4& viewProj, std::vector<uint8_t>& visible) const
+    {
+        const FrustumPlanes frustum = extractFrustumPlanes(viewProj);
+        const uint32_t chunkCount = (mInstanceCount + kChunkSize - 1) / kChunkSize;
+        visible.resize(mInstanceCount);
+
+        std::vector<uint32_t> visibleCounts(chunkCount, 0);
+        Threading::parallelFor(0, chunkCount, [&](uint32_t chunk)
+        {
+            uint32_t begin = chunk * kChunkSize;
+            uint32_t end = std::min(begin + kChunkSize, mInstanceCount);
+            cullRange(frustum, mCenter, mExtent, begin, end, visible.data());
+            for (uint32_t i = begin; i < end; i++) visibleCounts[chunk] += visible[i];
+        });
+
+        return std::accumulate(visibleCounts.begin(), visibleCounts.end(), 0u);
+    }
+
+    uint32_t SceneCuller::cullOccluded(const OcclusionCuller& occlusionCuller, std::vector<uint8_t>& visible) const
+    {
+        assert(visible.size() == mInstanceCount);
+        const uint32_t chunkCount = (mInstanceCount + kChunkSize - 1) / kChunkSize;
+
+        std::vector<uint32_t> occludedCounts(chunkCount, 0);
+        Threading::parallelFor(0, chunkCount, [&](uint32_t chunk)
+        {
+            uint32_t end = std::min((chunk + 1) * kChunkSize, mInstanceCount);
+            for (uint32_t i = chunk * kChunkSize; i < end; i++)
+            {
+                if (!visible[i]) continue;
+                BoundingBox box;
+                box.center = float3(mCenter[0][i], mCenter[1][i], mCenter[2][i]);
+                box.extent = float3(mExtent[0][i], mExtent[1][i], mExtent[2][i]);
+                if (!occlusionCuller.isVisible(box))
+                {
+                    visible[i] = 0;
+                    occludedCounts[chunk]++;
+                }
+            }
+        });
+
+        return std::accumulate(occludedCounts.begin(), occludedCounts.end(), 0u);
+    }
+
+    void SceneCuller::buildDrawLists(const glm::mat4& viewProj, const std::vector<MeshDesc>& meshes, const std::vector<MeshInstanceData>& instances, bool sortByMaterial, DrawLists& drawLists, const OcclusionCuller* pOcclusionCuller)
+    {
+        assert(instances.size() == mInstanceCount);
+
+        CpuTimer timer;
+        timer.update();
+        mStats.instanceCount = mInstanceCount;
+        mStats.visibleCount = cull(viewProj, mVisible);
+        mStats.occludedCount = pOcclusionCuller ? cullOccluded(*pOcclusionCuller, mVisible) : 0;
+        mStats.visibleCount -= mStats.occludedCount;
+        timer.update();
+        mStats.cullTime = timer.delta() * 1000.0;
+
+        // Count the visible draws of each chunk, then let every chunk write its draws at the prefix sum of the counts.
+        // This keeps the draws in instance order without any synchronization between the tasks.
+        const uint32_t chunkCount = (mInstanceCount + kChunkSize - 1) / kChunkSize;
+        std::vector<uint32_t> counterClockwiseOffsets(chunkCount + 1, 0);
+        std::vector<uint32_t> clockwiseOffsets(chunkCount + 1, 0);
+        Threading::parallelFor(0, chunkCount, [&](uint32_t chunk)
+        {
+            uint32_t end = std::min((chunk + 1) * kChunkSize, mInstanceCount);
+            for (uint32_t i = chunk * kChunkSize; i < end; i++)
+            {
+                if (!mVisible[i]) continue;
+                if (instances[i].flags & MeshInstanceFlags::Flipped) clockwiseOffsets[chunk + 1]++;
+                else counterClockwiseOffsets[chunk + 1]++;
+            }
+        });
+        std::partial_sum(counterClockwiseOffsets.begin(), counterClockwiseOffsets.end(), counterClockwiseOffsets.begin());
+        std::partial_sum(clockwiseOffsets.begin(), clockwiseOffsets.end(), clockwiseOffsets.begin());
+
+        drawLists.counterClockwise.resize(counterClockwiseOffsets.back());
+        drawLists.clockwise.resize(clockwiseOffsets.back());
+        Threading::parallelFor(0, chunkCount, [&](uint32_t chunk)
+        {
+            uint32_t counterClockwiseIndex = counterClockwiseOffsets[chunk];
+            uint32_t clockwiseIndex = clockwiseOffsets[chunk];
+            uint32_t end = std::min((chunk + 1) * kChunkSize, mInstanceCount);
+            for (uint32_t i = chunk * kChunkSize; i < end; i++)
+            {
+                if (!mVisible[i]) continue;
+                const auto& instance = instances[i];
+                const auto& mesh = meshes[instance.meshID];
+
+                D3D12_DRAW_INDEXED_ARGUMENTS draw;
+                draw.IndexCountPerInstance = mesh.indexCount;
+                draw.InstanceCount = 1;
+                draw.StartIndexLocation = mesh.ibOffset;
+                draw.BaseVertexLocation = mesh.vbOffset;
+                draw.StartInstanceLocation = i;
+
+                if (instance.flags & MeshInstanceFlags::Flipped) drawLists.clockwise[clockwiseIndex++] = draw;
+                else drawLists.counterClockwise[counterClockwiseIndex++] = draw;
+            }
+        });
+
+        if (sortByMaterial)
+        {
+            // Ties are broken by instance ID so that the order is deterministic.
+            auto byMaterial = [&](const D3D12_DRAW_INDEXED_ARGUMENTS& a, const D3D12_DRAW_INDEXED_ARGUMENTS& b)
+            {
+                uint32_t materialA = meshes[instances[a.StartInstanceLocation].meshID].materialID;
+                uint32_t materialB = meshes[instances[b.StartInstanceLocation].meshID].materialID;
+                return materialA != materialB ? materialA < materialB : a.StartInstanceLocation < b.StartInstanceLocation;
+            };
+            std::sort(drawLists.counterClockwise.begin(), drawLists.counterClockwise.end(), byMaterial);
+            std::sort(drawLists.clockwise.begin(), drawLists.clockwise.end(), byMaterial);
+        }
+
+        timer.update();
+        mStats.drawListTime = timer.delta() * 1000.0;
+    }
+
+    SceneCuller::BenchmarkResult SceneCuller::benchmark(const BoundingBox& bounds, const BenchmarkDesc& desc) const
+    {
+        BenchmarkResult result;
+        result.instanceCount = mInstanceCount;
+        result.viewCount = desc.viewCount;
+        if (mInstanceCount == 0 || desc.viewCount == 0) return result;
+
+        // Look from the center of the scene in random directions, so that roughly the fraction of the scene inside the field of view is visible.
+        const float radius = std::max(glm::length(bounds.extent), 1e-3f);
+        const glm::mat4 proj = glm::perspective(desc.fovY, desc.aspectRatio, radius * 1e-4f, radius * 2.f);
+        std::mt19937 rng(desc.seed);
+        std::normal_distribution<float> dist;
+        std::vector<glm::mat4> viewProjs(desc.viewCount);
+        for (auto& viewProj : viewProjs)
+        {
+            float3 dir = glm::normalize(float3(dist(rng), dist(rng), dist(rng)) + float3(1e-6f));
+            float3 up = std::abs(dir.y) < 0.99f ? float3(0, 1, 0) : float3(1, 0, 0);
+            viewProj = proj * glm::lookAt(bounds.center, bounds.center + dir, up);
+        }
+
+        std::vector<uint8_t> visible;
+        uint64_t visibleCount = 0;
+        CpuTimer timer;
+        timer.update();
+        for (const auto& viewProj : viewProjs) visibleCount += cull(viewProj, visible);
+        timer.update();
+
+        double ms = timer.delta() * 1000.0;
+        result.visibleRatio = (double)visibleCount / ((double)mInstanceCount * desc.viewCount);
+        result.msPerView = ms / desc.viewCount;
+        result.instancesPerMs = ms > 0.0 ? (double)mInstanceCount * desc.viewCount / ms : 0.0;
+        return result;
+    }
+
+    std::string SceneCuller::BenchmarkResult::toString() const
+    {
+        std::ostringstream oss;
+        oss << "  Instances:           " << instanceCount << std::endl
+            << "  Views:               " << viewCount << std::endl
+            << "  Visible:             " << std::fixed << std::setprecision(1) << visibleRatio * 100.0 << " %" << std::endl
+            << "  Time:                " << std::fixed << std::setprecision(3) << msPerView << " ms/view" << std::endl
+            << "  Throughput:          " << std::fixed << std::setprecision(0) << instancesPerMs << " instances/ms";
+        return oss.str();
+    }
+}
@@ -0,0 +1,139 @@
+/***************************************************************************
+ # Copyright (c) 2020, NVIDIA CORPORATION. All rights reserved.
+ #
+ # Redistribution and use in source and binary forms, with or without
+ # modification, are permitted provided that the following conditions
+ # are met:
+ #  * Redistributions of source code must retain the above copyright
+ #    notice, this list of conditions and the following disclaimer.
+ #  * Redistributions in binary form must reproduce the above copyright
+ #    notice, this list of conditions and the following disclaimer in the
+ #    documentation and/or other materials provided with the distribution.
+ #  * Neither the name of NVIDIA CORPORATION nor the names of its
+ #    contributors may be used to endorse or promote products derived
+ #    from this software without specific prior written permission.
+ #
+ # THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ # EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ # IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ # PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ # CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ # EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ # PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ # PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ # OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ # (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ # OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **************************************************************************/
+#pragma once
+#include "Utils/Math/AABB.h"
+#include "OcclusionCuller.h"
+#include "SceneTypes.slang"
+
+namespace Falcor
+{
+    /** CPU frustum culling of mesh instances and generation of the draw-indirect arguments for the visible ones.
+        Instance bounds are stored as a structure of arrays so that four instances are tested against a plane at once.
+        This class does not use the device.
+    */
+    class dlldecl SceneCuller
+    {
+    public:
+        using UniquePtr = std::unique_ptr<SceneCuller>;
+
+        /** Draw arguments of the visible instances, split by the winding order of their transforms.
+        */
+        struct DrawLists
+        {
+            std::vector<D3D12_DRAW_INDEXED_ARGUMENTS> counterClockwise;
+            std::vector<D3D12_DRAW_INDEXED_ARGUMENTS> clockwise;
+        };
+
+        struct Stats
+        {
+            uint32_t instanceCount = 0;     ///< Number of instances tested by the last call to buildDrawLists().
+            uint32_t visibleCount = 0;      ///< Number of instances that passed the tests.
+            uint32_t occludedCount = 0;     ///< Number of instances inside the frustum but hidden behind occluders.
+            double cullTime = 0.0;          ///< Time spent testing the instances against the frustum and the occluders in ms.
+            double drawListTime = 0.0;      ///< Time spent compacting and sorting the draw lists in ms.
+        };
+
+        struct BenchmarkDesc
+        {
+            uint32_t viewCount = 1024;      ///< Number of random views to cull the instances for.
+            float fovY = 1.0472f;           ///< Vertical field of view in radians.
+            float aspectRatio = 16.f / 9.f; ///< Aspect ratio of the views.
+            uint32_t seed = 1;              ///< Seed for the random view directions.
+        };
+
+        struct BenchmarkResult
+        {
+            uint32_t instanceCount = 0;
+            uint32_t viewCount = 0;
+            double visibleRatio = 0.0;      ///< Average fraction of the instances that are visible.
+            double msPerView = 0.0;         ///< Average time to cull all instances for a view.
+            double instancesPerMs = 0.0;    ///< Number of instances culled per ms.
+
+            std::string toString() const;
+        };
+
+        static UniquePtr create();
+
+        /** Set the number of instances. The bounds of new instances are empty boxes at the origin.
+        */
+        void resize(uint32_t instanceCount);
+
+        /** Get the number of instances.
+        */
+        uint32_t getInstanceCount() const { return mInstanceCount; }
+
+        /** Set the world space bounds of an instance.
+        */
+        void setInstanceBounds(uint32_t instanceID, const BoundingBox& bounds);
+
+        /** Test all instances against the frustum of a view-projection matrix.
+            The instances are tested in parallel.
+            \param[in] viewProj The view-projection matrix. Depth is expected in [0, w].
+            \param[out] visible Per-instance visibility, 1 if the instance intersects the frustum.
+            \return The number of visible instances.
+        */
+        uint32_t cull(const glm::mat4& viewProj, std::vector<uint8_t>& visible) const;
+
+        /** Test the instances inside the frustum against the depth buffer of an occlusion culler. The instances are tested in parallel.
+            \param[in] occlusionCuller Occlusion culler with the occluders of the view rasterized.
+            \param[in,out] visible Per-instance visibility. Instances found to be hidden are set to 0.
+            \return The number of instances found to be hidden.
+        */
+        uint32_t cullOccluded(const OcclusionCuller& occlusionCuller, std::vector<uint8_t>& visible) const;
+
+        /** Cull the instances and write the draw arguments of the visible ones.
+            The draws keep the instance ID in StartInstanceLocation, so the lists can be reordered freely.
+            \param[in] viewProj The view-projection matrix.
+            \param[in] meshes The mesh descs of the scene.
+            \param[in] instances The mesh instances of the scene. The Flipped flag selects the draw list.
+            \param[in] sortByMaterial Sort each list by material ID to reduce state changes between draws.
+            \param[out] drawLists The draw lists.
+            \param[in] pOcclusionCuller Optional occlusion culler with the occluders of the same view rasterized.
+        */
+        void buildDrawLists(const glm::mat4& viewProj, const std::vector<MeshDesc>& meshes, const std::vector<MeshInstanceData>& instances, bool sortByMaterial, DrawLists& drawLists, const OcclusionCuller* pOcclusionCuller = nullptr);
+
+        /** Get the statistics of the last call to buildDrawLists().
+        */
+        const Stats& getStats() const { return mStats; }
+
+        /** Measure the culling throughput. The views are placed at the center of the bounds, looking in random directions.
+            \param[in] bounds Bounds of the scene, used to place the views and set their depth range.
+            \param[in] desc Benchmark parameters.
+        */
+        BenchmarkResult benchmark(const BoundingBox& bounds, const BenchmarkDesc& desc) const;
+
+    private:
+        SceneCuller() = default;
+
+        uint32_t mInstanceCount = 0;
+        std::vector<float> mCenter[3];      ///< Bounds centers, padded to a multiple of 4 instances.
+        std::vector<float> mExtent[3];      ///< Bounds half extents, padded to a multiple of 4 instances.
+        std::vector<uint8_t> mVisible;      ///< Scratch visibility of the last call to buildDrawLists().
+        Stats mStats;
+    };
+}
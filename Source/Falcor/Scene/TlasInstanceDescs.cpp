@@ -0,0 +1,113 @@
+/***************************************************************************
+ # Copyright (c) 2020, NVIDIA CORPORATION. All rights reserved.
+ #
+ # Redistribution and use in source and binary forms, with or without
+ # modification, are permitted provided that the following conditions
+ # are met:
+ #  * Redistributions of source code must retain the above copyright
+ #    notice, this list of conditions and the following disclaimer.
+ #  * Redistributions in binary form must reproduce the above copyright
+ #    notice, this list of conditions and the following disclaimer in the
+ #    documentation and/or other materials provided with the distribution.
+ #  * Neither the name of NVIDIA CORPORATION nor the names of its
+ #    contributors may be used to endorse or promote products derived
+ #    from this software without specific prior written permission.
+ #
+ # THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ # EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ # IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ # PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ # CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ # EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ # PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ # PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ # OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ # (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ # OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **************************************************************************/
+#include "stdafx.h"
+#include "TlasInstanceDescs.h"
+
+namespace Falcor
+{
+    void TlasInstanceDescs::setInstanceDescs(const std::vector<D3D12_RAYTRACING_INSTANCE_DESC>& instanceDescs, const std::vector<uint32_t>& matrixIDs, uint32_t matrixCount)
+    {
+        assert(instanceDescs.size() == matrixIDs.size());
+        mInstanceDescs = instanceDescs;
+        mMatrixIDs = matrixIDs;
+
+        // Group the descs by global matrix.
+        mMatrixDescOffsets.assign(matrixCount + 1, 0);
+        for (uint32_t matrixID : mMatrixIDs)
+        {
+            assert(matrixID < matrixCount);
+            mMatrixDescOffsets[matrixID + 1]++;
+        }
+        for (uint32_t i = 0; i < matrixCount; i++) mMatrixDescOffsets[i + 1] += mMatrixDescOffsets[i];
+
+        std::vector<uint32_t> next(mMatrixDescOffsets.begin(), mMatrixDescOffsets.end() - 1);
+        mMatrixDescs.resize(mMatrixIDs.size());
+        for (uint32_t i = 0; i < (uint32_t)mMatrixIDs.size(); i++) mMatrixDescs[next[mMatrixIDs[i]]++] = i;
+
+        // Everything needs to be uploaded.
+        mDescDirty.assign(mInstanceDescs.size(), 0);
+        mDirtyDescs.clear();
+        for (uint32_t i = 0; i < (uint32_t)mInstanceDescs.size(); i++) markDirty(i);
+    }
+
+    bool TlasInstanceDescs::patchTransforms(const std::vector<uint32_t>& changedMatrices, const std::vector<glm::mat4>& globalMatrices)
+    {
+        bool patched = false;
+        for (uint32_t matrixID : changedMatrices)
+        {
+            if (matrixID + 1 >= mMatrixDescOffsets.size()) continue;
+            for (uint32_t i = mMatrixDescOffsets[matrixID]; i < mMatrixDescOffsets[matrixID + 1]; i++)
+            {
+                uint32_t descIndex = mMatrixDescs[i];
+                setTransform(mInstanceDescs[descIndex], globalMatrices[matrixID]);
+                markDirty(descIndex);
+                patched = true;
+            }
+        }
+        return patched;
+    }
+
+    std::vector<std::pair<uint32_t, uint32_t>> TlasInstanceDescs::getDirtyRanges(size_t maxRangeCount) const
+    {
+        std::vector<uint32_t> dirtyDescs = mDirtyDescs;
+        std::sort(dirtyDescs.begin(), dirtyDescs.end());
+
+        std::vector<std::pair<uint32_t, uint32_t>> ranges;
+        for (uint32_t descIndex : dirtyDescs)
+        {
+            if (!ranges.empty() && ranges.back().second == descIndex) ranges.back().second++;
+            else ranges.push_back({ descIndex, descIndex + 1 });
+        }
+
+        if (ranges.size() > maxRangeCount && !ranges.empty())
+        {
+            ranges = { { ranges.front().first, ranges.back().second } };
+        }
+        return ranges;
+    }
+
+    void TlasInstanceDescs::clearDirty()
+    {
+        for (uint32_t descIndex : mDirtyDescs) mDescDirty[descIndex] = 0;
+        mDirtyDescs.clear();
+    }
+
+    void TlasInstanceDescs::setTransform(D3D12_RAYTRACING_INSTANCE_DESC& desc, const glm::mat4& transform)
+    {
+        // The desc holds the top 3 rows of the row-major matrix.
+        glm::mat4 transform4x4 = transpose(transform);
+        std::memcpy(desc.Transform, &transform4x4, sizeof(desc.Transform));
+    }
+
+    void TlasInstanceDescs::markDirty(uint32_t descIndex)
+    {
+        if (mDescDirty[descIndex]) return;
+        mDescDirty[descIndex] = 1;
+        mDirtyDescs.push_back(descIndex);
+    }
+}
@@ -0,0 +1,89 @@
+/***************************************************************************
+ # Copyright (c) 2020, NVIDIA CORPORATION. All rights reserved.
+ #
+ # Redistribution and use in source and binary forms, with or without
+ # modification, are permitted provided that the following conditions
+ # are met:
+ #  * Redistributions of source code must retain the above copyright
+ #    notice, this list of conditions and the following disclaimer.
+ #  * Redistributions in binary form must reproduce the above copyright
+ #    notice, this list of conditions and the following disclaimer in the
+ #    documentation and/or other materials provided with the distribution.
+ #  * Neither the name of NVIDIA CORPORATION nor the names of its
+ #    contributors may be used to endorse or promote products derived
+ #    from this software without specific prior written permission.
+ #
+ # THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ # EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ # IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ # PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ # CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ # EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ # PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ # PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ # OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ # (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ # OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **************************************************************************/
+#pragma once
+
+namespace Falcor
+{
+    /** CPU copy of the instance descs of a TLAS, patched in place when global matrices change.
+        Tracks which descs changed since the last upload, so that only those need to be copied to the GPU.
+        This class does not use the device.
+    */
+    class dlldecl TlasInstanceDescs
+    {
+    public:
+        /** Sets the instance descs and marks all of them as dirty.
+            \param[in] instanceDescs The instance descs, with their transforms set.
+            \param[in] matrixIDs Global matrix ID of each instance desc.
+            \param[in] matrixCount Number of global matrices.
+        */
+        void setInstanceDescs(const std::vector<D3D12_RAYTRACING_INSTANCE_DESC>& instanceDescs, const std::vector<uint32_t>& matrixIDs, uint32_t matrixCount);
+
+        /** Patches the transforms of the instance descs that use any of the changed matrices and marks them as dirty.
+            \param[in] changedMatrices IDs of the changed global matrices.
+            \param[in] globalMatrices All global matrices.
+            \return True if any instance desc was patched.
+        */
+        bool patchTransforms(const std::vector<uint32_t>& changedMatrices, const std::vector<glm::mat4>& globalMatrices);
+
+        /** Get the instance descs.
+        */
+        const std::vector<D3D12_RAYTRACING_INSTANCE_DESC>& getInstanceDescs() const { return mInstanceDescs; }
+
+        /** Get the number of instance descs.
+        */
+        uint32_t getCount() const { return (uint32_t)mInstanceDescs.size(); }
+
+        /** Check if any instance desc changed since the last call to clearDirty().
+        */
+        bool isDirty() const { return !mDirtyDescs.empty(); }
+
+        /** Get the dirty instance descs merged into ranges of consecutive descs.
+            \param[in] maxRangeCount Maximum number of ranges. If more would be needed, a single range covering all dirty descs is returned.
+            \return List of [first, end) index pairs, in increasing order.
+        */
+        std::vector<std::pair<uint32_t, uint32_t>> getDirtyRanges(size_t maxRangeCount) const;
+
+        /** Mark all instance descs as uploaded.
+        */
+        void clearDirty();
+
+        /** Writes a transform into an instance desc.
+        */
+        static void setTransform(D3D12_RAYTRACING_INSTANCE_DESC& desc, const glm::mat4& transform);
+
+    private:
+        void markDirty(uint32_t descIndex);
+
+        std::vector<D3D12_RAYTRACING_INSTANCE_DESC> mInstanceDescs;
+        std::vector<uint32_t> mMatrixIDs;                   ///< Global matrix ID of each instance desc.
+        std::vector<uint32_t> mMatrixDescOffsets;           ///< Offset of each global matrix in mMatrixDescs, followed by the desc count.
+        std::vector<uint32_t> mMatrixDescs;                 ///< Instance desc indices, grouped by global matrix.
+        std::vector<uint8_t> mDescDirty;                    ///< Per-desc dirty flags.
+        std::vector<uint32_t> mDirtyDescs;                  ///< Indices of the dirty descs, unsorted.
+    };
+}
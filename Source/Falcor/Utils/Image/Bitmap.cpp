@@ -27,6 +27,7 @@
  **************************************************************************/
 #include "stdafx.h"
 #include "Bitmap.h"
+#include "ExrImageIO.h"
 #include "FreeImage.h"
 #include "Core/API/Texture.h"
 #include "Utils/StringUtils.h"
@@ -145,6 +146,35 @@ namespace Falcor
         return floatData;
     }
 
+    /** Saves RGB/RGBA float images with the native EXR writer, which reads half and float pixels directly without converting the image to RGBA32Float.
+        Returns false if the image should be saved through FreeImage instead.
+    */
+    static bool saveExrNative(const std::string& filename, uint32_t width, uint32_t height, Bitmap::ExportFlags exportFlags, ResourceFormat resourceFormat, bool isTopDown, const void* pData)
+    {
+        const bool exportAlpha = is_set(exportFlags, Bitmap::ExportFlags::ExportAlpha);
+        const uint32_t channelCount = getFormatChannelCount(resourceFormat);
+        if (getFormatType(resourceFormat) != FormatType::Float || channelCount < (exportAlpha ? 4u : 3u)) return false;
+        if (is_set(exportFlags, Bitmap::ExportFlags::Lossy)) return false;
+
+        const bool uncompressed = is_set(exportFlags, Bitmap::ExportFlags::Uncompressed);
+        ExrImageIO::Part part;
+        part.width = width;
+        part.height = height;
+        part.compression = uncompressed ? ExrImageIO::Compression::None : ExrImageIO::Compression::ZIP;
+        if (!part.addLayer("", resourceFormat, pData, uncompressed ? ExrImageIO::PixelType::Float : ExrImageIO::PixelType::Half, exportAlpha ? 4 : 3)) return false;
+
+        if (!isTopDown)
+        {
+            for (auto& c : part.channels)
+            {
+                c.pData += c.yStride * (height - 1);
+                c.yStride = -c.yStride;
+            }
+        }
+
+        return ExrImageIO::write(filename, { part });
+    }
+
     /** Converts 96bpp to 128bpp RGBA without clamping.
         Note that we can't use FreeImage_ConvertToRGBAF() as it clamps to [0,1].
     */
@@ -423,6 +453,8 @@ namespace Falcor
             return;
         }
 
+        if (fileFormat == Bitmap::FileFormat::ExrFile && saveExrNative(filename, width, height, exportFlags, resourceFormat, isTopDown, pData)) return;
+
         int flags = 0;
         FIBITMAP* pImage = nullptr;
         uint32_t bytesPerPixel = getFormatBytesPerBlock(resourceFormat);
@@ -0,0 +1,857 @@
+/***************************************************************************
+ # Copyright (c) 2020, NVIDIA CORPORATION. All rights reserved.
+ #
+ # Redistribution and use in source and binary forms, with or without
+ # modification, are permitted provided that the following conditions
+ # are met:
+ #  * Redistributions of source code must retain the above copyright
+ #    notice, this list of conditions and the following disclaimer.
+ #  * Redistributions in binary form must reproduce the above copyright
+ #    notice, this list of conditions and the following disclaimer in the
+ #    documentation and/or other materials provided with the distribution.
+ #  * Neither the name of NVIDIA CORPORATION nor the names of its
+ #    contributors may be used to endorse or promote products derived
+ #    from this software without specific prior written permission.
+ #
+ # THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ # EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ # IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ # PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ # CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ # EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ # PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ # PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ # OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ # (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ # OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **************************************************************************/
+#include "stdafx.h"
+#include "ExrImageIO.h"
+#include "FreeImage.h"
+#include "Utils/Threading.h"
+#include <fstream>
+#include <atomic>
+#include <numeric>
+
+namespace Falcor
+{
+    namespace
+    {
+        const uint32_t kMagic = 20000630;
+        const uint32_t kVersion = 2;
+        const uint32_t kVersionMask = 0xff;
+        const uint32_t kTiledFlag = 0x200;
+        const uint32_t kLongNamesFlag = 0x400;
+        const uint32_t kNonImageFlag = 0x800;
+        const uint32_t kMultiPartFlag = 0x1000;
+        const size_t kShortNameLength = 31;
+
+        using PixelType = ExrImageIO::PixelType;
+        using Compression = ExrImageIO::Compression;
+
+        /** Little-endian serialization helpers. EXR files are little-endian, like all platforms we run on.
+        */
+        class ByteWriter
+        {
+        public:
+            template<typename T>
+            void put(T value) { putBytes(&value, sizeof(T)); }
+            void putString(const std::string& s) { putBytes(s.c_str(), s.size() + 1); }
+            void putBytes(const void* pData, size_t size) { const uint8_t* p = (const uint8_t*)pData; mData.insert(mData.end(), p, p + size); }
+            const std::vector<uint8_t>& getData() const { return mData; }
+        private:
+            std::vector<uint8_t> mData;
+        };
+
+        class ByteReader
+        {
+        public:
+            ByteReader(const uint8_t* pData, size_t size, size_t offset = 0) : mpData(pData), mSize(size), mOffset(offset) { mValid = offset <= size; }
+
+            template<typename T>
+            T get()
+            {
+                T value = {};
+                if (!canRead(sizeof(T))) return value;
+                std::memcpy(&value, mpData + mOffset, sizeof(T));
+                mOffset += sizeof(T);
+                return value;
+            }
+
+            std::string getString()
+            {
+                std::string s;
+                while (mValid && mOffset < mSize && mpData[mOffset] != 0) s += char(mpData[mOffset++]);
+                if (mOffset >= mSize) mValid = false;
+                mOffset++;
+                return s;
+            }
+
+            const uint8_t* getBytes(size_t size)
+            {
+                if (!canRead(size)) return nullptr;
+                const uint8_t* p = mpData + mOffset;
+                mOffset += size;
+                return p;
+            }
+
+            uint8_t peek() const { return mValid && mOffset < mSize ? mpData[mOffset] : 0; }
+            bool isValid() const { return mValid; }
+
+        private:
+            bool canRead(size_t size)
+            {
+                mValid = mValid && size <= mSize - mOffset;
+                return mValid;
+            }
+
+            const uint8_t* mpData;
+            size_t mSize;
+            size_t mOffset;
+            bool mValid;
+        };
+
+        /** Splits a part into chunks. A chunk is either a block of scanlines or a tile.
+        */
+        struct ChunkLayout
+        {
+            struct Rect
+            {
+                uint32_t x, y, width, height;
+            };
+
+            uint32_t width = 0;
+            uint32_t height = 0;
+            bool tiled = false;
+            uint32_t chunkWidth = 0;
+            uint32_t chunkHeight = 0;
+            uint32_t chunksX = 0;
+            uint32_t chunksY = 0;
+
+            ChunkLayout() = default;
+            ChunkLayout(uint32_t w, uint32_t h, Compression compression, uint32_t tileWidth, uint32_t tileHeight)
+                : width(w), height(h), tiled(tileWidth > 0 && tileHeight > 0)
+            {
+                chunkWidth = tiled ? tileWidth : width;
+                chunkHeight = tiled ? tileHeight : (compression == Compression::ZIP ? 16 : 1);
+                chunksX = (width + chunkWidth - 1) / chunkWidth;
+                chunksY = (height + chunkHeight - 1) / chunkHeight;
+            }
+
+            uint32_t getChunkCount() const { return chunksX * chunksY; }
+
+            Rect getRect(uint32_t chunkX, uint32_t chunkY) const
+            {
+                Rect r;
+                r.x = chunkX * chunkWidth;
+                r.y = chunkY * chunkHeight;
+                r.width = std::min(chunkWidth, width - r.x);
+                r.height = std::min(chunkHeight, height - r.y);
+                return r;
+            }
+
+            Rect getRect(uint32_t chunk) const { return getRect(chunk % chunksX, chunk / chunksX); }
+        };
+
+        void convertPixel(const uint8_t* pSrc, PixelType srcType, PixelType dstType, uint8_t* pDst)
+        {
+            if (srcType == dstType)
+            {
+                std::memcpy(pDst, pSrc, ExrImageIO::getPixelTypeSize(srcType));
+            }
+            else if (srcType == PixelType::Float && dstType == PixelType::Half)
+            {
+                float f;
+                std::memcpy(&f, pSrc, sizeof(f));
+                glm::detail::hdata h = glm::detail::toFloat16(f);
+                std::memcpy(pDst, &h, sizeof(h));
+            }
+            else if (srcType == PixelType::Half && dstType == PixelType::Float)
+            {
+                glm::detail::hdata h;
+                std::memcpy(&h, pSrc, sizeof(h));
+                float f = glm::detail::toFloat32(h);
+                std::memcpy(pDst, &f, sizeof(f));
+            }
+            else should_not_get_here();
+        }
+
+        /** The ZIP and RLE compressors split the bytes into two halves (even and odd bytes) and delta-encode them before compressing.
+        */
+        void reorderAndPredict(const uint8_t* pSrc, size_t size, uint8_t* pDst)
+        {
+            uint8_t* t1 = pDst;
+            uint8_t* t2 = pDst + (size + 1) / 2;
+            for (size_t i = 0; i < size; i++) *((i & 1) ? t2++ : t1++) = pSrc[i];
+
+            int p = pDst[0];
+            for (size_t i = 1; i < size; i++)
+            {
+                int d = int(pDst[i]) - p + (128 + 256);
+                p = pDst[i];
+                pDst[i] = uint8_t(d);
+            }
+        }
+
+        void unpredictAndReorder(uint8_t* pSrc, size_t size, uint8_t* pDst)
+        {
+            for (size_t i = 1; i < size; i++) pSrc[i] = uint8_t(int(pSrc[i - 1]) + int(pSrc[i]) - 128);
+
+            const uint8_t* t1 = pSrc;
+            const uint8_t* t2 = pSrc + (size + 1) / 2;
+            for (size_t i = 0; i < size; i++) pDst[i] = *((i & 1) ? t2++ : t1++);
+        }
+
+        /** Run-length encoding as used by OpenEXR. Runs of 3 to 128 equal bytes are stored as (count - 1, value),
+            other bytes are stored as (-count, bytes...) with up to 127 bytes per literal block.
+        */
+        size_t rleCompress(const int8_t* pIn, size_t size, int8_t* pOut)
+        {
+            const int kMinRunLength = 3;
+            const int kMaxRunLength = 127;
+
+            const int8_t* pEnd = pIn + size;
+            const int8_t* pRunStart = pIn;
+            const int8_t* pRunEnd = pIn + 1;
+            int8_t* pWrite = pOut;
+
+            while (pRunStart < pEnd)
+            {
+                while (pRunEnd < pEnd && *pRunStart == *pRunEnd && pRunEnd - pRunStart - 1 < kMaxRunLength) ++pRunEnd;
+
+                if (pRunEnd - pRunStart >= kMinRunLength)
+                {
+                    *pWrite++ = int8_t((pRunEnd - pRunStart) - 1);
+                    *pWrite++ = *pRunStart;
+                    pRunStart = pRunEnd;
+                }
+                else
+                {
+                    while (pRunEnd < pEnd &&
+                        ((pRunEnd + 1 >= pEnd || *pRunEnd != *(pRunEnd + 1)) || (pRunEnd + 2 >= pEnd || *(pRunEnd + 1) != *(pRunEnd + 2))) &&
+                        pRunEnd - pRunStart < kMaxRunLength)
+                    {
+                        ++pRunEnd;
+                    }
+
+                    *pWrite++ = int8_t(pRunStart - pRunEnd);
+                    while (pRunStart < pRunEnd) *pWrite++ = *pRunStart++;
+                }
+
+                ++pRunEnd;
+            }
+
+            return size_t(pWrite - pOut);
+        }
+
+        bool rleUncompress(const int8_t* pIn, size_t size, int8_t* pOut, size_t outSize)
+        {
+            const int8_t* pEnd = pIn + size;
+            int8_t* pOutEnd = pOut + outSize;
+
+            while (pIn < pEnd)
+            {
+                if (*pIn < 0)
+                {
+                    size_t count = size_t(-int(*pIn++));
+                    if (count > size_t(pEnd - pIn) || count > size_t(pOutEnd - pOut)) return false;
+                    std::memcpy(pOut, pIn, count);
+                    pOut += count;
+                    pIn += count;
+                }
+                else
+                {
+                    size_t count = size_t(*pIn++) + 1;
+                    if (pIn >= pEnd || count > size_t(pOutEnd - pOut)) return false;
+                    std::memset(pOut, *pIn++, count);
+                    pOut += count;
+                }
+            }
+
+            return pOut == pOutEnd;
+        }
+
+        /** Compress a chunk. Returns the raw data if compression doesn't reduce the size, which readers detect by comparing sizes.
+        */
+        std::vector<uint8_t> compressChunk(Compression compression, std::vector<uint8_t>&& raw)
+        {
+            if (compression == Compression::None || raw.empty()) return std::move(raw);
+
+            std::vector<uint8_t> predicted(raw.size());
+            reorderAndPredict(raw.data(), raw.size(), predicted.data());
+
+            std::vector<uint8_t> packed;
+            if (compression == Compression::RLE)
+            {
+                packed.resize(raw.size() * 3 / 2 + 2);
+                packed.resize(rleCompress((const int8_t*)predicted.data(), predicted.size(), (int8_t*)packed.data()));
+            }
+            else
+            {
+                // Worst case size of zlib's compress()
+                packed.resize(raw.size() + raw.size() / 1000 + 64);
+                DWORD size = FreeImage_ZLibCompress(packed.data(), (DWORD)packed.size(), predicted.data(), (DWORD)predicted.size());
+                packed.resize(size);
+            }
+
+            if (packed.empty() || packed.size() >= raw.size()) return std::move(raw);
+            return packed;
+        }
+
+        bool decompressChunk(Compression compression, const uint8_t* pPacked, size_t packedSize, std::vector<uint8_t>& raw)
+        {
+            if (compression == Compression::None || packedSize == raw.size())
+            {
+                if (packedSize != raw.size()) return false;
+                std::memcpy(raw.data(), pPacked, packedSize);
+                return true;
+            }
+
+            std::vector<uint8_t> predicted(raw.size());
+            if (compression == Compression::RLE)
+            {
+                if (!rleUncompress((const int8_t*)pPacked, packedSize, (int8_t*)predicted.data(), predicted.size())) return false;
+            }
+            else
+            {
+                DWORD size = FreeImage_ZLibUncompress(predicted.data(), (DWORD)predicted.size(), const_cast<uint8_t*>(pPacked), (DWORD)packedSize);
+                if (size != predicted.size()) return false;
+            }
+
+            unpredictAndReorder(predicted.data(), predicted.size(), raw.data());
+            return true;
+        }
+
+        bool isCompressionSupported(uint8_t compression)
+        {
+            return compression <= uint8_t(Compression::ZIP);
+        }
+
+        void writeAttribute(ByteWriter& header, const std::string& name, const std::string& type, const ByteWriter& value)
+        {
+            header.putString(name);
+            header.putString(type);
+            header.put<int32_t>((int32_t)value.getData().size());
+            header.putBytes(value.getData().data(), value.getData().size());
+        }
+
+        template<typename T>
+        void writeAttribute(ByteWriter& header, const std::string& name, const std::string& type, const T& value)
+        {
+            ByteWriter w;
+            w.put(value);
+            writeAttribute(header, name, type, w);
+        }
+
+        void writeStringAttribute(ByteWriter& header, const std::string& name, const std::string& value)
+        {
+            // String attributes are not null-terminated, their size is stored in the attribute header
+            ByteWriter w;
+            w.putBytes(value.data(), value.size());
+            writeAttribute(header, name, "string", w);
+        }
+
+        void writeBox2iAttribute(ByteWriter& header, const std::string& name, int32_t xMax, int32_t yMax)
+        {
+            ByteWriter w;
+            w.put<int32_t>(0);
+            w.put<int32_t>(0);
+            w.put<int32_t>(xMax);
+            w.put<int32_t>(yMax);
+            writeAttribute(header, name, "box2i", w);
+        }
+
+        /** Part info shared by the reader and writer.
+        */
+        struct PartLayout
+        {
+            ChunkLayout chunks;
+            std::vector<uint32_t> channelOrder;     // Channel indices sorted by name, which is the order of the channels in the file
+            std::vector<uint32_t> channelSizes;     // Bytes per pixel for each channel in file order
+            uint32_t bytesPerPixel = 0;
+        };
+
+        const uint8_t kLevelModeOneLevel = 0;
+    }
+
+    bool ExrImageIO::Part::addLayer(const std::string& layerName, ResourceFormat format, const void* pData, PixelType type, uint32_t channelCount)
+    {
+        static const char* kChannelNames[] = { "R", "G", "B", "A" };
+
+        const FormatType formatType = getFormatType(format);
+        const uint32_t formatChannels = getFormatChannelCount(format);
+        const uint32_t channelBits = getNumChannelBits(format, 0);
+
+        PixelType sourceType;
+        if (formatType == FormatType::Float && channelBits == 16) sourceType = PixelType::Half;
+        else if (formatType == FormatType::Float && channelBits == 32) sourceType = PixelType::Float;
+        else if (formatType == FormatType::Uint && channelBits == 32) sourceType = type = PixelType::Uint;
+        else
+        {
+            logError("ExrImageIO::Part::addLayer() - Unsupported format " + to_string(format));
+            return false;
+        }
+
+        if (channelCount == 0 || channelCount > formatChannels) channelCount = formatChannels;
+
+        const uint32_t channelSize = getPixelTypeSize(sourceType);
+        const int64_t pixelSize = int64_t(channelSize) * formatChannels;
+        for (uint32_t c = 0; c < channelCount; c++)
+        {
+            Channel channel;
+            channel.name = layerName.empty() ? kChannelNames[c] : layerName + "." + kChannelNames[c];
+            channel.type = type;
+            channel.sourceType = sourceType;
+            channel.pData = (const uint8_t*)pData + c * channelSize;
+            channel.xStride = pixelSize;
+            channel.yStride = pixelSize * width;
+            channels.push_back(channel);
+        }
+        return true;
+    }
+
+    float ExrImageIO::LoadedChannel::getFloat(size_t index) const
+    {
+        float f = 0.f;
+        switch (type)
+        {
+        case PixelType::Uint:
+        {
+            uint32_t u;
+            std::memcpy(&u, data.data() + index * sizeof(u), sizeof(u));
+            f = float(u);
+            break;
+        }
+        case PixelType::Half:
+            convertPixel(data.data() + index * 2, PixelType::Half, PixelType::Float, (uint8_t*)&f);
+            break;
+        case PixelType::Float:
+            std::memcpy(&f, data.data() + index * sizeof(f), sizeof(f));
+            break;
+        }
+        return f;
+    }
+
+    const ExrImageIO::LoadedChannel* ExrImageIO::LoadedPart::findChannel(const std::string& name) const
+    {
+        for (const auto& c : channels)
+        {
+            if (c.name == name) return &c;
+        }
+        return nullptr;
+    }
+
+    bool ExrImageIO::write(const std::string& filename, const std::vector<Part>& parts)
+    {
+        auto error = [&filename](const std::string& msg)
+        {
+            logError("ExrImageIO::write() - " + msg + " File: '" + filename + "'.");
+            return false;
+        };
+
+        if (parts.empty()) return error("No parts to write.");
+        const bool multiPart = parts.size() > 1;
+
+        // Validate the parts and compute their layout
+        std::vector<PartLayout> layouts(parts.size());
+        bool longNames = false;
+        for (size_t p = 0; p < parts.size(); p++)
+        {
+            const Part& part = parts[p];
+            if (part.width == 0 || part.height == 0) return error("Part has zero size.");
+            if (part.channels.empty()) return error("Part has no channels.");
+            if (multiPart && part.name.empty()) return error("Parts in multi-part files must be named.");
+            if ((part.tileWidth == 0) != (part.tileHeight == 0)) return error("Tile width and height must both be zero or both non-zero.");
+            longNames = longNames || part.name.size() > kShortNameLength;
+            for (size_t q = 0; q < p; q++)
+            {
+                if (parts[q].name == part.name) return error("Part names must be unique.");
+            }
+
+            PartLayout& layout = layouts[p];
+            layout.chunks = ChunkLayout(part.width, part.height, part.compression, part.tileWidth, part.tileHeight);
+            layout.channelOrder.resize(part.channels.size());
+            std::iota(layout.channelOrder.begin(), layout.channelOrder.end(), 0);
+            std::sort(layout.channelOrder.begin(), layout.channelOrder.end(), [&part](uint32_t a, uint32_t b) { return part.channels[a].name < part.channels[b].name; });
+
+            for (size_t i = 0; i < layout.channelOrder.size(); i++)
+            {
+                const Channel& c = part.channels[layout.channelOrder[i]];
+                if (c.name.empty()) return error("Channel has no name.");
+                if (i > 0 && c.name == part.channels[layout.channelOrder[i - 1]].name) return error("Duplicate channel name '" + c.name + "'.");
+                if (c.pData == nullptr) return error("Channel '" + c.name + "' has no data.");
+                if ((c.type == PixelType::Uint) != (c.sourceType == PixelType::Uint)) return error("Channel '" + c.name + "' converts between uint and float.");
+                longNames = longNames || c.name.size() > kShortNameLength;
+                layout.channelSizes.push_back(getPixelTypeSize(c.type));
+                layout.bytesPerPixel += getPixelTypeSize(c.type);
+            }
+        }
+
+        // Compress all chunks of all parts in parallel
+        std::vector<std::pair<uint32_t, uint32_t>> chunkIDs; // (part, chunk) pairs
+        for (uint32_t p = 0; p < (uint32_t)parts.size(); p++)
+        {
+            for (uint32_t c = 0; c < layouts[p].chunks.getChunkCount(); c++) chunkIDs.push_back({ p, c });
+        }
+
+        std::vector<std::vector<uint8_t>> chunks(chunkIDs.size());
+        auto compressFunc = [&](uint32_t i)
+        {
+            const uint32_t p = chunkIDs[i].first;
+            const uint32_t c = chunkIDs[i].second;
+            const Part& part = parts[p];
+            const PartLayout& layout = layouts[p];
+            const ChunkLayout::Rect rect = layout.chunks.getRect(c);
+
+            // Pixel data is stored line by line, and for each line channel by channel
+            std::vector<uint8_t> raw(size_t(layout.bytesPerPixel) * rect.width * rect.height);
+            uint8_t* pDst = raw.data();
+            for (uint32_t y = rect.y; y < rect.y + rect.height; y++)
+            {
+                for (size_t k = 0; k < layout.channelOrder.size(); k++)
+                {
+                    const Channel& channel = part.channels[layout.channelOrder[k]];
+                    const uint8_t* pSrc = channel.pData + int64_t(y) * channel.yStride + int64_t(rect.x) * channel.xStride;
+                    for (uint32_t x = 0; x < rect.width; x++)
+                    {
+                        convertPixel(pSrc, channel.sourceType, channel.type, pDst);
+                        pSrc += channel.xStride;
+                        pDst += layout.channelSizes[k];
+                    }
+                }
+            }
+
+            std::vector<uint8_t> packed = compressChunk(part.compression, std::move(raw));
+
+            ByteWriter w;
+            if (multiPart) w.put<int32_t>((int32_t)p);
+            if (layout.chunks.tiled)
+            {
+                w.put<int32_t>(int32_t(c % layout.chunks.chunksX));
+                w.put<int32_t>(int32_t(c / layout.chunks.chunksX));
+                w.put<int32_t>(0); // Mip level
+                w.put<int32_t>(0);
+            }
+            else
+            {
+                w.put<int32_t>((int32_t)rect.y);
+            }
+            w.put<int32_t>((int32_t)packed.size());
+            w.putBytes(packed.data(), packed.size());
+            chunks[i] = w.getData();
+        };
+        Threading::parallelFor(0, (uint32_t)chunks.size(), compressFunc);
+
+        // Headers
+        ByteWriter header;
+        uint32_t version = kVersion;
+        if (multiPart) version |= kMultiPartFlag;
+        else if (layouts[0].chunks.tiled) version |= kTiledFlag;
+        if (longNames) version |= kLongNamesFlag;
+        header.put<uint32_t>(kMagic);
+        header.put<uint32_t>(version);
+
+        for (size_t p = 0; p < parts.size(); p++)
+        {
+            const Part& part = parts[p];
+            const PartLayout& layout = layouts[p];
+
+            ByteWriter channelList;
+            for (uint32_t index : layout.channelOrder)
+            {
+                const Channel& c = part.channels[index];
+                channelList.putString(c.name);
+                channelList.put<int32_t>((int32_t)c.type);
+                channelList.put<uint8_t>(0); // pLinear
+                channelList.put<uint8_t>(0); // Reserved
+                channelList.put<uint8_t>(0);
+                channelList.put<uint8_t>(0);
+                channelList.put<int32_t>(1); // x sampling
+                channelList.put<int32_t>(1); // y sampling
+            }
+            channelList.put<uint8_t>(0);
+
+            writeAttribute(header, "channels", "chlist", channelList);
+            writeAttribute(header, "compression", "compression", (uint8_t)part.compression);
+            writeBox2iAttribute(header, "dataWindow", part.width - 1, part.height - 1);
+            writeBox2iAttribute(header, "displayWindow", part.width - 1, part.height - 1);
+            writeAttribute(header, "lineOrder", "lineOrder", (uint8_t)0); // Increasing y
+            writeAttribute(header, "pixelAspectRatio", "float", 1.f);
+            writeAttribute(header, "screenWindowCenter", "v2f", float2(0.f));
+            writeAttribute(header, "screenWindowWidth", "float", 1.f);
+
+            if (layout.chunks.tiled)
+            {
+                ByteWriter tiles;
+                tiles.put<uint32_t>(part.tileWidth);
+                tiles.put<uint32_t>(part.tileHeight);
+                tiles.put<uint8_t>(kLevelModeOneLevel);
+                writeAttribute(header, "tiles", "tiledesc", tiles);
+            }
+
+            if (multiPart)
+            {
+                writeStringAttribute(header, "name", part.name);
+                writeStringAttribute(header, "type", layout.chunks.tiled ? "tiledimage" : "scanlineimage");
+                writeAttribute(header, "chunkCount", "int", (int32_t)layout.chunks.getChunkCount());
+            }
+            else if (!part.name.empty())
+            {
+                writeStringAttribute(header, "name", part.name);
+            }
+
+            header.put<uint8_t>(0); // End of header
+        }
+        if (multiPart) header.put<uint8_t>(0); // End of the header list
+
+        // Offset tables, the chunks follow in the same order
+        uint64_t offset = header.getData().size() + chunks.size() * sizeof(uint64_t);
+        for (const auto& chunk : chunks)
+        {
+            header.put<uint64_t>(offset);
+            offset += chunk.size();
+        }
+
+        std::ofstream file(filename, std::ios::binary);
+        if (!file) return error("Can't open file for writing.");
+        file.write((const char*)header.getData().data(), header.getData().size());
+        for (const auto& chunk : chunks) file.write((const char*)chunk.data(), chunk.size());
+        if (!file) return error("Failed to write file.");
+
+        return true;
+    }
+
+    bool ExrImageIO::read(const std::string& filename, std::vector<LoadedPart>& parts)
+    {
+        auto error = [&filename](const std::string& msg)
+        {
+            logError("ExrImageIO::read() - " + msg + " File: '" + filename + "'.");
+            return false;
+        };
+
+        std::string fullpath;
+        if (!findFileInDataDirectories(filename, fullpath)) return error("Can't find file.");
+
+        std::ifstream file(fullpath, std::ios::binary | std::ios::ate);
+        if (!file) return error("Can't open file.");
+        std::vector<uint8_t> data((size_t)file.tellg());
+        file.seekg(0);
+        file.read((char*)data.data(), data.size());
+        if (!file) return error("Failed to read file.");
+
+        ByteReader r(data.data(), data.size());
+        if (r.get<uint32_t>() != kMagic) return error("Not an EXR file.");
+        const uint32_t version = r.get<uint32_t>();
+        if ((version & kVersionMask) != kVersion) return error("Unsupported EXR version.");
+        if (version & kNonImageFlag) return error("Deep images are not supported.");
+        const bool multiPart = (version & kMultiPartFlag) != 0;
+
+        // Headers
+        struct PartHeader
+        {
+            std::vector<std::pair<std::string, PixelType>> channels;
+            uint8_t compression = 0;
+            int32_t dataWindow[4] = {};
+            bool tiled = false;
+            uint32_t tileWidth = 0;
+            uint32_t tileHeight = 0;
+            int32_t chunkCount = -1;
+            std::string name;
+        };
+        std::vector<PartHeader> headers;
+
+        while (true)
+        {
+            if (multiPart && r.peek() == 0)
+            {
+                r.get<uint8_t>();
+                break;
+            }
+
+            PartHeader h;
+            h.tiled = (version & kTiledFlag) != 0;
+            bool hasChannels = false, hasCompression = false, hasDataWindow = false;
+            while (r.isValid() && r.peek() != 0)
+            {
+                const std::string name = r.getString();
+                const std::string type = r.getString();
+                const int32_t size = r.get<int32_t>();
+                const uint8_t* pValue = r.getBytes(size < 0 ? SIZE_MAX : size_t(size));
+                if (!pValue) break;
+                ByteReader value(pValue, size);
+
+                if (name == "channels" && type == "chlist")
+                {
+                    while (value.isValid() && value.peek() != 0)
+                    {
+                        const std::string channelName = value.getString();
+                        const uint32_t pixelType = value.get<uint32_t>();
+                        value.getBytes(4); // pLinear and reserved
+                        const int32_t xSampling = value.get<int32_t>();
+                        const int32_t ySampling = value.get<int32_t>();
+                        if (pixelType > uint32_t(PixelType::Float)) return error("Unsupported pixel type.");
+                        if (xSampling != 1 || ySampling != 1) return error("Sub-sampled channels are not supported.");
+                        h.channels.push_back({ channelName, PixelType(pixelType) });
+                    }
+                    hasChannels = value.isValid();
+                }
+                else if (name == "compression")
+                {
+                    h.compression = value.get<uint8_t>();
+                    hasCompression = value.isValid();
+                }
+                else if (name == "dataWindow")
+                {
+                    for (int32_t& v : h.dataWindow) v = value.get<int32_t>();
+                    hasDataWindow = value.isValid();
+                }
+                else if (name == "tiles")
+                {
+                    h.tileWidth = value.get<uint32_t>();
+                    h.tileHeight = value.get<uint32_t>();
+                    const uint8_t mode = value.get<uint8_t>();
+                    if ((mode & 0xf) != kLevelModeOneLevel) return error("Mip-mapped images are not supported.");
+                }
+                else if (name == "type")
+                {
+                    const std::string partType((const char*)pValue, size);
+                    if (partType != "scanlineimage" && partType != "tiledimage") return error("Unsupported part type '" + partType + "'.");
+                    h.tiled = partType == "tiledimage";
+                }
+                else if (name == "name")
+                {
+                    h.name.assign((const char*)pValue, size);
+                }
+                else if (name == "chunkCount")
+                {
+                    h.chunkCount = value.get<int32_t>();
+                }
+            }
+            r.get<uint8_t>(); // End of header
+            if (!r.isValid()) return error("Corrupt header.");
+
+            if (!hasChannels || !hasCompression || !hasDataWindow) return error("Missing required header attributes.");
+            if (!isCompressionSupported(h.compression)) return error("Unsupported compression method " + std::to_string(h.compression) + ".");
+            if (h.dataWindow[2] < h.dataWindow[0] || h.dataWindow[3] < h.dataWindow[1]) return error("Invalid data window.");
+            if (h.tiled && (h.tileWidth == 0 || h.tileHeight == 0)) return error("Invalid tile size.");
+            std::sort(h.channels.begin(), h.channels.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+            headers.push_back(std::move(h));
+
+            if (!multiPart) break;
+        }
+
+        // Allocate the parts and read the offset tables
+        parts.clear();
+        parts.resize(headers.size());
+        std::vector<PartLayout> layouts(headers.size());
+        std::vector<std::vector<uint64_t>> offsets(headers.size());
+        for (size_t p = 0; p < headers.size(); p++)
+        {
+            const PartHeader& h = headers[p];
+            LoadedPart& part = parts[p];
+            part.name = h.name;
+            part.width = uint32_t(h.dataWindow[2] - h.dataWindow[0] + 1);
+            part.height = uint32_t(h.dataWindow[3] - h.dataWindow[1] + 1);
+            part.compression = Compression(h.compression);
+            part.tileWidth = h.tiled ? h.tileWidth : 0;
+            part.tileHeight = h.tiled ? h.tileHeight : 0;
+
+            PartLayout& layout = layouts[p];
+            layout.chunks = ChunkLayout(part.width, part.height, part.compression, part.tileWidth, part.tileHeight);
+            if (h.chunkCount >= 0 && uint32_t(h.chunkCount) != layout.chunks.getChunkCount()) return error("Unexpected chunk count.");
+
+            for (const auto& c : h.channels)
+            {
+                LoadedChannel channel;
+                channel.name = c.first;
+                channel.type = c.second;
+                channel.data.resize(size_t(part.width) * part.height * getPixelTypeSize(c.second));
+                part.channels.push_back(std::move(channel));
+                layout.channelSizes.push_back(getPixelTypeSize(c.second));
+                layout.bytesPerPixel += getPixelTypeSize(c.second);
+            }
+
+            offsets[p].resize(layout.chunks.getChunkCount());
+            for (uint64_t& offset : offsets[p]) offset = r.get<uint64_t>();
+        }
+        if (!r.isValid()) return error("Corrupt offset table.");
+
+        // Decompress all chunks of all parts in parallel
+        std::vector<std::pair<uint32_t, uint32_t>> chunkIDs; // (part, chunk) pairs
+        for (uint32_t p = 0; p < (uint32_t)parts.size(); p++)
+        {
+            for (uint32_t c = 0; c < layouts[p].chunks.getChunkCount(); c++) chunkIDs.push_back({ p, c });
+        }
+
+        std::atomic<bool> failed = false;
+        auto decompressFunc = [&](uint32_t i)
+        {
+            const uint32_t p = chunkIDs[i].first;
+            const PartHeader& h = headers[p];
+            const PartLayout& layout = layouts[p];
+            LoadedPart& part = parts[p];
+
+            ByteReader chunk(data.data(), data.size(), (size_t)offsets[p][chunkIDs[i].second]);
+            if (multiPart && chunk.get<int32_t>() != int32_t(p))
+            {
+                failed = true;
+                return;
+            }
+
+            // Use the coordinates stored in the chunk, the offset table isn't required to be sorted
+            ChunkLayout::Rect rect;
+            if (layout.chunks.tiled)
+            {
+                const uint32_t tileX = chunk.get<uint32_t>();
+                const uint32_t tileY = chunk.get<uint32_t>();
+                chunk.get<int32_t>(); // Mip level
+                chunk.get<int32_t>();
+                if (tileX >= layout.chunks.chunksX || tileY >= layout.chunks.chunksY)
+                {
+                    failed = true;
+                    return;
+                }
+                rect = layout.chunks.getRect(tileX, tileY);
+            }
+            else
+            {
+                const int64_t y = int64_t(chunk.get<int32_t>()) - h.dataWindow[1];
+                if (y < 0 || y >= part.height || y % layout.chunks.chunkHeight != 0)
+                {
+                    failed = true;
+                    return;
+                }
+                rect = layout.chunks.getRect(0, uint32_t(y / layout.chunks.chunkHeight));
+            }
+
+            const int32_t packedSize = chunk.get<int32_t>();
+            const uint8_t* pPacked = chunk.getBytes(packedSize < 0 ? SIZE_MAX : size_t(packedSize));
+            std::vector<uint8_t> raw(size_t(layout.bytesPerPixel) * rect.width * rect.height);
+            if (!pPacked || !decompressChunk(part.compression, pPacked, packedSize, raw))
+            {
+                failed = true;
+                return;
+            }
+
+            const uint8_t* pSrc = raw.data();
+            for (uint32_t y = rect.y; y < rect.y + rect.height; y++)
+            {
+                for (size_t c = 0; c < part.channels.size(); c++)
+                {
+                    const size_t lineSize = size_t(rect.width) * layout.channelSizes[c];
+                    std::memcpy(part.channels[c].data.data() + (size_t(y) * part.width + rect.x) * layout.channelSizes[c], pSrc, lineSize);
+                    pSrc += lineSize;
+                }
+            }
+        };
+        Threading::parallelFor(0, (uint32_t)chunkIDs.size(), decompressFunc);
+
+        if (failed)
+        {
+            parts.clear();
+            return error("Corrupt chunk data.");
+        }
+
+        return true;
+    }
+}
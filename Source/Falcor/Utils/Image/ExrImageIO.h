@@ -0,0 +1,138 @@
+/***************************************************************************
+ # Copyright (c) 2020, NVIDIA CORPORATION. All rights reserved.
+ #
+ # Redistribution and use in source and binary forms, with or without
+ # modification, are permitted provided that the following conditions
+ # are met:
+ #  * Redistributions of source code must retain the above copyright
+ #    notice, this list of conditions and the following disclaimer.
+ #  * Redistributions in binary form must reproduce the above copyright
+ #    notice, this list of conditions and the following disclaimer in the
+ #    documentation and/or other materials provided with the distribution.
+ #  * Neither the name of NVIDIA CORPORATION nor the names of its
+ #    contributors may be used to endorse or promote products derived
+ #    from this software without specific prior written permission.
+ #
+ # THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ # EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ # IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ # PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ # CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ # EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ # PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ # PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ # OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ # (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ # OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **************************************************************************/
+#pragma once
+
+namespace Falcor
+{
+    /** Native reader and writer for OpenEXR files.
+        Supports scanline and tiled images, multi-part files, multi-layer channel names (e.g. "albedo.R"),
+        half/float/uint channels and the NONE, RLE, ZIPS and ZIP compression methods. Mip-mapped, deep and sub-sampled images are not supported.
+        Chunks (scanline blocks or tiles) are compressed and decompressed in parallel.
+    */
+    class dlldecl ExrImageIO
+    {
+    public:
+        enum class PixelType : uint32_t
+        {
+            Uint = 0,
+            Half = 1,
+            Float = 2,
+        };
+
+        enum class Compression : uint8_t
+        {
+            None = 0,
+            RLE = 1,    ///< Run-length encoding, one scanline per chunk
+            ZIPS = 2,   ///< zlib, one scanline per chunk
+            ZIP = 3,    ///< zlib, 16 scanlines per chunk
+        };
+
+        /** A channel to write. The pixels are read from memory owned by the caller.
+        */
+        struct Channel
+        {
+            std::string name;                           ///< Channel name. Prefixed with the layer name in multi-layer images, e.g. "albedo.R"
+            PixelType type = PixelType::Half;           ///< Pixel type stored in the file
+            PixelType sourceType = PixelType::Float;    ///< Pixel type of the source data. Uint channels can't be converted to or from other types
+            const uint8_t* pData = nullptr;             ///< Address of the top-left pixel
+            int64_t xStride = 0;                        ///< Bytes between horizontally adjacent pixels
+            int64_t yStride = 0;                        ///< Bytes between vertically adjacent pixels. Use a negative stride to flip the image
+        };
+
+        /** A part to write. Files with more than one part are written as multi-part files.
+        */
+        struct Part
+        {
+            std::string name;                           ///< Part name. Required in multi-part files
+            uint32_t width = 0;
+            uint32_t height = 0;
+            Compression compression = Compression::ZIP;
+            uint32_t tileWidth = 0;                     ///< Tile size. Set to zero to write a scanline image
+            uint32_t tileHeight = 0;
+            std::vector<Channel> channels;
+
+            /** Add all channels of an image in memory, e.g. a texture read back with RenderContext::readTextureSubresource().
+                \param[in] layerName Name of the layer. Empty for the default layer, which uses the plain R, G, B, A channel names.
+                \param[in] format Format of the image. Must be a 16/32-bit float or a 32-bit uint format.
+                \param[in] pData The pixels, tightly packed, top-left pixel first. The memory must stay valid until the part is written.
+                \param[in] type Pixel type stored in the file for float formats. Ignored for uint formats.
+                \param[in] channelCount Number of channels to add, starting with R. Zero adds all channels of the format.
+                \return False if the format isn't supported.
+            */
+            bool addLayer(const std::string& layerName, ResourceFormat format, const void* pData, PixelType type = PixelType::Half, uint32_t channelCount = 0);
+        };
+
+        /** A channel read from a file. Pixels are stored planar and top-down, in the pixel type of the file.
+        */
+        struct LoadedChannel
+        {
+            std::string name;
+            PixelType type = PixelType::Half;
+            std::vector<uint8_t> data;
+
+            /** Get a pixel converted to float.
+            */
+            float getFloat(size_t index) const;
+        };
+
+        /** A part read from a file.
+        */
+        struct LoadedPart
+        {
+            std::string name;
+            uint32_t width = 0;
+            uint32_t height = 0;
+            Compression compression = Compression::None;
+            uint32_t tileWidth = 0;                     ///< Zero for scanline images
+            uint32_t tileHeight = 0;
+            std::vector<LoadedChannel> channels;        ///< Sorted by name
+
+            /** Find a channel by name. Returns nullptr if the part has no such channel.
+            */
+            const LoadedChannel* findChannel(const std::string& name) const;
+        };
+
+        /** Write an EXR file.
+            \param[in] filename The file to write.
+            \param[in] parts The parts of the image. Pass a single part to write a single-part file.
+            \return True if successful.
+        */
+        static bool write(const std::string& filename, const std::vector<Part>& parts);
+
+        /** Read an EXR file.
+            \param[in] filename The file to read.
+            \param[out] parts The parts of the image.
+            \return True if successful.
+        */
+        static bool read(const std::string& filename, std::vector<LoadedPart>& parts);
+
+        /** Get the size in bytes of a pixel type.
+        */
+        static uint32_t getPixelTypeSize(PixelType type) { return type == PixelType::Half ? 2 : 4; }
+    };
+}
@@ -0,0 +1,181 @@
+/***************************************************************************
+ # Copyright (c) 2020, NVIDIA CORPORATION. All rights reserved.
+ #
+ # Redistribution and use in source and binary forms, with or without
+ # modification, are permitted provided that the following conditions
+ # are met:
+ #  * Redistributions of source code must retain the above copyright
+ #    notice, this list of conditions and the following disclaimer.
+ #  * Redistributions in binary form must reproduce the above copyright
+ #    notice, this list of conditions and the following disclaimer in the
+ #    documentation and/or other materials provided with the distribution.
+ #  * Neither the name of NVIDIA CORPORATION nor the names of its
+ #    contributors may be used to endorse or promote products derived
+ #    from this software without specific prior written permission.
+ #
+ # THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ # EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ # IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ # PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ # CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ # EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ # PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ # PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ # OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ # (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ # OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **************************************************************************/
+#include "stdafx.h"
+#include "ImageWriteQueue.h"
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+
+namespace Falcor
+{
+    namespace
+    {
+        struct QueueData
+        {
+            std::mutex mutex;
+            std::condition_variable jobQueued;      // Signaled when a job was queued or the workers should stop
+            std::condition_variable jobDone;        // Signaled when a worker finished a job
+            std::deque<ImageWriteQueue::Job> jobs;
+            std::vector<std::thread> workers;
+            uint32_t maxPendingImages = 0;
+            uint32_t pendingCount = 0;              // Queued jobs plus jobs currently executing
+            bool stopping = false;
+        } gData;
+
+        void saveImage(ImageWriteQueue::Image& image)
+        {
+            Bitmap::saveImage(image.filename, image.width, image.height, image.fileFormat, image.exportFlags, image.resourceFormat, image.isTopDown, image.data.data());
+        }
+
+        ImageWriteQueue::Job createSaveJob(ImageWriteQueue::Image& image)
+        {
+            return [image = std::move(image)]() mutable { saveImage(image); };
+        }
+
+        void workerFunc()
+        {
+            while (true)
+            {
+                ImageWriteQueue::Job job;
+                {
+                    std::unique_lock<std::mutex> lock(gData.mutex);
+                    gData.jobQueued.wait(lock, [] { return gData.stopping || !gData.jobs.empty(); });
+                    // Keep draining the queue when stopping, shutdown() promises that every queued image gets written
+                    if (gData.jobs.empty()) return;
+                    job = std::move(gData.jobs.front());
+                    gData.jobs.pop_front();
+                }
+
+                job();
+                job = nullptr; // Release the image data before the slot is freed
+
+                {
+                    std::lock_guard<std::mutex> lock(gData.mutex);
+                    gData.pendingCount--;
+                }
+                gData.jobDone.notify_all();
+            }
+        }
+    }
+
+    void ImageWriteQueue::start(uint32_t workerCount, uint32_t maxPendingImages)
+    {
+        if (isRunning()) return;
+        assert(workerCount > 0 && maxPendingImages > 0);
+
+        gData.stopping = false;
+        gData.maxPendingImages = maxPendingImages;
+        gData.pendingCount = 0;
+        for (uint32_t i = 0; i < workerCount; i++) gData.workers.emplace_back(workerFunc);
+    }
+
+    void ImageWriteQueue::shutdown()
+    {
+        if (!isRunning()) return;
+
+        {
+            std::lock_guard<std::mutex> lock(gData.mutex);
+            gData.stopping = true;
+        }
+        gData.jobQueued.notify_all();
+
+        for (auto& t : gData.workers) t.join();
+        gData.workers.clear();
+        assert(gData.jobs.empty() && gData.pendingCount == 0);
+    }
+
+    bool ImageWriteQueue::isRunning()
+    {
+        return !gData.workers.empty();
+    }
+
+    void ImageWriteQueue::write(Image&& image)
+    {
+        if (!isRunning())
+        {
+            saveImage(image);
+            return;
+        }
+
+        enqueue(createSaveJob(image));
+    }
+
+    void ImageWriteQueue::enqueue(Job&& job)
+    {
+        if (!isRunning())
+        {
+            job();
+            return;
+        }
+
+        {
+            std::unique_lock<std::mutex> lock(gData.mutex);
+            gData.jobDone.wait(lock, [] { return gData.pendingCount < gData.maxPendingImages; });
+            gData.jobs.push_back(std::move(job));
+            gData.pendingCount++;
+        }
+        gData.jobQueued.notify_one();
+    }
+
+    bool ImageWriteQueue::tryWrite(Image& image)
+    {
+        if (!isRunning())
+        {
+            saveImage(image);
+            return true;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(gData.mutex);
+            if (gData.pendingCount >= gData.maxPendingImages) return false;
+            gData.jobs.push_back(createSaveJob(image));
+            gData.pendingCount++;
+        }
+        gData.jobQueued.notify_one();
+        return true;
+    }
+
+    bool ImageWriteQueue::isFull()
+    {
+        if (!isRunning()) return false;
+        std::lock_guard<std::mutex> lock(gData.mutex);
+        return gData.pendingCount >= gData.maxPendingImages;
+    }
+
+    void ImageWriteQueue::flush()
+    {
+        std::unique_lock<std::mutex> lock(gData.mutex);
+        gData.jobDone.wait(lock, [] { return gData.pendingCount == 0; });
+    }
+
+    uint32_t ImageWriteQueue::getPendingCount()
+    {
+        std::lock_guard<std::mutex> lock(gData.mutex);
+        return gData.pendingCount;
+    }
+}
@@ -0,0 +1,104 @@
+/***************************************************************************
+ # Copyright (c) 2020, NVIDIA CORPORATION. All rights reserved.
+ #
+ # Redistribution and use in source and binary forms, with or without
+ # modification, are permitted provided that the following conditions
+ # are met:
+ #  * Redistributions of source code must retain the above copyright
+ #    notice, this list of conditions and the following disclaimer.
+ #  * Redistributions in binary form must reproduce the above copyright
+ #    notice, this list of conditions and the following disclaimer in the
+ #    documentation and/or other materials provided with the distribution.
+ #  * Neither the name of NVIDIA CORPORATION nor the names of its
+ #    contributors may be used to endorse or promote products derived
+ #    from this software without specific prior written permission.
+ #
+ # THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ # EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ # IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ # PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ # CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ # EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ # PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ # PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ # OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ # (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ # OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **************************************************************************/
+#pragma once
+#include "Bitmap.h"
+
+namespace Falcor
+{
+    /** Bounded queue of images that are encoded and written to disk by background worker threads.
+        The queue takes ownership of the pixel data, so handing an image to it never copies the pixels.
+        The number of queued images is limited. write() blocks when the queue is full, tryWrite() returns immediately instead.
+        If the queue wasn't started, images are written synchronously on the calling thread.
+    */
+    class dlldecl ImageWriteQueue
+    {
+    public:
+        static const uint32_t kDefaultWorkerCount = 2;
+        static const uint32_t kDefaultMaxPendingImages = 8;
+
+        /** A job which writes an image. Used for writers other than Bitmap::saveImage(), such as ExrImageIO. The job should own the data it writes.
+        */
+        using Job = std::function<void(void)>;
+
+        /** An image to write. The fields match the arguments of Bitmap::saveImage().
+        */
+        struct Image
+        {
+            std::string filename;
+            uint32_t width = 0;
+            uint32_t height = 0;
+            Bitmap::FileFormat fileFormat = Bitmap::FileFormat::PngFile;
+            Bitmap::ExportFlags exportFlags = Bitmap::ExportFlags::None;
+            ResourceFormat resourceFormat = ResourceFormat::Unknown;
+            bool isTopDown = true;
+            std::vector<uint8_t> data;
+        };
+
+        /** Start the worker threads.
+            \param[in] workerCount Number of threads encoding images.
+            \param[in] maxPendingImages Maximum number of images which are queued or being encoded. Bounds the memory used by the queue.
+        */
+        static void start(uint32_t workerCount = kDefaultWorkerCount, uint32_t maxPendingImages = kDefaultMaxPendingImages);
+
+        /** Write all pending images and stop the worker threads.
+        */
+        static void shutdown();
+
+        /** Check if the worker threads are running.
+        */
+        static bool isRunning();
+
+        /** Queue an image for writing. Blocks while the queue is full.
+            \param[in] image The image. Its pixel data is moved into the queue.
+        */
+        static void write(Image&& image);
+
+        /** Queue a job which writes an image. Blocks while the queue is full.
+            \param[in] job The job. If the queue wasn't started, the job is executed on the calling thread.
+        */
+        static void enqueue(Job&& job);
+
+        /** Queue an image for writing if there is room for it.
+            \param[in] image The image. If the call succeeds, its pixel data is moved into the queue. Otherwise, the image is left untouched.
+            \return True if the image was queued, false if the queue is full.
+        */
+        static bool tryWrite(Image& image);
+
+        /** Check if the queue is full, i.e. if write() would block.
+        */
+        static bool isFull();
+
+        /** Block until all images queued so far were written.
+        */
+        static void flush();
+
+        /** Get the number of images which are queued or being encoded.
+        */
+        static uint32_t getPendingCount();
+    };
+}
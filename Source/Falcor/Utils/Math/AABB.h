@@ -45,34 +45,17 @@ namespace Falcor
         }
 
         /** Calculates the bounding box transformed by a matrix
+            The center is transformed, and the extent is transformed by the absolute value of the matrix (Arvo's method).
+            Use transformBoxes() in BoxBatch.h to transform many boxes.
             \param[in] mat Transform matrix
             \return Bounding box after transformation
         */
         BoundingBox transform(const glm::mat4& mat) const
         {
-            float3 min = center - extent;
-            float3 max = center + extent;
-
-            float3 xa = float3(mat[0] * min.x);
-            float3 xb = float3(mat[0] * max.x);
-            float3 xMin = glm::min(xa, xb);
-            float3 xMax = glm::max(xa, xb);
-
-            float3 ya = float3(mat[1] * min.y);
-            float3 yb = float3(mat[1] * max.y);
-            float3 yMin = glm::min(ya, yb);
-            float3 yMax = glm::max(ya, yb);
-
-            float3 za = float3(mat[2] * min.z);
-            float3 zb = float3(mat[2] * max.z);
-            float3 zMin = glm::min(za, zb);
-            float3 zMax = glm::max(za, zb);
-
-
-            float3 newMin = xMin + yMin + zMin + float3(mat[3]);
-            float3 newMax = xMax + yMax + zMax + float3(mat[3]);
-
-            return BoundingBox::fromMinMax(newMin, newMax);
+            BoundingBox box;
+            box.center = float3(mat * float4(center, 1.f));
+            box.extent = glm::abs(float3(mat[0])) * extent.x + glm::abs(float3(mat[1])) * extent.y + glm::abs(float3(mat[2])) * extent.z;
+            return box;
         }
 
         /** Gets the minimum position of the bounding box
@@ -0,0 +1,385 @@
+/***************************************************************************
+ # Copyright (c) 2020, NVIDIA CORPORATION. All rights reserved.
+ #
+ # Redistribution and use in source and binary forms, with or without
+ # modification, are permitted provided that the following conditions
+ # are met:
+ #  * Redistributions of source code must retain the above copyright
+ #    notice, this list of conditions and the following disclaimer.
+ #  * Redistributions in binary form must reproduce the above copyright
+ #    notice, this list of conditions and the following disclaimer in the
+ #    documentation and/or other materials provided with the distribution.
+ #  * Neither the name of NVIDIA CORPORATION nor the names of its
+ #    contributors may be used to endorse or promote products derived
+ #    from this software without specific prior written permission.
+ #
+ # THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ # EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ # IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ # PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ # CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ # EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ # PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ # PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ # OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ # (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ # OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **************************************************************************/
+#include "stdafx.h"
+#include "BoxBatch.h"
+#include <iomanip>
+#include <limits>
+#include <random>
+#include <sstream>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#define FALCOR_BOX_BATCH_USE_SSE 1
+#include <emmintrin.h>
+#else
+#define FALCOR_BOX_BATCH_USE_SSE 0
+#endif
+
+namespace Falcor
+{
+    namespace
+    {
+        const float kInf = std::numeric_limits<float>::infinity();
+
+        template<typename T>
+        const T* offsetPtr(const T* p, size_t index, size_t stride)
+        {
+            return reinterpret_cast<const T*>(reinterpret_cast<const uint8_t*>(p) + index * stride);
+        }
+
+#if FALCOR_BOX_BATCH_USE_SSE
+        /** Load three floats into the xyz lanes without reading past them. The w lane is 0.
+        */
+        __m128 load3(const float* p)
+        {
+            return _mm_movelh_ps(_mm_castpd_ps(_mm_load_sd(reinterpret_cast<const double*>(p))), _mm_load_ss(p + 2));
+        }
+
+        /** Store the xyz lanes without writing past them.
+        */
+        void store3(float* p, __m128 v)
+        {
+            _mm_store_sd(reinterpret_cast<double*>(p), _mm_castps_pd(v));
+            _mm_store_ss(p + 2, _mm_movehl_ps(v, v));
+        }
+
+        __m128 absPs(__m128 v)
+        {
+            return _mm_and_ps(v, _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff)));
+        }
+
+        float3 toFloat3(__m128 v)
+        {
+            float f[4];
+            _mm_storeu_ps(f, v);
+            return float3(f[0], f[1], f[2]);
+        }
+
+        /** Matrix columns and their absolute values, loaded once per matrix.
+        */
+        struct BoxTransform
+        {
+            __m128 col[4];
+            __m128 absCol[3];
+
+            BoxTransform(const glm::mat4& mat)
+            {
+                for (int i = 0; i < 4; i++) col[i] = _mm_loadu_ps(&mat[i][0]);
+                for (int i = 0; i < 3; i++) absCol[i] = absPs(col[i]);
+            }
+
+            void apply(const BoundingBox& in, BoundingBox& out) const
+            {
+                const __m128 c = load3(&in.center.x);
+                const __m128 e = load3(&in.extent.x);
+                __m128 center = _mm_add_ps(_mm_mul_ps(col[0], _mm_shuffle_ps(c, c, _MM_SHUFFLE(0, 0, 0, 0))), col[3]);
+                center = _mm_add_ps(center, _mm_mul_ps(col[1], _mm_shuffle_ps(c, c, _MM_SHUFFLE(1, 1, 1, 1))));
+                center = _mm_add_ps(center, _mm_mul_ps(col[2], _mm_shuffle_ps(c, c, _MM_SHUFFLE(2, 2, 2, 2))));
+                __m128 extent = _mm_mul_ps(absCol[0], _mm_shuffle_ps(e, e, _MM_SHUFFLE(0, 0, 0, 0)));
+                extent = _mm_add_ps(extent, _mm_mul_ps(absCol[1], _mm_shuffle_ps(e, e, _MM_SHUFFLE(1, 1, 1, 1))));
+                extent = _mm_add_ps(extent, _mm_mul_ps(absCol[2], _mm_shuffle_ps(e, e, _MM_SHUFFLE(2, 2, 2, 2))));
+
+                store3(&out.center.x, center);
+                store3(&out.extent.x, extent);
+            }
+        };
+#else
+        struct BoxTransform
+        {
+            glm::mat4 mat;
+            glm::mat3 absMat;
+
+            BoxTransform(const glm::mat4& m) : mat(m)
+            {
+                for (int i = 0; i < 3; i++) absMat[i] = glm::abs(float3(m[i]));
+            }
+
+            void apply(const BoundingBox& in, BoundingBox& out) const
+            {
+                const float3 center = float3(mat * float4(in.center, 1.f));
+                const float3 extent = absMat * in.extent;
+                out.center = center;
+                out.extent = extent;
+            }
+        };
+#endif
+    }
+
+    void transformBoxes(const glm::mat4& mat, const BoundingBox* pIn, BoundingBox* pOut, size_t count)
+    {
+        const BoxTransform transform(mat);
+        for (size_t i = 0; i < count; i++) transform.apply(pIn[i], pOut[i]);
+    }
+
+    void transformBoxes(const glm::mat4* pMatrices, const BoundingBox* pIn, BoundingBox* pOut, size_t count)
+    {
+        for (size_t i = 0; i < count; i++) BoxTransform(pMatrices[i]).apply(pIn[i], pOut[i]);
+    }
+
+    void transformBoxes(const glm::mat4& mat, const BoxArrays& in, const BoxArrays& out, size_t count)
+    {
+        // Remaining boxes go through the array-of-structs code, so the results match that overload.
+        const BoxTransform transform(mat);
+        auto transformBox = [&](size_t i)
+        {
+            BoundingBox box;
+            box.center = float3(in.center[0][i], in.center[1][i], in.center[2][i]);
+            box.extent = float3(in.extent[0][i], in.extent[1][i], in.extent[2][i]);
+            transform.apply(box, box);
+            for (int j = 0; j < 3; j++)
+            {
+                out.center[j][i] = box.center[j];
+                out.extent[j][i] = box.extent[j];
+            }
+        };
+
+        size_t i = 0;
+#if FALCOR_BOX_BATCH_USE_SSE
+        // Broadcast each matrix element, then each register holds one coordinate of four boxes.
+        // The operations are done in the same order as in BoxTransform::apply().
+        __m128 m[4][3], absM[3][3];
+        for (int col = 0; col < 4; col++)
+        {
+            for (int row = 0; row < 3; row++)
+            {
+                m[col][row] = _mm_set1_ps(mat[col][row]);
+                if (col < 3) absM[col][row] = absPs(m[col][row]);
+            }
+        }
+
+        for (; i + 4 <= count; i += 4)
+        {
+            __m128 c[3], e[3];
+            for (int j = 0; j < 3; j++)
+            {
+                c[j] = _mm_loadu_ps(in.center[j] + i);
+                e[j] = _mm_loadu_ps(in.extent[j] + i);
+            }
+            for (int j = 0; j < 3; j++)
+            {
+                __m128 center = _mm_add_ps(_mm_mul_ps(m[0][j], c[0]), m[3][j]);
+                center = _mm_add_ps(center, _mm_mul_ps(m[1][j], c[1]));
+                center = _mm_add_ps(center, _mm_mul_ps(m[2][j], c[2]));
+                __m128 extent = _mm_mul_ps(absM[0][j], e[0]);
+                extent = _mm_add_ps(extent, _mm_mul_ps(absM[1][j], e[1]));
+                extent = _mm_add_ps(extent, _mm_mul_ps(absM[2][j], e[2]));
+                _mm_storeu_ps(out.center[j] + i, center);
+                _mm_storeu_ps(out.extent[j] + i, extent);
+            }
+        }
+#endif
+        for (; i < count; i++) transformBox(i);
+    }
+
+    BBox unionBoxes(const BoundingBox* pBoxes, size_t count)
+    {
+        BBox bounds;
+#if FALCOR_BOX_BATCH_USE_SSE
+        __m128 minPoint = _mm_set1_ps(kInf);
+        __m128 maxPoint = _mm_set1_ps(-kInf);
+        for (size_t i = 0; i < count; i++)
+        {
+            const __m128 c = load3(&pBoxes[i].center.x);
+            const __m128 e = load3(&pBoxes[i].extent.x);
+            minPoint = _mm_min_ps(minPoint, _mm_sub_ps(c, e));
+            maxPoint = _mm_max_ps(maxPoint, _mm_add_ps(c, e));
+        }
+        bounds.minPoint = toFloat3(minPoint);
+        bounds.maxPoint = toFloat3(maxPoint);
+#else
+        for (size_t i = 0; i < count; i++)
+        {
+            bounds.minPoint = glm::min(bounds.minPoint, pBoxes[i].getMinPos());
+            bounds.maxPoint = glm::max(bounds.maxPoint, pBoxes[i].getMaxPos());
+        }
+#endif
+        return bounds;
+    }
+
+    BBox unionBoxes(const BBox* pBoxes, size_t count, size_t stride)
+    {
+        BBox bounds;
+#if FALCOR_BOX_BATCH_USE_SSE
+        __m128 minPoint = _mm_set1_ps(kInf);
+        __m128 maxPoint = _mm_set1_ps(-kInf);
+        for (size_t i = 0; i < count; i++)
+        {
+            const BBox* pBox = offsetPtr(pBoxes, i, stride);
+            minPoint = _mm_min_ps(minPoint, load3(&pBox->minPoint.x));
+            maxPoint = _mm_max_ps(maxPoint, load3(&pBox->maxPoint.x));
+        }
+        bounds.minPoint = toFloat3(minPoint);
+        bounds.maxPoint = toFloat3(maxPoint);
+#else
+        for (size_t i = 0; i < count; i++) bounds |= *offsetPtr(pBoxes, i, stride);
+#endif
+        return bounds;
+    }
+
+    BBox boundPoints(const float3* pPoints, size_t count, size_t stride)
+    {
+        BBox bounds;
+#if FALCOR_BOX_BATCH_USE_SSE
+        __m128 minPoint = _mm_set1_ps(kInf);
+        __m128 maxPoint = _mm_set1_ps(-kInf);
+        for (size_t i = 0; i < count; i++)
+        {
+            const __m128 p = load3(&offsetPtr(pPoints, i, stride)->x);
+            minPoint = _mm_min_ps(minPoint, p);
+            maxPoint = _mm_max_ps(maxPoint, p);
+        }
+        bounds.minPoint = toFloat3(minPoint);
+        bounds.maxPoint = toFloat3(maxPoint);
+#else
+        for (size_t i = 0; i < count; i++) bounds |= BBox(*offsetPtr(pPoints, i, stride));
+#endif
+        return bounds;
+    }
+
+    uint32_t intersectRayBoxes(const float3& origin, const float3& dir, float tMax, const BBox* pBoxes, size_t count, float* pHitT)
+    {
+        uint32_t hitCount = 0;
+        const float3 invDir = 1.f / dir;
+#if FALCOR_BOX_BATCH_USE_SSE
+        const __m128 o = load3(&origin.x);
+        const __m128 inv = load3(&invDir.x);
+        // The w lanes clamp the entry distance to 0 and the exit distance to tMax.
+        const __m128 xyzMask = _mm_castsi128_ps(_mm_set_epi32(0, -1, -1, -1));
+        const __m128 tMaxW = _mm_andnot_ps(xyzMask, _mm_set1_ps(tMax));
+        for (size_t i = 0; i < count; i++)
+        {
+            const __m128 t0 = _mm_mul_ps(_mm_sub_ps(load3(&pBoxes[i].minPoint.x), o), inv);
+            const __m128 t1 = _mm_mul_ps(_mm_sub_ps(load3(&pBoxes[i].maxPoint.x), o), inv);
+            __m128 tNear = _mm_and_ps(_mm_min_ps(t0, t1), xyzMask);
+            __m128 tFar = _mm_or_ps(_mm_and_ps(_mm_max_ps(t0, t1), xyzMask), tMaxW);
+
+            // Horizontal max of the entry distances and min of the exit distances.
+            tNear = _mm_max_ps(tNear, _mm_shuffle_ps(tNear, tNear, _MM_SHUFFLE(1, 0, 3, 2)));
+            tNear = _mm_max_ps(tNear, _mm_shuffle_ps(tNear, tNear, _MM_SHUFFLE(2, 3, 0, 1)));
+            tFar = _mm_min_ps(tFar, _mm_shuffle_ps(tFar, tFar, _MM_SHUFFLE(1, 0, 3, 2)));
+            tFar = _mm_min_ps(tFar, _mm_shuffle_ps(tFar, tFar, _MM_SHUFFLE(2, 3, 0, 1)));
+
+            const float tEnter = _mm_cvtss_f32(tNear);
+            const bool hit = tEnter <= _mm_cvtss_f32(tFar);
+            pHitT[i] = hit ? tEnter : kInf;
+            hitCount += hit ? 1 : 0;
+        }
+#else
+        for (size_t i = 0; i < count; i++)
+        {
+            const float3 t0 = (pBoxes[i].minPoint - origin) * invDir;
+            const float3 t1 = (pBoxes[i].maxPoint - origin) * invDir;
+            const float3 tNear = glm::min(t0, t1);
+            const float3 tFar = glm::max(t0, t1);
+            const float tEnter = std::max(std::max(tNear.x, tNear.y), std::max(tNear.z, 0.f));
+            const float tExit = std::min(std::min(tFar.x, tFar.y), std::min(tFar.z, tMax));
+            const bool hit = tEnter <= tExit;
+            pHitT[i] = hit ? tEnter : kInf;
+            hitCount += hit ? 1 : 0;
+        }
+#endif
+        return hitCount;
+    }
+
+    BoxBatchBenchmarkResult benchmarkBoxBatch(uint32_t boxCount, uint32_t iterations)
+    {
+        BoxBatchBenchmarkResult result;
+        result.boxCount = boxCount;
+        if (boxCount == 0 || iterations == 0) return result;
+
+        std::mt19937 rng(1);
+        std::uniform_real_distribution<float> dist(-1.f, 1.f);
+        std::vector<BoundingBox> boxes(boxCount), transformed(boxCount);
+        std::vector<BBox> bboxes(boxCount);
+        std::vector<float3> points(boxCount);
+        std::vector<float> hitT(boxCount);
+        for (uint32_t i = 0; i < boxCount; i++)
+        {
+            boxes[i].center = float3(dist(rng), dist(rng), dist(rng)) * 100.f;
+            boxes[i].extent = glm::abs(float3(dist(rng), dist(rng), dist(rng)));
+            bboxes[i].minPoint = boxes[i].getMinPos();
+            bboxes[i].maxPoint = boxes[i].getMaxPos();
+            points[i] = boxes[i].center;
+        }
+        glm::mat4 mat = glm::rotate(glm::translate(glm::mat4(), float3(1, 2, 3)), 0.7f, glm::normalize(float3(1, 1, 0)));
+
+        // Returns ns per element. The results feed a volatile sink so the loops are not optimized away.
+        volatile float sink = 0.f;
+        auto measure = [&](auto&& func)
+        {
+            CpuTimer timer;
+            timer.update();
+            for (uint32_t i = 0; i < iterations; i++) func();
+            timer.update();
+            return timer.delta() * 1e9 / ((double)iterations * boxCount);
+        };
+
+        result.transformNs = measure([&]() { transformBoxes(mat, boxes.data(), transformed.data(), boxCount); sink = sink + transformed.back().center.x; });
+        std::vector<float> soa[12];
+        for (auto& v : soa) v.resize(boxCount);
+        BoxArrays soaIn, soaOut;
+        for (int j = 0; j < 3; j++)
+        {
+            soaIn.center[j] = soa[j].data();
+            soaIn.extent[j] = soa[3 + j].data();
+            soaOut.center[j] = soa[6 + j].data();
+            soaOut.extent[j] = soa[9 + j].data();
+            for (uint32_t i = 0; i < boxCount; i++)
+            {
+                soaIn.center[j][i] = boxes[i].center[j];
+                soaIn.extent[j][i] = boxes[i].extent[j];
+            }
+        }
+        result.transformSoANs = measure([&]() { transformBoxes(mat, soaIn, soaOut, boxCount); sink = sink + soaOut.center[0][boxCount - 1]; });
+        result.transformScalarNs = measure([&]() { for (uint32_t i = 0; i < boxCount; i++) transformed[i] = boxes[i].transform(mat); sink = sink + transformed.back().center.x; });
+        result.unionNs = measure([&]() { sink = sink + unionBoxes(bboxes.data(), boxCount).minPoint.x; });
+        result.unionScalarNs = measure([&]() { BBox bounds; for (const auto& b : bboxes) bounds |= b; sink = sink + bounds.minPoint.x; });
+        result.boundPointsNs = measure([&]() { sink = sink + boundPoints(points.data(), boxCount).minPoint.x; });
+        result.rayNs = measure([&]() { sink = sink + (float)intersectRayBoxes(float3(0), float3(1, 0.5f, 0.25f), kInf, bboxes.data(), boxCount, hitT.data()); });
+
+        return result;
+    }
+
+    std::string BoxBatchBenchmarkResult::toString() const
+    {
+        std::ostringstream oss;
+        oss << std::fixed << std::setprecision(2)
+            << "  Boxes:               " << boxCount << std::endl
+            << "  Transform:           " << transformNs << " ns/box (one at a time: " << transformScalarNs << " ns/box)" << std::endl
+            << "  Transform (SoA):     " << transformSoANs << " ns/box" << std::endl
+            << "  Union:               " << unionNs << " ns/box (one at a time: " << unionScalarNs << " ns/box)" << std::endl
+            << "  Bound points:        " << boundPointsNs << " ns/point" << std::endl
+            << "  Ray-box:             " << rayNs << " ns/box";
+        return oss.str();
+    }
+
+    SCRIPT_BINDING(BoxBatch)
+    {
+        auto benchmark = [](uint32_t boxCount, uint32_t iterations) { return benchmarkBoxBatch(boxCount, iterations).toString(); };
+        m.func_("benchmarkBoxBatch", benchmark, "boxCount"_a = 262144, "iterations"_a = 16);
+    }
+}
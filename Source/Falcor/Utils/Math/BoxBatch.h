@@ -0,0 +1,129 @@
+/***************************************************************************
+ # Copyright (c) 2020, NVIDIA CORPORATION. All rights reserved.
+ #
+ # Redistribution and use in source and binary forms, with or without
+ # modification, are permitted provided that the following conditions
+ # are met:
+ #  * Redistributions of source code must retain the above copyright
+ #    notice, this list of conditions and the following disclaimer.
+ #  * Redistributions in binary form must reproduce the above copyright
+ #    notice, this list of conditions and the following disclaimer in the
+ #    documentation and/or other materials provided with the distribution.
+ #  * Neither the name of NVIDIA CORPORATION nor the names of its
+ #    contributors may be used to endorse or promote products derived
+ #    from this software without specific prior written permission.
+ #
+ # THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ # EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ # IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ # PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ # CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ # EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ # PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ # PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ # OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ # (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ # OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **************************************************************************/
+#pragma once
+#include "Utils/Math/AABB.h"
+#include "Utils/Math/BBox.h"
+
+namespace Falcor
+{
+    /** Operations on arrays of boxes, vectorized with SSE2 where available.
+        Most operations take boxes in their usual array-of-structs layout and process each box with its x, y and z in the lanes
+        of one register. This leaves one of four lanes idle, but it runs directly on the BoundingBox and BBox arrays of the scene,
+        and arrays of points and boxes can be strided to run over fields of larger structs. Converting those arrays to another
+        layout would cost about as much as the operations themselves.
+        Callers that can keep their boxes in structure-of-arrays layout (BoxArrays) can use the transformBoxes() overload that
+        processes four boxes per register.
+    */
+
+    /** Boxes in structure-of-arrays layout, with each coordinate of the centers and extents in its own array.
+    */
+    struct BoxArrays
+    {
+        float* center[3] = {};  ///< Arrays of the x, y and z coordinates of the centers.
+        float* extent[3] = {};  ///< Arrays of the x, y and z coordinates of the extents.
+    };
+
+    /** Transform boxes by a matrix, using the center/extent formulation of Arvo's method:
+        the new center is the transformed center and the new extent is the extent transformed by the absolute value of the matrix.
+        See: Arvo 1990, "Transforming Axis-Aligned Bounding Boxes".
+        \param[in] mat The transform. Must be affine.
+        \param[in] pIn The boxes to transform.
+        \param[out] pOut The transformed boxes. Can be the same array as pIn.
+        \param[in] count Number of boxes.
+    */
+    dlldecl void transformBoxes(const glm::mat4& mat, const BoundingBox* pIn, BoundingBox* pOut, size_t count);
+
+    /** Transform each box by its own matrix.
+        \param[in] pMatrices One affine transform per box.
+        \param[in] pIn The boxes to transform.
+        \param[out] pOut The transformed boxes. Can be the same array as pIn.
+        \param[in] count Number of boxes.
+    */
+    dlldecl void transformBoxes(const glm::mat4* pMatrices, const BoundingBox* pIn, BoundingBox* pOut, size_t count);
+
+    /** Transform boxes in structure-of-arrays layout by a matrix, four boxes at a time.
+        The results are identical to the array-of-structs overload.
+        \param[in] mat The transform. Must be affine.
+        \param[in] in The boxes to transform.
+        \param[out] out The transformed boxes. Can be the same arrays as in.
+        \param[in] count Number of boxes.
+    */
+    dlldecl void transformBoxes(const glm::mat4& mat, const BoxArrays& in, const BoxArrays& out, size_t count);
+
+    /** Compute the union of boxes.
+        \return The union, or an invalid box if count is 0.
+    */
+    dlldecl BBox unionBoxes(const BoundingBox* pBoxes, size_t count);
+
+    /** Compute the union of boxes.
+        \param[in] pBoxes The first box.
+        \param[in] count Number of boxes.
+        \param[in] stride Distance in bytes between consecutive boxes.
+        \return The union, or an invalid box if count is 0.
+    */
+    dlldecl BBox unionBoxes(const BBox* pBoxes, size_t count, size_t stride = sizeof(BBox));
+
+    /** Compute the bounds of points.
+        \param[in] pPoints The first point.
+        \param[in] count Number of points.
+        \param[in] stride Distance in bytes between consecutive points.
+        \return The bounds, or an invalid box if count is 0.
+    */
+    dlldecl BBox boundPoints(const float3* pPoints, size_t count, size_t stride = sizeof(float3));
+
+    /** Intersect a ray with boxes using the slab test.
+        \param[in] origin Ray origin.
+        \param[in] dir Ray direction. Does not need to be normalized.
+        \param[in] tMax Maximum distance along the ray, in units of dir.
+        \param[in] pBoxes The boxes.
+        \param[in] count Number of boxes.
+        \param[out] pHitT For each box, the distance at which the ray enters it, or infinity if the ray misses it. Inside a box the distance is 0.
+        \return The number of boxes hit.
+    */
+    dlldecl uint32_t intersectRayBoxes(const float3& origin, const float3& dir, float tMax, const BBox* pBoxes, size_t count, float* pHitT);
+
+    struct BoxBatchBenchmarkResult
+    {
+        uint32_t boxCount = 0;
+        double transformNs = 0.0;           ///< Batched transform, ns per box.
+        double transformSoANs = 0.0;        ///< Batched transform of boxes in structure-of-arrays layout, ns per box.
+        double transformScalarNs = 0.0;     ///< BoundingBox::transform() in a loop, ns per box.
+        double unionNs = 0.0;               ///< Batched union, ns per box.
+        double unionScalarNs = 0.0;         ///< BBox::operator|=() in a loop, ns per box.
+        double boundPointsNs = 0.0;         ///< Batched point bounds, ns per point.
+        double rayNs = 0.0;                 ///< Batched ray-box intersection, ns per box.
+
+        std::string toString() const;
+    };
+
+    /** Measure the batched box operations against the equivalent one-box-at-a-time loops.
+        \param[in] boxCount Number of random boxes.
+        \param[in] iterations Number of times each operation runs over all boxes.
+    */
+    dlldecl BoxBatchBenchmarkResult benchmarkBoxBatch(uint32_t boxCount = 262144, uint32_t iterations = 16);
+}
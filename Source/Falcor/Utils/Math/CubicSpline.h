@@ -29,6 +29,27 @@
 
 namespace Falcor
 {
+    namespace detail
+    {
+        inline float splineLength(float v) { return std::abs(v); }
+        inline float splineLength(const float2& v) { return glm::length(v); }
+        inline float splineLength(const float3& v) { return glm::length(v); }
+        inline float splineLength(const float4& v) { return glm::length(v); }
+
+        template<typename T>
+        T splineNormalize(const T& v)
+        {
+            float length = splineLength(v);
+            return length > 0.f ? v / length : v;
+        }
+    }
+
+    /** Cubic spline through a set of control points.
+        The spline has one section per pair of consecutive control points. A section is evaluated with interpolate(), and the whole spline with
+        evaluate(), which takes a global parameter t in [0, getSectionCount()] whose integer part is the section.
+        The speed along the spline varies with the spacing of the control points. After buildArcLengthTable(), the spline can also be evaluated
+        by distance along it, which moves at constant speed.
+    */
     template<typename T>
     class CubicSpline
     {
@@ -136,6 +157,14 @@ namespace Falcor
             }
         }
 
+        /** Get the number of sections. This is one less than the number of control points.
+        */
+        uint32_t getSectionCount() const { return (uint32_t)mCoefficient.size(); }
+
+        /** Evaluate a section.
+            \param[in] section The section index.
+            \param[in] point Parameter within the section, in [0, 1].
+        */
         T interpolate(uint32_t section, float point) const
         {
             const CubicCoeff& coeff = mCoefficient[section];
@@ -143,11 +172,146 @@ namespace Falcor
             return result;
         }
 
+        /** Evaluate the derivative of a section with respect to its parameter.
+        */
+        T derivative(uint32_t section, float point) const
+        {
+            const CubicCoeff& coeff = mCoefficient[section];
+            return ((T(3) * coeff.d * point) + T(2) * coeff.c) * point + coeff.b;
+        }
+
+        /** Evaluate the spline at a global parameter.
+            \param[in] t Parameter in [0, getSectionCount()]. Values outside are clamped.
+        */
+        T evaluate(float t) const
+        {
+            uint32_t section;
+            float point = findSection(t, section);
+            return interpolate(section, point);
+        }
+
+        /** Evaluate the spline at many global parameters. Equivalent to calling evaluate(float) for each parameter.
+            Each parameter reads the coefficients of its own section, so the loop is scalar.
+            \param[in] pT Parameters in [0, getSectionCount()]. Values outside are clamped.
+            \param[out] pOut The evaluated points.
+            \param[in] count Number of parameters.
+        */
+        void evaluate(const float* pT, T* pOut, size_t count) const
+        {
+            assert(!mCoefficient.empty());
+            const CubicCoeff* pCoeff = mCoefficient.data();
+            const float maxT = float(mCoefficient.size());
+            const float lastSection = maxT - 1.f;
+            for (size_t i = 0; i < count; i++)
+            {
+                float t = std::min(std::max(pT[i], 0.f), maxT);
+                float section = std::min(std::floor(t), lastSection);
+                float point = t - section;
+                const CubicCoeff& coeff = pCoeff[(size_t)section];
+                pOut[i] = (((coeff.d * point) + coeff.c) * point + coeff.b) * point + coeff.a;
+            }
+        }
+
+        /** Evaluate the derivative of the spline with respect to the global parameter.
+        */
+        T derivative(float t) const
+        {
+            uint32_t section;
+            float point = findSection(t, section);
+            return derivative(section, point);
+        }
+
+        /** Evaluate the direction of the spline at a global parameter. Zero where the spline is stationary.
+        */
+        T tangent(float t) const
+        {
+            return detail::splineNormalize(derivative(t));
+        }
+
+        /** Build the table that maps distance along the spline to the global parameter.
+            The length of each section is approximated by the length of a polyline through uniformly spaced points on it.
+            \param[in] samplesPerSection Number of polyline segments per section. Must be at least 1.
+        */
+        void buildArcLengthTable(uint32_t samplesPerSection = 16)
+        {
+            assert(samplesPerSection > 0);
+            mSamplesPerSection = std::max(samplesPerSection, 1u);
+            mArcLength.clear();
+            if (mCoefficient.empty()) return;
+
+            const uint32_t sampleCount = getSectionCount() * mSamplesPerSection;
+            std::vector<float> t(sampleCount + 1);
+            std::vector<T> points(sampleCount + 1);
+            for (uint32_t i = 0; i <= sampleCount; i++) t[i] = float(i) / float(mSamplesPerSection);
+            evaluate(t.data(), points.data(), t.size());
+
+            mArcLength.resize(sampleCount + 1);
+            mArcLength[0] = 0.f;
+            for (uint32_t i = 1; i <= sampleCount; i++)
+            {
+                mArcLength[i] = mArcLength[i - 1] + detail::splineLength(points[i] - points[i - 1]);
+            }
+        }
+
+        /** Check if buildArcLengthTable() was called.
+        */
+        bool hasArcLengthTable() const { return !mArcLength.empty(); }
+
+        /** Get the length of the spline. Requires the arc length table.
+        */
+        float getArcLength() const { return hasArcLengthTable() ? mArcLength.back() : 0.f; }
+
+        /** Convert a distance along the spline to the global parameter. Requires the arc length table.
+            \param[in] distance Distance from the start of the spline. Values outside [0, getArcLength()] are clamped.
+        */
+        float getParameterAtArcLength(float distance) const
+        {
+            assert(hasArcLengthTable());
+            if (distance <= 0.f) return 0.f;
+            if (distance >= mArcLength.back()) return float(getSectionCount());
+
+            // Find the polyline segment that contains the distance, and interpolate the parameter linearly within it.
+            size_t i = std::upper_bound(mArcLength.begin(), mArcLength.end(), distance) - mArcLength.begin();
+            float length0 = mArcLength[i - 1];
+            float length1 = mArcLength[i];
+            float fraction = length1 > length0 ? (distance - length0) / (length1 - length0) : 0.f;
+            return (float(i - 1) + fraction) / float(mSamplesPerSection);
+        }
+
+        /** Evaluate the spline at a distance along it. Requires the arc length table.
+        */
+        T evaluateAtArcLength(float distance) const
+        {
+            return evaluate(getParameterAtArcLength(distance));
+        }
+
+        /** Evaluate the spline at many distances along it. Requires the arc length table.
+            \param[in] pDistances Distances from the start of the spline.
+            \param[out] pOut The evaluated points.
+            \param[in] count Number of distances.
+        */
+        void evaluateAtArcLength(const float* pDistances, T* pOut, size_t count) const
+        {
+            for (size_t i = 0; i < count; i++) pOut[i] = evaluate(getParameterAtArcLength(pDistances[i]));
+        }
+
     private:
         struct CubicCoeff
         {
             T a, b, c, d;
         };
+
+        float findSection(float t, uint32_t& section) const
+        {
+            assert(!mCoefficient.empty());
+            const uint32_t lastSection = getSectionCount() - 1;
+            t = std::min(std::max(t, 0.f), float(getSectionCount()));
+            section = std::min((uint32_t)t, lastSection);
+            return t - float(section);
+        }
+
         std::vector<CubicCoeff> mCoefficient;
+        std::vector<float> mArcLength;      ///< Distance along the spline at each polyline sample. Sample i is at global parameter i / mSamplesPerSection.
+        uint32_t mSamplesPerSection = 0;
     };
-}
\ No newline at end of file
+}
@@ -0,0 +1,281 @@
+/***************************************************************************
+ # Copyright (c) 2020, NVIDIA CORPORATION. All rights reserved.
+ #
+ # Redistribution and use in source and binary forms, with or without
+ # modification, are permitted provided that the following conditions
+ # are met:
+ #  * Redistributions of source code must retain the above copyright
+ #    notice, this list of conditions and the following disclaimer.
+ #  * Redistributions in binary form must reproduce the above copyright
+ #    notice, this list of conditions and the following disclaimer in the
+ #    documentation and/or other materials provided with the distribution.
+ #  * Neither the name of NVIDIA CORPORATION nor the names of its
+ #    contributors may be used to endorse or promote products derived
+ #    from this software without specific prior written permission.
+ #
+ # THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ # EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ # IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ # PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ # CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ # EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ # PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ # PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ # OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ # (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ # OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **************************************************************************/
+#include "stdafx.h"
+#include "DynamicAABBTree.h"
+
+namespace Falcor
+{
+    namespace
+    {
+        BBox toBBox(const BoundingBox& box)
+        {
+            BBox bounds;
+            bounds.minPoint = box.getMinPos();
+            bounds.maxPoint = box.getMaxPos();
+            return bounds;
+        }
+    }
+
+    uint32_t DynamicAABBTree::insert(const BoundingBox& box, uint32_t userData)
+    {
+        const uint32_t leaf = allocateNode();
+        mNodes[leaf].bounds = toBBox(box);
+        mNodes[leaf].userData = userData;
+
+        if (mRoot == kInvalidNode)
+        {
+            mRoot = leaf;
+            return leaf;
+        }
+
+        // Pair the leaf with its best sibling under a new parent.
+        const uint32_t sibling = findBestSibling(mNodes[leaf].bounds);
+        const uint32_t newParent = allocateNode();
+        const uint32_t oldParent = mNodes[sibling].parent;
+        mNodes[newParent].parent = oldParent;
+        mNodes[newParent].children[0] = sibling;
+        mNodes[newParent].children[1] = leaf;
+        mNodes[sibling].parent = newParent;
+        mNodes[leaf].parent = newParent;
+
+        if (oldParent == kInvalidNode) mRoot = newParent;
+        else
+        {
+            auto& children = mNodes[oldParent].children;
+            children[children[0] == sibling ? 0 : 1] = newParent;
+        }
+
+        refit(newParent);
+        return leaf;
+    }
+
+    void DynamicAABBTree::remove(uint32_t leaf)
+    {
+        assert(leaf < mNodes.size() && mNodes[leaf].isLeaf());
+        if (leaf == mRoot)
+        {
+            mRoot = kInvalidNode;
+            freeNode(leaf);
+            return;
+        }
+
+        // The sibling of the leaf takes the place of their parent.
+        const uint32_t parent = mNodes[leaf].parent;
+        const uint32_t grandParent = mNodes[parent].parent;
+        const uint32_t sibling = mNodes[parent].children[mNodes[parent].children[0] == leaf ? 1 : 0];
+        mNodes[sibling].parent = grandParent;
+
+        if (grandParent == kInvalidNode) mRoot = sibling;
+        else
+        {
+            auto& children = mNodes[grandParent].children;
+            children[children[0] == parent ? 0 : 1] = sibling;
+        }
+
+        freeNode(parent);
+        freeNode(leaf);
+        if (grandParent != kInvalidNode) refit(grandParent);
+    }
+
+    void DynamicAABBTree::update(uint32_t leaf, const BoundingBox& box)
+    {
+        assert(leaf < mNodes.size() && mNodes[leaf].isLeaf());
+        mNodes[leaf].bounds = toBBox(box);
+        refit(mNodes[leaf].parent);
+    }
+
+    void DynamicAABBTree::clear()
+    {
+        mNodes.clear();
+        mFreeNodes.clear();
+        mRoot = kInvalidNode;
+    }
+
+    BoundingBox DynamicAABBTree::getBounds() const
+    {
+        if (empty()) return BoundingBox::fromMinMax(float3(0), float3(0));
+        const BBox& bounds = mNodes[mRoot].bounds;
+        return BoundingBox::fromMinMax(bounds.minPoint, bounds.maxPoint);
+    }
+
+    void DynamicAABBTree::queryBox(const BoundingBox& box, std::vector<uint32_t>& userData) const
+    {
+        if (empty()) return;
+        const BBox queryBounds = toBBox(box);
+
+        mStack.clear();
+        mStack.push_back(mRoot);
+        while (!mStack.empty())
+        {
+            const Node& node = mNodes[mStack.back()];
+            mStack.pop_back();
+            if (!(node.bounds & queryBounds).valid()) continue;
+
+            if (node.isLeaf()) userData.push_back(node.userData);
+            else
+            {
+                mStack.push_back(node.children[0]);
+                mStack.push_back(node.children[1]);
+            }
+        }
+    }
+
+    void DynamicAABBTree::queryRay(const float3& origin, const float3& dir, float tMax, std::vector<uint32_t>& userData) const
+    {
+        if (empty()) return;
+        const float3 invDir = 1.f / dir;
+
+        mStack.clear();
+        mStack.push_back(mRoot);
+        while (!mStack.empty())
+        {
+            const Node& node = mNodes[mStack.back()];
+            mStack.pop_back();
+
+            // Slab test.
+            float3 t0 = (node.bounds.minPoint - origin) * invDir;
+            float3 t1 = (node.bounds.maxPoint - origin) * invDir;
+            float3 tNear = glm::min(t0, t1);
+            float3 tFar = glm::max(t0, t1);
+            float tEnter = std::max(std::max(tNear.x, tNear.y), std::max(tNear.z, 0.f));
+            float tExit = std::min(std::min(tFar.x, tFar.y), std::min(tFar.z, tMax));
+            if (tEnter > tExit) continue;
+
+            if (node.isLeaf()) userData.push_back(node.userData);
+            else
+            {
+                mStack.push_back(node.children[0]);
+                mStack.push_back(node.children[1]);
+            }
+        }
+    }
+
+    uint32_t DynamicAABBTree::allocateNode()
+    {
+        if (mFreeNodes.empty())
+        {
+            mNodes.push_back(Node());
+            return (uint32_t)mNodes.size() - 1;
+        }
+
+        uint32_t node = mFreeNodes.back();
+        mFreeNodes.pop_back();
+        mNodes[node] = Node();
+        return node;
+    }
+
+    void DynamicAABBTree::freeNode(uint32_t node)
+    {
+        mFreeNodes.push_back(node);
+    }
+
+    uint32_t DynamicAABBTree::findBestSibling(const BBox& bounds) const
+    {
+        // Descend towards the child with the lowest cost, until pairing with the current node is cheaper than descending.
+        // See: Catto 2019, "Dynamic Bounding Volume Hierarchies".
+        uint32_t index = mRoot;
+        while (!mNodes[index].isLeaf())
+        {
+            const Node& node = mNodes[index];
+            const float area = node.bounds.surfaceArea();
+            const float combinedArea = (node.bounds | bounds).surfaceArea();
+
+            // Cost of a new parent for this node and the leaf, and the minimum cost of pushing the leaf further down.
+            const float cost = 2.f * combinedArea;
+            const float inheritanceCost = 2.f * (combinedArea - area);
+
+            float childCosts[2];
+            for (uint32_t i = 0; i < 2; i++)
+            {
+                const Node& child = mNodes[node.children[i]];
+                float childArea = (child.bounds | bounds).surfaceArea();
+                if (!child.isLeaf()) childArea -= child.bounds.surfaceArea();
+                childCosts[i] = childArea + inheritanceCost;
+            }
+
+            if (cost < childCosts[0] && cost < childCosts[1]) break;
+            index = node.children[childCosts[0] < childCosts[1] ? 0 : 1];
+        }
+        return index;
+    }
+
+    void DynamicAABBTree::refit(uint32_t node)
+    {
+        while (node != kInvalidNode)
+        {
+            rotate(node);
+
+            Node& n = mNodes[node];
+            const Node& child0 = mNodes[n.children[0]];
+            const Node& child1 = mNodes[n.children[1]];
+            n.bounds = child0.bounds | child1.bounds;
+            n.height = 1 + std::max(child0.height, child1.height);
+            node = n.parent;
+        }
+    }
+
+    void DynamicAABBTree::rotate(uint32_t node)
+    {
+        // Try swapping a child with one of the children of its sibling. The bounds of the node don't change,
+        // only those of the sibling, so pick the swap that shrinks the sibling the most.
+        float bestGain = 0.f;
+        uint32_t bestSide = 0, bestGrandChild = 0;
+        for (uint32_t side = 0; side < 2; side++)
+        {
+            const Node& child = mNodes[mNodes[node].children[side]];
+            const Node& sibling = mNodes[mNodes[node].children[1 - side]];
+            if (sibling.isLeaf()) continue;
+
+            const float siblingArea = sibling.bounds.surfaceArea();
+            for (uint32_t g = 0; g < 2; g++)
+            {
+                const Node& other = mNodes[sibling.children[1 - g]];
+                float gain = siblingArea - (child.bounds | other.bounds).surfaceArea();
+                if (gain > bestGain)
+                {
+                    bestGain = gain;
+                    bestSide = side;
+                    bestGrandChild = g;
+                }
+            }
+        }
+        if (bestGain <= 0.f) return;
+
+        const uint32_t child = mNodes[node].children[bestSide];
+        const uint32_t sibling = mNodes[node].children[1 - bestSide];
+        const uint32_t grandChild = mNodes[sibling].children[bestGrandChild];
+        const uint32_t other = mNodes[sibling].children[1 - bestGrandChild];
+
+        mNodes[node].children[bestSide] = grandChild;
+        mNodes[grandChild].parent = node;
+        mNodes[sibling].children[bestGrandChild] = child;
+        mNodes[child].parent = sibling;
+        mNodes[sibling].bounds = mNodes[child].bounds | mNodes[other].bounds;
+        mNodes[sibling].height = 1 + std::max(mNodes[child].height, mNodes[other].height);
+    }
+}
@@ -0,0 +1,123 @@
+/***************************************************************************
+ # Copyright (c) 2020, NVIDIA CORPORATION. All rights reserved.
+ #
+ # Redistribution and use in source and binary forms, with or without
+ # modification, are permitted provided that the following conditions
+ # are met:
+ #  * Redistributions of source code must retain the above copyright
+ #    notice, this list of conditions and the following disclaimer.
+ #  * Redistributions in binary form must reproduce the above copyright
+ #    notice, this list of conditions and the following disclaimer in the
+ #    documentation and/or other materials provided with the distribution.
+ #  * Neither the name of NVIDIA CORPORATION nor the names of its
+ #    contributors may be used to endorse or promote products derived
+ #    from this software without specific prior written permission.
+ #
+ # THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ # EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ # IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ # PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ # CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ # EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ # PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ # PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ # OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ # (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ # OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **************************************************************************/
+#pragma once
+#include "Utils/Math/AABB.h"
+#include "Utils/Math/BBox.h"
+
+namespace Falcor
+{
+    /** A bounding volume hierarchy over boxes that move, are added and are removed.
+        Changing a box refits its ancestors and rotates subtrees along the way to keep the tree efficient,
+        so the root bounds stay exact in O(log n) per change. Leaves are inserted at the sibling that adds the least surface area.
+        See: Kopta et al. 2012, "Fast, Effective BVH Updates for Animated Scenes".
+    */
+    class dlldecl DynamicAABBTree
+    {
+    public:
+        static const uint32_t kInvalidNode = -1;
+
+        /** Insert a box.
+            \param[in] box The box.
+            \param[in] userData Value returned by queries for this box.
+            \return The ID of the leaf holding the box, valid until it is removed.
+        */
+        uint32_t insert(const BoundingBox& box, uint32_t userData);
+
+        /** Remove a box.
+            \param[in] leaf The leaf returned by insert().
+        */
+        void remove(uint32_t leaf);
+
+        /** Change a box. The ancestors of the leaf are refit and rotated.
+            \param[in] leaf The leaf returned by insert().
+            \param[in] box The new box.
+        */
+        void update(uint32_t leaf, const BoundingBox& box);
+
+        /** Remove all boxes.
+        */
+        void clear();
+
+        /** Returns true if the tree holds no boxes.
+        */
+        bool empty() const { return mRoot == kInvalidNode; }
+
+        /** Get the bounds of all boxes. Returns an empty box at the origin if the tree is empty.
+        */
+        BoundingBox getBounds() const;
+
+        /** Get the bounds of a leaf.
+        */
+        const BBox& getLeafBounds(uint32_t leaf) const { return mNodes[leaf].bounds; }
+
+        /** Get the user data of a leaf.
+        */
+        uint32_t getUserData(uint32_t leaf) const { return mNodes[leaf].userData; }
+
+        /** Get the height of the tree. A single leaf has height 0.
+        */
+        uint32_t getHeight() const { return empty() ? 0 : mNodes[mRoot].height; }
+
+        /** Find the boxes overlapping a box.
+            \param[in] box The query box.
+            \param[out] userData User data of the overlapping boxes, appended in no particular order.
+        */
+        void queryBox(const BoundingBox& box, std::vector<uint32_t>& userData) const;
+
+        /** Find the boxes hit by a ray.
+            \param[in] origin Ray origin.
+            \param[in] dir Ray direction. Does not need to be normalized.
+            \param[in] tMax Maximum distance along the ray, in units of dir.
+            \param[out] userData User data of the hit boxes, appended in no particular order.
+        */
+        void queryRay(const float3& origin, const float3& dir, float tMax, std::vector<uint32_t>& userData) const;
+
+    private:
+        struct Node
+        {
+            BBox bounds;
+            uint32_t parent = kInvalidNode;
+            uint32_t children[2] = { kInvalidNode, kInvalidNode };
+            uint32_t height = 0;            ///< 0 for leaves.
+            uint32_t userData = 0;          ///< Only used by leaves.
+
+            bool isLeaf() const { return children[0] == kInvalidNode; }
+        };
+
+        uint32_t allocateNode();
+        void freeNode(uint32_t node);
+        uint32_t findBestSibling(const BBox& bounds) const;
+        void refit(uint32_t node);
+        void rotate(uint32_t node);
+
+        std::vector<Node> mNodes;
+        std::vector<uint32_t> mFreeNodes;
+        uint32_t mRoot = kInvalidNode;
+        mutable std::vector<uint32_t> mStack;   ///< Scratch traversal stack. Queries are not thread safe.
+    };
+}
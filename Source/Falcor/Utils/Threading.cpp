@@ -27,17 +27,89 @@
  **************************************************************************/
 #include "stdafx.h"
 #include "Threading.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <execution>
+#include <mutex>
+#include <numeric>
 
 namespace Falcor
 {
     namespace
     {
+        /** A parallelFor() call running under the thread count limit. Workers help by calling work() until it runs out of chunks.
+        */
+        struct ParallelForJob
+        {
+            std::function<void()> work;
+            std::mutex mutex;
+            std::condition_variable helpersDone;
+            uint32_t pendingHelpers = 0;            ///< Posted helpers that have not finished yet.
+        };
+
         struct ThreadingData
         {
             bool initialized = false;
             std::vector<std::thread> threads;
             uint32_t current;
+            uint32_t parallelForThreadCount = 0;
+            std::atomic<uint32_t> freeWorkerCount{ 0 };   ///< Workers parallelFor() can still reserve under the thread count limit.
+
+            // Persistent workers of the limited parallelFor(). Each queue entry asks one worker to help with a job.
+            std::vector<std::thread> parallelForWorkers;
+            std::deque<ParallelForJob*> parallelForQueue;
+            std::mutex parallelForMutex;
+            std::condition_variable parallelForQueued;
+            bool stopParallelForWorkers = false;
         } gData;
+
+        void parallelForWorkerMain()
+        {
+            while (true)
+            {
+                ParallelForJob* pJob;
+                {
+                    std::unique_lock<std::mutex> lock(gData.parallelForMutex);
+                    gData.parallelForQueued.wait(lock, []() { return gData.stopParallelForWorkers || !gData.parallelForQueue.empty(); });
+                    if (gData.parallelForQueue.empty()) return;
+                    pJob = gData.parallelForQueue.front();
+                    gData.parallelForQueue.pop_front();
+                }
+
+                pJob->work();
+
+                // Notify while holding the lock, so the job can't be destroyed before the notification.
+                std::lock_guard<std::mutex> lock(pJob->mutex);
+                if (--pJob->pendingHelpers == 0) pJob->helpersDone.notify_one();
+            }
+        }
+
+        void stopParallelForWorkers()
+        {
+            {
+                std::lock_guard<std::mutex> lock(gData.parallelForMutex);
+                gData.stopParallelForWorkers = true;
+            }
+            gData.parallelForQueued.notify_all();
+            for (auto& t : gData.parallelForWorkers) t.join();
+            gData.parallelForWorkers.clear();
+            gData.stopParallelForWorkers = false;
+        }
+
+        /** Reserve up to count workers under the thread count limit.
+            \return The number of workers reserved.
+        */
+        uint32_t acquireWorkers(uint32_t count)
+        {
+            uint32_t freeCount = gData.freeWorkerCount.load();
+            while (freeCount > 0)
+            {
+                uint32_t acquired = std::min(freeCount, count);
+                if (gData.freeWorkerCount.compare_exchange_weak(freeCount, freeCount - acquired)) return acquired;
+            }
+            return 0;
+        }
     }
 
     void Threading::start(uint32_t threadCount)
@@ -50,6 +122,8 @@ namespace Falcor
 
     void Threading::shutdown()
     {
+        setParallelForThreadCount(0);
+
         for (auto& t : gData.threads)
         {
             if (t.joinable()) t.join();
@@ -70,6 +144,79 @@ namespace Falcor
         return Task();
     }
 
+    void Threading::parallelFor(uint32_t begin, uint32_t end, const std::function<void(uint32_t)>& func, uint32_t grainSize)
+    {
+        if (begin >= end) return;
+        grainSize = std::max(grainSize, 1u);
+
+        const uint32_t chunkCount = (end - begin + grainSize - 1) / grainSize;
+        if (chunkCount == 1)
+        {
+            for (uint32_t i = begin; i < end; i++) func(i);
+            return;
+        }
+
+        auto processChunk = [&](uint32_t chunk)
+        {
+            const uint32_t first = begin + chunk * grainSize;
+            const uint32_t last = std::min(end - first, grainSize) + first;
+            for (uint32_t i = first; i < last; i++) func(i);
+        };
+
+        // With a thread count limit, the chunks are shared between the calling thread and the idle workers it could reserve.
+        // Every reserved worker is idle or about to finish another job, so the posted help always gets picked up, also for nested calls.
+        if (gData.parallelForThreadCount > 0)
+        {
+            std::atomic<uint32_t> nextChunk{ 0 };
+            ParallelForJob job;
+            job.work = [&]()
+            {
+                for (uint32_t chunk = nextChunk++; chunk < chunkCount; chunk = nextChunk++) processChunk(chunk);
+            };
+
+            const uint32_t workerCount = acquireWorkers(chunkCount - 1);
+            if (workerCount > 0)
+            {
+                job.pendingHelpers = workerCount;
+                {
+                    std::lock_guard<std::mutex> lock(gData.parallelForMutex);
+                    gData.parallelForQueue.insert(gData.parallelForQueue.end(), workerCount, &job);
+                }
+                if (workerCount == 1) gData.parallelForQueued.notify_one();
+                else gData.parallelForQueued.notify_all();
+            }
+
+            job.work();
+
+            if (workerCount > 0)
+            {
+                std::unique_lock<std::mutex> lock(job.mutex);
+                job.helpersDone.wait(lock, [&job]() { return job.pendingHelpers == 0; });
+            }
+            gData.freeWorkerCount += workerCount;
+            return;
+        }
+
+        std::vector<uint32_t> chunks(chunkCount);
+        std::iota(chunks.begin(), chunks.end(), 0);
+        std::for_each(std::execution::par, chunks.begin(), chunks.end(), processChunk);
+    }
+
+    void Threading::setParallelForThreadCount(uint32_t threadCount)
+    {
+        if (threadCount == gData.parallelForThreadCount) return;
+
+        stopParallelForWorkers();
+        gData.parallelForThreadCount = threadCount;
+        gData.freeWorkerCount = threadCount > 0 ? threadCount - 1 : 0;
+        for (uint32_t i = 0; i < gData.freeWorkerCount; i++) gData.parallelForWorkers.emplace_back(parallelForWorkerMain);
+    }
+
+    uint32_t Threading::getParallelForThreadCount()
+    {
+        return gData.parallelForThreadCount;
+    }
+
     Threading::Task::Task()
     {
     }
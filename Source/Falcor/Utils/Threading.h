@@ -27,6 +27,7 @@
  **************************************************************************/
 #pragma once
 #include <thread>
+#include <functional>
 
 namespace Falcor
 {
@@ -72,5 +73,28 @@ namespace Falcor
             \return Handle to the task
         */
         static Task dispatchTask(const std::function<void(void)>& func);
+
+        /** Call a function for every index in [begin, end). Blocks until all calls returned.
+            Without a thread count limit, this uses the parallel algorithms of the standard library. With a limit set by setParallelForThreadCount(),
+            it runs on the calling thread and a fixed set of worker threads.
+            The order of the calls is unspecified, the function must be safe to call concurrently.
+            \param[in] begin First index.
+            \param[in] end One past the last index.
+            \param[in] func The function to call with each index.
+            \param[in] grainSize Number of consecutive indices processed by a single call of the worker. Use larger values for cheap functions.
+        */
+        static void parallelFor(uint32_t begin, uint32_t end, const std::function<void(uint32_t)>& func, uint32_t grainSize = 1);
+
+        /** Limit the number of threads used by parallelFor(), e.g. to measure how a workload scales with the core count.
+            The limit includes the calling thread and holds across nested calls: a nested call only gets workers while fewer than threadCount threads are busy,
+            and otherwise runs on its calling thread. Starts threadCount - 1 persistent worker threads, so parallelFor() doesn't create threads per call.
+            Must not be called while a parallelFor() is running.
+            \param[in] threadCount Maximum number of threads, or 0 to use the parallel algorithms of the standard library without a limit.
+        */
+        static void setParallelForThreadCount(uint32_t threadCount);
+
+        /** Get the limit set by setParallelForThreadCount(), or 0 if there is no limit.
+        */
+        static uint32_t getParallelForThreadCount();
     };
 }
@@ -26,6 +26,9 @@
  # OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  **************************************************************************/
 #include "PathTracer.h"
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
 
 #define SCREEN_WIDTH 1600
 #define SCREEN_HEIGHT 900
@@ -38,6 +41,8 @@ uint32_t mSampleGuiPositionY = 40;
 static float s_exposure = 1.0f;
 static bool s_enableGBufferDebug = false;
 static int s_GBufferDebugType = 5;
+static const size_t s_maxPendingAOVFrames = 3;
+static const FileDialogFilterVec s_cameraPathFilters = { { "campath", "Camera Path" } };
 static const std::string s_defaultScene =
 "Arcade/Arcade.fscene";
 //"SunTemple/SunTemple.fscene";
@@ -51,6 +56,30 @@ void PathTracer::LoadScene()
     m_scene->bindSamplerToMaterials(m_linearSampler);
     m_scene->setCameraController(Scene::CameraControllerType::FirstPerson);
     // m_scene->setCameraAspectRatio(m_width / m_height);
+
+    // The G-buffer is rasterized from the scene camera, so instances outside its frustum or hidden behind large occluders can be skipped.
+    m_scene->setFrustumCulling(true);
+    m_scene->setOcclusionCulling(true);
+
+    // Report the culling throughput and exit when started with -benchmarkCulling.
+    if (gpFramework->getArgList().argExists("benchmarkCulling"))
+    {
+        logInfo("Culling benchmark for '" + s_defaultScene + "':\n" + m_scene->benchmarkCulling().toString());
+        logInfo("Occlusion culling benchmark for '" + s_defaultScene + "':\n" + m_scene->benchmarkOcclusionCulling().toString());
+        gpFramework->shutdown();
+    }
+
+    // Replay a recorded camera path, log the frame time report and exit when started with -cameraPath <file>. Add -constantSpeed to move at constant speed.
+    auto cameraPathArgs = gpFramework->getArgList().getValues("cameraPath");
+    if (!cameraPathArgs.empty())
+    {
+        m_CameraPath = CameraPath::createFromFile(cameraPathArgs[0].asString());
+        m_ExitAfterCameraPath = true;
+        m_CameraPathConstantSpeed = gpFramework->getArgList().argExists("constantSpeed");
+        gProfileEnabled = true; // The benchmark needs the profiler for GPU times. No profiled event is open while loading.
+        StartCameraPathBenchmark();
+        if (!m_CameraPathBenchmark) gpFramework->shutdown();
+    }
 }
 
 void PathTracer::CreateGBufferFBO()
@@ -173,6 +202,90 @@ void PathTracer::CreateCompositePipeline()
     m_CompositePass = FullScreenPass::create("PathTracer/Composite.ps.slang", m_scene->getSceneDefines());
 }
 
+void PathTracer::DumpAOVs(RenderContext* pRenderContext)
+{
+    struct AOV
+    {
+        std::string layer;
+        Texture::SharedPtr pTexture;
+        ExrImageIO::PixelType type;
+        uint32_t channelCount;
+    };
+
+    const AOV aovs[] =
+    {
+        { "",           m_AccumRT,              ExrImageIO::PixelType::Half,    4 },
+        { "albedo",     m_GBufferAlbedoRT,      ExrImageIO::PixelType::Half,    3 },
+        { "specular",   m_GBufferSpecRT,        ExrImageIO::PixelType::Half,    4 }, /* linear roughness in A */
+        { "normal",     m_GBufferNormalRT,      ExrImageIO::PixelType::Half,    4 }, /* distance to camera in A */
+        { "position",   m_GBufferPositionRT,    ExrImageIO::PixelType::Float,   3 },
+        { "extra",      m_GBufferExtraRT,       ExrImageIO::PixelType::Half,    2 }, /* ior in R, double sided in G */
+        { "emissive",   m_GBufferEmissiveRT,    ExrImageIO::PixelType::Half,    3 },
+    };
+
+    // Readbacks finish a few frames later. Only wait for the GPU when too many frames are in flight.
+    ResolveAOVDumps(s_maxPendingAOVFrames - 1);
+
+    std::ostringstream filename;
+    filename << getExecutableDirectory() << "/AOV." << std::setfill('0') << std::setw(6) << m_AOVFrameCount++ << ".exr";
+
+    PendingAOVFrame frame;
+    frame.filename = filename.str();
+    for (const auto& aov : aovs)
+    {
+        frame.layers.push_back({ aov.layer, aov.pTexture->getFormat(), aov.type, aov.channelCount, pRenderContext->asyncReadTextureSubresource(aov.pTexture.get(), 0) });
+    }
+    m_PendingAOVFrames.push_back(std::move(frame));
+}
+
+void PathTracer::ResolveAOVDumps(size_t maxPendingFrames)
+{
+    // Hand finished readbacks to the image writers in frame order. Wait for the oldest frames only while more than maxPendingFrames are in flight.
+    while (!m_PendingAOVFrames.empty())
+    {
+        auto& frame = m_PendingAOVFrames.front();
+        bool ready = std::all_of(frame.layers.begin(), frame.layers.end(), [](const AOVReadback& layer) { return layer.pReadback->isReady(); });
+        if (!ready && m_PendingAOVFrames.size() <= maxPendingFrames) break;
+
+        // The channels point into the read back buffers. Moving the outer vector into the job keeps the buffers in place.
+        std::vector<std::vector<uint8_t>> buffers;
+        ExrImageIO::Part part;
+        part.width = (uint32_t)m_width;
+        part.height = (uint32_t)m_height;
+        for (const auto& layer : frame.layers)
+        {
+            buffers.push_back(layer.pReadback->getData());
+            part.addLayer(layer.layer, layer.format, buffers.back().data(), layer.type, layer.channelCount);
+        }
+
+        // Every frame is needed for training, so this waits for the image writers if they fall behind
+        ImageWriteQueue::enqueue([filename = std::move(frame.filename), parts = std::vector<ExrImageIO::Part>{ part }, buffers = std::move(buffers)]()
+        {
+            ExrImageIO::write(filename, parts);
+        });
+        m_PendingAOVFrames.pop_front();
+    }
+}
+
+void PathTracer::StartCameraPathBenchmark()
+{
+    m_CameraPathBenchmark = nullptr;
+    if (!m_CameraPath || m_CameraPath->getKeyframeCount() == 0) return;
+
+    m_RecordingCameraPath = false;
+    CameraPathBenchmark::Desc desc;
+    desc.constantSpeed = m_CameraPathConstantSpeed;
+    m_CameraPathBenchmark = CameraPathBenchmark::create(m_CameraPath, desc);
+    if (m_CameraPathBenchmark && !m_CameraPathBenchmark->start()) m_CameraPathBenchmark = nullptr;
+}
+
+void PathTracer::FinishCameraPathBenchmark()
+{
+    logInfo("Camera path benchmark for '" + s_defaultScene + "':\n" + m_CameraPathBenchmark->getReport().toString());
+    m_CameraPathBenchmark = nullptr;
+    if (m_ExitAfterCameraPath) gpFramework->shutdown();
+}
+
 void PathTracer::onLoad(RenderContext* pRenderContext)
 {
     m_width = SCREEN_WIDTH;
@@ -204,6 +317,8 @@ void PathTracer::onGuiRender(Gui* pGui)
     //w.text("Hello from ProjectTemplate");
     w.slider("Exposure", s_exposure, 0.0f, 5.0f);
     w.checkbox("GBufferDebug", s_enableGBufferDebug);
+    w.checkbox("Dump AOVs", m_DumpAOVs);
+    w.tooltip("Write the accumulated result and the G-buffer targets of every frame as layers of a multi-layer EXR file");
 
     if (w.button("GBufferAlbedo"))
     {
@@ -225,6 +340,49 @@ void PathTracer::onGuiRender(Gui* pGui)
     {
         s_GBufferDebugType = 4;
     }
+
+    auto cameraPathGroup = Gui::Group(w, "Camera Path");
+    if (cameraPathGroup.open())
+    {
+        const bool benchmarkRunning = m_CameraPathBenchmark && m_CameraPathBenchmark->isRunning();
+        if (m_RecordingCameraPath)
+        {
+            if (cameraPathGroup.button("Stop and save"))
+            {
+                // Close the path at the current view, which the sampling interval may have skipped.
+                m_CameraPath->record(m_scene->getCamera().get(), gpFramework->getGlobalClock().getTime(), 0.0);
+                m_RecordingCameraPath = false;
+                std::string filename;
+                if (saveFileDialog(s_cameraPathFilters, filename)) m_CameraPath->write(filename);
+            }
+        }
+        else if (!benchmarkRunning)
+        {
+            if (cameraPathGroup.button("Record"))
+            {
+                m_CameraPath = CameraPath::create();
+                m_RecordingCameraPath = true;
+            }
+            if (cameraPathGroup.button("Load", true))
+            {
+                std::string filename;
+                if (openFileDialog(s_cameraPathFilters, filename)) m_CameraPath = CameraPath::createFromFile(filename);
+            }
+            if (m_CameraPath)
+            {
+                if (gProfileEnabled)
+                {
+                    if (cameraPathGroup.button("Benchmark", true)) StartCameraPathBenchmark();
+                    cameraPathGroup.tooltip("Replay the path with a fixed time step and log the mean, p50, p95 and p99 frame times");
+                }
+                else cameraPathGroup.text("Enable the profiler (P) to benchmark the path");
+                cameraPathGroup.checkbox("Constant speed", m_CameraPathConstantSpeed);
+                cameraPathGroup.tooltip("Move the camera at constant speed along the path instead of following the recorded timing");
+            }
+        }
+
+        if (m_CameraPath) cameraPathGroup.text(std::to_string(m_CameraPath->getKeyframeCount()) + " keyframes, " + std::to_string(m_CameraPath->getDuration()) + " s");
+    }
 }
 
 void PathTracer::onFrameRender(RenderContext* pRenderContext, const Fbo::SharedPtr& pTargetFbo)
@@ -233,7 +391,17 @@ void PathTracer::onFrameRender(RenderContext* pRenderContext, const Fbo::SharedP
     float xJitter = (sampledPoint.x) / m_width;
     float yJitter = (sampledPoint.y) / m_height;
     m_scene->getCamera()->setJitter(xJitter, yJitter);
-    m_scene->update(pRenderContext, gpFramework->getGlobalClock().getTime());
+
+    // A camera path benchmark drives both the camera and the scene time, so every run renders the same frames.
+    double sceneTime = gpFramework->getGlobalClock().getTime();
+    if (m_CameraPathBenchmark)
+    {
+        double pathTime = m_CameraPathBenchmark->beginFrame(m_scene->getCamera().get());
+        if (pathTime >= 0.0) sceneTime = pathTime;
+        else FinishCameraPathBenchmark();
+    }
+    m_scene->update(pRenderContext, sceneTime);
+    if (m_RecordingCameraPath) m_CameraPath->record(m_scene->getCamera().get(), sceneTime);
 
     const float4 clearColor(0.0f, 0.0f, 0.0f, 0.0f);
 
@@ -300,6 +468,9 @@ void PathTracer::onFrameRender(RenderContext* pRenderContext, const Fbo::SharedP
 
         m_AccumFrameCount++;
 
+        if (m_DumpAOVs) DumpAOVs(pRenderContext);
+        else if (!m_PendingAOVFrames.empty()) ResolveAOVDumps(0);
+
         // Post Processing
 
         m_PostProcessingPass->getVars()->setTexture("_texLinearResult", m_AccumRT);
@@ -312,6 +483,7 @@ void PathTracer::onFrameRender(RenderContext* pRenderContext, const Fbo::SharedP
 
 void PathTracer::onShutdown()
 {
+    ResolveAOVDumps(0);
 }
 
 bool PathTracer::onKeyEvent(const KeyboardEvent& keyEvent)
@@ -59,6 +59,12 @@ private:
 
     void LoadScene();
 
+    void DumpAOVs(RenderContext* pRenderContext);
+    void ResolveAOVDumps(size_t maxPendingFrames);
+
+    void StartCameraPathBenchmark();
+    void FinishCameraPathBenchmark();
+
 private:
     HaltonSampler                   m_haltonSampler;
 
@@ -111,6 +117,37 @@ private:
     */
     FullScreenPass::SharedPtr       m_PostProcessingPass;
 
+    /*
+    AOV Dump
+    */
+    struct AOVReadback
+    {
+        std::string layer;
+        ResourceFormat format;
+        ExrImageIO::PixelType type;
+        uint32_t channelCount;
+        CopyContext::ReadTextureTask::SharedPtr pReadback;
+    };
+
+    struct PendingAOVFrame
+    {
+        std::string filename;
+        std::vector<AOVReadback> layers;
+    };
+
+    bool                            m_DumpAOVs = false;
+    uint32_t                        m_AOVFrameCount = 0;
+    std::deque<PendingAOVFrame>     m_PendingAOVFrames; /* AOV readbacks in flight, oldest first */
+
+    /*
+    Camera Path
+    */
+    CameraPath::SharedPtr           m_CameraPath;
+    CameraPathBenchmark::SharedPtr  m_CameraPathBenchmark;
+    bool                            m_RecordingCameraPath = false;
+    bool                            m_ExitAfterCameraPath = false;
+    bool                            m_CameraPathConstantSpeed = false;
+
     /*
     Gerneal
     */
@@ -0,0 +1,345 @@
+/***************************************************************************
+ # Copyright (c) 2020, NVIDIA CORPORATION. All rights reserved.
+ #
+ # Redistribution and use in source and binary forms, with or without
+ # modification, are permitted provided that the following conditions
+ # are met:
+ #  * Redistributions of source code must retain the above copyright
+ #    notice, this list of conditions and the following disclaimer.
+ #  * Redistributions in binary form must reproduce the above copyright
+ #    notice, this list of conditions and the following disclaimer in the
+ #    documentation and/or other materials provided with the distribution.
+ #  * Neither the name of NVIDIA CORPORATION nor the names of its
+ #    contributors may be used to endorse or promote products derived
+ #    from this software without specific prior written permission.
+ #
+ # THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ # EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ # IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ # PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ # CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ # EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ # PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ # PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ # OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ # (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ # OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **************************************************************************/
+#include "Testing/UnitTest.h"
+#include "Scene/GeometryStreamer.h"
+#include <filesystem>
+
+namespace Falcor
+{
+    namespace
+    {
+        struct Vertex
+        {
+            float3 position;
+            float3 normal;
+            float2 texCrd;
+        };
+
+        const uint32_t kPageSize = 4096;
+
+        /** Mesh i is a grid of vertexCount vertices offset by i along x, with two triangles per vertex.
+        */
+        void createMesh(uint32_t meshID, uint32_t vertexCount, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices)
+        {
+            vertices.resize(vertexCount);
+            for (uint32_t i = 0; i < vertexCount; i++)
+            {
+                vertices[i].position = float3(float(meshID) + float(i % 4), float(i / 4), -float(i));
+                vertices[i].normal = float3(0.f, 0.f, 1.f);
+                vertices[i].texCrd = float2(float(i), float(meshID));
+            }
+            indices.resize(6 * size_t(vertexCount));
+            for (size_t i = 0; i < indices.size(); i++) indices[i] = uint32_t((i * 7 + meshID) % vertexCount);
+        }
+
+        /** Writes meshCount meshes of vertexCount vertices each.
+        */
+        bool writePageFile(const std::string& filename, uint32_t meshCount, uint32_t vertexCount)
+        {
+            auto pWriter = GeometryPageFile::Writer::create(filename, sizeof(Vertex), kPageSize);
+            if (!pWriter) return false;
+
+            std::vector<Vertex> vertices;
+            std::vector<uint32_t> indices;
+            for (uint32_t meshID = 0; meshID < meshCount; meshID++)
+            {
+                createMesh(meshID, vertexCount, vertices, indices);
+                if (pWriter->addMesh(vertices.data(), vertexCount, indices.data(), (uint32_t)indices.size()) != meshID) return false;
+            }
+            return pWriter->finish();
+        }
+
+        /** Returns a budget that holds exactly meshCount meshes of vertexCount vertices each.
+        */
+        uint64_t getBudget(uint32_t meshCount, uint32_t vertexCount)
+        {
+            // Slack of less than a vertex, so that rounding in the pool split can't lose a mesh.
+            return meshCount * uint64_t(vertexCount) * (sizeof(Vertex) + 6 * sizeof(uint32_t)) + 16;
+        }
+
+        /** Runs an update, waits for the scheduled loads, and runs a second update with the same priorities to collect them.
+            \return The meshes evicted by either update.
+        */
+        std::vector<uint32_t> updateAndWait(GeometryStreamer* pStreamer, const std::vector<float>& priorities)
+        {
+            std::vector<GeometryStreamer::LoadedMesh> loaded;
+            std::vector<uint32_t> evicted, evictedAfterWait;
+            pStreamer->update(priorities, loaded, evicted);
+            pStreamer->waitIdle();
+            pStreamer->update(priorities, loaded, evictedAfterWait);
+            evicted.insert(evicted.end(), evictedAfterWait.begin(), evictedAfterWait.end());
+            return evicted;
+        }
+    }
+
+    CPU_TEST(GeometryPageFile_RoundTrip)
+    {
+        const uint32_t kMeshCount = 5;
+        const uint32_t kVertexCount = 300;     // 300 * 32 + 1800 * 4 bytes, spanning several pages.
+        std::string filename = getTempFilename();
+        EXPECT(writePageFile(filename, kMeshCount, kVertexCount));
+
+        auto pFile = GeometryPageFile::open(filename, true);
+        EXPECT(pFile != nullptr);
+        if (!pFile) return;
+        EXPECT_EQ(pFile->getMeshCount(), kMeshCount);
+        EXPECT_EQ(pFile->getVertexStride(), (uint32_t)sizeof(Vertex));
+        EXPECT_EQ(pFile->getPageSize(), kPageSize);
+        EXPECT_EQ(pFile->getVertexBytes(), uint64_t(kMeshCount) * kVertexCount * sizeof(Vertex));
+        EXPECT_EQ(pFile->getIndexBytes(), uint64_t(kMeshCount) * kVertexCount * 6 * sizeof(uint32_t));
+
+        std::vector<Vertex> vertices;
+        std::vector<uint32_t> indices;
+        std::vector<uint8_t> data;
+        for (uint32_t meshID = 0; meshID < kMeshCount; meshID++)
+        {
+            createMesh(meshID, kVertexCount, vertices, indices);
+            const auto& info = pFile->getMesh(meshID);
+            EXPECT_EQ(info.vertexCount, kVertexCount);
+            EXPECT_EQ(info.indexCount, (uint32_t)indices.size());
+            EXPECT(info.bounds.minPoint == float3(float(meshID), 0.f, -float(kVertexCount - 1)));
+            EXPECT(info.bounds.maxPoint == float3(float(meshID) + 3.f, float(kVertexCount / 4 - 1), 0.f));
+
+            size_t vertexBytes = vertices.size() * sizeof(Vertex);
+            size_t indexBytes = indices.size() * sizeof(uint32_t);
+            EXPECT(pFile->readMesh(meshID, data));
+            EXPECT_EQ(data.size(), size_t(info.pageCount) * kPageSize);
+            EXPECT_GE(data.size(), vertexBytes + indexBytes);
+            if (data.size() < vertexBytes + indexBytes) continue;
+            EXPECT(std::memcmp(data.data(), vertices.data(), vertexBytes) == 0) << "mesh " << meshID;
+            EXPECT(std::memcmp(data.data() + vertexBytes, indices.data(), indexBytes) == 0) << "mesh " << meshID;
+        }
+    }
+
+    CPU_TEST(GeometryPageFile_RejectsCorruptFile)
+    {
+        std::string filename = getTempFilename();
+        EXPECT(writePageFile(filename, 3, 300));
+        auto fileSize = std::filesystem::file_size(filename);
+
+        // The mesh table is at the end of the file.
+        std::filesystem::resize_file(filename, fileSize - 1);
+        EXPECT(GeometryPageFile::open(filename) == nullptr);
+
+        // Only part of the header.
+        std::filesystem::resize_file(filename, 8);
+        EXPECT(GeometryPageFile::open(filename) == nullptr);
+
+        // Wrong magic number.
+        EXPECT(writePageFile(filename, 3, 300));
+        {
+            std::fstream stream(filename, std::ios::binary | std::ios::in | std::ios::out);
+            stream.put('X');
+        }
+        EXPECT(GeometryPageFile::open(filename) == nullptr);
+
+        EXPECT(GeometryPageFile::open(filename + ".missing") == nullptr);
+        std::remove(filename.c_str());
+    }
+
+    CPU_TEST(GeometryStreamer_RangeAllocatorMerging)
+    {
+        const uint32_t kInvalid = GeometryStreamer::RangeAllocator::kInvalidOffset;
+        GeometryStreamer::RangeAllocator allocator;
+        allocator.init(100);
+        EXPECT_EQ(allocator.getCapacity(), 100u);
+
+        uint32_t a = allocator.allocate(30);
+        uint32_t b = allocator.allocate(30);
+        uint32_t c = allocator.allocate(40);
+        EXPECT_EQ(a, 0u);
+        EXPECT_EQ(b, 30u);
+        EXPECT_EQ(c, 60u);
+        EXPECT_EQ(allocator.allocate(1), kInvalid);
+        EXPECT_EQ(allocator.allocate(0), 0u);
+
+        // Two free ranges that are not adjacent.
+        allocator.release(a, 30);
+        allocator.release(c, 40);
+        EXPECT_EQ(allocator.allocate(50), kInvalid);
+
+        // Releasing the range between them merges all three.
+        allocator.release(b, 30);
+        EXPECT_EQ(allocator.allocate(100), 0u);
+        allocator.release(0, 100);
+
+        // Merge with the previous range only, then with the next range only.
+        a = allocator.allocate(20);
+        b = allocator.allocate(20);
+        c = allocator.allocate(60);
+        allocator.release(a, 20);
+        allocator.release(b, 20);
+        EXPECT_EQ(allocator.allocate(40), 0u);
+        allocator.release(0, 20);
+        allocator.release(c, 60);
+        allocator.release(20, 20);
+        EXPECT_EQ(allocator.allocate(100), 0u);
+
+        // First fit: the lowest free range that is large enough.
+        allocator.init(100);
+        a = allocator.allocate(10);
+        b = allocator.allocate(10);
+        c = allocator.allocate(50);
+        EXPECT_EQ(allocator.allocate(10), 70u);
+        allocator.release(a, 10);
+        allocator.release(c, 50);
+        EXPECT_EQ(allocator.allocate(5), 0u);
+        EXPECT_EQ(allocator.allocate(20), 20u);
+        EXPECT_EQ(allocator.allocate(40), kInvalid);
+        EXPECT_EQ(allocator.allocate(30), 40u);
+        EXPECT_EQ(allocator.allocate(20), 80u);
+    }
+
+    CPU_TEST(GeometryStreamer_EvictionOrder)
+    {
+        const uint32_t kMeshCount = 5;
+        const uint32_t kVertexCount = 64;
+        std::string filename = getTempFilename();
+        EXPECT(writePageFile(filename, kMeshCount, kVertexCount));
+        auto pFile = GeometryPageFile::open(filename, true);
+        EXPECT(pFile != nullptr);
+        if (!pFile) return;
+
+        GeometryStreamer::Desc desc;
+        desc.budget = getBudget(3, kVertexCount);
+        auto pStreamer = GeometryStreamer::create(pFile, desc);
+        EXPECT_GE(pStreamer->getVertexCapacity(), 3 * kVertexCount);
+        EXPECT_LT(pStreamer->getVertexCapacity(), 4 * kVertexCount);
+        EXPECT_GE(pStreamer->getIndexCapacity(), 3 * 6 * kVertexCount);
+        EXPECT_LT(pStreamer->getIndexCapacity(), 4 * 6 * kVertexCount);
+
+        auto want = [&](uint32_t meshID)
+        {
+            std::vector<float> priorities(kMeshCount, 0.f);
+            priorities[meshID] = 1.f;
+            return updateAndWait(pStreamer.get(), priorities);
+        };
+
+        EXPECT(updateAndWait(pStreamer.get(), { 1.f, 1.f, 1.f, 0.f, 0.f }).empty());
+        for (uint32_t meshID = 0; meshID < 3; meshID++) EXPECT(pStreamer->isResident(meshID));
+
+        // Using the meshes in the order 2, 0, 1 makes mesh 2 the least recently used.
+        EXPECT(want(2).empty());
+        EXPECT(want(0).empty());
+        EXPECT(want(1).empty());
+
+        auto evicted = want(3);
+        EXPECT(evicted == std::vector<uint32_t>{ 2 });
+        EXPECT(pStreamer->isResident(3));
+
+        evicted = want(4);
+        EXPECT(evicted == std::vector<uint32_t>{ 0 });
+        EXPECT(pStreamer->isResident(4));
+        EXPECT(pStreamer->isResident(1));
+        EXPECT(pStreamer->isResident(3));
+
+        const auto& stats = pStreamer->getStats();
+        EXPECT_EQ(stats.residentMeshCount, 3u);
+        EXPECT_EQ(stats.pendingLoadCount, 0u);
+        EXPECT_EQ(stats.loadCount, 5ull);
+        EXPECT_EQ(stats.evictionCount, 2ull);
+    }
+
+    CPU_TEST(GeometryStreamer_EvictionHysteresis)
+    {
+        const uint32_t kMeshCount = 4;
+        const uint32_t kVertexCount = 64;
+        std::string filename = getTempFilename();
+        EXPECT(writePageFile(filename, kMeshCount, kVertexCount));
+        auto pFile = GeometryPageFile::open(filename, true);
+        EXPECT(pFile != nullptr);
+        if (!pFile) return;
+
+        GeometryStreamer::Desc desc;
+        desc.budget = getBudget(3, kVertexCount);
+        desc.evictionHysteresis = 2.f;
+        auto pStreamer = GeometryStreamer::create(pFile, desc);
+
+        EXPECT(updateAndWait(pStreamer.get(), { 1.f, 0.5f, 1.f, 0.f }).empty());
+
+        // All resident meshes are wanted. Mesh 3 doesn't have twice the priority of mesh 1, so nothing is evicted.
+        EXPECT(updateAndWait(pStreamer.get(), { 1.f, 0.5f, 1.f, 0.9f }).empty());
+        EXPECT(!pStreamer->isResident(3));
+        EXPECT(updateAndWait(pStreamer.get(), { 1.f, 0.5f, 1.f, 0.9f }).empty());
+        EXPECT(!pStreamer->isResident(3));
+
+        // With more than twice the priority, the wanted mesh of lowest priority is evicted.
+        auto evicted = updateAndWait(pStreamer.get(), { 1.f, 0.5f, 1.f, 1.5f });
+        EXPECT(evicted == std::vector<uint32_t>{ 1 });
+        EXPECT(pStreamer->isResident(3));
+
+        // Mesh 1 can't take its place back at the same priorities.
+        EXPECT(updateAndWait(pStreamer.get(), { 1.f, 0.5f, 1.f, 1.5f }).empty());
+        EXPECT(!pStreamer->isResident(1));
+        EXPECT_EQ(pStreamer->getStats().evictionCount, 1ull);
+    }
+
+    CPU_TEST(GeometryStreamer_CancelUnwantedLoads)
+    {
+        const uint32_t kMeshCount = 32;
+        const uint32_t kVertexCount = 2048;    // 28 pages per mesh.
+        std::string filename = getTempFilename();
+        EXPECT(writePageFile(filename, kMeshCount, kVertexCount));
+        auto pFile = GeometryPageFile::open(filename, true);
+        EXPECT(pFile != nullptr);
+        if (!pFile) return;
+
+        GeometryStreamer::Desc desc;
+        desc.budget = getBudget(kMeshCount, kVertexCount);
+        desc.maxPendingLoads = kMeshCount;
+        auto pStreamer = GeometryStreamer::create(pFile, desc);
+        const auto& stats = pStreamer->getStats();
+
+        std::vector<GeometryStreamer::LoadedMesh> loaded;
+        std::vector<uint32_t> evicted;
+        std::vector<float> wanted(kMeshCount, 1.f);
+        std::vector<float> unwanted(kMeshCount, 0.f);
+        pStreamer->update(wanted, loaded, evicted);
+        EXPECT_EQ(stats.pendingLoadCount, kMeshCount);
+
+        // The loads still in the queue are cancelled. Those already being read complete.
+        pStreamer->update(unwanted, loaded, evicted);
+        uint32_t loadedCount = (uint32_t)loaded.size();
+        EXPECT_LE(stats.pendingLoadCount + loadedCount, kMeshCount);
+        EXPECT(evicted.empty());
+        pStreamer->waitIdle();
+        pStreamer->update(unwanted, loaded, evicted);
+        loadedCount += (uint32_t)loaded.size();
+        EXPECT_EQ(stats.pendingLoadCount, 0u);
+        EXPECT(evicted.empty());
+        EXPECT_EQ(stats.residentMeshCount, loadedCount);
+        EXPECT_EQ(stats.loadCount, (uint64_t)loadedCount);
+
+        // The budget holds exactly all meshes, so the ranges of the cancelled loads must have been released.
+        EXPECT(updateAndWait(pStreamer.get(), wanted).empty());
+        EXPECT_EQ(stats.residentMeshCount, kMeshCount);
+        EXPECT_EQ(stats.pendingLoadCount, 0u);
+        EXPECT_EQ(stats.evictionCount, 0ull);
+        for (uint32_t meshID = 0; meshID < kMeshCount; meshID++) EXPECT(pStreamer->isResident(meshID)) << "mesh " << meshID;
+    }
+}
@@ -0,0 +1,177 @@
+/***************************************************************************
+ # Copyright (c) 2020, NVIDIA CORPORATION. All rights reserved.
+ #
+ # Redistribution and use in source and binary forms, with or without
+ # modification, are permitted provided that the following conditions
+ # are met:
+ #  * Redistributions of source code must retain the above copyright
+ #    notice, this list of conditions and the following disclaimer.
+ #  * Redistributions in binary form must reproduce the above copyright
+ #    notice, this list of conditions and the following disclaimer in the
+ #    documentation and/or other materials provided with the distribution.
+ #  * Neither the name of NVIDIA CORPORATION nor the names of its
+ #    contributors may be used to endorse or promote products derived
+ #    from this software without specific prior written permission.
+ #
+ # THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ # EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ # IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ # PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ # CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ # EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ # PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ # PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ # OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ # (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ # OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **************************************************************************/
+#include "Testing/UnitTest.h"
+#include "Scene/OcclusionCuller.h"
+
+namespace Falcor
+{
+    namespace
+    {
+        const float kNear = 0.1f;
+        const float kFar = 100.f;
+
+        /** Perspective projection with a 90 degree field of view, looking along +z from the origin.
+            Depth is z/w in [0,1] between the near and far planes.
+        */
+        glm::mat4 getViewProj()
+        {
+            glm::mat4 viewProj(1.f);
+            viewProj[2] = float4(0.f, 0.f, kFar / (kFar - kNear), 1.f);
+            viewProj[3] = float4(0.f, 0.f, -kNear * kFar / (kFar - kNear), 0.f);
+            return viewProj;
+        }
+
+        /** Creates a culler with a square occluder at z = 10 covering x, y in [-5, 5], i.e. the middle half of the view.
+        */
+        OcclusionCuller::UniquePtr createCullerWithQuad()
+        {
+            OcclusionCuller::Desc desc;
+            desc.width = 64;
+            desc.height = 32;
+            OcclusionCuller::UniquePtr pCuller = OcclusionCuller::create(desc);
+
+            uint32_t quad = pCuller->addOccluderMesh({ { -5.f, -5.f, 10.f }, { 5.f, -5.f, 10.f }, { 5.f, 5.f, 10.f }, { -5.f, 5.f, 10.f } }, { 0, 1, 2, 0, 2, 3 });
+            pCuller->beginFrame(getViewProj());
+            pCuller->rasterize(quad, glm::mat4(1.f));
+            return pCuller;
+        }
+
+        BoundingBox makeBox(float3 center, float3 extent)
+        {
+            BoundingBox box;
+            box.center = center;
+            box.extent = extent;
+            return box;
+        }
+    }
+
+    CPU_TEST(OcclusionCuller_HiddenBehindOccluder)
+    {
+        auto pCuller = createCullerWithQuad();
+        EXPECT_EQ(pCuller->getStats().triangleCount, 2u);
+
+        EXPECT(!pCuller->isVisible(makeBox(float3(0.f, 0.f, 20.f), float3(1.f))));
+        EXPECT(!pCuller->isVisible(makeBox(float3(2.f, -2.f, 30.f), float3(1.f, 2.f, 5.f))));
+        EXPECT(!pCuller->isVisible(makeBox(float3(0.f, 0.f, 50.f), float3(5.f))));
+    }
+
+    CPU_TEST(OcclusionCuller_VisibleInFrontOrUncovered)
+    {
+        auto pCuller = createCullerWithQuad();
+
+        // In front of the occluder.
+        EXPECT(pCuller->isVisible(makeBox(float3(0.f, 0.f, 5.f), float3(1.f))));
+
+        // Intersecting the occluder.
+        EXPECT(pCuller->isVisible(makeBox(float3(0.f, 0.f, 10.f), float3(1.f))));
+
+        // Behind the occluder, but partly past its edge.
+        EXPECT(pCuller->isVisible(makeBox(float3(10.f, 0.f, 20.f), float3(1.f))));
+
+        // Behind the occluder, but next to it.
+        EXPECT(pCuller->isVisible(makeBox(float3(0.f, 15.f, 20.f), float3(1.f))));
+    }
+
+    CPU_TEST(OcclusionCuller_PartiallyCoveredPixels)
+    {
+        OcclusionCuller::Desc desc;
+        desc.width = 64;
+        desc.height = 32;
+        OcclusionCuller::UniquePtr pCuller = OcclusionCuller::create(desc);
+
+        // Two quads at z = 10 with a gap of a tenth of a pixel between them at x = 0. A pixel is 20 / 64 wide at z = 10.
+        const float gap = 20.f / 64.f * 0.05f;
+        uint32_t left = pCuller->addOccluderMesh({ { -5.f, -5.f, 10.f }, { -gap, -5.f, 10.f }, { -gap, 5.f, 10.f }, { -5.f, 5.f, 10.f } }, { 0, 1, 2, 0, 2, 3 });
+        uint32_t right = pCuller->addOccluderMesh({ { gap, -5.f, 10.f }, { 5.f, -5.f, 10.f }, { 5.f, 5.f, 10.f }, { gap, 5.f, 10.f } }, { 0, 1, 2, 0, 2, 3 });
+        pCuller->beginFrame(getViewProj());
+        pCuller->rasterize(left, glm::mat4(1.f));
+        pCuller->rasterize(right, glm::mat4(1.f));
+
+        // A thin box behind the gap is seen through it.
+        EXPECT(pCuller->isVisible(makeBox(float3(0.f, 0.f, 20.f), float3(0.01f, 1.f, 1.f))));
+
+        // Boxes behind either quad are hidden, including across the diagonal shared by its two triangles.
+        EXPECT(!pCuller->isVisible(makeBox(float3(-2.5f, 0.f, 20.f), float3(1.f))));
+        EXPECT(!pCuller->isVisible(makeBox(float3(2.5f, 0.f, 20.f), float3(1.f))));
+
+        // A box behind the right quad that reaches into the gap is visible.
+        EXPECT(pCuller->isVisible(makeBox(float3(1.f, 0.f, 20.f), float3(1.f))));
+    }
+
+    CPU_TEST(OcclusionCuller_NearPlane)
+    {
+        auto pCuller = createCullerWithQuad();
+
+        // Boxes crossing the near plane are always visible, even if they extend behind the occluder.
+        EXPECT(pCuller->isVisible(makeBox(float3(0.f, 0.f, 0.f), float3(1.f))));
+        EXPECT(pCuller->isVisible(makeBox(float3(0.f, 0.f, 20.f), float3(1.f, 1.f, 25.f))));
+
+        // Occluder triangles crossing the near plane are not rasterized.
+        OcclusionCuller::UniquePtr pOther = OcclusionCuller::create(OcclusionCuller::Desc());
+        uint32_t triangle = pOther->addOccluderMesh({ { -5.f, -5.f, -1.f }, { 5.f, -5.f, 10.f }, { 0.f, 5.f, 10.f } }, { 0, 1, 2 });
+        pOther->beginFrame(getViewProj());
+        pOther->rasterize(triangle, glm::mat4(1.f));
+        for (float depth : pOther->getDepthBuffer()) EXPECT_EQ(depth, std::numeric_limits<float>::max());
+        EXPECT(pOther->isVisible(makeBox(float3(0.f, 0.f, 20.f), float3(1.f))));
+    }
+
+    CPU_TEST(OcclusionCuller_TileMaxDepth)
+    {
+        auto pCuller = createCullerWithQuad();
+
+        // Add a closer triangle that partially covers some tiles.
+        uint32_t triangle = pCuller->addOccluderMesh({ { -3.f, -1.f, 6.f }, { 4.f, 0.f, 6.f }, { -1.f, 3.f, 6.f } }, { 0, 1, 2 });
+        pCuller->rasterize(triangle, glm::mat4(1.f));
+
+        const uint32_t width = pCuller->getWidth();
+        const uint32_t tileCountX = width / OcclusionCuller::kTileWidth;
+        const uint32_t tileCountY = pCuller->getHeight() / OcclusionCuller::kTileHeight;
+        const std::vector<float> depth = pCuller->getDepthBuffer();
+        const std::vector<float>& tileMaxDepth = pCuller->getTileMaxDepth();
+        EXPECT_EQ(tileMaxDepth.size(), (size_t)tileCountX * tileCountY);
+
+        uint32_t coveredTileCount = 0;
+        for (uint32_t tileY = 0; tileY < tileCountY; tileY++)
+        {
+            for (uint32_t tileX = 0; tileX < tileCountX; tileX++)
+            {
+                float maxDepth = -std::numeric_limits<float>::max();
+                for (uint32_t y = tileY * OcclusionCuller::kTileHeight; y < (tileY + 1) * OcclusionCuller::kTileHeight; y++)
+                {
+                    for (uint32_t x = tileX * OcclusionCuller::kTileWidth; x < (tileX + 1) * OcclusionCuller::kTileWidth; x++)
+                    {
+                        maxDepth = std::max(maxDepth, depth[y * width + x]);
+                    }
+                }
+                EXPECT_EQ(tileMaxDepth[tileY * tileCountX + tileX], maxDepth) << "tile (" << tileX << ", " << tileY << ")";
+                if (maxDepth < std::numeric_limits<float>::max()) coveredTileCount++;
+            }
+        }
+        EXPECT_GT(coveredTileCount, 0u);
+    }
+}
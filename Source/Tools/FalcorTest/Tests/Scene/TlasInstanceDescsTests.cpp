@@ -0,0 +1,140 @@
+/***************************************************************************
+ # Copyright (c) 2020, NVIDIA CORPORATION. All rights reserved.
+ #
+ # Redistribution and use in source and binary forms, with or without
+ # modification, are permitted provided that the following conditions
+ # are met:
+ #  * Redistributions of source code must retain the above copyright
+ #    notice, this list of conditions and the following disclaimer.
+ #  * Redistributions in binary form must reproduce the above copyright
+ #    notice, this list of conditions and the following disclaimer in the
+ #    documentation and/or other materials provided with the distribution.
+ #  * Neither the name of NVIDIA CORPORATION nor the names of its
+ #    contributors may be used to endorse or promote products derived
+ #    from this software without specific prior written permission.
+ #
+ # THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ # EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ # IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ # PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ # CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ # EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ # PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ # PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ # OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ # (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ # OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **************************************************************************/
+#include "Testing/UnitTest.h"
+#include "Scene/TlasInstanceDescs.h"
+
+namespace Falcor
+{
+    namespace
+    {
+        using Ranges = std::vector<std::pair<uint32_t, uint32_t>>;
+
+        /** Creates instance descs with identity transforms. Desc i uses the global matrix matrixIDs[i].
+        */
+        TlasInstanceDescs createInstanceDescs(const std::vector<uint32_t>& matrixIDs, uint32_t matrixCount)
+        {
+            std::vector<D3D12_RAYTRACING_INSTANCE_DESC> descs(matrixIDs.size());
+            for (uint32_t i = 0; i < (uint32_t)descs.size(); i++)
+            {
+                descs[i] = {};
+                descs[i].InstanceID = i;
+                TlasInstanceDescs::setTransform(descs[i], glm::mat4(1.f));
+            }
+
+            TlasInstanceDescs instanceDescs;
+            instanceDescs.setInstanceDescs(descs, matrixIDs, matrixCount);
+            return instanceDescs;
+        }
+
+        glm::mat4 translation(float x, float y, float z)
+        {
+            glm::mat4 m(1.f);
+            m[3] = glm::vec4(x, y, z, 1.f);
+            return m;
+        }
+    }
+
+    CPU_TEST(TlasInstanceDescs_SetInstanceDescs)
+    {
+        TlasInstanceDescs instanceDescs = createInstanceDescs({ 0, 1, 2, 3 }, 4);
+
+        EXPECT_EQ(instanceDescs.getCount(), 4u);
+        for (uint32_t i = 0; i < 4; i++) EXPECT_EQ(instanceDescs.getInstanceDescs()[i].InstanceID, i);
+
+        // All descs need to be uploaded after they are set.
+        EXPECT(instanceDescs.isDirty());
+        EXPECT(instanceDescs.getDirtyRanges(16) == Ranges({ { 0, 4 } }));
+    }
+
+    CPU_TEST(TlasInstanceDescs_PatchTransforms)
+    {
+        // Descs 1 and 4 share matrix 2. Matrix 5 is not used by any desc.
+        TlasInstanceDescs instanceDescs = createInstanceDescs({ 0, 2, 1, 3, 2, 4 }, 6);
+        instanceDescs.clearDirty();
+
+        std::vector<glm::mat4> globalMatrices(6, glm::mat4(1.f));
+        globalMatrices[2] = translation(1.f, 2.f, 3.f);
+        EXPECT(instanceDescs.patchTransforms({ 2 }, globalMatrices));
+
+        // Only the descs using the changed matrix are patched and marked dirty.
+        EXPECT(instanceDescs.getDirtyRanges(16) == Ranges({ { 1, 2 }, { 4, 5 } }));
+        for (uint32_t i = 0; i < instanceDescs.getCount(); i++)
+        {
+            const D3D12_RAYTRACING_INSTANCE_DESC& desc = instanceDescs.getInstanceDescs()[i];
+            const bool patched = i == 1 || i == 4;
+            EXPECT_EQ(desc.Transform[0][3], patched ? 1.f : 0.f) << "desc " << i;
+            EXPECT_EQ(desc.Transform[1][3], patched ? 2.f : 0.f) << "desc " << i;
+            EXPECT_EQ(desc.Transform[2][3], patched ? 3.f : 0.f) << "desc " << i;
+            EXPECT_EQ(desc.Transform[0][0], 1.f) << "desc " << i;
+        }
+
+        // Matrices without descs and out-of-range matrix IDs patch nothing.
+        instanceDescs.clearDirty();
+        EXPECT(!instanceDescs.patchTransforms({ 5, 100 }, globalMatrices));
+        EXPECT(!instanceDescs.isDirty());
+    }
+
+    CPU_TEST(TlasInstanceDescs_DirtyRanges)
+    {
+        TlasInstanceDescs instanceDescs = createInstanceDescs({ 0, 1, 2, 3, 4, 5, 6, 7, 8, 9 }, 10);
+        instanceDescs.clearDirty();
+
+        // Consecutive dirty descs are merged, regardless of the order they were patched in.
+        std::vector<glm::mat4> globalMatrices(10, translation(1.f, 0.f, 0.f));
+        instanceDescs.patchTransforms({ 7, 2, 3, 8, 5 }, globalMatrices);
+        const Ranges ranges = { { 2, 4 }, { 5, 6 }, { 7, 9 } };
+        EXPECT(instanceDescs.getDirtyRanges(16) == ranges);
+        EXPECT(instanceDescs.getDirtyRanges(3) == ranges);
+
+        // Patching a desc again doesn't add it twice.
+        instanceDescs.patchTransforms({ 5, 7 }, globalMatrices);
+        EXPECT(instanceDescs.getDirtyRanges(16) == ranges);
+
+        // Above the limit, a single range covers all dirty descs.
+        EXPECT(instanceDescs.getDirtyRanges(2) == Ranges({ { 2, 9 } }));
+        EXPECT(instanceDescs.getDirtyRanges(1) == Ranges({ { 2, 9 } }));
+    }
+
+    CPU_TEST(TlasInstanceDescs_ClearDirty)
+    {
+        TlasInstanceDescs instanceDescs = createInstanceDescs({ 0, 1, 2, 3 }, 4);
+
+        instanceDescs.clearDirty();
+        EXPECT(!instanceDescs.isDirty());
+        EXPECT(instanceDescs.getDirtyRanges(16).empty());
+
+        // Descs can be marked dirty again after they were cleared.
+        std::vector<glm::mat4> globalMatrices(4, glm::mat4(1.f));
+        instanceDescs.patchTransforms({ 1 }, globalMatrices);
+        EXPECT(instanceDescs.isDirty());
+        EXPECT(instanceDescs.getDirtyRanges(16) == Ranges({ { 1, 2 } }));
+
+        instanceDescs.clearDirty();
+        EXPECT(!instanceDescs.isDirty());
+    }
+}
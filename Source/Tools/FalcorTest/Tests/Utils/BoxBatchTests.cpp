@@ -0,0 +1,154 @@
+/***************************************************************************
+ # Copyright (c) 2020, NVIDIA CORPORATION. All rights reserved.
+ #
+ # Redistribution and use in source and binary forms, with or without
+ # modification, are permitted provided that the following conditions
+ # are met:
+ #  * Redistributions of source code must retain the above copyright
+ #    notice, this list of conditions and the following disclaimer.
+ #  * Redistributions in binary form must reproduce the above copyright
+ #    notice, this list of conditions and the following disclaimer in the
+ #    documentation and/or other materials provided with the distribution.
+ #  * Neither the name of NVIDIA CORPORATION nor the names of its
+ #    contributors may be used to endorse or promote products derived
+ #    from this software without specific prior written permission.
+ #
+ # THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ # EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ # IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ # PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ # CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ # EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ # PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ # PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ # OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ # (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ # OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **************************************************************************/
+#include "Testing/UnitTest.h"
+#include "Utils/Math/BoxBatch.h"
+#include <random>
+
+namespace Falcor
+{
+    namespace
+    {
+        const uint32_t kBoxCount = 1001;    ///< Not a multiple of four, so that the SoA path also handles a remainder.
+        const float kEpsilon = 1e-4f;
+
+        std::vector<BoundingBox> createRandomBoxes(std::mt19937& rng)
+        {
+            std::uniform_real_distribution<float> dist(-3.f, 3.f);
+            std::vector<BoundingBox> boxes(kBoxCount);
+            for (auto& box : boxes)
+            {
+                box.center = float3(dist(rng), dist(rng), dist(rng));
+                box.extent = float3(std::abs(dist(rng)), std::abs(dist(rng)), std::abs(dist(rng)));
+            }
+            return boxes;
+        }
+
+        /** Creates a random affine transform, including shear and negative scale.
+        */
+        glm::mat4 createRandomTransform(std::mt19937& rng)
+        {
+            std::uniform_real_distribution<float> dist(-3.f, 3.f);
+            glm::mat4 mat;
+            for (int col = 0; col < 4; col++)
+            {
+                for (int row = 0; row < 3; row++) mat[col][row] = dist(rng);
+                mat[col][3] = col == 3 ? 1.f : 0.f;
+            }
+            return mat;
+        }
+
+        /** Checks a transformed box against the bounds of the eight transformed corners of the original box.
+        */
+        void checkTransformedBox(CPUUnitTestContext& ctx, const glm::mat4& mat, const BoundingBox& box, const BoundingBox& result, uint32_t index)
+        {
+            float3 cornerMin(std::numeric_limits<float>::max()), cornerMax(-std::numeric_limits<float>::max());
+            for (uint32_t i = 0; i < 8; i++)
+            {
+                const float3 corner = box.center + box.extent * float3((i & 1) ? 1.f : -1.f, (i & 2) ? 1.f : -1.f, (i & 4) ? 1.f : -1.f);
+                for (int row = 0; row < 3; row++)
+                {
+                    float p = mat[3][row];
+                    for (int col = 0; col < 3; col++) p += mat[col][row] * corner[col];
+                    cornerMin[row] = std::min(cornerMin[row], p);
+                    cornerMax[row] = std::max(cornerMax[row], p);
+                }
+            }
+
+            const float3 resultMin = result.getMinPos();
+            const float3 resultMax = result.getMaxPos();
+            for (int row = 0; row < 3; row++)
+            {
+                EXPECT_LE(std::abs(resultMin[row] - cornerMin[row]), kEpsilon) << "box " << index << ", axis " << row;
+                EXPECT_LE(std::abs(resultMax[row] - cornerMax[row]), kEpsilon) << "box " << index << ", axis " << row;
+            }
+        }
+    }
+
+    CPU_TEST(BoxBatch_TransformBoxes)
+    {
+        std::mt19937 rng(1);
+        const std::vector<BoundingBox> boxes = createRandomBoxes(rng);
+        std::vector<BoundingBox> result(kBoxCount);
+
+        // One matrix for all boxes.
+        const glm::mat4 mat = createRandomTransform(rng);
+        transformBoxes(mat, boxes.data(), result.data(), kBoxCount);
+        for (uint32_t i = 0; i < kBoxCount; i++) checkTransformedBox(ctx, mat, boxes[i], result[i], i);
+
+        // In place.
+        std::vector<BoundingBox> inPlace = boxes;
+        transformBoxes(mat, inPlace.data(), inPlace.data(), kBoxCount);
+        for (uint32_t i = 0; i < kBoxCount; i++)
+        {
+            EXPECT(inPlace[i].center == result[i].center && inPlace[i].extent == result[i].extent) << "box " << i;
+        }
+
+        // One matrix per box.
+        std::vector<glm::mat4> matrices(kBoxCount);
+        for (auto& m : matrices) m = createRandomTransform(rng);
+        transformBoxes(matrices.data(), boxes.data(), result.data(), kBoxCount);
+        for (uint32_t i = 0; i < kBoxCount; i++) checkTransformedBox(ctx, matrices[i], boxes[i], result[i], i);
+    }
+
+    CPU_TEST(BoxBatch_TransformBoxesSoA)
+    {
+        std::mt19937 rng(2);
+        const std::vector<BoundingBox> boxes = createRandomBoxes(rng);
+        const glm::mat4 mat = createRandomTransform(rng);
+
+        std::vector<BoundingBox> expected(kBoxCount);
+        transformBoxes(mat, boxes.data(), expected.data(), kBoxCount);
+
+        // Transform in place in SoA layout.
+        std::vector<float> arrays[6];
+        BoxArrays soa;
+        for (int j = 0; j < 3; j++)
+        {
+            arrays[j].resize(kBoxCount);
+            arrays[3 + j].resize(kBoxCount);
+            soa.center[j] = arrays[j].data();
+            soa.extent[j] = arrays[3 + j].data();
+            for (uint32_t i = 0; i < kBoxCount; i++)
+            {
+                soa.center[j][i] = boxes[i].center[j];
+                soa.extent[j][i] = boxes[i].extent[j];
+            }
+        }
+        transformBoxes(mat, soa, soa, kBoxCount);
+
+        // The results are identical to the AoS overload.
+        for (uint32_t i = 0; i < kBoxCount; i++)
+        {
+            for (int j = 0; j < 3; j++)
+            {
+                EXPECT_EQ(soa.center[j][i], expected[i].center[j]) << "box " << i << ", axis " << j;
+                EXPECT_EQ(soa.extent[j][i], expected[i].extent[j]) << "box " << i << ", axis " << j;
+            }
+        }
+    }
+}
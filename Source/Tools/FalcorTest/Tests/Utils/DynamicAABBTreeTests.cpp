@@ -0,0 +1,168 @@
+/***************************************************************************
+ # Copyright (c) 2020, NVIDIA CORPORATION. All rights reserved.
+ #
+ # Redistribution and use in source and binary forms, with or without
+ # modification, are permitted provided that the following conditions
+ # are met:
+ #  * Redistributions of source code must retain the above copyright
+ #    notice, this list of conditions and the following disclaimer.
+ #  * Redistributions in binary form must reproduce the above copyright
+ #    notice, this list of conditions and the following disclaimer in the
+ #    documentation and/or other materials provided with the distribution.
+ #  * Neither the name of NVIDIA CORPORATION nor the names of its
+ #    contributors may be used to endorse or promote products derived
+ #    from this software without specific prior written permission.
+ #
+ # THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ # EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ # IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ # PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ # CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ # EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ # PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ # PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ # OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ # (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ # OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **************************************************************************/
+#include "Testing/UnitTest.h"
+#include "Utils/Math/DynamicAABBTree.h"
+#include <random>
+
+namespace Falcor
+{
+    namespace
+    {
+        const uint32_t kBoxCount = 1000;
+        const uint32_t kIterationCount = 20000;
+        const uint32_t kCheckInterval = 500;
+        const float kBoundsEpsilon = 1e-4f;
+
+        /** Reference box query: the boxes whose bounds overlap the query box, sorted.
+        */
+        std::vector<uint32_t> queryBoxBruteForce(const std::vector<BoundingBox>& boxes, const std::vector<bool>& alive, const BoundingBox& query)
+        {
+            const float3 queryMin = query.getMinPos(), queryMax = query.getMaxPos();
+            std::vector<uint32_t> result;
+            for (uint32_t i = 0; i < (uint32_t)boxes.size(); i++)
+            {
+                if (!alive[i]) continue;
+                const float3 boxMin = boxes[i].getMinPos(), boxMax = boxes[i].getMaxPos();
+                if (boxMin.x <= queryMax.x && boxMin.y <= queryMax.y && boxMin.z <= queryMax.z &&
+                    queryMin.x <= boxMax.x && queryMin.y <= boxMax.y && queryMin.z <= boxMax.z)
+                {
+                    result.push_back(i);
+                }
+            }
+            return result;
+        }
+
+        /** Reference ray query: the boxes hit by the ray within [0, tMax], sorted. Uses the same slab test as the tree.
+        */
+        std::vector<uint32_t> queryRayBruteForce(const std::vector<BoundingBox>& boxes, const std::vector<bool>& alive, const float3& origin, const float3& dir, float tMax)
+        {
+            const float3 invDir = 1.f / dir;
+            std::vector<uint32_t> result;
+            for (uint32_t i = 0; i < (uint32_t)boxes.size(); i++)
+            {
+                if (!alive[i]) continue;
+                const float3 t0 = (boxes[i].getMinPos() - origin) * invDir;
+                const float3 t1 = (boxes[i].getMaxPos() - origin) * invDir;
+                const float3 tNear = glm::min(t0, t1);
+                const float3 tFar = glm::max(t0, t1);
+                const float tEnter = std::max(std::max(tNear.x, tNear.y), std::max(tNear.z, 0.f));
+                const float tExit = std::min(std::min(tFar.x, tFar.y), std::min(tFar.z, tMax));
+                if (tEnter <= tExit) result.push_back(i);
+            }
+            return result;
+        }
+    }
+
+    CPU_TEST(DynamicAABBTree_Randomized)
+    {
+        std::mt19937 rng(1);
+        std::uniform_real_distribution<float> position(-100.f, 100.f);
+        std::uniform_real_distribution<float> size(0.1f, 5.f);
+        std::uniform_real_distribution<float> offset(-5.f, 5.f);
+        auto randomBox = [&]()
+        {
+            BoundingBox box;
+            box.center = float3(position(rng), position(rng), position(rng));
+            box.extent = float3(size(rng), size(rng), size(rng));
+            return box;
+        };
+
+        DynamicAABBTree tree;
+        EXPECT(tree.empty());
+
+        // Box i is held by leaves[i] while alive[i] is set. The user data is the box index.
+        std::vector<BoundingBox> boxes(kBoxCount);
+        std::vector<uint32_t> leaves(kBoxCount);
+        std::vector<bool> alive(kBoxCount, true);
+        for (uint32_t i = 0; i < kBoxCount; i++)
+        {
+            boxes[i] = randomBox();
+            leaves[i] = tree.insert(boxes[i], i);
+        }
+
+        for (uint32_t iteration = 0; iteration < kIterationCount; iteration++)
+        {
+            // Mostly move boxes, sometimes remove or reinsert them.
+            const uint32_t i = rng() % kBoxCount;
+            const uint32_t op = rng() % 10;
+            if (alive[i] && op == 0)
+            {
+                tree.remove(leaves[i]);
+                alive[i] = false;
+            }
+            else if (!alive[i] && op == 1)
+            {
+                boxes[i] = randomBox();
+                leaves[i] = tree.insert(boxes[i], i);
+                alive[i] = true;
+            }
+            else if (alive[i])
+            {
+                boxes[i].center = boxes[i].center + float3(offset(rng), offset(rng), offset(rng));
+                tree.update(leaves[i], boxes[i]);
+            }
+
+            if (iteration % kCheckInterval != 0) continue;
+
+            // The root bounds are exact, up to the rounding of the conversion to center and extent in getBounds().
+            float3 boundsMin(std::numeric_limits<float>::max()), boundsMax(-std::numeric_limits<float>::max());
+            for (uint32_t j = 0; j < kBoxCount; j++)
+            {
+                if (!alive[j]) continue;
+                boundsMin = glm::min(boundsMin, boxes[j].getMinPos());
+                boundsMax = glm::max(boundsMax, boxes[j].getMaxPos());
+            }
+            const BoundingBox bounds = tree.getBounds();
+            EXPECT_LE(glm::length(bounds.getMinPos() - boundsMin), kBoundsEpsilon) << "iteration " << iteration;
+            EXPECT_LE(glm::length(bounds.getMaxPos() - boundsMax), kBoundsEpsilon) << "iteration " << iteration;
+
+            // Box queries return each overlapping box once.
+            BoundingBox query = randomBox();
+            query.extent = query.extent * 5.f;
+            std::vector<uint32_t> result;
+            tree.queryBox(query, result);
+            std::sort(result.begin(), result.end());
+            EXPECT(result == queryBoxBruteForce(boxes, alive, query)) << "iteration " << iteration;
+
+            // Ray queries return each hit box once.
+            const float3 origin(position(rng), position(rng), position(rng));
+            const float3 dir(position(rng), position(rng), position(rng));
+            result.clear();
+            tree.queryRay(origin, dir, 1.f, result);
+            std::sort(result.begin(), result.end());
+            EXPECT(result == queryRayBruteForce(boxes, alive, origin, dir, 1.f)) << "iteration " << iteration;
+        }
+
+        // Removing all boxes empties the tree.
+        for (uint32_t i = 0; i < kBoxCount; i++)
+        {
+            if (alive[i]) tree.remove(leaves[i]);
+        }
+        EXPECT(tree.empty());
+    }
+}
@@ -0,0 +1,361 @@
+/***************************************************************************
+ # Copyright (c) 2020, NVIDIA CORPORATION. All rights reserved.
+ #
+ # Redistribution and use in source and binary forms, with or without
+ # modification, are permitted provided that the following conditions
+ # are met:
+ #  * Redistributions of source code must retain the above copyright
+ #    notice, this list of conditions and the following disclaimer.
+ #  * Redistributions in binary form must reproduce the above copyright
+ #    notice, this list of conditions and the following disclaimer in the
+ #    documentation and/or other materials provided with the distribution.
+ #  * Neither the name of NVIDIA CORPORATION nor the names of its
+ #    contributors may be used to endorse or promote products derived
+ #    from this software without specific prior written permission.
+ #
+ # THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ # EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ # IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ # PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ # CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ # EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ # PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ # PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ # OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ # (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ # OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **************************************************************************/
+#include "BatchCompare.h"
+
+#include <atomic>
+#include <thread>
+#include <algorithm>
+#include <cctype>
+#include <set>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <filesystem>
+#include <stdexcept>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    bool isImageFile(const fs::path& path)
+    {
+        return FreeImage_GetFIFFromFilename(path.string().c_str()) != FIF_UNKNOWN;
+    }
+
+    std::set<std::string> findImages(const fs::path& directory)
+    {
+        std::set<std::string> images;
+        for (const auto& entry : fs::recursive_directory_iterator(directory))
+        {
+            if (entry.is_regular_file() && isImageFile(entry.path()))
+            {
+                images.insert(fs::relative(entry.path(), directory).generic_string());
+            }
+        }
+        return images;
+    }
+
+    Image::SharedPtr loadImage(const std::string& filename, std::string& message)
+    {
+        if (filename.empty())
+        {
+            message = "Image is missing";
+            return nullptr;
+        }
+
+        try
+        {
+            return Image::loadFromFile(filename);
+        }
+        catch (const std::runtime_error& e)
+        {
+            message = "Cannot load image from '" + filename + "' (Error: " + e.what() + ")";
+            return nullptr;
+        }
+    }
+
+    /** Get the heat map filename for a pair. The pair's name is flattened into a single file name, prefixed with the pair's index,
+        so names with directories, absolute paths or ".." stay in the heat map directory, and names which only differ in their extension don't collide.
+    */
+    std::string getHeatMapFilename(const std::string& directory, size_t index, const std::string& name)
+    {
+        std::string flatName = fs::u8path(name).generic_u8string();
+        std::replace_if(flatName.begin(), flatName.end(), [] (char c) { return !std::isalnum((unsigned char)c) && c != '-' && c != '_'; }, '_');
+
+        std::ostringstream filename;
+        filename << std::setfill('0') << std::setw(4) << index << "_" << flatName << ".png";
+        return (fs::path(directory) / fs::u8path(filename.str())).string();
+    }
+
+    bool isSameFile(const std::string& filenameA, const std::string& filenameB)
+    {
+        std::error_code ec;
+        return !filenameA.empty() && !filenameB.empty() && fs::weakly_canonical(filenameA, ec) == fs::weakly_canonical(filenameB, ec);
+    }
+
+    CompareResult comparePair(const ComparePair& pair, size_t index, const BatchOptions& options)
+    {
+        CompareResult result;
+        result.pair = pair;
+        result.threshold = pair.threshold ? *pair.threshold : options.threshold;
+
+        // Load images.
+        auto imageA = loadImage(pair.filenameA, result.message);
+        if (!imageA) return result;
+        auto imageB = loadImage(pair.filenameB, result.message);
+        if (!imageB) return result;
+
+        // Check resolution.
+        uint32_t width = imageA->getWidth();
+        uint32_t height = imageA->getHeight();
+        if (width != imageB->getWidth() || height != imageB->getHeight())
+        {
+            result.message = "Cannot compare images with different resolutions";
+            return result;
+        }
+
+        // Compare images. Nans and infs are treated as errors.
+        result.compared = true;
+        result.error = options.metric.compare(*imageA, *imageB, options.alpha, nullptr);
+        result.passed = std::isfinite(result.error) && result.error <= result.threshold;
+
+        // Generate heat maps for failing pairs only. The comparison is repeated to produce the error map,
+        // so passing pairs never allocate it.
+        if (!result.passed && !options.heatMapDirectory.empty())
+        {
+            auto errorMap = std::make_unique<float[]>(size_t(width) * height);
+            options.metric.compare(*imageA, *imageB, options.alpha, errorMap.get());
+            auto heatMap = generateHeatMap(width, height, errorMap.get());
+
+            // Never overwrite an input image with its heat map.
+            std::string heatMapFilename = getHeatMapFilename(options.heatMapDirectory, index, pair.name);
+            if (isSameFile(heatMapFilename, pair.filenameA) || isSameFile(heatMapFilename, pair.filenameB))
+            {
+                result.message = "Cannot save heat map to '" + heatMapFilename + "' (Error: The file is an input image)";
+                return result;
+            }
+
+            try
+            {
+                std::error_code ec;
+                fs::create_directories(options.heatMapDirectory, ec);
+                heatMap->saveToFile(heatMapFilename);
+                result.heatMapFilename = heatMapFilename;
+            }
+            catch (const std::runtime_error& e)
+            {
+                result.message = "Cannot save heat map to '" + heatMapFilename + "' (Error: " + e.what() + ")";
+            }
+        }
+
+        return result;
+    }
+
+    std::string escapeJson(const std::string& str)
+    {
+        std::ostringstream ss;
+        for (char c : str)
+        {
+            switch (c)
+            {
+            case '"': ss << "\\\""; break;
+            case '\\': ss << "\\\\"; break;
+            case '\n': ss << "\\n"; break;
+            case '\r': ss << "\\r"; break;
+            case '\t': ss << "\\t"; break;
+            default:
+                if (uint8_t(c) < 0x20) ss << "\\u" << std::hex << std::setw(4) << std::setfill('0') << int(c) << std::dec;
+                else ss << c;
+            }
+        }
+        return ss.str();
+    }
+
+    std::string escapeCsv(const std::string& str)
+    {
+        if (str.find_first_of(",\"\n\r") == std::string::npos) return str;
+        std::string escaped = "\"";
+        for (char c : str)
+        {
+            if (c == '"') escaped += '"';
+            escaped += c;
+        }
+        return escaped + "\"";
+    }
+
+    void writeJson(std::ostream& stream, const std::vector<CompareResult>& results, const BatchOptions& options)
+    {
+        auto writeNumber = [&stream] (double value)
+        {
+            if (std::isfinite(value)) stream << value;
+            else stream << "null";
+        };
+
+        size_t passedCount = std::count_if(results.begin(), results.end(), [] (const CompareResult& r) { return r.passed; });
+
+        stream << std::setprecision(9);
+        stream << "{\n";
+        stream << "  \"metric\": \"" << escapeJson(options.metric.name) << "\",\n";
+        stream << "  \"alpha\": " << (options.alpha ? "true" : "false") << ",\n";
+        stream << "  \"threshold\": "; writeNumber(options.threshold); stream << ",\n";
+        stream << "  \"passed\": " << passedCount << ",\n";
+        stream << "  \"failed\": " << (results.size() - passedCount) << ",\n";
+        stream << "  \"results\": [";
+        for (size_t i = 0; i < results.size(); ++i)
+        {
+            const auto& r = results[i];
+            stream << (i == 0 ? "\n" : ",\n");
+            stream << "    {\n";
+            stream << "      \"name\": \"" << escapeJson(r.pair.name) << "\",\n";
+            stream << "      \"imageA\": \"" << escapeJson(r.pair.filenameA) << "\",\n";
+            stream << "      \"imageB\": \"" << escapeJson(r.pair.filenameB) << "\",\n";
+            stream << "      \"error\": "; if (r.compared) writeNumber(r.error); else stream << "null"; stream << ",\n";
+            stream << "      \"threshold\": "; writeNumber(r.threshold); stream << ",\n";
+            stream << "      \"passed\": " << (r.passed ? "true" : "false");
+            if (!r.heatMapFilename.empty()) stream << ",\n      \"heatMap\": \"" << escapeJson(r.heatMapFilename) << "\"";
+            if (!r.message.empty()) stream << ",\n      \"message\": \"" << escapeJson(r.message) << "\"";
+            stream << "\n    }";
+        }
+        stream << (results.empty() ? "]\n" : "\n  ]\n");
+        stream << "}\n";
+    }
+
+    void writeCsv(std::ostream& stream, const std::vector<CompareResult>& results, const BatchOptions& options)
+    {
+        stream << std::setprecision(9);
+        stream << "name,imageA,imageB,metric,error,threshold,passed,heatMap,message\n";
+        for (const auto& r : results)
+        {
+            stream << escapeCsv(r.pair.name) << ",";
+            stream << escapeCsv(r.pair.filenameA) << ",";
+            stream << escapeCsv(r.pair.filenameB) << ",";
+            stream << escapeCsv(options.metric.name) << ",";
+            if (r.compared) stream << r.error;
+            stream << ",";
+            stream << r.threshold << ",";
+            stream << (r.passed ? "true" : "false") << ",";
+            stream << escapeCsv(r.heatMapFilename) << ",";
+            stream << escapeCsv(r.message) << "\n";
+        }
+    }
+}
+
+std::vector<ComparePair> findImagePairs(const std::string& directoryA, const std::string& directoryB)
+{
+    auto imagesA = findImages(directoryA);
+    auto imagesB = findImages(directoryB);
+
+    std::set<std::string> names = imagesA;
+    names.insert(imagesB.begin(), imagesB.end());
+
+    std::vector<ComparePair> pairs;
+    for (const auto& name : names)
+    {
+        ComparePair pair;
+        pair.name = name;
+        if (imagesA.count(name)) pair.filenameA = (fs::path(directoryA) / fs::u8path(name)).string();
+        if (imagesB.count(name)) pair.filenameB = (fs::path(directoryB) / fs::u8path(name)).string();
+        pairs.push_back(pair);
+    }
+
+    return pairs;
+}
+
+std::vector<ComparePair> loadManifest(const std::string& filename)
+{
+    std::ifstream stream(filename);
+    if (!stream) throw std::runtime_error("Cannot open manifest '" + filename + "'");
+
+    const fs::path baseDirectory = fs::path(filename).parent_path();
+    auto resolve = [&baseDirectory] (const std::string& path)
+    {
+        fs::path p(path);
+        return p.is_relative() ? (baseDirectory / p).string() : p.string();
+    };
+
+    std::vector<ComparePair> pairs;
+    std::string line;
+    uint32_t lineNumber = 0;
+    while (std::getline(stream, line))
+    {
+        lineNumber++;
+        size_t start = line.find_first_not_of(" \t\r");
+        if (start == std::string::npos || line[start] == '#') continue;
+
+        std::istringstream ss(line);
+        std::string filenameA, filenameB;
+        if (!(ss >> std::quoted(filenameA) >> std::quoted(filenameB)))
+        {
+            throw std::runtime_error("Invalid manifest entry on line " + std::to_string(lineNumber));
+        }
+
+        ComparePair pair;
+        pair.name = filenameA;
+        pair.filenameA = resolve(filenameA);
+        pair.filenameB = resolve(filenameB);
+
+        // The optional threshold must be a number, and nothing may follow it.
+        std::string token;
+        if (ss >> token)
+        {
+            size_t length = 0;
+            try
+            {
+                pair.threshold = std::stof(token, &length);
+            }
+            catch (const std::exception&)
+            {
+                length = 0;
+            }
+            if (length != token.size()) throw std::runtime_error("Invalid threshold '" + token + "' in manifest entry on line " + std::to_string(lineNumber));
+        }
+        if (ss >> token) throw std::runtime_error("Unexpected '" + token + "' in manifest entry on line " + std::to_string(lineNumber));
+
+        pairs.push_back(pair);
+    }
+
+    return pairs;
+}
+
+std::vector<CompareResult> compareBatch(const std::vector<ComparePair>& pairs, const BatchOptions& options)
+{
+    std::vector<CompareResult> results(pairs.size());
+
+    // Each worker compares one pair at a time, which bounds the number of decoded images to two per worker.
+    // The comparison itself runs in parallel over tiles.
+    std::atomic<size_t> nextPair = 0;
+    auto worker = [&] ()
+    {
+        for (size_t i = nextPair++; i < pairs.size(); i = nextPair++)
+        {
+            results[i] = comparePair(pairs[i], i, options);
+        }
+    };
+
+    uint32_t workerCount = std::max(1u, std::min(options.maxInFlight, uint32_t(pairs.size())));
+    std::vector<std::thread> workers;
+    for (uint32_t i = 1; i < workerCount; ++i) workers.emplace_back(worker);
+    worker();
+    for (auto& t : workers) t.join();
+
+    return results;
+}
+
+bool writeReport(const std::string& filename, const std::vector<CompareResult>& results, const BatchOptions& options)
+{
+    std::ofstream stream(filename);
+    if (!stream) return false;
+
+    std::string extension = fs::path(filename).extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(), [] (char c) { return (char)std::tolower(c); });
+    if (extension == ".csv") writeCsv(stream, results, options);
+    else writeJson(stream, results, options);
+
+    return stream.good();
+}
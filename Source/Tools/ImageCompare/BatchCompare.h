@@ -0,0 +1,84 @@
+/***************************************************************************
+ # Copyright (c) 2020, NVIDIA CORPORATION. All rights reserved.
+ #
+ # Redistribution and use in source and binary forms, with or without
+ # modification, are permitted provided that the following conditions
+ # are met:
+ #  * Redistributions of source code must retain the above copyright
+ #    notice, this list of conditions and the following disclaimer.
+ #  * Redistributions in binary form must reproduce the above copyright
+ #    notice, this list of conditions and the following disclaimer in the
+ #    documentation and/or other materials provided with the distribution.
+ #  * Neither the name of NVIDIA CORPORATION nor the names of its
+ #    contributors may be used to endorse or promote products derived
+ #    from this software without specific prior written permission.
+ #
+ # THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ # EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ # IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ # PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ # CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ # EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ # PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ # PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ # OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ # (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ # OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **************************************************************************/
+#pragma once
+#include "ErrorMetrics.h"
+
+#include <optional>
+#include <string>
+#include <vector>
+
+/** A pair of images to compare in batch mode.
+*/
+struct ComparePair
+{
+    std::string name;                   ///< Name of the pair in the report.
+    std::string filenameA;
+    std::string filenameB;
+    std::optional<float> threshold;     ///< Threshold for this pair. Uses the batch threshold if not set.
+};
+
+struct BatchOptions
+{
+    ErrorMetric metric;
+    float threshold = 0.f;
+    bool alpha = false;
+    std::string heatMapDirectory;       ///< Heat maps of failing pairs are written here, named after the index and name of the pair. No heat maps are written if empty.
+    uint32_t maxInFlight = 4;           ///< Maximum number of pairs decoded at the same time.
+};
+
+struct CompareResult
+{
+    ComparePair pair;
+    bool compared = false;              ///< True if both images were loaded and compared.
+    double error = 0.0;
+    float threshold = 0.f;
+    bool passed = false;
+    std::string heatMapFilename;
+    std::string message;                ///< Reason the pair could not be compared.
+};
+
+/** Match images in two directories by their relative path. Images missing from either directory are returned with an empty filename.
+*/
+std::vector<ComparePair> findImagePairs(const std::string& directoryA, const std::string& directoryB);
+
+/** Load pairs of images from a manifest file.
+    Each line holds the two image filenames and optionally a threshold, separated by whitespace. Filenames containing spaces must be quoted.
+    Relative filenames are relative to the manifest. Empty lines and lines starting with '#' are skipped.
+    Throws std::runtime_error if the manifest cannot be read, or if a line is malformed.
+*/
+std::vector<ComparePair> loadManifest(const std::string& filename);
+
+/** Compare pairs of images in parallel. At most options.maxInFlight pairs are decoded at the same time.
+    \return Results in the same order as the pairs.
+*/
+std::vector<CompareResult> compareBatch(const std::vector<ComparePair>& pairs, const BatchOptions& options);
+
+/** Write a report of the results. The format is chosen by the file extension: .csv for CSV, JSON otherwise.
+    \return True if the report was written.
+*/
+bool writeReport(const std::string& filename, const std::vector<CompareResult>& results, const BatchOptions& options);
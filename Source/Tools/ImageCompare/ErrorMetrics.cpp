@@ -0,0 +1,240 @@
+/***************************************************************************
+ # Copyright (c) 2020, NVIDIA CORPORATION. All rights reserved.
+ #
+ # Redistribution and use in source and binary forms, with or without
+ # modification, are permitted provided that the following conditions
+ # are met:
+ #  * Redistributions of source code must retain the above copyright
+ #    notice, this list of conditions and the following disclaimer.
+ #  * Redistributions in binary form must reproduce the above copyright
+ #    notice, this list of conditions and the following disclaimer in the
+ #    documentation and/or other materials provided with the distribution.
+ #  * Neither the name of NVIDIA CORPORATION nor the names of its
+ #    contributors may be used to endorse or promote products derived
+ #    from this software without specific prior written permission.
+ #
+ # THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ # EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ # IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ # PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ # CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ # EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ # PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ # PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ # OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ # (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ # OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **************************************************************************/
+#include "ErrorMetrics.h"
+#include "ImageFilter.h"
+#include "PerceptualMetrics.h"
+
+#include <cmath>
+#include <algorithm>
+#include <numeric>
+#include <execution>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#define IMAGE_COMPARE_USE_SSE 1
+#include <emmintrin.h>
+#else
+#define IMAGE_COMPARE_USE_SSE 0
+#endif
+
+namespace
+{
+    /** Images are compared in square tiles of this size. Each thread converts one tile of both images to RGBA32F at a time.
+    */
+    const uint32_t kTileSize = 256;
+
+    // Each metric evaluates the per-channel error. The per-pixel error is the mean over channels multiplied by kScale.
+
+    struct MSE
+    {
+        static constexpr double kScale = 1.0;
+        static float eval(float a, float b) { return sqr(a - b); }
+#if IMAGE_COMPARE_USE_SSE
+        static __m128 eval(__m128 a, __m128 b) { __m128 d = _mm_sub_ps(a, b); return _mm_mul_ps(d, d); }
+#endif
+    };
+
+    struct RMSE
+    {
+        static constexpr double kScale = 1.0;
+        static float eval(float a, float b) { return sqr(a - b) / (sqr(a) + 1e-3f); }
+#if IMAGE_COMPARE_USE_SSE
+        static __m128 eval(__m128 a, __m128 b)
+        {
+            __m128 d = _mm_sub_ps(a, b);
+            return _mm_div_ps(_mm_mul_ps(d, d), _mm_add_ps(_mm_mul_ps(a, a), _mm_set1_ps(1e-3f)));
+        }
+#endif
+    };
+
+    struct MAE
+    {
+        static constexpr double kScale = 1.0;
+        static float eval(float a, float b) { return std::fabs(a - b); }
+#if IMAGE_COMPARE_USE_SSE
+        static __m128 eval(__m128 a, __m128 b) { return _mm_andnot_ps(_mm_set1_ps(-0.f), _mm_sub_ps(a, b)); }
+#endif
+    };
+
+    struct MAPE
+    {
+        static constexpr double kScale = 100.0;
+        static float eval(float a, float b) { return std::fabs((a - b) / (a + 1e-3f)); }
+#if IMAGE_COMPARE_USE_SSE
+        static __m128 eval(__m128 a, __m128 b)
+        {
+            return _mm_andnot_ps(_mm_set1_ps(-0.f), _mm_div_ps(_mm_sub_ps(a, b), _mm_add_ps(a, _mm_set1_ps(1e-3f))));
+        }
+#endif
+    };
+
+    /** Compare one tile of RGBA32F pixels.
+        \param[in] a Tile of the first image, tightly packed rows.
+        \param[in] b Tile of the second image, tightly packed rows.
+        \param[out] errorMap Optional per-pixel error, addressed with errorMapPitch floats per row.
+        \return Sum of the per-channel errors over the tile.
+    */
+    template<typename Metric>
+    double compareTile(const float* a, const float* b, uint32_t width, uint32_t height, bool alpha, float* errorMap, size_t errorMapPitch)
+    {
+        const uint32_t channelCount = alpha ? 4 : 3;
+        const float pixelScale = float(Metric::kScale / channelCount);
+
+        // Rows are summed in double precision and added to the tile sum with Kahan summation.
+        double sum = 0.0;
+        double compensation = 0.0;
+
+        for (uint32_t y = 0; y < height; ++y)
+        {
+            double rowSum = 0.0;
+#if IMAGE_COMPARE_USE_SSE
+            const __m128 mask = _mm_castsi128_ps(_mm_set_epi32(alpha ? -1 : 0, -1, -1, -1));
+            __m128d acc0 = _mm_setzero_pd();
+            __m128d acc1 = _mm_setzero_pd();
+            for (uint32_t x = 0; x < width; ++x)
+            {
+                __m128 e = _mm_and_ps(Metric::eval(_mm_loadu_ps(a), _mm_loadu_ps(b)), mask);
+                __m128 eHigh = _mm_movehl_ps(e, e);
+                acc0 = _mm_add_pd(acc0, _mm_cvtps_pd(e));
+                acc1 = _mm_add_pd(acc1, _mm_cvtps_pd(eHigh));
+                if (errorMap)
+                {
+                    __m128 s = _mm_add_ps(e, eHigh);
+                    s = _mm_add_ss(s, _mm_shuffle_ps(s, s, _MM_SHUFFLE(1, 1, 1, 1)));
+                    errorMap[x] = _mm_cvtss_f32(s) * pixelScale;
+                }
+                a += 4;
+                b += 4;
+            }
+            acc0 = _mm_add_pd(acc0, acc1);
+            rowSum = _mm_cvtsd_f64(_mm_add_sd(acc0, _mm_unpackhi_pd(acc0, acc0)));
+#else
+            for (uint32_t x = 0; x < width; ++x)
+            {
+                float pixelSum = 0.f;
+                for (uint32_t c = 0; c < channelCount; ++c) pixelSum += Metric::eval(a[c], b[c]);
+                if (errorMap) errorMap[x] = pixelSum * pixelScale;
+                rowSum += pixelSum;
+                a += 4;
+                b += 4;
+            }
+#endif
+            if (errorMap) errorMap += errorMapPitch;
+
+            double t = rowSum - compensation;
+            double newSum = sum + t;
+            compensation = (newSum - sum) - t;
+            sum = newSum;
+        }
+
+        return sum;
+    }
+
+    template<typename Metric>
+    double compare(const Image& imageA, const Image& imageB, bool alpha, float* errorMap)
+    {
+        const uint32_t width = imageA.getWidth();
+        const uint32_t height = imageA.getHeight();
+        const uint32_t tilesX = (width + kTileSize - 1) / kTileSize;
+        const uint32_t tilesY = (height + kTileSize - 1) / kTileSize;
+
+        std::vector<double> tileSums(size_t(tilesX) * tilesY);
+        std::vector<uint32_t> tileIndices(tileSums.size());
+        std::iota(tileIndices.begin(), tileIndices.end(), 0);
+
+        std::for_each(std::execution::par, tileIndices.begin(), tileIndices.end(), [&] (uint32_t tileIndex)
+        {
+            thread_local std::vector<float> tileA;
+            thread_local std::vector<float> tileB;
+
+            const uint32_t x = (tileIndex % tilesX) * kTileSize;
+            const uint32_t y = (tileIndex / tilesX) * kTileSize;
+            const uint32_t tileWidth = std::min(kTileSize, width - x);
+            const uint32_t tileHeight = std::min(kTileSize, height - y);
+
+            tileA.resize(size_t(tileWidth) * tileHeight * 4);
+            tileB.resize(size_t(tileWidth) * tileHeight * 4);
+            imageA.readRect(x, y, tileWidth, tileHeight, tileA.data());
+            imageB.readRect(x, y, tileWidth, tileHeight, tileB.data());
+
+            float* tileErrorMap = errorMap ? errorMap + size_t(y) * width + x : nullptr;
+            tileSums[tileIndex] = compareTile<Metric>(tileA.data(), tileB.data(), tileWidth, tileHeight, alpha, tileErrorMap, width);
+        });
+
+        const double count = double(width) * double(height) * (alpha ? 4 : 3);
+        return Metric::kScale * pairwiseSum(tileSums.data(), tileSums.size()) / count;
+    }
+}
+
+const std::vector<ErrorMetric>& getErrorMetrics()
+{
+    static const std::vector<ErrorMetric> errorMetrics =
+    {
+        { "mse", "Mean Squared Error", compare<MSE> },
+        { "rmse", "Relative Mean Squared Error", compare<RMSE> },
+        { "mae", "Mean Absolute Error", compare<MAE> },
+        { "mape", "Mean Absolute Percentage Error", compare<MAPE> },
+        { "ssim", "Structural Dissimilarity (1 - SSIM of luminance)", compareSSIM },
+        { "msssim", "Multi-Scale Structural Dissimilarity (1 - MS-SSIM of luminance)", compareMSSSIM },
+        { "flip", "FLIP perceptual difference (LDR, 67 pixels per degree)", compareFLIP },
+    };
+    return errorMetrics;
+}
+
+Image::SharedPtr generateHeatMap(uint32_t width, uint32_t height, const float* errorMap)
+{
+    auto writeColor = [] (float t, float* dst)
+    {
+        static const float colors[5][3] = {
+            { 0.f, 0.f, 1.f },
+            { 0.f, 1.f, 1.f },
+            { 0.f, 1.f, 0.f },
+            { 1.f, 1.f, 0.f },
+            { 1.f, 0.f, 0.f },
+        };
+
+        int c = clamp(int(std::floor(t * 4.f)), 0, 3);
+        for (size_t i = 0; i < 3; ++i) *dst++ = lerp(colors[c][i], colors[c + 1][i], t * 4.f - c);
+        *dst++ = 1.f;
+    };
+
+    const auto [minValue, maxValue] = std::minmax_element(errorMap, errorMap + size_t(width) * height);
+    const float range = std::max(1e-5f, *maxValue - *minValue);
+    auto image = Image::create(width, height);
+    for (uint32_t y = 0; y < height; ++y)
+    {
+        float* dst = image->getRGBARow(y);
+        for (uint32_t x = 0; x < width; ++x)
+        {
+            float t = clamp((errorMap[size_t(y) * width + x] - *minValue) / range, 0.f, 1.f);
+            writeColor(t, dst);
+            dst += 4;
+        }
+    }
+
+    return image;
+}
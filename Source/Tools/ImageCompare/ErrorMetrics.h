@@ -0,0 +1,59 @@
+/***************************************************************************
+ # Copyright (c) 2020, NVIDIA CORPORATION. All rights reserved.
+ #
+ # Redistribution and use in source and binary forms, with or without
+ # modification, are permitted provided that the following conditions
+ # are met:
+ #  * Redistributions of source code must retain the above copyright
+ #    notice, this list of conditions and the following disclaimer.
+ #  * Redistributions in binary form must reproduce the above copyright
+ #    notice, this list of conditions and the following disclaimer in the
+ #    documentation and/or other materials provided with the distribution.
+ #  * Neither the name of NVIDIA CORPORATION nor the names of its
+ #    contributors may be used to endorse or promote products derived
+ #    from this software without specific prior written permission.
+ #
+ # THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ # EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ # IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ # PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ # CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ # EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ # PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ # PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ # OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ # (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ # OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **************************************************************************/
+#pragma once
+#include "Image.h"
+
+#include <string>
+#include <vector>
+#include <functional>
+
+/** Error metric comparing two images of the same size.
+    Images are compared in tiles in parallel. The result is deterministic: per-tile sums are reduced in a fixed order independent of the thread count.
+*/
+struct ErrorMetric
+{
+    std::string name;
+    std::string desc;
+    /** Compare two images.
+        \param[in] imageA First image.
+        \param[in] imageB Second image.
+        \param[in] alpha Include the alpha channel.
+        \param[out] errorMap Optional per-pixel error, width * height floats, top row first. Can be nullptr.
+        \return Error averaged over all pixels and channels.
+    */
+    std::function<double(const Image& imageA, const Image& imageB, bool alpha, float* errorMap)> compare;
+};
+
+/** Get the list of available error metrics. The first entry is the default metric.
+*/
+const std::vector<ErrorMetric>& getErrorMetrics();
+
+/** Generate a heat map from a per-pixel error map. The error is normalized to the range of values in the map.
+    \param[in] errorMap Per-pixel error, width * height floats, top row first.
+*/
+Image::SharedPtr generateHeatMap(uint32_t width, uint32_t height, const float* errorMap);
@@ -0,0 +1,254 @@
+/***************************************************************************
+ # Copyright (c) 2020, NVIDIA CORPORATION. All rights reserved.
+ #
+ # Redistribution and use in source and binary forms, with or without
+ # modification, are permitted provided that the following conditions
+ # are met:
+ #  * Redistributions of source code must retain the above copyright
+ #    notice, this list of conditions and the following disclaimer.
+ #  * Redistributions in binary form must reproduce the above copyright
+ #    notice, this list of conditions and the following disclaimer in the
+ #    documentation and/or other materials provided with the distribution.
+ #  * Neither the name of NVIDIA CORPORATION nor the names of its
+ #    contributors may be used to endorse or promote products derived
+ #    from this software without specific prior written permission.
+ #
+ # THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ # EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ # IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ # PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ # CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ # EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ # PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ # PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ # OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ # (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ # OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **************************************************************************/
+#include "Image.h"
+
+#include <stdexcept>
+#include <cassert>
+#include <cstring>
+
+namespace
+{
+    /** Check if readRect() can convert the bitmap type directly.
+    */
+    bool isNativeType(FIBITMAP* bitmap)
+    {
+        switch (FreeImage_GetImageType(bitmap))
+        {
+        case FIT_RGBAF:
+        case FIT_RGBF:
+        case FIT_FLOAT:
+        case FIT_RGBA16:
+        case FIT_RGB16:
+        case FIT_UINT16:
+            return true;
+        case FIT_BITMAP:
+            return FreeImage_GetBPP(bitmap) == 24 || FreeImage_GetBPP(bitmap) == 32;
+        default:
+            return false;
+        }
+    }
+}
+
+Image::Image(FIBITMAP* bitmap)
+    : mBitmap(bitmap)
+    , mWidth(FreeImage_GetWidth(bitmap))
+    , mHeight(FreeImage_GetHeight(bitmap))
+{}
+
+Image::~Image()
+{
+    FreeImage_Unload(mBitmap);
+}
+
+Image::SharedPtr Image::create(uint32_t width, uint32_t height)
+{
+    FIBITMAP* bitmap = FreeImage_AllocateT(FIT_RGBAF, width, height);
+    if (!bitmap) throw std::runtime_error("Cannot allocate image");
+    return SharedPtr(new Image(bitmap));
+}
+
+Image::SharedPtr Image::loadFromFile(const std::string& filename)
+{
+    FREE_IMAGE_FORMAT fifFormat = FIF_UNKNOWN;
+
+    // Determine file format.
+    fifFormat = FreeImage_GetFileType(filename.c_str(), 0);
+    if (fifFormat == FIF_UNKNOWN) fifFormat = FreeImage_GetFIFFromFilename(filename.c_str());
+    if (fifFormat == FIF_UNKNOWN) throw std::runtime_error("Unknown image format");
+    if (!FreeImage_FIFSupportsReading(fifFormat)) throw std::runtime_error("Unsupported image format");
+
+    // Read image.
+    FIBITMAP* bitmap = FreeImage_Load(fifFormat, filename.c_str());
+    if (!bitmap) throw std::runtime_error("Cannot read image");
+
+    // Keep the pixel format of the file if we can convert it per tile. Otherwise convert it once to RGBA32F.
+    if (!isNativeType(bitmap))
+    {
+        FIBITMAP* floatBitmap = FreeImage_ConvertToRGBAF(bitmap);
+        FreeImage_Unload(bitmap);
+        if (!floatBitmap) throw std::runtime_error("Cannot convert to RGBA float format");
+        bitmap = floatBitmap;
+    }
+
+    return SharedPtr(new Image(bitmap));
+}
+
+void Image::saveToFile(const std::string& filename, bool writeAlpha) const
+{
+    FREE_IMAGE_FORMAT fifFormat = FIF_UNKNOWN;
+
+    // Determine file format.
+    fifFormat = FreeImage_GetFIFFromFilename(filename.c_str());
+    if (fifFormat == FIF_UNKNOWN) throw std::runtime_error("Unknown image format");
+    if (!FreeImage_FIFSupportsWriting(fifFormat)) throw std::runtime_error("Unsupported image format");
+
+    bool writeFloat = fifFormat == FIF_EXR || fifFormat == FIF_PFM || fifFormat == FIF_HDR;
+    if (fifFormat != FIF_EXR || fifFormat != FIF_PNG) writeAlpha = false;
+
+    // Create bitmap.
+    FIBITMAP* bitmap;
+    std::unique_ptr<float[]> row = std::make_unique<float[]>(mWidth * 4);
+    if (writeFloat)
+    {
+        bitmap = FreeImage_AllocateT(writeAlpha ? FIT_RGBAF : FIT_RGBF, mWidth, mHeight);
+        for (uint32_t y = 0; y < mHeight; y++)
+        {
+            const float* src = row.get();
+            readRect(0, y, mWidth, 1, row.get());
+            float* dst = reinterpret_cast<float*>(FreeImage_GetScanLine(bitmap, mHeight - y - 1));
+            if (writeAlpha)
+            {
+                std::memcpy(dst, src, mWidth * 4 * sizeof(float));
+            }
+            else
+            {
+                for (uint32_t x = 0; x < mWidth; ++x)
+                {
+                    dst[0] = src[0];
+                    dst[1] = src[1];
+                    dst[2] = src[2];
+                    dst += 3;
+                    src += 4;
+                }
+            }
+        }
+    }
+    else
+    {
+        bitmap = FreeImage_Allocate(mWidth, mHeight, writeAlpha ? 32 : 24);
+        for (uint32_t y = 0; y < mHeight; y++)
+        {
+            const float* src = row.get();
+            readRect(0, y, mWidth, 1, row.get());
+            uint8_t* dst = reinterpret_cast<uint8_t*>(FreeImage_GetScanLine(bitmap, mHeight - y - 1));
+            for (uint32_t x = 0; x < mWidth; ++x)
+            {
+                dst[2] = clamp(int(src[0] * 255.f), 0, 255);
+                dst[1] = clamp(int(src[1] * 255.f), 0, 255);
+                dst[0] = clamp(int(src[2] * 255.f), 0, 255);
+                if (writeAlpha) dst[3] = clamp(int(src[3] * 255.f), 0, 255);
+                dst += writeAlpha ? 4 : 3;
+                src += 4;
+            }
+        }
+    }
+
+    // Write image.
+    FreeImage_Save(fifFormat, bitmap, filename.c_str());
+    FreeImage_Unload(bitmap);
+}
+
+void Image::readRect(uint32_t x, uint32_t y, uint32_t width, uint32_t height, float* dst) const
+{
+    assert(x + width <= mWidth && y + height <= mHeight);
+
+    const FREE_IMAGE_TYPE type = FreeImage_GetImageType(mBitmap);
+    const uint32_t bytesPerPixel = FreeImage_GetBPP(mBitmap) / 8;
+
+    for (uint32_t row = y; row < y + height; row++)
+    {
+        // FreeImage stores the bottom row first.
+        const BYTE* src = FreeImage_GetScanLine(mBitmap, mHeight - row - 1) + size_t(x) * bytesPerPixel;
+
+        switch (type)
+        {
+        case FIT_RGBAF:
+            std::memcpy(dst, src, width * 4 * sizeof(float));
+            dst += width * 4;
+            break;
+        case FIT_RGBF:
+            for (uint32_t i = 0; i < width; i++)
+            {
+                const FIRGBF* p = reinterpret_cast<const FIRGBF*>(src) + i;
+                *dst++ = p->red;
+                *dst++ = p->green;
+                *dst++ = p->blue;
+                *dst++ = 1.f;
+            }
+            break;
+        case FIT_FLOAT:
+            for (uint32_t i = 0; i < width; i++)
+            {
+                const float v = reinterpret_cast<const float*>(src)[i];
+                *dst++ = v;
+                *dst++ = v;
+                *dst++ = v;
+                *dst++ = 1.f;
+            }
+            break;
+        case FIT_RGBA16:
+            for (uint32_t i = 0; i < width; i++)
+            {
+                const FIRGBA16* p = reinterpret_cast<const FIRGBA16*>(src) + i;
+                *dst++ = p->red / 65535.f;
+                *dst++ = p->green / 65535.f;
+                *dst++ = p->blue / 65535.f;
+                *dst++ = p->alpha / 65535.f;
+            }
+            break;
+        case FIT_RGB16:
+            for (uint32_t i = 0; i < width; i++)
+            {
+                const FIRGB16* p = reinterpret_cast<const FIRGB16*>(src) + i;
+                *dst++ = p->red / 65535.f;
+                *dst++ = p->green / 65535.f;
+                *dst++ = p->blue / 65535.f;
+                *dst++ = 1.f;
+            }
+            break;
+        case FIT_UINT16:
+            for (uint32_t i = 0; i < width; i++)
+            {
+                const float v = reinterpret_cast<const uint16_t*>(src)[i] / 65535.f;
+                *dst++ = v;
+                *dst++ = v;
+                *dst++ = v;
+                *dst++ = 1.f;
+            }
+            break;
+        case FIT_BITMAP:
+            for (uint32_t i = 0; i < width; i++)
+            {
+                const BYTE* p = src + i * bytesPerPixel;
+                *dst++ = p[FI_RGBA_RED] / 255.f;
+                *dst++ = p[FI_RGBA_GREEN] / 255.f;
+                *dst++ = p[FI_RGBA_BLUE] / 255.f;
+                *dst++ = bytesPerPixel == 4 ? p[FI_RGBA_ALPHA] / 255.f : 1.f;
+            }
+            break;
+        default:
+            throw std::runtime_error("Unsupported bitmap type");
+        }
+    }
+}
+
+float* Image::getRGBARow(uint32_t y)
+{
+    assert(FreeImage_GetImageType(mBitmap) == FIT_RGBAF);
+    return reinterpret_cast<float*>(FreeImage_GetScanLine(mBitmap, mHeight - y - 1));
+}
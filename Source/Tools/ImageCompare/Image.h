@@ -0,0 +1,82 @@
+/***************************************************************************
+ # Copyright (c) 2020, NVIDIA CORPORATION. All rights reserved.
+ #
+ # Redistribution and use in source and binary forms, with or without
+ # modification, are permitted provided that the following conditions
+ # are met:
+ #  * Redistributions of source code must retain the above copyright
+ #    notice, this list of conditions and the following disclaimer.
+ #  * Redistributions in binary form must reproduce the above copyright
+ #    notice, this list of conditions and the following disclaimer in the
+ #    documentation and/or other materials provided with the distribution.
+ #  * Neither the name of NVIDIA CORPORATION nor the names of its
+ #    contributors may be used to endorse or promote products derived
+ #    from this software without specific prior written permission.
+ #
+ # THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ # EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ # IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ # PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ # CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ # EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ # PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ # PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ # OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ # (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ # OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **************************************************************************/
+#pragma once
+#include "FreeImage.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <algorithm>
+
+template<typename T>
+T sqr(T x) { return x * x; }
+
+template<typename T>
+T lerp(T a, T b, T t) { return a + t * (b - a); }
+
+template<typename T>
+T clamp(T x, T lo, T hi) { return std::max(lo, std::min(hi, x)); }
+
+/** An image in memory.
+    Loaded images keep the pixel format of the file. Pixels are converted to RGBA32F one rectangle at a time with readRect(),
+    so processing an image in tiles never needs a float copy of the whole image.
+*/
+class Image
+{
+public:
+    using SharedPtr = std::shared_ptr<Image>;
+
+    ~Image();
+
+    uint32_t getWidth() const { return mWidth; }
+    uint32_t getHeight() const { return mHeight; }
+
+    /** Create an RGBA32F image.
+    */
+    static SharedPtr create(uint32_t width, uint32_t height);
+
+    static SharedPtr loadFromFile(const std::string& filename);
+
+    void saveToFile(const std::string& filename, bool writeAlpha = true) const;
+
+    /** Read a rectangle of pixels, converted to RGBA32F.
+        \param[out] dst Destination, width * height * 4 floats. Rows are tightly packed, top row first.
+    */
+    void readRect(uint32_t x, uint32_t y, uint32_t width, uint32_t height, float* dst) const;
+
+    /** Get a row of pixels of an image created with create(). Row 0 is the top row.
+    */
+    float* getRGBARow(uint32_t y);
+
+private:
+    Image(FIBITMAP* bitmap);
+
+    FIBITMAP* mBitmap;
+    uint32_t mWidth;
+    uint32_t mHeight;
+};
@@ -26,245 +26,20 @@
  # OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  **************************************************************************/
 #include "args.h"
-#include "FreeImage.h"
+#include "Image.h"
+#include "ErrorMetrics.h"
+#include "BatchCompare.h"
 
 #include <iostream>
 #include <memory>
 #include <string>
 #include <vector>
 #include <stdexcept>
-#include <map>
-#include <functional>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
 
-template<typename T>
-T sqr(T x) { return x * x; }
-
-template<typename T>
-T lerp(T a, T b, T t) { return a + t * (b - a); }
-
-template<typename T>
-T clamp(T x, T lo, T hi) { return std::max(lo, std::min(hi, x)); }
-
-class Image
-{
-public:
-    using SharedPtr = std::shared_ptr<Image>;
-
-    uint32_t getWidth() const { return mWidth; }
-    uint32_t getHeight() const { return mHeight; }
-    const float* getData() const { return mData.get(); }
-    float* getData() { return mData.get(); }
-
-    static SharedPtr create(uint32_t width, uint32_t height) { return SharedPtr(new Image(width, height)); }
-
-    static SharedPtr loadFromFile(const std::string& filename)
-    {
-        FREE_IMAGE_FORMAT fifFormat = FIF_UNKNOWN;
-
-        // Determine file format.
-        fifFormat = FreeImage_GetFileType(filename.c_str(), 0);
-        if (fifFormat == FIF_UNKNOWN) fifFormat = FreeImage_GetFIFFromFilename(filename.c_str());
-        if (fifFormat == FIF_UNKNOWN) throw std::runtime_error("Unknown image format");
-        if (!FreeImage_FIFSupportsReading(fifFormat)) throw std::runtime_error("Unsupported image format");
-
-        // Read image.
-        FIBITMAP* srcBitmap = FreeImage_Load(fifFormat, filename.c_str());
-        if (!srcBitmap) throw std::runtime_error("Cannot read image");
-
-        // Convert to RGBA32F.
-        FIBITMAP* floatBitmap = FreeImage_ConvertToRGBAF(srcBitmap);
-        FreeImage_Unload(srcBitmap);
-        if (!floatBitmap) throw std::runtime_error("Cannot convert to RGBA float format");
-
-        // Create image.
-        auto image = create(FreeImage_GetWidth(floatBitmap), FreeImage_GetHeight(floatBitmap));
-        int bytesPerPixel = 4 * sizeof(float);
-        FreeImage_ConvertToRawBits(reinterpret_cast<BYTE*>(image->getData()), floatBitmap, bytesPerPixel * image->getWidth(), bytesPerPixel * 8, FI_RGBA_RED_MASK, FI_RGBA_GREEN_MASK, FI_RGBA_BLUE_MASK, true);
-        FreeImage_Unload(floatBitmap);
-
-        return image;
-    }
-
-    void saveToFile(const std::string& filename, bool writeAlpha = true) const
-    {
-        FREE_IMAGE_FORMAT fifFormat = FIF_UNKNOWN;
-
-        // Determine file format.
-        fifFormat = FreeImage_GetFIFFromFilename(filename.c_str());
-        if (fifFormat == FIF_UNKNOWN) throw std::runtime_error("Unknown image format");
-        if (!FreeImage_FIFSupportsWriting(fifFormat)) throw std::runtime_error("Unsupported image format");
-
-        bool writeFloat = fifFormat == FIF_EXR || fifFormat == FIF_PFM || fifFormat == FIF_HDR;
-        if (fifFormat != FIF_EXR || fifFormat != FIF_PNG) writeAlpha = false;
-
-        // Create bitmap.
-        FIBITMAP* bitmap;
-        const float* src = getData();
-        if (writeFloat)
-        {
-            bitmap = FreeImage_AllocateT(writeAlpha ? FIT_RGBAF : FIT_RGBF, mWidth, mHeight);
-            for (uint32_t y = 0; y < mHeight; y++)
-            {
-                float* dst = reinterpret_cast<float*>(FreeImage_GetScanLine(bitmap, mHeight - y - 1));
-                if (writeAlpha)
-                {
-                    std::memcpy(dst, src, mWidth * 4 * sizeof(float));
-                    src += mWidth * 4;
-                }
-                else
-                {
-                    for (uint32_t x = 0; x < mWidth; ++x)
-                    {
-                        dst[0] = src[0];
-                        dst[1] = src[1];
-                        dst[2] = src[2];
-                        dst += 3;
-                        src += 4;
-                    }
-                }
-            }
-        }
-        else
-        {
-            bitmap = FreeImage_Allocate(mWidth, mHeight, writeAlpha ? 32 : 24);
-            for (uint32_t y = 0; y < mHeight; y++)
-            {
-                uint8_t* dst = reinterpret_cast<uint8_t*>(FreeImage_GetScanLine(bitmap, mHeight - y - 1));
-                for (uint32_t x = 0; x < mWidth; ++x)
-                {
-                    dst[2] = clamp(int(src[0] * 255.f), 0, 255);
-                    dst[1] = clamp(int(src[1] * 255.f), 0, 255);
-                    dst[0] = clamp(int(src[2] * 255.f), 0, 255);
-                    if (writeAlpha) dst[3] = clamp(int(src[3] * 255.f), 0, 255);
-                    dst += writeAlpha ? 4 : 3;
-                    src += 4;
-                }
-            }
-        }
-
-        // Write image.
-        FreeImage_Save(fifFormat, bitmap, filename.c_str());
-        FreeImage_Unload(bitmap);
-    }
-
-private:
-    uint32_t mWidth;
-    uint32_t mHeight;
-    std::unique_ptr<float[]> mData;
-
-    Image(uint32_t width, uint32_t height)
-        : mWidth(width)
-        , mHeight(height)
-        , mData(std::make_unique<float[]>(width * height * 4))
-    {}
-};
-
-struct MSE
-{
-    double operator()(const float* a, const float* b, size_t count) const
-    {
-        double error = 0.0;
-        for (size_t i = 0; i < count; ++i) { error += sqr(a[i] - b[i]); }
-        return error / count;
-    }
-};
-
-struct RMSE
-{
-    double operator()(const float* a, const float* b, size_t count) const
-    {
-        double error = 0.0;
-        for (size_t i = 0; i < count; ++i) { error += sqr(a[i] - b[i]) / (sqr(a[i]) + 1e-3); }
-        return error / count;
-    }
-};
-
-struct MAE
-{
-    double operator()(const float* a, const float* b, size_t count) const
-    {
-        double error = 0.0;
-        for (size_t i = 0; i < count; ++i) { error += std::fabs(sqr(a[i] - b[i])); }
-        return error / count;
-    }
-};
-
-struct MAPE
-{
-    double operator()(const float* a, const float* b, size_t count) const
-    {
-        double error = 0.0;
-        for (size_t i = 0; i < count; ++i) { error += std::fabs((a[i] - b[i]) / (a[i] + 1e-3)); }
-        return 100.0 * error / count;
-    }
-};
-
-template<typename Metric>
-double compare(const Image& imageA, const Image& imageB, bool alpha, float* errorMap)
-{
-    Metric metric;
-    double sum = 0.0;
-    const float* a = imageA.getData();
-    const float* b = imageB.getData();
-    size_t count = imageA.getWidth() * imageA.getHeight();
-    for (size_t i = 0; i < count; ++i)
-    {
-        double error = metric(a, b, alpha ? 4 : 3);
-        if (errorMap) *errorMap++ = float(error);
-        sum += error;
-        a += 4;
-        b += 4;
-    }
-    return sum / count;
-}
-
-struct ErrorMetric
-{
-    std::string name;
-    std::string desc;
-    std::function<double(const Image& imageA, const Image& imageB, bool alpha, float* errorMap)> compare;
-};
-
-static const std::vector<ErrorMetric> errorMetrics =
-{
-    { "mse", "Mean Squared Error", compare<MSE> },
-    { "rmse", "Relative Mean Squared Error", compare<RMSE> },
-    { "mae", "Mean Absolute Error", compare<MAE> },
-    { "mape", "Mean Absolute Percentage Error", compare<MAPE> },
-};
-
-static Image::SharedPtr generateHeatMap(uint32_t width, uint32_t height, const float* errorMap)
-{
-    auto writeColor = [] (float t, float* dst)
-    {
-        static const float colors[5][3] = {
-            { 0.f, 0.f, 1.f },
-            { 0.f, 1.f, 1.f },
-            { 0.f, 1.f, 0.f },
-            { 1.f, 1.f, 0.f },
-            { 1.f, 0.f, 0.f },
-        };
-
-        int c = clamp(int(std::floor(t * 4.f)), 0, 3);
-        for (size_t i = 0; i < 3; ++i) *dst++ = lerp(colors[c][i], colors[c + 1][i], t * 4.f - c);
-        *dst++ = 1.f;
-    };
-
-    const auto [minValue, maxValue] = std::minmax_element(errorMap, errorMap + width * height);
-    const float range = std::max(1e-5f, *maxValue - *minValue);
-    auto image = Image::create(width, height);
-    float* dst = image->getData();
-    for (size_t i = 0; i < width * height; ++i)
-    {
-        float t = clamp((errorMap[i] - *minValue) / range, 0.f, 1.f);
-        writeColor(t, dst);
-        dst += 4;
-    }
-
-    return image;
-}
-
-static bool compareImages(const std::string& filenameA, const std::string& filenameB, ErrorMetric metric, float threshold, bool alpha, const std::string& heatMapFilename)
+static bool compareImages(const std::string& filenameA, const std::string& filenameB, ErrorMetric metric, float threshold, bool alpha, const std::string& heatMapFilename, uint32_t benchmarkIterations)
 {
     auto loadImage = [] (const std::string& filename)
     {
@@ -308,9 +83,21 @@ static bool compareImages(const std::string& filenameA, const std::string& filen
     uint32_t height = imageB->getHeight();
 
     // Compare images.
-    std::unique_ptr<float[]> errorMap = heatMapFilename.empty() ? nullptr : std::make_unique<float[]>(width * height);
+    std::unique_ptr<float[]> errorMap = heatMapFilename.empty() ? nullptr : std::make_unique<float[]>(size_t(width) * height);
     double error = metric.compare(*imageA, *imageB, alpha, errorMap.get());
 
+    // Measure comparison throughput. Loading and saving images is not included.
+    if (benchmarkIterations > 0)
+    {
+        auto start = std::chrono::high_resolution_clock::now();
+        for (uint32_t i = 0; i < benchmarkIterations; ++i) metric.compare(*imageA, *imageB, alpha, errorMap.get());
+        auto end = std::chrono::high_resolution_clock::now();
+
+        double seconds = std::chrono::duration<double>(end - start).count();
+        double pixels = double(width) * double(height) * benchmarkIterations;
+        std::cerr << "Benchmark: " << benchmarkIterations << " iterations, " << (1000.0 * seconds / benchmarkIterations) << " ms/iteration, " << (pixels / seconds * 1e-9) << " GPix/s" << std::endl;
+    }
+
     // Generate heat map.
     if (errorMap)
     {
@@ -326,10 +113,32 @@ static bool compareImages(const std::string& filenameA, const std::string& filen
     return error <= threshold;
 }
 
+static bool runBatch(const std::vector<ComparePair>& pairs, const BatchOptions& options, const std::string& reportFilename)
+{
+    auto results = compareBatch(pairs, options);
+
+    size_t passedCount = 0;
+    for (const auto& result : results)
+    {
+        if (result.passed) passedCount++;
+        else if (!result.message.empty()) std::cerr << result.pair.name << ": " << result.message << "." << std::endl;
+        else std::cerr << result.pair.name << ": error " << result.error << " exceeds threshold " << result.threshold << "." << std::endl;
+    }
+    std::cout << passedCount << " of " << results.size() << " image pairs passed." << std::endl;
+
+    if (!reportFilename.empty() && !writeReport(reportFilename, results, options))
+    {
+        std::cerr << "Cannot write report to '" << reportFilename << "'." << std::endl;
+        return false;
+    }
+
+    return passedCount == results.size();
+}
+
 static void printMetrics(std::ostream &stream = std::cout)
 {
     stream << "Available error metrics:" << std::endl;
-    for (const auto& metric : errorMetrics)
+    for (const auto& metric : getErrorMetrics())
     {
         stream << "  " << metric.name << " - " << metric.desc << std::endl;
     }
@@ -344,9 +153,13 @@ int main(int argc, char** argv)
     args::ValueFlag<std::string> metricFlag(parser, "metric", "The error metric.", {'m'});
     args::ValueFlag<float> thresholdFlag(parser, "threshold", "The error threshold.", {'t'});
     args::Flag alphaFlag(parser, "", "Include alpha channel.", {'a'});
-    args::ValueFlag<std::string> heatMapFlag(parser, "filename", "Generate error heat map.", {'e'});
-    args::Positional<std::string> image1(parser, "image1", "The first image.", args::Options::Required);
-    args::Positional<std::string> image2(parser, "image2", "The second image.", args::Options::Required);
+    args::ValueFlag<std::string> heatMapFlag(parser, "filename", "Generate error heat map. In batch mode, the directory for heat maps of failing pairs.", {'e'});
+    args::ValueFlag<uint32_t> benchmarkFlag(parser, "iterations", "Repeat the comparison and report its throughput.", {'b', "benchmark"});
+    args::ValueFlag<std::string> manifestFlag(parser, "filename", "Batch mode: compare the pairs of images listed in a manifest.", {"manifest"});
+    args::ValueFlag<std::string> reportFlag(parser, "filename", "Batch mode: write a JSON report, or CSV if the extension is .csv.", {'r', "report"});
+    args::ValueFlag<uint32_t> jobsFlag(parser, "count", "Batch mode: maximum number of image pairs decoded at the same time (default 4).", {'j', "jobs"});
+    args::Positional<std::string> image1(parser, "image1", "The first image, or directory for batch mode.");
+    args::Positional<std::string> image2(parser, "image2", "The second image, or directory for batch mode.");
     args::CompletionFlag completionFlag(parser, {"complete"});
 
     try
@@ -382,6 +195,7 @@ int main(int argc, char** argv)
         return 0;
     }
 
+    const auto& errorMetrics = getErrorMetrics();
     ErrorMetric metric = errorMetrics.front();
     if (metricFlag)
     {
@@ -396,12 +210,45 @@ int main(int argc, char** argv)
         metric = *it;
     }
 
+    // Batch mode compares a manifest or two directories of images.
+    bool compareDirectories = image1 && image2 && std::filesystem::is_directory(args::get(image1)) && std::filesystem::is_directory(args::get(image2));
+    if (manifestFlag || compareDirectories)
+    {
+        BatchOptions options;
+        options.metric = metric;
+        options.threshold = thresholdFlag ? args::get(thresholdFlag) : 0.f;
+        options.alpha = alphaFlag ? args::get(alphaFlag) : false;
+        options.heatMapDirectory = heatMapFlag ? args::get(heatMapFlag) : "";
+        if (jobsFlag) options.maxInFlight = std::max(1u, args::get(jobsFlag));
+
+        std::vector<ComparePair> pairs;
+        try
+        {
+            pairs = manifestFlag ? loadManifest(args::get(manifestFlag)) : findImagePairs(args::get(image1), args::get(image2));
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << e.what() << "." << std::endl;
+            return 1;
+        }
+
+        return runBatch(pairs, options, reportFlag ? args::get(reportFlag) : "") ? 0 : 1;
+    }
+
+    if (!image1 || !image2)
+    {
+        std::cerr << "Two images are required." << std::endl;
+        std::cerr << parser;
+        return 1;
+    }
+
     return compareImages(
         args::get(image1),
         args::get(image2),
         metric,
         thresholdFlag ? args::get(thresholdFlag) : 0.f,
         alphaFlag ? args::get(alphaFlag) : false,
-        heatMapFlag ? args::get(heatMapFlag) : ""
+        heatMapFlag ? args::get(heatMapFlag) : "",
+        benchmarkFlag ? args::get(benchmarkFlag) : 0
     ) ? 0 : 1;
 }
@@ -0,0 +1,196 @@
+/***************************************************************************
+ # Copyright (c) 2020, NVIDIA CORPORATION. All rights reserved.
+ #
+ # Redistribution and use in source and binary forms, with or without
+ # modification, are permitted provided that the following conditions
+ # are met:
+ #  * Redistributions of source code must retain the above copyright
+ #    notice, this list of conditions and the following disclaimer.
+ #  * Redistributions in binary form must reproduce the above copyright
+ #    notice, this list of conditions and the following disclaimer in the
+ #    documentation and/or other materials provided with the distribution.
+ #  * Neither the name of NVIDIA CORPORATION nor the names of its
+ #    contributors may be used to endorse or promote products derived
+ #    from this software without specific prior written permission.
+ #
+ # THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ # EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ # IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ # PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ # CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ # EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ # PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ # PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ # OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ # (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ # OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **************************************************************************/
+#include "ImageFilter.h"
+
+#include <cmath>
+#include <numeric>
+#include <algorithm>
+#include <execution>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#define IMAGE_FILTER_USE_SSE 1
+#include <emmintrin.h>
+#else
+#define IMAGE_FILTER_USE_SSE 0
+#endif
+
+namespace
+{
+    const uint32_t kRowsPerBand = 16;
+
+    /** Horizontal pass over one row. The source row is padded by the kernel radius on both sides.
+    */
+    void convolveRow(const float* paddedSrc, float* dst, uint32_t width, const std::vector<float>& kernel)
+    {
+        const uint32_t taps = (uint32_t)kernel.size();
+        uint32_t x = 0;
+#if IMAGE_FILTER_USE_SSE
+        for (; x + 4 <= width; x += 4)
+        {
+            __m128 acc = _mm_setzero_ps();
+            for (uint32_t k = 0; k < taps; ++k)
+            {
+                acc = _mm_add_ps(acc, _mm_mul_ps(_mm_set1_ps(kernel[k]), _mm_loadu_ps(paddedSrc + x + k)));
+            }
+            _mm_storeu_ps(dst + x, acc);
+        }
+#endif
+        for (; x < width; ++x)
+        {
+            float acc = 0.f;
+            for (uint32_t k = 0; k < taps; ++k) acc += kernel[k] * paddedSrc[x + k];
+            dst[x] = acc;
+        }
+    }
+
+    /** Vertical pass for one output row.
+        \param[in] rows Source rows for each kernel tap.
+    */
+    void convolveColumns(const float* const* rows, float* dst, uint32_t width, const std::vector<float>& kernel)
+    {
+        const uint32_t taps = (uint32_t)kernel.size();
+        uint32_t x = 0;
+#if IMAGE_FILTER_USE_SSE
+        for (; x + 4 <= width; x += 4)
+        {
+            __m128 acc = _mm_setzero_ps();
+            for (uint32_t k = 0; k < taps; ++k)
+            {
+                acc = _mm_add_ps(acc, _mm_mul_ps(_mm_set1_ps(kernel[k]), _mm_loadu_ps(rows[k] + x)));
+            }
+            _mm_storeu_ps(dst + x, acc);
+        }
+#endif
+        for (; x < width; ++x)
+        {
+            float acc = 0.f;
+            for (uint32_t k = 0; k < taps; ++k) acc += kernel[k] * rows[k][x];
+            dst[x] = acc;
+        }
+    }
+}
+
+uint32_t getRowBandCount(uint32_t height)
+{
+    return (height + kRowsPerBand - 1) / kRowsPerBand;
+}
+
+uint32_t parallelForRows(uint32_t height, const std::function<void(uint32_t band, uint32_t y0, uint32_t y1)>& func)
+{
+    const uint32_t bandCount = getRowBandCount(height);
+    std::vector<uint32_t> bands(bandCount);
+    std::iota(bands.begin(), bands.end(), 0);
+    std::for_each(std::execution::par, bands.begin(), bands.end(), [&] (uint32_t band)
+    {
+        uint32_t y0 = band * kRowsPerBand;
+        func(band, y0, std::min(height, y0 + kRowsPerBand));
+    });
+    return bandCount;
+}
+
+double pairwiseSum(const double* values, size_t count)
+{
+    if (count == 0) return 0.0;
+    if (count == 1) return values[0];
+    size_t half = count / 2;
+    return pairwiseSum(values, half) + pairwiseSum(values + half, count - half);
+}
+
+void convolveSeparable(const Plane& src, Plane& dst, const std::vector<float>& kernelX, const std::vector<float>& kernelY)
+{
+    const uint32_t width = src.width;
+    const uint32_t height = src.height;
+    const int32_t radiusX = int32_t(kernelX.size() / 2);
+    const int32_t radiusY = int32_t(kernelY.size() / 2);
+
+    // Horizontal pass.
+    Plane tmp(width, height);
+    parallelForRows(height, [&] (uint32_t, uint32_t y0, uint32_t y1)
+    {
+        thread_local std::vector<float> padded;
+        padded.resize(width + 2 * radiusX);
+        for (uint32_t y = y0; y < y1; ++y)
+        {
+            const float* row = src.getRow(y);
+            std::fill(padded.begin(), padded.begin() + radiusX, row[0]);
+            std::copy(row, row + width, padded.begin() + radiusX);
+            std::fill(padded.begin() + radiusX + width, padded.end(), row[width - 1]);
+            convolveRow(padded.data(), tmp.getRow(y), width, kernelX);
+        }
+    });
+
+    // Vertical pass.
+    dst = Plane(width, height);
+    parallelForRows(height, [&] (uint32_t, uint32_t y0, uint32_t y1)
+    {
+        thread_local std::vector<const float*> rows;
+        rows.resize(kernelY.size());
+        for (uint32_t y = y0; y < y1; ++y)
+        {
+            for (int32_t k = 0; k < (int32_t)kernelY.size(); ++k)
+            {
+                int32_t sy = std::clamp(int32_t(y) + k - radiusY, 0, int32_t(height) - 1);
+                rows[k] = tmp.getRow(sy);
+            }
+            convolveColumns(rows.data(), dst.getRow(y), width, kernelY);
+        }
+    });
+}
+
+Plane downsample2x(const Plane& src)
+{
+    Plane dst(src.width / 2, src.height / 2);
+    parallelForRows(dst.height, [&] (uint32_t, uint32_t y0, uint32_t y1)
+    {
+        for (uint32_t y = y0; y < y1; ++y)
+        {
+            const float* row0 = src.getRow(2 * y);
+            const float* row1 = src.getRow(2 * y + 1);
+            float* dstRow = dst.getRow(y);
+            for (uint32_t x = 0; x < dst.width; ++x)
+            {
+                dstRow[x] = 0.25f * (row0[2 * x] + row0[2 * x + 1] + row1[2 * x] + row1[2 * x + 1]);
+            }
+        }
+    });
+    return dst;
+}
+
+std::vector<float> createGaussianKernel(float sigma, uint32_t radius)
+{
+    std::vector<float> kernel(2 * radius + 1);
+    float sum = 0.f;
+    for (int32_t i = -(int32_t)radius; i <= (int32_t)radius; ++i)
+    {
+        float w = std::exp(-float(i * i) / (2.f * sigma * sigma));
+        kernel[i + radius] = w;
+        sum += w;
+    }
+    for (auto& w : kernel) w /= sum;
+    return kernel;
+}
@@ -0,0 +1,78 @@
+/***************************************************************************
+ # Copyright (c) 2020, NVIDIA CORPORATION. All rights reserved.
+ #
+ # Redistribution and use in source and binary forms, with or without
+ # modification, are permitted provided that the following conditions
+ # are met:
+ #  * Redistributions of source code must retain the above copyright
+ #    notice, this list of conditions and the following disclaimer.
+ #  * Redistributions in binary form must reproduce the above copyright
+ #    notice, this list of conditions and the following disclaimer in the
+ #    documentation and/or other materials provided with the distribution.
+ #  * Neither the name of NVIDIA CORPORATION nor the names of its
+ #    contributors may be used to endorse or promote products derived
+ #    from this software without specific prior written permission.
+ #
+ # THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ # EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ # IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ # PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ # CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ # EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ # PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ # PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ # OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ # (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ # OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **************************************************************************/
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <functional>
+
+/** Single channel float image, top row first.
+*/
+struct Plane
+{
+    uint32_t width = 0;
+    uint32_t height = 0;
+    std::vector<float> data;
+
+    Plane() = default;
+    Plane(uint32_t width, uint32_t height) : width(width), height(height), data(size_t(width) * height) {}
+
+    float* getRow(uint32_t y) { return data.data() + size_t(y) * width; }
+    const float* getRow(uint32_t y) const { return data.data() + size_t(y) * width; }
+};
+
+/** Run a function over bands of rows in parallel.
+    \param[in] func Called with the first row and one past the last row of each band.
+    \return Number of bands. Bands are numbered top to bottom, which allows callers to store per-band results.
+*/
+uint32_t parallelForRows(uint32_t height, const std::function<void(uint32_t band, uint32_t y0, uint32_t y1)>& func);
+
+/** Get the number of bands parallelForRows() splits the given height into.
+*/
+uint32_t getRowBandCount(uint32_t height);
+
+/** Pairwise summation. The order of additions only depends on the count, so results are deterministic.
+*/
+double pairwiseSum(const double* values, size_t count);
+
+/** Convolve a plane with a separable kernel. Pixels outside the plane are clamped to the edge.
+    \param[in] src Source plane.
+    \param[out] dst Destination plane. Resized to the size of the source. Must not alias the source.
+    \param[in] kernelX Horizontal kernel with an odd number of taps.
+    \param[in] kernelY Vertical kernel with an odd number of taps.
+*/
+void convolveSeparable(const Plane& src, Plane& dst, const std::vector<float>& kernelX, const std::vector<float>& kernelY);
+
+/** Downsample a plane by 2x2 box filtering. Odd trailing rows and columns are dropped.
+*/
+Plane downsample2x(const Plane& src);
+
+/** Create a normalized Gaussian kernel.
+    \param[in] sigma Standard deviation in pixels.
+    \param[in] radius Kernel radius. The kernel has 2 * radius + 1 taps.
+*/
+std::vector<float> createGaussianKernel(float sigma, uint32_t radius);
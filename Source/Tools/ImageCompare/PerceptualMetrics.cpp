@@ -0,0 +1,450 @@
+/***************************************************************************
+ # Copyright (c) 2020, NVIDIA CORPORATION. All rights reserved.
+ #
+ # Redistribution and use in source and binary forms, with or without
+ # modification, are permitted provided that the following conditions
+ # are met:
+ #  * Redistributions of source code must retain the above copyright
+ #    notice, this list of conditions and the following disclaimer.
+ #  * Redistributions in binary form must reproduce the above copyright
+ #    notice, this list of conditions and the following disclaimer in the
+ #    documentation and/or other materials provided with the distribution.
+ #  * Neither the name of NVIDIA CORPORATION nor the names of its
+ #    contributors may be used to endorse or promote products derived
+ #    from this software without specific prior written permission.
+ #
+ # THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY
+ # EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ # IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ # PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ # CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ # EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ # PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ # PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+ # OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ # (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ # OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ **************************************************************************/
+#include "PerceptualMetrics.h"
+#include "ImageFilter.h"
+
+#include <cmath>
+#include <array>
+#include <algorithm>
+
+namespace
+{
+    const float kPi = 3.14159265358979f;
+
+    // SSIM parameters for a dynamic range of 1.
+    const float kSSIMSigma = 1.5f;
+    const uint32_t kSSIMRadius = 5;
+    const float kSSIMC1 = 0.01f * 0.01f;
+    const float kSSIMC2 = 0.03f * 0.03f;
+    const std::array<double, 5> kMSSSIMWeights = { 0.0448, 0.2856, 0.3001, 0.2363, 0.1333 };
+
+    // FLIP parameters.
+    const float kFLIPPixelsPerDegree = 67.f;
+    const float kFLIPQc = 0.7f;
+    const float kFLIPQf = 0.5f;
+    const float kFLIPPc = 0.4f;
+    const float kFLIPPt = 0.95f;
+    const float kFLIPFeatureWidth = 0.082f;
+
+    /** Read the images into planes, converting each pixel with a function.
+    */
+    template<size_t N, typename Func>
+    void readPlanes(const Image& image, std::array<Plane, N>& planes, Func func)
+    {
+        const uint32_t width = image.getWidth();
+        const uint32_t height = image.getHeight();
+        for (auto& plane : planes) plane = Plane(width, height);
+
+        parallelForRows(height, [&] (uint32_t, uint32_t y0, uint32_t y1)
+        {
+            thread_local std::vector<float> rows;
+            rows.resize(size_t(width) * (y1 - y0) * 4);
+            image.readRect(0, y0, width, y1 - y0, rows.data());
+            const float* src = rows.data();
+            for (uint32_t y = y0; y < y1; ++y)
+            {
+                for (uint32_t x = 0; x < width; ++x)
+                {
+                    std::array<float, N> values = func(src[0], src[1], src[2]);
+                    for (size_t i = 0; i < N; ++i) planes[i].getRow(y)[x] = values[i];
+                    src += 4;
+                }
+            }
+        });
+    }
+
+    float luminance(float r, float g, float b)
+    {
+        return 0.2126f * r + 0.7152f * g + 0.0722f * b;
+    }
+
+    /** Compute SSIM at one scale.
+        \param[out] ssimMap Optional per-pixel SSIM.
+        \param[out] meanSSIM Mean SSIM.
+        \param[out] meanCS Mean contrast-structure term.
+    */
+    void computeSSIM(const Plane& a, const Plane& b, Plane* ssimMap, double& meanSSIM, double& meanCS)
+    {
+        const uint32_t width = a.width;
+        const uint32_t height = a.height;
+        const auto kernel = createGaussianKernel(kSSIMSigma, kSSIMRadius);
+
+        Plane aa(width, height), bb(width, height), ab(width, height);
+        parallelForRows(height, [&] (uint32_t, uint32_t y0, uint32_t y1)
+        {
+            for (size_t i = size_t(y0) * width; i < size_t(y1) * width; ++i)
+            {
+                aa.data[i] = a.data[i] * a.data[i];
+                bb.data[i] = b.data[i] * b.data[i];
+                ab.data[i] = a.data[i] * b.data[i];
+            }
+        });
+
+        Plane muA, muB, sigmaAA, sigmaBB, sigmaAB;
+        convolveSeparable(a, muA, kernel, kernel);
+        convolveSeparable(b, muB, kernel, kernel);
+        convolveSeparable(aa, sigmaAA, kernel, kernel);
+        convolveSeparable(bb, sigmaBB, kernel, kernel);
+        convolveSeparable(ab, sigmaAB, kernel, kernel);
+
+        std::vector<double> ssimSums(getRowBandCount(height));
+        std::vector<double> csSums(ssimSums.size());
+        parallelForRows(height, [&] (uint32_t band, uint32_t y0, uint32_t y1)
+        {
+            double ssimSum = 0.0;
+            double csSum = 0.0;
+            for (uint32_t y = y0; y < y1; ++y)
+            {
+                size_t offset = size_t(y) * width;
+                for (uint32_t x = 0; x < width; ++x)
+                {
+                    size_t i = offset + x;
+                    float ma = muA.data[i];
+                    float mb = muB.data[i];
+                    float vaa = sigmaAA.data[i] - ma * ma;
+                    float vbb = sigmaBB.data[i] - mb * mb;
+                    float vab = sigmaAB.data[i] - ma * mb;
+                    float cs = (2.f * vab + kSSIMC2) / (vaa + vbb + kSSIMC2);
+                    float ssim = (2.f * ma * mb + kSSIMC1) / (ma * ma + mb * mb + kSSIMC1) * cs;
+                    if (ssimMap) ssimMap->data[i] = ssim;
+                    ssimSum += ssim;
+                    csSum += cs;
+                }
+            }
+            ssimSums[band] = ssimSum;
+            csSums[band] = csSum;
+        });
+
+        const double count = double(width) * height;
+        meanSSIM = pairwiseSum(ssimSums.data(), ssimSums.size()) / count;
+        meanCS = pairwiseSum(csSums.data(), csSums.size()) / count;
+    }
+
+    void writeErrorMap(const Plane& ssimMap, float* errorMap)
+    {
+        for (size_t i = 0; i < ssimMap.data.size(); ++i) errorMap[i] = 1.f - ssimMap.data[i];
+    }
+
+    // Color conversions for FLIP. Linear RGB uses sRGB primaries and the reference white is RGB (1,1,1).
+
+    const std::array<float, 3> kWhiteXYZ = { 0.950456f, 1.f, 1.088754f };
+
+    std::array<float, 3> linearRGBToXYZ(float r, float g, float b)
+    {
+        return {
+            0.4124564f * r + 0.3575761f * g + 0.1804375f * b,
+            0.2126729f * r + 0.7151522f * g + 0.0721750f * b,
+            0.0193339f * r + 0.1191920f * g + 0.9503041f * b,
+        };
+    }
+
+    std::array<float, 3> XYZToLinearRGB(float x, float y, float z)
+    {
+        return {
+            3.2404542f * x - 1.5371385f * y - 0.4985314f * z,
+            -0.9692660f * x + 1.8760108f * y + 0.0415560f * z,
+            0.0556434f * x - 0.2040259f * y + 1.0572252f * z,
+        };
+    }
+
+    std::array<float, 3> linearRGBToYCxCz(float r, float g, float b)
+    {
+        auto xyz = linearRGBToXYZ(r, g, b);
+        float yn = xyz[1] / kWhiteXYZ[1];
+        return { 116.f * yn - 16.f, 500.f * (xyz[0] / kWhiteXYZ[0] - yn), 200.f * (yn - xyz[2] / kWhiteXYZ[2]) };
+    }
+
+    std::array<float, 3> YCxCzToLinearRGB(float y, float cx, float cz)
+    {
+        float yn = (y + 16.f) / 116.f;
+        float xn = cx / 500.f + yn;
+        float zn = yn - cz / 200.f;
+        return XYZToLinearRGB(xn * kWhiteXYZ[0], yn * kWhiteXYZ[1], zn * kWhiteXYZ[2]);
+    }
+
+    /** Convert linear RGB to Hunt-adjusted L*a*b*.
+    */
+    std::array<float, 3> linearRGBToHuntLab(float r, float g, float b)
+    {
+        auto f = [] (float t)
+        {
+            const float delta = 6.f / 29.f;
+            return t > delta * delta * delta ? std::cbrt(t) : t / (3.f * delta * delta) + 4.f / 29.f;
+        };
+        auto xyz = linearRGBToXYZ(r, g, b);
+        float fx = f(xyz[0] / kWhiteXYZ[0]);
+        float fy = f(xyz[1] / kWhiteXYZ[1]);
+        float fz = f(xyz[2] / kWhiteXYZ[2]);
+        float L = 116.f * fy - 16.f;
+        return { L, 0.01f * L * 500.f * (fx - fy), 0.01f * L * 200.f * (fy - fz) };
+    }
+
+    float HyAB(const std::array<float, 3>& a, const std::array<float, 3>& b)
+    {
+        return std::fabs(a[0] - b[0]) + std::sqrt(sqr(a[1] - b[1]) + sqr(a[2] - b[2]));
+    }
+
+    /** Create the 1D factors of a FLIP contrast sensitivity Gaussian a * pi / b * exp(-pi^2 * (x^2 + y^2) / b), with x and y in degrees.
+    */
+    std::vector<float> createCSFKernel(float a, float b, uint32_t radius)
+    {
+        std::vector<float> kernel(2 * radius + 1);
+        for (int32_t i = -(int32_t)radius; i <= (int32_t)radius; ++i)
+        {
+            float x = i / kFLIPPixelsPerDegree;
+            kernel[i + radius] = std::sqrt(a * kPi / b) * std::exp(-kPi * kPi * x * x / b);
+        }
+        return kernel;
+    }
+
+    /** Filter a plane with the sum of up to two separable CSF Gaussians, normalized to unit sum.
+    */
+    void applyCSF(const Plane& src, Plane& dst, float a1, float b1, float a2, float b2)
+    {
+        const float maxB = std::max(b1, b2);
+        const uint32_t radius = (uint32_t)std::ceil(3.f * std::sqrt(maxB / (2.f * kPi * kPi)) * kFLIPPixelsPerDegree);
+
+        auto kernel1 = createCSFKernel(a1, b1, radius);
+        float sum1 = 0.f;
+        for (float w : kernel1) sum1 += w;
+        float sum = sum1 * sum1;
+
+        std::vector<float> kernel2;
+        if (a2 > 0.f)
+        {
+            kernel2 = createCSFKernel(a2, b2, radius);
+            float sum2 = 0.f;
+            for (float w : kernel2) sum2 += w;
+            sum += sum2 * sum2;
+        }
+
+        const float scale = 1.f / std::sqrt(sum);
+        for (auto& w : kernel1) w *= scale;
+        convolveSeparable(src, dst, kernel1, kernel1);
+
+        if (!kernel2.empty())
+        {
+            for (auto& w : kernel2) w *= scale;
+            Plane dst2;
+            convolveSeparable(src, dst2, kernel2, kernel2);
+            for (size_t i = 0; i < dst.data.size(); ++i) dst.data[i] += dst2.data[i];
+        }
+    }
+
+    struct FeatureKernels
+    {
+        std::vector<float> gaussian;
+        std::vector<float> edge;
+        std::vector<float> point;
+    };
+
+    FeatureKernels createFeatureKernels()
+    {
+        const float sigma = 0.5f * kFLIPFeatureWidth * kFLIPPixelsPerDegree;
+        const uint32_t radius = (uint32_t)std::ceil(3.f * sigma);
+
+        FeatureKernels kernels;
+        kernels.gaussian.resize(2 * radius + 1);
+        kernels.edge.resize(2 * radius + 1);
+        kernels.point.resize(2 * radius + 1);
+        for (int32_t i = -(int32_t)radius; i <= (int32_t)radius; ++i)
+        {
+            float x = float(i);
+            float g = std::exp(-x * x / (2.f * sigma * sigma));
+            kernels.gaussian[i + radius] = g;
+            kernels.edge[i + radius] = -x * g;
+            kernels.point[i + radius] = (x * x / (sigma * sigma) - 1.f) * g;
+        }
+
+        // Normalize the Gaussian to unit sum, and the positive and negative weights of the derivatives to sum to 1 and -1.
+        float sum = 0.f;
+        for (float w : kernels.gaussian) sum += w;
+        for (auto& w : kernels.gaussian) w /= sum;
+
+        for (auto kernel : { &kernels.edge, &kernels.point })
+        {
+            float positive = 0.f, negative = 0.f;
+            for (float w : *kernel) (w > 0.f ? positive : negative) += w;
+            for (auto& w : *kernel) w = w > 0.f ? w / positive : w / -negative;
+        }
+
+        return kernels;
+    }
+
+    /** Color and feature planes of one image for FLIP.
+    */
+    struct FLIPPlanes
+    {
+        std::array<Plane, 3> color;     ///< CSF filtered YCxCz.
+        Plane edgeMagnitude;
+        Plane pointMagnitude;
+    };
+
+    FLIPPlanes prepareFLIP(const Image& image, const FeatureKernels& featureKernels)
+    {
+        // Split the image into YCxCz and normalized luminance.
+        std::array<Plane, 4> planes;
+        readPlanes(image, planes, [] (float r, float g, float b)
+        {
+            r = clamp(r, 0.f, 1.f);
+            g = clamp(g, 0.f, 1.f);
+            b = clamp(b, 0.f, 1.f);
+            auto ycxcz = linearRGBToYCxCz(r, g, b);
+            return std::array<float, 4>{ ycxcz[0], ycxcz[1], ycxcz[2], (ycxcz[0] + 16.f) / 116.f };
+        });
+
+        FLIPPlanes result;
+
+        // Spatial filtering with the contrast sensitivity functions of the achromatic, red-green and blue-yellow channels.
+        applyCSF(planes[0], result.color[0], 1.f, 0.0047f, 0.f, 1e-5f);
+        applyCSF(planes[1], result.color[1], 1.f, 0.0053f, 0.f, 1e-5f);
+        applyCSF(planes[2], result.color[2], 34.1f, 0.04f, 13.5f, 0.025f);
+
+        // Edge and point detection on the luminance.
+        Plane dx, dy;
+        const Plane& y = planes[3];
+        convolveSeparable(y, dx, featureKernels.edge, featureKernels.gaussian);
+        convolveSeparable(y, dy, featureKernels.gaussian, featureKernels.edge);
+        result.edgeMagnitude = Plane(y.width, y.height);
+        for (size_t i = 0; i < dx.data.size(); ++i) result.edgeMagnitude.data[i] = std::sqrt(dx.data[i] * dx.data[i] + dy.data[i] * dy.data[i]);
+
+        convolveSeparable(y, dx, featureKernels.point, featureKernels.gaussian);
+        convolveSeparable(y, dy, featureKernels.gaussian, featureKernels.point);
+        result.pointMagnitude = Plane(y.width, y.height);
+        for (size_t i = 0; i < dx.data.size(); ++i) result.pointMagnitude.data[i] = std::sqrt(dx.data[i] * dx.data[i] + dy.data[i] * dy.data[i]);
+
+        return result;
+    }
+}
+
+double compareSSIM(const Image& imageA, const Image& imageB, bool alpha, float* errorMap)
+{
+    std::array<Plane, 1> a, b;
+    auto toLuminance = [] (float r, float g, float b) { return std::array<float, 1>{ luminance(r, g, b) }; };
+    readPlanes(imageA, a, toLuminance);
+    readPlanes(imageB, b, toLuminance);
+
+    Plane ssimMap;
+    if (errorMap) ssimMap = Plane(a[0].width, a[0].height);
+
+    double meanSSIM, meanCS;
+    computeSSIM(a[0], b[0], errorMap ? &ssimMap : nullptr, meanSSIM, meanCS);
+    if (errorMap) writeErrorMap(ssimMap, errorMap);
+
+    return 1.0 - meanSSIM;
+}
+
+double compareMSSSIM(const Image& imageA, const Image& imageB, bool alpha, float* errorMap)
+{
+    std::array<Plane, 1> a, b;
+    auto toLuminance = [] (float r, float g, float b) { return std::array<float, 1>{ luminance(r, g, b) }; };
+    readPlanes(imageA, a, toLuminance);
+    readPlanes(imageB, b, toLuminance);
+
+    Plane ssimMap;
+    if (errorMap) ssimMap = Plane(a[0].width, a[0].height);
+
+    // Use as many scales as the image size allows and renormalize the weights.
+    const uint32_t minSize = 2 * kSSIMRadius + 1;
+    size_t scaleCount = 1;
+    for (uint32_t size = std::min(a[0].width, a[0].height) / 2; scaleCount < kMSSSIMWeights.size() && size >= minSize; size /= 2) scaleCount++;
+    double weightSum = 0.0;
+    for (size_t i = 0; i < scaleCount; ++i) weightSum += kMSSSIMWeights[i];
+
+    Plane planeA = std::move(a[0]);
+    Plane planeB = std::move(b[0]);
+    double msssim = 1.0;
+    for (size_t scale = 0; scale < scaleCount; ++scale)
+    {
+        double meanSSIM, meanCS;
+        computeSSIM(planeA, planeB, scale == 0 && errorMap ? &ssimMap : nullptr, meanSSIM, meanCS);
+
+        // Negative terms are clamped to zero so the fractional powers stay defined.
+        double weight = kMSSSIMWeights[scale] / weightSum;
+        double value = scale + 1 == scaleCount ? meanSSIM : meanCS;
+        msssim *= std::pow(std::max(value, 0.0), weight);
+
+        if (scale + 1 < scaleCount)
+        {
+            planeA = downsample2x(planeA);
+            planeB = downsample2x(planeB);
+        }
+    }
+
+    if (errorMap) writeErrorMap(ssimMap, errorMap);
+
+    return 1.0 - msssim;
+}
+
+double compareFLIP(const Image& imageA, const Image& imageB, bool alpha, float* errorMap)
+{
+    const uint32_t width = imageA.getWidth();
+    const uint32_t height = imageA.getHeight();
+
+    const FeatureKernels featureKernels = createFeatureKernels();
+    FLIPPlanes a = prepareFLIP(imageA, featureKernels);
+    FLIPPlanes b = prepareFLIP(imageB, featureKernels);
+
+    // The largest color difference is between green and blue.
+    const float maxColorError = std::pow(HyAB(linearRGBToHuntLab(0.f, 1.f, 0.f), linearRGBToHuntLab(0.f, 0.f, 1.f)), kFLIPQc);
+
+    std::vector<double> sums(getRowBandCount(height));
+    parallelForRows(height, [&] (uint32_t band, uint32_t y0, uint32_t y1)
+    {
+        double sum = 0.0;
+        for (uint32_t y = y0; y < y1; ++y)
+        {
+            for (uint32_t x = 0; x < width; ++x)
+            {
+                size_t i = size_t(y) * width + x;
+
+                // Color difference of the filtered images, clamped to the displayable range.
+                auto toHuntLab = [i] (const FLIPPlanes& p)
+                {
+                    auto rgb = YCxCzToLinearRGB(p.color[0].data[i], p.color[1].data[i], p.color[2].data[i]);
+                    return linearRGBToHuntLab(clamp(rgb[0], 0.f, 1.f), clamp(rgb[1], 0.f, 1.f), clamp(rgb[2], 0.f, 1.f));
+                };
+                float colorError = std::pow(HyAB(toHuntLab(a), toHuntLab(b)), kFLIPQc);
+                if (colorError < kFLIPPc * maxColorError) colorError = kFLIPPt / (kFLIPPc * maxColorError) * colorError;
+                else colorError = kFLIPPt + (colorError - kFLIPPc * maxColorError) / (maxColorError - kFLIPPc * maxColorError) * (1.f - kFLIPPt);
+
+                // Feature difference.
+                float edgeDifference = std::fabs(a.edgeMagnitude.data[i] - b.edgeMagnitude.data[i]);
+                float pointDifference = std::fabs(a.pointMagnitude.data[i] - b.pointMagnitude.data[i]);
+                float featureError = std::pow(std::max(edgeDifference, pointDifference) / std::sqrt(2.f), kFLIPQf);
+
+                float error = std::pow(colorError, 1.f - featureError);
+                if (errorMap) errorMap[i] = error;
+                sum += error;
+            }
+        }
+        sums[band] = sum;
+    });
+
+    return pairwiseSum(sums.data(), sums.size()) / (double(width) * height);
+}